@@ -0,0 +1,106 @@
+/**
+ * @file openaptx-cache.h
+ * @brief Pre-encoded clip cache.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_CACHE_H_
+#define OPENAPTX_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "openaptx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Clip cache handler.
+ *
+ * The cache stores apt-X / apt-X HD streams of short PCM clips (e.g.
+ * notification sounds) in a memory-mapped file. Entries are addressed by
+ * the content of the PCM clip, the codec variant and the endianness. Every
+ * stream is encoded with a freshly initialized encoder, hence the result is
+ * deterministic. When the cache is full, the least recently used entries
+ * are evicted.
+ *
+ * The cache file is locked for the exclusive usage of one cache handler.
+ * It uses the host native byte order and shall not be shared between hosts
+ * with different architectures. */
+typedef struct openaptx_cache openaptx_cache;
+
+/**
+ * Open clip cache.
+ *
+ * If the file does not exist or it was created with a different capacity,
+ * new empty cache is created.
+ *
+ * @param path Path to the cache file.
+ * @param capacity Maximum number of bytes for encoded streams.
+ * @return On success, this function returns the cache handler. Otherwise,
+ *   NULL is returned and errno is set to indicate the error. */
+openaptx_cache * openaptx_cache_open(const char * path, size_t capacity);
+
+/**
+ * Close clip cache.
+ *
+ * All data returned by the lookup functions becomes invalid.
+ *
+ * @param cache Cache handler or NULL. */
+void openaptx_cache_close(openaptx_cache * cache);
+
+/**
+ * Look up encoded clip in the cache.
+ *
+ * The returned data points directly into the cache file mapping. It is
+ * pinned in the cache (it will not be evicted) until released with the
+ * openaptx_cache_release() function.
+ *
+ * The encoded stream contains codewords serialized from the most significant
+ * byte (2 bytes per apt-X codeword, 3 bytes per apt-X HD codeword), exactly
+ * as returned by the encoder initialized with the given endianness. If the
+ * number of frames is not a multiple of 4, the last block is zero-padded.
+ *
+ * @param cache Cache handler.
+ * @param codec Codec variant.
+ * @param endian Endianness passed to the encoder initialization function.
+ * @param pcm Interleaved stereo PCM samples (16-bit for apt-X and 24-bit
+ *   for apt-X HD).
+ * @param frames Number of stereo PCM frames.
+ * @param size Address where the size of the encoded stream will be stored.
+ * @return On cache hit, this function returns the encoded stream. Otherwise,
+ *   NULL is returned and errno is set to ENOENT. */
+const uint8_t * openaptx_cache_lookup(openaptx_cache * cache, enum openaptx_codec codec, short endian,
+                                      const int32_t * pcm, size_t frames, size_t * size);
+
+/**
+ * Look up encoded clip in the cache or encode and store it.
+ *
+ * On cache miss the clip is encoded with the apt-X library encoder. See
+ * the openaptx_cache_lookup() function for the description of parameters.
+ *
+ * @return On success, this function returns the encoded stream. Otherwise,
+ *   NULL is returned and errno is set to indicate the error (e.g. ENOSPC if
+ *   the clip does not fit into the cache). */
+const uint8_t * openaptx_cache_encode(openaptx_cache * cache, enum openaptx_codec codec, short endian,
+                                      const int32_t * pcm, size_t frames, size_t * size);
+
+/**
+ * Release data returned by the lookup functions.
+ *
+ * @param cache Cache handler.
+ * @param data Encoded stream returned by the lookup function. */
+void openaptx_cache_release(openaptx_cache * cache, const uint8_t * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * @file openaptx-client.h
+ * @brief Client of the apt-X encoding daemon.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_CLIENT_H_
+#define OPENAPTX_CLIENT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "openaptx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Encoding stream handled by the aptxd daemon.
+ *
+ * PCM samples and encoded codewords are exchanged with the daemon via
+ * ring buffers placed in the shared memory (memfd). The daemon socket is
+ * used only for the stream setup. The handler shall not be used from more
+ * than one thread at a time. */
+typedef struct openaptx_client openaptx_client;
+
+/**
+ * Statistics of the encoding stream. */
+struct openaptx_client_stats {
+	/* number of encoded PCM frames */
+	uint64_t frames;
+	/* time spent by the daemon on encoding */
+	uint64_t encode_ns;
+	/* number of PCM frames waiting for encoding */
+	size_t pcm_queued;
+	/* maximum number of PCM frames waiting for encoding */
+	size_t pcm_queued_max;
+	/* number of encoded bytes waiting to be read */
+	size_t code_queued;
+};
+
+/**
+ * Open new encoding stream.
+ *
+ * @param path Path to the daemon socket. If NULL, the path is taken from
+ *   the OPENAPTX_SOCKET environment variable, or the default one is used.
+ * @param codec Codec variant.
+ * @param endian Endianness passed to the encoder initialization function.
+ * @param frames Capacity of the PCM ring buffer in stereo frames. It is
+ *   rounded up to the multiple of 4 frames.
+ * @return On success, this function returns the stream handler. Otherwise,
+ *   NULL is returned and errno is set to indicate the error. */
+openaptx_client * openaptx_client_open(const char * path, enum openaptx_codec codec, short endian,
+                                       size_t frames);
+
+/**
+ * Close encoding stream.
+ *
+ * @param client Stream handler or NULL. */
+void openaptx_client_close(openaptx_client * client);
+
+/**
+ * Get file descriptor which becomes readable when the daemon has encoded
+ * new data or consumed PCM frames.
+ *
+ * @param client Stream handler.
+ * @return The file descriptor suitable for poll(). */
+int openaptx_client_fd(openaptx_client * client);
+
+/**
+ * Write PCM samples to the stream.
+ *
+ * The daemon encodes PCM frames only when there is room for codewords in
+ * the codeword ring, which has the same capacity (in blocks) as the PCM
+ * ring. Once both rings are full, the waiting write will never return
+ * unless the encoded stream is read by another thread. A single-threaded
+ * caller shall not wait for the write, but read the encoded stream when
+ * the PCM ring is full instead.
+ *
+ * @param client Stream handler.
+ * @param pcm Interleaved stereo PCM samples (16-bit for apt-X and 24-bit
+ *   for apt-X HD).
+ * @param frames Number of stereo PCM frames.
+ * @param wait If true, wait until all frames are written.
+ * @return On success, the number of written frames is returned (it might be
+ *   0 if the ring is full). Otherwise, -1 is returned and errno is set to
+ *   indicate the error. */
+ssize_t openaptx_client_write(openaptx_client * client, const int32_t * pcm, size_t frames, bool wait);
+
+/**
+ * Read encoded stream.
+ *
+ * Codewords are serialized from the most significant byte (2 bytes per
+ * apt-X codeword, 3 bytes per apt-X HD codeword).
+ *
+ * @param client Stream handler.
+ * @param data Buffer for the encoded stream.
+ * @param len Size of the buffer.
+ * @param wait If true, wait for at least one encoded block.
+ * @return On success, the number of read bytes is returned (it might be
+ *   0 if there is no encoded data). Otherwise, -1 is returned and errno is
+ *   set to indicate the error (e.g. EPIPE if the daemon has terminated). */
+ssize_t openaptx_client_read(openaptx_client * client, uint8_t * data, size_t len, bool wait);
+
+/**
+ * Get statistics of the encoding stream.
+ *
+ * @param client Stream handler.
+ * @param stats Address where the statistics will be stored. */
+void openaptx_client_stats(openaptx_client * client, struct openaptx_client_stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file openaptx-container.h
+ * @brief Seekable container for apt-X and apt-X HD streams.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_CONTAINER_H_
+#define OPENAPTX_CONTAINER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "openaptx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Container writer handler.
+ *
+ * The container stores the codeword stream in chunks of equal duration.
+ * Every chunk is preceded with the snapshot of the decoder state at the
+ * beginning of the chunk, so decoding can be started at any chunk. The
+ * index with PCM frame offsets of all chunks is stored at the end of the
+ * file, so the container can be written to a pipe. */
+typedef struct openaptx_container_writer openaptx_container_writer;
+
+/**
+ * Container reader handler. */
+typedef struct openaptx_container_reader openaptx_container_reader;
+
+/**
+ * Create new container writer.
+ *
+ * Snapshots are produced by the reverse-engineered decoder, which runs
+ * alongside the writer. Hence, swapped apt-X HD codewords (which can not
+ * be decoded) are not supported.
+ *
+ * @param fd File descriptor opened for writing.
+ * @param codec Codec variant.
+ * @param endian Endianness of the codewords.
+ * @param rate PCM sampling rate in Hz.
+ * @param interval Interval between snapshots in milliseconds.
+ * @return On success, this function returns the writer handler. Otherwise,
+ *   NULL is returned and errno is set to indicate the error. */
+openaptx_container_writer * openaptx_container_writer_new(int fd, enum openaptx_codec codec, short endian,
+                                                          unsigned int rate, unsigned int interval);
+
+/**
+ * Write codewords to the container.
+ *
+ * @param w Writer handler.
+ * @param data Encoded stream (whole blocks only).
+ * @param len Size of the encoded stream.
+ * @return On success, the number of consumed bytes is returned. Otherwise,
+ *   -1 is returned and errno is set to indicate the error. */
+ssize_t openaptx_container_write(openaptx_container_writer * w, const uint8_t * data, size_t len);
+
+/**
+ * Write pending chunk and the index, and free the writer.
+ *
+ * The file descriptor is not closed.
+ *
+ * @param w Writer handler.
+ * @return On success 0 is returned. Otherwise, -1 is returned and errno is
+ *   set to indicate the error. The writer is freed in both cases. */
+int openaptx_container_writer_close(openaptx_container_writer * w);
+
+/**
+ * Open container for reading.
+ *
+ * @param fd File descriptor of a regular file opened for reading.
+ * @return On success, this function returns the reader handler. Otherwise,
+ *   NULL is returned and errno is set to indicate the error. If the file
+ *   is not a container, errno is set to EBADMSG. */
+openaptx_container_reader * openaptx_container_reader_new(int fd);
+
+/**
+ * Free container reader.
+ *
+ * The file descriptor is not closed.
+ *
+ * @param r Reader handler or NULL. */
+void openaptx_container_reader_free(openaptx_container_reader * r);
+
+/**
+ * Get the codec variant of the stream.
+ *
+ * @param r Reader handler. */
+enum openaptx_codec openaptx_container_codec(openaptx_container_reader * r);
+
+/**
+ * Get the PCM sampling rate of the stream.
+ *
+ * @param r Reader handler. */
+unsigned int openaptx_container_rate(openaptx_container_reader * r);
+
+/**
+ * Get the number of PCM frames in the stream.
+ *
+ * @param r Reader handler. */
+size_t openaptx_container_frames(openaptx_container_reader * r);
+
+/**
+ * Set the decoding position.
+ *
+ * The decoder state is restored from the snapshot of the chunk containing
+ * the given frame, so only the part of this chunk before the frame has to
+ * be decoded.
+ *
+ * @param r Reader handler.
+ * @param frame PCM frame offset.
+ * @return On success 0 is returned. Otherwise, -1 is returned and errno is
+ *   set to indicate the error. */
+int openaptx_container_seek(openaptx_container_reader * r, size_t frame);
+
+/**
+ * Decode PCM from the current position.
+ *
+ * @param r Reader handler.
+ * @param pcm Buffer for interleaved stereo 24-bit PCM samples.
+ * @param frames Number of stereo PCM frames to decode.
+ * @return On success, the number of decoded frames is returned, which is
+ *   0 at the end of the stream. Otherwise, -1 is returned and errno is set
+ *   to indicate the error. */
+ssize_t openaptx_container_read(openaptx_container_reader * r, int32_t * pcm, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+/**
+ * @file openaptx-coro.hpp
+ * @brief C++20 coroutine adapter for streaming apt-X encoding.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_CORO_HPP_
+#define OPENAPTX_CORO_HPP_
+
+#include <cerrno>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "openaptx.hpp"
+
+namespace openaptx {
+
+/**
+ * Select the memory resource for coroutine frames.
+ *
+ * Frames of generators created on the calling thread while the guard is
+ * alive are allocated from the given memory resource. Guards can be
+ * nested, the previous resource is restored on destruction. */
+class frame_resource_guard {
+public:
+	explicit frame_resource_guard(std::pmr::memory_resource * mr) noexcept : prev_(std::exchange(current_, mr)) {}
+	frame_resource_guard(const frame_resource_guard &) = delete;
+	frame_resource_guard & operator=(const frame_resource_guard &) = delete;
+	~frame_resource_guard() { current_ = prev_; }
+
+	/**
+	 * Get the memory resource selected on the calling thread or the default
+	 * memory resource. */
+	static std::pmr::memory_resource * resource() noexcept {
+		return current_ != nullptr ? current_ : std::pmr::get_default_resource();
+	}
+
+private:
+	static inline thread_local std::pmr::memory_resource * current_ = nullptr;
+	std::pmr::memory_resource * prev_;
+};
+
+/**
+ * Lazy asynchronous generator.
+ *
+ * The body of the generator is resumed only when the consumer awaits the
+ * next() call, and it runs until it yields a value, finishes or awaits
+ * something which suspends it. In the last case, the generator is resumed
+ * by whoever completes the awaited operation (e.g. the executor of the
+ * pipeline), and control is transferred back to the consumer on the next
+ * yield. There are no threads involved, so the coroutines run wherever
+ * they are resumed, and the producer never runs ahead of the consumer.
+ *
+ * Yielded values are not copied. The consumer gets a pointer to the value
+ * which is valid until the generator is resumed again. The coroutine frame
+ * is allocated once from the memory resource selected with the
+ * frame_resource_guard on the calling thread, or from the default memory
+ * resource. */
+template <typename T> class generator {
+public:
+	using value_type = T;
+
+	struct promise_type;
+	using handle_type = std::coroutine_handle<promise_type>;
+
+	/**
+	 * Transfer control to the consumer which awaits the value. */
+	struct yield_awaiter {
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle_type h) noexcept { return h.promise().consumer_; }
+		void await_resume() const noexcept {}
+	};
+
+	struct promise_type {
+
+		generator get_return_object() noexcept { return generator(handle_type::from_promise(*this)); }
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		yield_awaiter final_suspend() noexcept { return {}; }
+		yield_awaiter yield_value(const T & value) noexcept {
+			value_ = std::addressof(value);
+			return {};
+		}
+		void return_void() noexcept { value_ = nullptr; }
+		void unhandled_exception() noexcept {
+			value_ = nullptr;
+			error_ = std::current_exception();
+		}
+
+		/* The allocation function does not take coroutine arguments, because
+		 * it has to match the deallocation function, which can not be a
+		 * template. The memory resource is selected by the caller instead. */
+		static void * operator new(size_t size) { return allocate(frame_resource_guard::resource(), size); }
+		static void operator delete(void * ptr, size_t size) noexcept {
+			auto * p = static_cast<std::byte *>(ptr) - header_size;
+			auto * mr = *reinterpret_cast<std::pmr::memory_resource **>(p);
+			mr->deallocate(p, size + header_size, alignof(std::max_align_t));
+		}
+
+		const T * value_ = nullptr;
+		std::exception_ptr error_;
+		std::coroutine_handle<> consumer_;
+
+	private:
+		/* the memory resource is stored in front of the coroutine frame */
+		static constexpr size_t header_size = alignof(std::max_align_t) > sizeof(void *)
+		                                          ? alignof(std::max_align_t)
+		                                          : sizeof(void *);
+		static void * allocate(std::pmr::memory_resource * mr, size_t size) {
+			auto * p = static_cast<std::byte *>(mr->allocate(size + header_size, alignof(std::max_align_t)));
+			*reinterpret_cast<std::pmr::memory_resource **>(p) = mr;
+			return p + header_size;
+		}
+	};
+
+	/**
+	 * Resume the generator until it yields the next value.
+	 *
+	 * The result of the co_await expression is the pointer to the value or
+	 * nullptr at the end of the sequence. The exception thrown by the body
+	 * of the generator is rethrown to the consumer. */
+	struct next_awaiter {
+		bool await_ready() const noexcept { return h_.done(); }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept {
+			h_.promise().consumer_ = consumer;
+			return h_;
+		}
+		const T * await_resume() {
+			if (auto error = std::exchange(h_.promise().error_, nullptr))
+				std::rethrow_exception(error);
+			return h_.done() ? nullptr : h_.promise().value_;
+		}
+		handle_type h_;
+	};
+
+	generator(generator && other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+	generator & operator=(generator && other) noexcept {
+		if (this != &other) {
+			if (h_)
+				h_.destroy();
+			h_ = std::exchange(other.h_, nullptr);
+		}
+		return *this;
+	}
+	generator(const generator &) = delete;
+	generator & operator=(const generator &) = delete;
+	~generator() {
+		if (h_)
+			h_.destroy();
+	}
+
+	next_awaiter next() noexcept { return { h_ }; }
+
+private:
+	explicit generator(handle_type h) noexcept : h_(h) {}
+	handle_type h_;
+};
+
+/**
+ * Chunk of planar PCM samples.
+ *
+ * Samples are signed 16-bit (apt-X) or 24-bit (apt-X HD) integers stored
+ * on 4 bytes. The number of frames is the size of the smaller span. */
+struct pcm_chunk {
+	std::span<const int32_t> left;
+	std::span<const int32_t> right;
+	size_t frames() const noexcept { return left.size() < right.size() ? left.size() : right.size(); }
+};
+
+/**
+ * Asynchronous source of PCM chunks.
+ *
+ * The next() call returns an awaitable which yields the pointer to the
+ * chunk or nullptr at the end of the stream, e.g. generator<pcm_chunk>. */
+template <typename Source>
+concept pcm_source = requires(Source & source) {
+	{ source.next().await_resume() } -> std::convertible_to<const pcm_chunk *>;
+};
+
+namespace detail {
+
+template <openaptx_codec Codec, pcm_source Source>
+generator<std::span<const typename codec_traits<Codec>::code_type>> encode_stage(basic_encoder<Codec> & enc,
+                                                                                Source source) {
+
+	using code_type = typename codec_traits<Codec>::code_type;
+
+	std::vector<code_type, std::pmr::polymorphic_allocator<code_type>> code(enc.get_allocator());
+	/* frames carried over from the previous chunk */
+	int32_t tailL[4], tailR[4];
+	size_t tail = 0;
+
+	while (const pcm_chunk * chunk = co_await source.next()) {
+
+		const size_t frames = chunk->frames();
+		const int32_t * pcmL = chunk->left.data();
+		const int32_t * pcmR = chunk->right.data();
+		size_t blocks = 0;
+		size_t i = 0;
+
+		if (const size_t size = (tail + frames) / 4 * 2; code.size() < size)
+			code.resize(size);
+
+		if (tail != 0) {
+			for (; tail < 4 && i < frames; tail++, i++) {
+				tailL[tail] = pcmL[i];
+				tailR[tail] = pcmR[i];
+			}
+			if (tail < 4)
+				continue;
+			if (!enc.encode(tailL, tailR, code.data()))
+				throw std::system_error(errno != 0 ? errno : EINVAL, std::generic_category(),
+				                        "Couldn't encode PCM samples");
+			blocks = 1;
+			tail = 0;
+		}
+
+		const size_t n = (frames - i) / 4;
+		if (enc.encode(&pcmL[i], &pcmR[i], n * 4, &code[blocks * 2]) != n)
+			throw std::system_error(errno != 0 ? errno : EINVAL, std::generic_category(),
+			                        "Couldn't encode PCM samples");
+		blocks += n;
+
+		for (i += n * 4; i < frames; tail++, i++) {
+			tailL[tail] = pcmL[i];
+			tailR[tail] = pcmR[i];
+		}
+
+		if (blocks != 0)
+			co_yield std::span<const code_type>(code.data(), blocks * 2);
+
+	}
+}
+
+} // namespace detail
+
+/**
+ * Encoding stage of the asynchronous pipeline.
+ *
+ * Every PCM chunk awaited from the source is encoded in place and yielded
+ * as the span of codewords. Frames which do not form a whole block are
+ * carried over to the next chunk, so chunks can be of any size, and the
+ * chunk which does not complete any block is not yielded at all. The
+ * coroutine frame and the codeword buffer are allocated from the memory
+ * resource of the encoder. The buffer grows only when a chunk larger than
+ * any previous one arrives, so there is no allocation per chunk in the
+ * steady state. The yielded span is valid until the stage is resumed
+ * again.
+ *
+ * The encoder has to outlive the stage. On encoding failure, the
+ * std::system_error is thrown to the consumer.
+ *
+ * @code
+ * auto stage = openaptx::encode_stage(enc, capture(device));
+ * while (const auto * code = co_await stage.next())
+ *     co_await send(*code);
+ * @endcode */
+template <openaptx_codec Codec, pcm_source Source>
+generator<std::span<const typename codec_traits<Codec>::code_type>> encode_stage(basic_encoder<Codec> & enc,
+                                                                                Source source) {
+	const frame_resource_guard guard(enc.get_allocator().resource());
+	return detail::encode_stage(enc, std::move(source));
+}
+
+} // namespace openaptx
+
+#endif
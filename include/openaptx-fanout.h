@@ -0,0 +1,148 @@
+/**
+ * @file openaptx-fanout.h
+ * @brief Encode-once fan-out to many subscribers.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_FANOUT_H_
+#define OPENAPTX_FANOUT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "openaptx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fan-out encoder handler.
+ *
+ * The fan-out encoder encodes PCM once and shares encoded packets with any
+ * number of subscribers without copying. Every packet contains a multiple
+ * of 8 blocks (32 PCM frames), which is the period of the apt-X autosync.
+ * Hence, every packet starts at the same autosync phase and subscribers can
+ * join the stream at any time. */
+typedef struct openaptx_fanout openaptx_fanout;
+
+/**
+ * Fan-out subscriber handler. */
+typedef struct openaptx_subscriber openaptx_subscriber;
+
+/**
+ * Encoded packet shared between subscribers.
+ *
+ * Packet data shall not be modified. */
+struct openaptx_packet {
+	/* Encoded stream with codewords serialized from the most significant
+	 * byte (2 bytes per apt-X codeword, 3 bytes per apt-X HD codeword). */
+	const uint8_t * data;
+	size_t size;
+	/* Position of the first block in the stream. */
+	uint64_t block;
+};
+
+/**
+ * Create new fan-out encoder.
+ *
+ * @param codec Codec variant.
+ * @param endian Endianness passed to the encoder initialization function.
+ * @param packet_frames Number of PCM frames per packet. It is rounded up to
+ *   the multiple of 32 frames.
+ * @return On success, this function returns the fan-out handler. Otherwise,
+ *   NULL is returned and errno is set to indicate the error. */
+openaptx_fanout * openaptx_fanout_new(enum openaptx_codec codec, short endian, size_t packet_frames);
+
+/**
+ * Free fan-out encoder.
+ *
+ * All subscribers shall be unsubscribed before calling this function.
+ * Packets which were read by subscribers remain valid until released.
+ *
+ * @param fanout Fan-out handler or NULL. */
+void openaptx_fanout_free(openaptx_fanout * fanout);
+
+/**
+ * Mark the end of the stream.
+ *
+ * Subscribers will be able to read all pending packets. Afterwards, the
+ * read function will fail with errno set to EPIPE. Frames which do not
+ * fill the whole packet are discarded.
+ *
+ * @param fanout Fan-out handler. */
+void openaptx_fanout_close(openaptx_fanout * fanout);
+
+/**
+ * Encode PCM and publish packets to subscribers.
+ *
+ * This function blocks as long as a blocking subscriber has the maximum
+ * number of pending packets.
+ *
+ * @param fanout Fan-out handler.
+ * @param pcm Interleaved stereo PCM samples (16-bit for apt-X and 24-bit
+ *   for apt-X HD).
+ * @param frames Number of stereo PCM frames.
+ * @return On success, the number of consumed frames is returned. If an error
+ *   occurs after some frames were consumed, the number of consumed frames is
+ *   returned and the error is reported by the next call. Otherwise, -1 is
+ *   returned and errno is set to indicate the error (EPIPE if the stream was
+ *   closed). Consumed frames of a packet which could not be published are
+ *   kept, and the next call retries publishing of that packet. */
+ssize_t openaptx_fanout_write(openaptx_fanout * fanout, const int32_t * pcm, size_t frames);
+
+/**
+ * Subscribe to the fan-out encoder.
+ *
+ * New subscriber will receive packets published after the subscription.
+ *
+ * @param fanout Fan-out handler.
+ * @param max_packets Maximum number of pending packets.
+ * @param blocking If true, the fan-out writer is blocked when the maximum
+ *   number of pending packets was reached. Otherwise, the oldest pending
+ *   packet is dropped and the overrun counter is incremented.
+ * @return On success, this function returns the subscriber handler.
+ *   Otherwise, NULL is returned and errno is set to indicate the error. */
+openaptx_subscriber * openaptx_fanout_subscribe(openaptx_fanout * fanout, size_t max_packets, bool blocking);
+
+/**
+ * Unsubscribe from the fan-out encoder.
+ *
+ * @param sub Subscriber handler or NULL. */
+void openaptx_fanout_unsubscribe(openaptx_subscriber * sub);
+
+/**
+ * Read the next packet.
+ *
+ * @param sub Subscriber handler.
+ * @param wait If true, wait for the packet to be published.
+ * @return On success, this function returns the packet, which shall be
+ *   released with openaptx_packet_unref(). Otherwise, NULL is returned and
+ *   errno is set to EAGAIN if there is no pending packet or to EPIPE if the
+ *   stream was closed. */
+const struct openaptx_packet * openaptx_fanout_read(openaptx_subscriber * sub, bool wait);
+
+/**
+ * Get the number of packets dropped for a non-blocking subscriber.
+ *
+ * @param sub Subscriber handler. */
+size_t openaptx_fanout_overruns(openaptx_subscriber * sub);
+
+/**
+ * Release packet returned by openaptx_fanout_read().
+ *
+ * @param packet Packet or NULL. */
+void openaptx_packet_unref(const struct openaptx_packet * packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * @file openaptx-packetizer.h
+ * @brief A2DP media packetizer for apt-X and apt-X HD.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_PACKETIZER_H_
+#define OPENAPTX_PACKETIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "openaptx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size of the RTP header prepended to the payload. */
+#define OPENAPTX_RTP_HEADER_SIZE 12
+
+/**
+ * Packetizer handler.
+ *
+ * The packetizer encodes PCM directly into caller-provided packet buffers.
+ * Every packet contains the optional RTP header followed by as many whole
+ * blocks (codeword pairs) as fit in the MTU. */
+typedef struct openaptx_packetizer openaptx_packetizer;
+
+/**
+ * Initial state of the RTP header. */
+struct openaptx_rtp {
+	uint8_t payload_type;
+	uint16_t seq_number;
+	/* timestamp of the first packet in PCM frames */
+	uint32_t timestamp;
+	uint32_t ssrc;
+};
+
+/**
+ * Create new packetizer.
+ *
+ * @param codec Codec variant.
+ * @param endian Endianness passed to the encoder initialization function.
+ * @param mtu Maximum size of the packet including the RTP header.
+ * @param rtp Initial RTP header state. If NULL, packets will contain the
+ *   encoded stream only (as in the A2DP apt-X transport). The apt-X HD
+ *   transport requires the RTP header.
+ * @return On success, this function returns the packetizer handler.
+ *   Otherwise, NULL is returned and errno is set to indicate the error. */
+openaptx_packetizer * openaptx_packetizer_new(enum openaptx_codec codec, short endian, size_t mtu,
+                                              const struct openaptx_rtp * rtp);
+
+/**
+ * Free packetizer.
+ *
+ * @param p Packetizer handler or NULL. */
+void openaptx_packetizer_free(openaptx_packetizer * p);
+
+/**
+ * Get the number of PCM frames in a complete packet.
+ *
+ * @param p Packetizer handler. */
+size_t openaptx_packetizer_frames(openaptx_packetizer * p);
+
+/**
+ * Get the size of a complete packet.
+ *
+ * @param p Packetizer handler. */
+size_t openaptx_packetizer_size(openaptx_packetizer * p);
+
+/**
+ * Encode PCM into the packet.
+ *
+ * The packet is written directly to the given buffers, which shall have
+ * the total size of at least openaptx_packetizer_size() bytes. If there is
+ * not enough PCM to complete the packet, already written data is kept in
+ * the buffers and the next call shall be made with the same buffers. Up to
+ * 3 frames which do not form a whole block are kept by the packetizer.
+ *
+ * @param p Packetizer handler.
+ * @param pcm Interleaved stereo PCM samples (16-bit for apt-X and 24-bit
+ *   for apt-X HD).
+ * @param frames Number of stereo PCM frames.
+ * @param iov Packet buffers, e.g. the ones passed later to sendmsg().
+ * @param iovcnt Number of packet buffers.
+ * @param len Address where the size of the complete packet is stored. If
+ *   the packet is not complete, 0 is stored.
+ * @return On success, the number of consumed frames is returned. Otherwise,
+ *   -1 is returned and errno is set to indicate the error. If the encoder
+ *   fails, errno is set to EIO and the packet is not advanced past blocks
+ *   which were encoded successfully. */
+ssize_t openaptx_packetizer_writev(openaptx_packetizer * p, const int32_t * pcm, size_t frames,
+                                   const struct iovec * iov, int iovcnt, size_t * len);
+
+/**
+ * Encode PCM into the packet stored in a single buffer.
+ *
+ * This function is a shorthand for openaptx_packetizer_writev() with a
+ * single buffer. */
+ssize_t openaptx_packetizer_write(openaptx_packetizer * p, const int32_t * pcm, size_t frames,
+                                  void * buffer, size_t size, size_t * len);
+
+/**
+ * Complete the packet with pending data.
+ *
+ * Pending frames which do not form a whole block are padded with silence.
+ *
+ * @param p Packetizer handler.
+ * @param iov Packet buffers used in the previous write call.
+ * @param iovcnt Number of packet buffers.
+ * @param len Address where the size of the packet is stored. If there is
+ *   no pending data, 0 is stored.
+ * @return On success 0 is returned. Otherwise, -1 is returned and errno is
+ *   set to indicate the error. */
+int openaptx_packetizer_flushv(openaptx_packetizer * p, const struct iovec * iov, int iovcnt, size_t * len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
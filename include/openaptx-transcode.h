@@ -0,0 +1,90 @@
+/**
+ * @file openaptx-transcode.h
+ * @brief Transcoding between apt-X and apt-X HD streams.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_TRANSCODE_H_
+#define OPENAPTX_TRANSCODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "openaptx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Transcoder handler.
+ *
+ * Both apt-X and apt-X HD split the signal into the same four subbands with
+ * the same QMF filter bank. Hence, subband signals reconstructed by the
+ * inverse quantization and prediction of one codec can be passed directly
+ * to the quantizers of the other codec, skipping the QMF synthesis and the
+ * QMF analysis of the full decode and re-encode path. */
+typedef struct openaptx_transcoder openaptx_transcoder;
+
+/**
+ * Transcoding path. */
+enum openaptx_transcode_mode {
+	/* Map reconstructed subband signals to the target quantizers. */
+	OPENAPTX_TRANSCODE_SUBBAND = 0,
+	/* Decode to PCM and encode it again (reference path). */
+	OPENAPTX_TRANSCODE_PCM,
+};
+
+/**
+ * Create new transcoder.
+ *
+ * Encoded streams contain codewords serialized from the most significant
+ * byte (2 bytes per apt-X codeword, 3 bytes per apt-X HD codeword).
+ *
+ * @param src Codec variant of the input stream.
+ * @param src_endian Endianness of the input stream. The apt-X HD stream
+ *   encoded with swapped bytes can not be decoded, so it shall be 0 for
+ *   the apt-X HD input stream.
+ * @param dst Codec variant of the output stream.
+ * @param dst_endian Endianness of the output stream.
+ * @param mode Transcoding path.
+ * @return On success, this function returns the transcoder handler.
+ *   Otherwise, NULL is returned and errno is set to indicate the error. */
+openaptx_transcoder * openaptx_transcoder_new(enum openaptx_codec src, short src_endian, enum openaptx_codec dst,
+                                              short dst_endian, enum openaptx_transcode_mode mode);
+
+/**
+ * Free transcoder.
+ *
+ * @param t Transcoder handler or NULL. */
+void openaptx_transcoder_free(openaptx_transcoder * t);
+
+/**
+ * Transcode stream.
+ *
+ * Only complete blocks (two codewords) are transcoded. The number of blocks
+ * is limited by the size of the output buffer.
+ *
+ * @param t Transcoder handler.
+ * @param input Input stream.
+ * @param len Number of bytes in the input stream.
+ * @param output Output buffer.
+ * @param output_len Size of the output buffer.
+ * @param written Address where the number of bytes written to the output
+ *   buffer will be stored.
+ * @return On success, the number of consumed bytes is returned. Otherwise,
+ *   -1 is returned and errno is set to indicate the error. */
+ssize_t openaptx_transcode(openaptx_transcoder * t, const uint8_t * input, size_t len, uint8_t * output,
+                           size_t output_len, size_t * written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
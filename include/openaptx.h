@@ -38,6 +38,13 @@ typedef void * APTXENC;
  * Decoder handler. */
 typedef void * APTXDEC;
 
+/**
+ * Codec variant used by the [open]aptx extension API. */
+enum openaptx_codec {
+	OPENAPTX_CODEC_APTX = 0,
+	OPENAPTX_CODEC_APTX_HD,
+};
+
 /**
  * Initialize encoder structure.
  *
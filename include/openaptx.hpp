@@ -0,0 +1,266 @@
+/**
+ * @file openaptx.hpp
+ * @brief Header-only C++ interface for apt-X and apt-X HD codecs.
+ *
+ * This file is a part of [open]aptx.
+ *
+ * @copyright
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_HPP_
+#define OPENAPTX_HPP_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <system_error>
+#include <utility>
+
+#if __has_include(<span>)
+#	include <span>
+#endif
+
+#include "openaptx.h"
+
+namespace openaptx {
+
+/**
+ * Codec-specific types and functions.
+ *
+ * Codeword type is uint16_t for apt-X and uint32_t (24-bit codeword) for
+ * apt-X HD. Every block of 4 stereo PCM frames is coded as 2 codewords. */
+template <openaptx_codec Codec> struct codec_traits;
+
+template <> struct codec_traits<OPENAPTX_CODEC_APTX> {
+	using code_type = uint16_t;
+	static size_t encoder_size() { return SizeofAptxbtenc(); }
+	static int encoder_init(APTXENC enc, short endian) { return aptxbtenc_init(enc, endian); }
+	static void encoder_destroy(APTXENC enc) {
+		/* this symbol is not available in older libraries */
+		if (aptxbtenc_destroy != nullptr)
+			aptxbtenc_destroy(enc);
+	}
+	static int encode(APTXENC enc, const int32_t * pcmL, const int32_t * pcmR, code_type * code) {
+		return aptxbtenc_encodestereo(enc, pcmL, pcmR, code);
+	}
+	static size_t decoder_size() { return SizeofAptxbtdec(); }
+	static int decoder_init(APTXDEC dec, short endian) { return aptxbtdec_init(dec, endian); }
+	static void decoder_destroy(APTXDEC dec) { aptxbtdec_destroy(dec); }
+	static int decode(APTXDEC dec, int32_t * pcmL, int32_t * pcmR, const code_type * code) {
+		return aptxbtdec_decodestereo(dec, pcmL, pcmR, code);
+	}
+};
+
+template <> struct codec_traits<OPENAPTX_CODEC_APTX_HD> {
+	using code_type = uint32_t;
+	static size_t encoder_size() { return SizeofAptxhdbtenc(); }
+	static int encoder_init(APTXENC enc, short endian) { return aptxhdbtenc_init(enc, endian); }
+	static void encoder_destroy(APTXENC enc) {
+		if (aptxhdbtenc_destroy != nullptr)
+			aptxhdbtenc_destroy(enc);
+	}
+	static int encode(APTXENC enc, const int32_t * pcmL, const int32_t * pcmR, code_type * code) {
+		return aptxhdbtenc_encodestereo(enc, pcmL, pcmR, code);
+	}
+	static size_t decoder_size() { return SizeofAptxhdbtdec(); }
+	static int decoder_init(APTXDEC dec, short endian) { return aptxhdbtdec_init(dec, endian); }
+	static void decoder_destroy(APTXDEC dec) { aptxhdbtdec_destroy(dec); }
+	static int decode(APTXDEC dec, int32_t * pcmL, int32_t * pcmR, const code_type * code) {
+		return aptxhdbtdec_decodestereo(dec, pcmL, pcmR, code);
+	}
+};
+
+namespace detail {
+
+/**
+ * Move-only owner of the codec state allocated from the memory resource. */
+class state {
+public:
+	state(std::pmr::memory_resource * mr, size_t size)
+	    : mr_(mr), size_(size), ptr_(mr->allocate(size, alignof(std::max_align_t))) {}
+	state(state && other) noexcept
+	    : mr_(other.mr_), size_(other.size_), ptr_(std::exchange(other.ptr_, nullptr)) {}
+	state & operator=(state && other) noexcept {
+		if (this != &other) {
+			release();
+			mr_ = other.mr_;
+			size_ = other.size_;
+			ptr_ = std::exchange(other.ptr_, nullptr);
+		}
+		return *this;
+	}
+	state(const state &) = delete;
+	state & operator=(const state &) = delete;
+	~state() { release(); }
+	void * get() const noexcept { return ptr_; }
+	std::pmr::memory_resource * resource() const noexcept { return mr_; }
+
+private:
+	void release() noexcept {
+		if (ptr_ != nullptr)
+			mr_->deallocate(std::exchange(ptr_, nullptr), size_, alignof(std::max_align_t));
+	}
+	std::pmr::memory_resource * mr_;
+	size_t size_;
+	void * ptr_;
+};
+
+} // namespace detail
+
+/**
+ * Encoder handler.
+ *
+ * The state of the encoder is allocated from the given memory resource
+ * (the default resource, if not given). The encoder can be moved, but not
+ * copied. On initialization failure std::system_error is thrown. */
+template <openaptx_codec Codec> class basic_encoder {
+public:
+	using traits = codec_traits<Codec>;
+	using code_type = typename traits::code_type;
+	using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+	explicit basic_encoder(short endian = 0, const allocator_type & alloc = {})
+	    : state_(alloc.resource(), traits::encoder_size()) {
+		if (traits::encoder_init(state_.get(), endian) != 0)
+			throw std::system_error(errno != 0 ? errno : EINVAL, std::generic_category(),
+			                        "Couldn't initialize apt-X encoder");
+	}
+	basic_encoder(basic_encoder &&) noexcept = default;
+	basic_encoder & operator=(basic_encoder && other) noexcept {
+		if (this != &other) {
+			destroy();
+			state_ = std::move(other.state_);
+		}
+		return *this;
+	}
+	~basic_encoder() { destroy(); }
+
+	APTXENC native_handle() const noexcept { return state_.get(); }
+	allocator_type get_allocator() const noexcept { return state_.resource(); }
+
+	/**
+	 * Encode single block of 4 stereo PCM frames into 2 codewords. */
+	bool encode(const int32_t pcmL[4], const int32_t pcmR[4], code_type code[2]) noexcept {
+		return traits::encode(state_.get(), pcmL, pcmR, code) == 0;
+	}
+
+	/**
+	 * Encode planar PCM samples block by block.
+	 *
+	 * Samples and codewords are passed to the library in place, so there
+	 * is no copying. Incomplete trailing block is not encoded.
+	 *
+	 * @param pcmL Left channel samples.
+	 * @param pcmR Right channel samples.
+	 * @param frames Number of frames in both channels.
+	 * @param code Buffer for at least frames / 2 codewords.
+	 * @return The number of encoded blocks. */
+	size_t encode(const int32_t * pcmL, const int32_t * pcmR, size_t frames, code_type * code) noexcept {
+		const size_t blocks = frames / 4;
+		for (size_t i = 0; i < blocks; i++)
+			if (traits::encode(state_.get(), &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]) != 0)
+				return i;
+		return blocks;
+	}
+
+#if __cpp_lib_span >= 202002L
+	/**
+	 * Encode planar PCM samples, limited by the size of the smallest span. */
+	size_t encode(std::span<const int32_t> pcmL, std::span<const int32_t> pcmR,
+	              std::span<code_type> code) noexcept {
+		size_t frames = pcmL.size() < pcmR.size() ? pcmL.size() : pcmR.size();
+		if (frames > code.size() * 2)
+			frames = code.size() * 2;
+		return encode(pcmL.data(), pcmR.data(), frames, code.data());
+	}
+#endif
+
+private:
+	void destroy() noexcept {
+		if (state_.get() != nullptr)
+			traits::encoder_destroy(state_.get());
+	}
+	detail::state state_;
+};
+
+/**
+ * Decoder handler.
+ *
+ * See basic_encoder for the ownership and allocation rules. */
+template <openaptx_codec Codec> class basic_decoder {
+public:
+	using traits = codec_traits<Codec>;
+	using code_type = typename traits::code_type;
+	using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+	explicit basic_decoder(short endian = 0, const allocator_type & alloc = {})
+	    : state_(alloc.resource(), traits::decoder_size()) {
+		if (traits::decoder_init(state_.get(), endian) != 0)
+			throw std::system_error(errno != 0 ? errno : EINVAL, std::generic_category(),
+			                        "Couldn't initialize apt-X decoder");
+	}
+	basic_decoder(basic_decoder &&) noexcept = default;
+	basic_decoder & operator=(basic_decoder && other) noexcept {
+		if (this != &other) {
+			destroy();
+			state_ = std::move(other.state_);
+		}
+		return *this;
+	}
+	~basic_decoder() { destroy(); }
+
+	APTXDEC native_handle() const noexcept { return state_.get(); }
+	allocator_type get_allocator() const noexcept { return state_.resource(); }
+
+	/**
+	 * Decode 2 codewords into single block of 4 stereo PCM frames. */
+	bool decode(const code_type code[2], int32_t pcmL[4], int32_t pcmR[4]) noexcept {
+		return traits::decode(state_.get(), pcmL, pcmR, code) == 0;
+	}
+
+	/**
+	 * Decode codewords into planar PCM samples block by block.
+	 *
+	 * @param code Codewords, incomplete trailing pair is not decoded.
+	 * @param count Number of codewords.
+	 * @param pcmL Buffer for at least count * 2 left channel samples.
+	 * @param pcmR Buffer for at least count * 2 right channel samples.
+	 * @return The number of decoded blocks. */
+	size_t decode(const code_type * code, size_t count, int32_t * pcmL, int32_t * pcmR) noexcept {
+		const size_t blocks = count / 2;
+		for (size_t i = 0; i < blocks; i++)
+			if (traits::decode(state_.get(), &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]) != 0)
+				return i;
+		return blocks;
+	}
+
+#if __cpp_lib_span >= 202002L
+	/**
+	 * Decode codewords, limited by the size of the smallest span. */
+	size_t decode(std::span<const code_type> code, std::span<int32_t> pcmL, std::span<int32_t> pcmR) noexcept {
+		size_t frames = pcmL.size() < pcmR.size() ? pcmL.size() : pcmR.size();
+		if (frames > code.size() * 2)
+			frames = code.size() * 2;
+		return decode(code.data(), frames / 2, pcmL.data(), pcmR.data());
+	}
+#endif
+
+private:
+	void destroy() noexcept {
+		if (state_.get() != nullptr)
+			traits::decoder_destroy(state_.get());
+	}
+	detail::state state_;
+};
+
+using encoder = basic_encoder<OPENAPTX_CODEC_APTX>;
+using hd_encoder = basic_encoder<OPENAPTX_CODEC_APTX_HD>;
+using decoder = basic_decoder<OPENAPTX_CODEC_APTX>;
+using hd_decoder = basic_decoder<OPENAPTX_CODEC_APTX_HD>;
+
+} // namespace openaptx
+
+#endif
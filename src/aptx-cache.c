@@ -0,0 +1,432 @@
+/*
+ * [open]aptx - aptx-cache.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "openaptx-cache.h"
+#include "openaptx.h"
+
+#include "stream.h"
+
+#define CACHE_MAGIC "OAPTXCC"
+#define CACHE_VERSION 1
+/* Maximum number of cached clips. */
+#define CACHE_SLOTS 1024
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t slots;
+	uint64_t capacity;
+	/* clock for the LRU eviction */
+	uint64_t tick;
+};
+
+struct cache_slot {
+	uint64_t hash[2];
+	uint64_t frames;
+	/* offset of the encoded stream in the data region */
+	uint64_t offset;
+	/* size of the encoded stream, 0 for a free slot */
+	uint64_t size;
+	/* the last usage tick */
+	uint64_t used;
+	uint8_t codec;
+	uint8_t endian;
+	/* set when the encoded stream is complete */
+	uint8_t valid;
+	uint8_t reserved[5];
+};
+
+struct openaptx_cache {
+	pthread_mutex_t mutex;
+	int fd;
+	uint8_t * map;
+	size_t map_size;
+	struct cache_header * header;
+	struct cache_slot * slots;
+	uint8_t * data;
+	/* process-local pin counters */
+	unsigned int refs[CACHE_SLOTS];
+};
+
+struct cache_key {
+	uint64_t hash[2];
+	uint64_t frames;
+	uint8_t codec;
+	uint8_t endian;
+};
+
+static void cache_key_init(struct cache_key * key, enum openaptx_codec codec, short endian, const int32_t * pcm,
+                           size_t frames) {
+
+	/* Two independent 64-bit multiplicative hashes (FNV-1a applied to the
+	 * whole samples and a SplitMix-like mixing) form the content hash. */
+	uint64_t h1 = 0xCBF29CE484222325;
+	uint64_t h2 = 0x9E3779B97F4A7C15 ^ frames;
+
+	for (size_t i = 0; i < frames * 2; i++) {
+		const uint32_t v = pcm[i];
+		h1 = (h1 ^ v) * 0x100000001B3;
+		h2 = (h2 ^ v) * 0xBF58476D1CE4E5B9;
+		h2 ^= h2 >> 31;
+	}
+
+	key->hash[0] = h1;
+	key->hash[1] = h2;
+	key->frames = frames;
+	key->codec = codec;
+	key->endian = endian ? 1 : 0;
+}
+
+static bool cache_slot_match(const struct cache_slot * slot, const struct cache_key * key) {
+	return slot->valid && slot->size != 0 && slot->hash[0] == key->hash[0] && slot->hash[1] == key->hash[1] &&
+	       slot->frames == key->frames && slot->codec == key->codec && slot->endian == key->endian;
+}
+
+static size_t cache_encoded_size(enum openaptx_codec codec, size_t frames) {
+	const size_t blocks = (frames + 3) / 4;
+	return blocks * 2 * stream_codeword_size(codec);
+}
+
+struct cache_extent {
+	uint64_t offset;
+	uint64_t size;
+};
+
+static int cache_extent_cmp(const void * a, const void * b) {
+	const uint64_t x = ((const struct cache_extent *)a)->offset;
+	const uint64_t y = ((const struct cache_extent *)b)->offset;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Get extents of all entries sorted by the offset.
+ *
+ * @return The number of extents. */
+static size_t cache_extents(openaptx_cache * cache, struct cache_extent extents[CACHE_SLOTS]) {
+
+	size_t n = 0;
+
+	for (size_t i = 0; i < CACHE_SLOTS; i++)
+		if (cache->slots[i].size != 0) {
+			extents[n].offset = cache->slots[i].offset;
+			extents[n++].size = cache->slots[i].size;
+		}
+	qsort(extents, n, sizeof(*extents), cache_extent_cmp);
+
+	return n;
+}
+
+/**
+ * Initialize empty cache. */
+static void cache_reset(openaptx_cache * cache, size_t capacity) {
+	struct cache_header * h = cache->header;
+	memset(cache->map, 0, sizeof(*h) + CACHE_SLOTS * sizeof(*cache->slots));
+	memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+	h->version = CACHE_VERSION;
+	h->slots = CACHE_SLOTS;
+	h->capacity = capacity;
+}
+
+/**
+ * Check whether entries read from the file are consistent.
+ *
+ * Entries which were not completed (e.g. due to a crash) or which do not
+ * fit in the data region are dropped.
+ *
+ * @return If entries overlap, false is returned. */
+static bool cache_check(openaptx_cache * cache, size_t capacity) {
+
+	for (size_t i = 0; i < CACHE_SLOTS; i++) {
+		struct cache_slot * slot = &cache->slots[i];
+		if (!slot->valid || slot->size > capacity || slot->offset > capacity - slot->size)
+			slot->size = 0;
+	}
+
+	struct cache_extent used[CACHE_SLOTS];
+	const size_t n = cache_extents(cache, used);
+
+	for (size_t i = 1; i < n; i++)
+		if (used[i].offset < used[i - 1].offset + used[i - 1].size)
+			return false;
+
+	return true;
+}
+
+openaptx_cache * openaptx_cache_open(const char * path, size_t capacity) {
+
+	const size_t map_size = sizeof(struct cache_header) + CACHE_SLOTS * sizeof(struct cache_slot) + capacity;
+	struct openaptx_cache * cache;
+	struct stat st;
+	int err;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+
+	pthread_mutex_init(&cache->mutex, NULL);
+	cache->map = MAP_FAILED;
+	cache->fd = -1;
+
+	if ((cache->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1)
+		goto fail;
+	if (flock(cache->fd, LOCK_EX | LOCK_NB) == -1)
+		goto fail;
+	if (fstat(cache->fd, &st) == -1)
+		goto fail;
+
+	/* Make sure that we will not access memory beyond the end of file. */
+	if ((size_t)st.st_size != map_size && (ftruncate(cache->fd, 0) == -1 || ftruncate(cache->fd, map_size) == -1))
+		goto fail;
+
+	if ((cache->map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0)) == MAP_FAILED)
+		goto fail;
+
+	cache->map_size = map_size;
+	cache->header = (struct cache_header *)cache->map;
+	cache->slots = (struct cache_slot *)&cache->header[1];
+	cache->data = (uint8_t *)&cache->slots[CACHE_SLOTS];
+
+	struct cache_header * h = cache->header;
+	if (memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) != 0 || h->version != CACHE_VERSION ||
+	    h->slots != CACHE_SLOTS || h->capacity != capacity)
+		cache_reset(cache, capacity);
+
+	/* Overlapping entries of the corrupted file can not be told apart from
+	 * the valid ones, so the whole cache is dropped. */
+	if (!cache_check(cache, capacity))
+		cache_reset(cache, capacity);
+
+	return cache;
+
+fail:
+	err = errno;
+	openaptx_cache_close(cache);
+	errno = err;
+	return NULL;
+}
+
+void openaptx_cache_close(openaptx_cache * cache) {
+	if (cache == NULL)
+		return;
+	if (cache->map != MAP_FAILED)
+		munmap(cache->map, cache->map_size);
+	if (cache->fd != -1)
+		close(cache->fd);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+static ssize_t cache_find(openaptx_cache * cache, const struct cache_key * key) {
+	for (size_t i = 0; i < CACHE_SLOTS; i++)
+		if (cache_slot_match(&cache->slots[i], key))
+			return i;
+	return -1;
+}
+
+static const uint8_t * cache_pin(openaptx_cache * cache, size_t i, size_t * size) {
+	struct cache_slot * slot = &cache->slots[i];
+	slot->used = ++cache->header->tick;
+	cache->refs[i]++;
+	*size = slot->size;
+	return &cache->data[slot->offset];
+}
+
+const uint8_t * openaptx_cache_lookup(openaptx_cache * cache, enum openaptx_codec codec, short endian,
+                                      const int32_t * pcm, size_t frames, size_t * size) {
+
+	const uint8_t * data = NULL;
+	struct cache_key key;
+	ssize_t i;
+
+	cache_key_init(&key, codec, endian, pcm, frames);
+
+	pthread_mutex_lock(&cache->mutex);
+	if ((i = cache_find(cache, &key)) != -1)
+		data = cache_pin(cache, i, size);
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (data == NULL)
+		errno = ENOENT;
+	return data;
+}
+
+/**
+ * Find free space in the data region using the first-fit strategy.
+ *
+ * @return On success, the offset is returned. Otherwise, -1 is returned. */
+static int64_t cache_alloc(openaptx_cache * cache, size_t size) {
+
+	struct cache_extent used[CACHE_SLOTS];
+	const size_t n = cache_extents(cache, used);
+
+	uint64_t offset = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (used[i].offset - offset >= size)
+			return offset;
+		offset = used[i].offset + used[i].size;
+	}
+
+	if (cache->header->capacity - offset >= size)
+		return offset;
+	return -1;
+}
+
+/**
+ * Evict the least recently used entry which is not pinned.
+ *
+ * @return On success 0 is returned. Otherwise, -1 is returned. */
+static int cache_evict(openaptx_cache * cache) {
+
+	ssize_t lru = -1;
+	for (size_t i = 0; i < CACHE_SLOTS; i++) {
+		const struct cache_slot * slot = &cache->slots[i];
+		if (slot->size == 0 || cache->refs[i] != 0)
+			continue;
+		if (lru == -1 || slot->used < cache->slots[lru].used)
+			lru = i;
+	}
+
+	if (lru == -1)
+		return -1;
+
+	cache->slots[lru].valid = 0;
+	cache->slots[lru].size = 0;
+	return 0;
+}
+
+static int cache_encode(enum openaptx_codec codec, short endian, const int32_t * pcm, size_t frames,
+                        uint8_t * data) {
+
+	APTXENC enc;
+	if ((enc = stream_encoder_new(codec, endian)) == NULL)
+		return -1;
+
+	int rv = stream_encode(codec, enc, pcm, frames, data);
+	stream_encoder_free(codec, enc);
+	return rv;
+}
+
+const uint8_t * openaptx_cache_encode(openaptx_cache * cache, enum openaptx_codec codec, short endian,
+                                      const int32_t * pcm, size_t frames, size_t * size) {
+
+	const size_t encoded_size = cache_encoded_size(codec, frames);
+	const uint8_t * data = NULL;
+	struct cache_key key;
+	ssize_t i;
+	int err = 0;
+
+	cache_key_init(&key, codec, endian, pcm, frames);
+
+	if (encoded_size == 0)
+		return errno = EINVAL, NULL;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	if ((i = cache_find(cache, &key)) != -1) {
+		data = cache_pin(cache, i, size);
+		goto final;
+	}
+
+	if (encoded_size > cache->header->capacity) {
+		err = ENOSPC;
+		goto final;
+	}
+
+	for (i = 0; i < CACHE_SLOTS; i++)
+		if (cache->slots[i].size == 0)
+			break;
+	if (i == CACHE_SLOTS) {
+		if (cache_evict(cache) == -1) {
+			err = ENOSPC;
+			goto final;
+		}
+		for (i = 0; i < CACHE_SLOTS; i++)
+			if (cache->slots[i].size == 0)
+				break;
+	}
+
+	int64_t offset;
+	while ((offset = cache_alloc(cache, encoded_size)) == -1)
+		if (cache_evict(cache) == -1) {
+			err = ENOSPC;
+			goto final;
+		}
+
+	/* Reserve the space and pin the slot, so it will not be evicted while
+	 * we are encoding with the mutex released. */
+	struct cache_slot * slot = &cache->slots[i];
+	memset(slot, 0, sizeof(*slot));
+	slot->offset = offset;
+	slot->size = encoded_size;
+	cache->refs[i]++;
+
+	pthread_mutex_unlock(&cache->mutex);
+	int rv = cache_encode(codec, endian, pcm, frames, &cache->data[offset]);
+	err = errno;
+	pthread_mutex_lock(&cache->mutex);
+
+	cache->refs[i]--;
+	if (rv != 0) {
+		slot->size = 0;
+		goto final;
+	}
+
+	ssize_t ii;
+	/* The same clip might have been stored in the meantime. */
+	if ((ii = cache_find(cache, &key)) != -1) {
+		slot->size = 0;
+		data = cache_pin(cache, ii, size);
+		goto final;
+	}
+
+	slot->hash[0] = key.hash[0];
+	slot->hash[1] = key.hash[1];
+	slot->frames = key.frames;
+	slot->codec = key.codec;
+	slot->endian = key.endian;
+	slot->valid = 1;
+	data = cache_pin(cache, i, size);
+
+final:
+	pthread_mutex_unlock(&cache->mutex);
+	if (data == NULL)
+		errno = err;
+	return data;
+}
+
+void openaptx_cache_release(openaptx_cache * cache, const uint8_t * data) {
+
+	if (data == NULL)
+		return;
+
+	const uint64_t offset = data - cache->data;
+
+	pthread_mutex_lock(&cache->mutex);
+	for (size_t i = 0; i < CACHE_SLOTS; i++)
+		if (cache->slots[i].size != 0 && cache->slots[i].offset == offset && cache->refs[i] > 0) {
+			cache->refs[i]--;
+			break;
+		}
+	pthread_mutex_unlock(&cache->mutex);
+}
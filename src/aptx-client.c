@@ -0,0 +1,288 @@
+/*
+ * [open]aptx - aptx-client.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "openaptx-client.h"
+#include "openaptx.h"
+
+#include "daemon.h"
+
+struct openaptx_client {
+	int sock;
+	/* eventfd used to notify the daemon */
+	int efd_daemon;
+	/* eventfd used by the daemon to notify us */
+	int efd_client;
+	struct daemon_shm * shm;
+	size_t shm_size;
+	int32_t * pcm;
+	size_t pcm_frames;
+	uint8_t * code;
+	size_t code_size;
+	size_t block_size;
+	/* local copies of the positions owned by the client */
+	uint64_t pcm_head;
+	uint64_t code_tail;
+};
+
+static int client_request(openaptx_client * c, const struct daemon_request * req, int fds[3]) {
+
+	char buf[CMSG_SPACE(3 * sizeof(int))] = { 0 };
+	struct iovec iov = { .iov_base = (void *)req, .iov_len = sizeof(*req) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = buf,
+		.msg_controllen = sizeof(buf),
+	};
+
+	struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+	if (sendmsg(c->sock, &msg, MSG_NOSIGNAL) != sizeof(*req))
+		return -1;
+
+	struct daemon_response rsp;
+	ssize_t len;
+	while ((len = recv(c->sock, &rsp, sizeof(rsp), MSG_WAITALL)) == -1 && errno == EINTR)
+		continue;
+	if (len != sizeof(rsp))
+		return errno = len == -1 ? errno : EPIPE, -1;
+	if (rsp.error != 0)
+		return errno = rsp.error, -1;
+
+	return 0;
+}
+
+openaptx_client * openaptx_client_open(const char * path, enum openaptx_codec codec, short endian,
+                                       size_t frames) {
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct openaptx_client * c;
+	int memfd = -1;
+	int err;
+
+	if (codec != OPENAPTX_CODEC_APTX && codec != OPENAPTX_CODEC_APTX_HD)
+		return errno = EINVAL, NULL;
+
+	frames = (frames + 3) / 4 * 4;
+	if (frames < DAEMON_RING_FRAMES_MIN || frames > DAEMON_RING_FRAMES_MAX)
+		return errno = EINVAL, NULL;
+
+	if (path != NULL)
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	else
+		daemon_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return NULL;
+
+	c->sock = c->efd_daemon = c->efd_client = -1;
+	c->shm = MAP_FAILED;
+	c->pcm_frames = frames;
+	c->code_size = daemon_code_size(codec, frames);
+	c->block_size = daemon_code_size(codec, 4);
+	c->shm_size = daemon_shm_size(codec, frames);
+
+	if ((c->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+		goto fail;
+	if (connect(c->sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+		goto fail;
+
+	if ((c->efd_daemon = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1 ||
+	    (c->efd_client = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+		goto fail;
+
+	if ((memfd = memfd_create("openaptx-client", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+		goto fail;
+	if (ftruncate(memfd, c->shm_size) == -1)
+		goto fail;
+	/* The daemon requires the size of the shared memory to be sealed, so
+	 * it will not be killed by SIGBUS when accessing truncated memory. */
+	if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+		goto fail;
+	if ((c->shm = mmap(NULL, c->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0)) == MAP_FAILED)
+		goto fail;
+
+	c->shm->magic = DAEMON_SHM_MAGIC;
+	c->shm->version = DAEMON_SHM_VERSION;
+	c->pcm = daemon_shm_pcm(c->shm);
+	c->code = daemon_shm_code(c->shm, frames);
+
+	const struct daemon_request req = {
+		.type = DAEMON_REQUEST_OPEN,
+		.codec = codec,
+		.endian = endian,
+		.pcm_frames = frames,
+	};
+
+	int fds[3] = { memfd, c->efd_daemon, c->efd_client };
+	if (client_request(c, &req, fds) == -1)
+		goto fail;
+
+	close(memfd);
+	return c;
+
+fail:
+	err = errno;
+	if (memfd != -1)
+		close(memfd);
+	openaptx_client_close(c);
+	errno = err;
+	return NULL;
+}
+
+void openaptx_client_close(openaptx_client * client) {
+	if (client == NULL)
+		return;
+	if (client->shm != MAP_FAILED)
+		munmap(client->shm, client->shm_size);
+	if (client->efd_client != -1)
+		close(client->efd_client);
+	if (client->efd_daemon != -1)
+		close(client->efd_daemon);
+	/* closing the socket terminates the stream */
+	if (client->sock != -1)
+		close(client->sock);
+	free(client);
+}
+
+int openaptx_client_fd(openaptx_client * client) {
+	return client->efd_client;
+}
+
+/**
+ * Wait for the notification from the daemon. */
+static int client_wait(openaptx_client * c) {
+
+	struct pollfd pfds[2] = {
+		{ c->efd_client, POLLIN, 0 },
+		{ c->sock, POLLIN, 0 },
+	};
+
+	while (poll(pfds, 2, -1) == -1)
+		if (errno != EINTR)
+			return -1;
+
+	/* The daemon does not send anything over the socket once the stream
+	 * is opened, so any activity means that the connection was closed. */
+	if (pfds[1].revents)
+		return errno = EPIPE, -1;
+
+	eventfd_t tmp;
+	eventfd_read(c->efd_client, &tmp);
+	return 0;
+}
+
+ssize_t openaptx_client_write(openaptx_client * client, const int32_t * pcm, size_t frames, bool wait) {
+
+	struct daemon_shm * shm = client->shm;
+	size_t written = 0;
+
+	while (written < frames) {
+
+		const uint64_t tail = atomic_load_explicit(&shm->pcm.tail, memory_order_acquire);
+		size_t n = client->pcm_frames - (client->pcm_head - tail);
+
+		if (n == 0) {
+			if (!wait)
+				break;
+			if (client_wait(client) == -1)
+				return -1;
+			continue;
+		}
+
+		const size_t offset = client->pcm_head % client->pcm_frames;
+		if (n > client->pcm_frames - offset)
+			n = client->pcm_frames - offset;
+		if (n > frames - written)
+			n = frames - written;
+
+		memcpy(&client->pcm[offset * 2], &pcm[written * 2], n * 2 * sizeof(*pcm));
+		client->pcm_head += n;
+		written += n;
+
+		atomic_store_explicit(&shm->pcm.head, client->pcm_head, memory_order_release);
+		eventfd_write(client->efd_daemon, 1);
+
+	}
+
+	return written;
+}
+
+ssize_t openaptx_client_read(openaptx_client * client, uint8_t * data, size_t len, bool wait) {
+
+	struct daemon_shm * shm = client->shm;
+	size_t count = 0;
+
+	/* read only complete blocks */
+	len -= len % client->block_size;
+	if (len == 0)
+		return errno = EINVAL, -1;
+
+	for (;;) {
+
+		const uint64_t head = atomic_load_explicit(&shm->code.head, memory_order_acquire);
+		size_t n = head - client->code_tail;
+
+		if (n == 0) {
+			if (count > 0 || !wait)
+				break;
+			if (client_wait(client) == -1)
+				return -1;
+			continue;
+		}
+
+		const size_t offset = client->code_tail % client->code_size;
+		if (n > client->code_size - offset)
+			n = client->code_size - offset;
+		if (n > len - count)
+			n = len - count;
+		if (n == 0)
+			break;
+
+		memcpy(&data[count], &client->code[offset], n);
+		client->code_tail += n;
+		count += n;
+
+		atomic_store_explicit(&shm->code.tail, client->code_tail, memory_order_release);
+		eventfd_write(client->efd_daemon, 1);
+
+	}
+
+	return count;
+}
+
+void openaptx_client_stats(openaptx_client * client, struct openaptx_client_stats * stats) {
+	struct daemon_shm * shm = client->shm;
+	stats->frames = atomic_load_explicit(&shm->stats.frames, memory_order_relaxed);
+	stats->encode_ns = atomic_load_explicit(&shm->stats.encode_ns, memory_order_relaxed);
+	stats->pcm_queued = client->pcm_head - atomic_load_explicit(&shm->pcm.tail, memory_order_relaxed);
+	stats->pcm_queued_max = atomic_load_explicit(&shm->stats.pcm_queued_max, memory_order_relaxed);
+	stats->code_queued = atomic_load_explicit(&shm->code.head, memory_order_relaxed) - client->code_tail;
+}
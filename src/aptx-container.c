@@ -0,0 +1,583 @@
+/*
+ * [open]aptx - aptx-container.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "openaptx-container.h"
+#include "openaptx.h"
+
+#include "transcode.h"
+
+/*
+ * Container layout (all integers are stored in the little-endian order):
+ *
+ *   header   - magic, version, codec, endian, rate, chunk length in blocks,
+ *              size of a single block and size of a snapshot
+ *   chunks   - snapshot followed by blocks of codewords, the last chunk
+ *              might be shorter than the others
+ *   index    - PCM frame offset and file offset of every chunk
+ *   trailer  - index offset, number of blocks and the index magic
+ */
+
+#define CONTAINER_MAGIC "OAPTXCNT"
+#define CONTAINER_INDEX_MAGIC "OAPTXIDX"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 32
+#define CONTAINER_INDEX_ENTRY_SIZE 16
+#define CONTAINER_TRAILER_SIZE 24
+
+/* number of blocks read from the file at once */
+#define CONTAINER_READ_BLOCKS 256
+
+struct container_index {
+	uint64_t frame;
+	uint64_t offset;
+};
+
+/**
+ * The reverse-engineered decoder. */
+struct container_decoder {
+	const struct transcode_codec * codec;
+	short endian;
+	void * state;
+	struct transcode_qmf qmf[2];
+};
+
+struct openaptx_container_writer {
+
+	int fd;
+	struct container_decoder dec;
+
+	size_t block_size;
+	size_t snapshot_size;
+	size_t chunk_blocks;
+
+	/* number of blocks in the current chunk */
+	size_t blocks;
+	size_t total_blocks;
+	/* number of bytes written to the file */
+	uint64_t offset;
+
+	struct container_index * index;
+	size_t index_len;
+	size_t index_size;
+
+	uint8_t * snapshot;
+
+};
+
+struct openaptx_container_reader {
+
+	int fd;
+	struct container_decoder dec;
+
+	enum openaptx_codec codec;
+	unsigned int rate;
+	size_t block_size;
+	size_t snapshot_size;
+	size_t chunk_blocks;
+	size_t total_blocks;
+
+	struct container_index * index;
+	size_t index_len;
+
+	/* position of the next block to decode */
+	size_t block;
+	/* decoded block with frames not returned yet */
+	int32_t pcm[4 * 2];
+	size_t pcm_offset;
+
+	uint8_t * buffer;
+
+};
+
+static uint8_t * put_uint16(uint8_t * data, uint16_t v) {
+	*data++ = v, *data++ = v >> 8;
+	return data;
+}
+
+static uint8_t * put_uint32(uint8_t * data, uint32_t v) {
+	*data++ = v, *data++ = v >> 8, *data++ = v >> 16, *data++ = v >> 24;
+	return data;
+}
+
+static uint8_t * put_uint64(uint8_t * data, uint64_t v) {
+	data = put_uint32(data, v);
+	return put_uint32(data, v >> 32);
+}
+
+static uint16_t get_uint16(const uint8_t * data) {
+	return data[0] | (data[1] << 8);
+}
+
+static uint32_t get_uint32(const uint8_t * data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint64_t get_uint64(const uint8_t * data) {
+	return get_uint32(data) | ((uint64_t)get_uint32(data + 4) << 32);
+}
+
+static const struct transcode_codec * container_codec(enum openaptx_codec codec) {
+	switch (codec) {
+	case OPENAPTX_CODEC_APTX:
+		return &transcode_codec_aptx;
+	case OPENAPTX_CODEC_APTX_HD:
+		return &transcode_codec_aptxhd;
+	default:
+		return NULL;
+	}
+}
+
+static int decoder_init(struct container_decoder * dec, enum openaptx_codec codec, short endian) {
+	dec->codec = container_codec(codec);
+	dec->endian = endian;
+	if ((dec->state = malloc(dec->codec->size)) == NULL)
+		return -1;
+	dec->codec->init(dec->state, endian);
+	memset(dec->qmf, 0, sizeof(dec->qmf));
+	return 0;
+}
+
+static size_t decoder_snapshot_size(const struct container_decoder * dec) {
+	return dec->codec->snapshot_size + 2 * TRANSCODE_QMF_SNAPSHOT_SIZE;
+}
+
+static void decoder_snapshot(const struct container_decoder * dec, uint8_t * data) {
+	dec->codec->snapshot(dec->state, data);
+	data += dec->codec->snapshot_size;
+	data = transcode_qmf_snapshot(&dec->qmf[0], data);
+	transcode_qmf_snapshot(&dec->qmf[1], data);
+}
+
+static void decoder_restore(struct container_decoder * dec, const uint8_t * data) {
+	dec->codec->init(dec->state, dec->endian);
+	dec->codec->restore(dec->state, data);
+	data += dec->codec->snapshot_size;
+	data = transcode_qmf_restore(&dec->qmf[0], data);
+	transcode_qmf_restore(&dec->qmf[1], data);
+}
+
+/**
+ * Decode single block into interleaved stereo PCM. */
+static void decoder_decode(struct container_decoder * dec, const uint8_t * data, int32_t pcm[4 * 2]) {
+
+	int32_t subbands[2][4];
+	int32_t tmp[2][4];
+
+	dec->codec->decode(dec->state, data, subbands);
+	transcode_qmf_synthesis(&dec->qmf[0], subbands[0], tmp[0]);
+	transcode_qmf_synthesis(&dec->qmf[1], subbands[1], tmp[1]);
+
+	for (size_t i = 0; i < 4; i++) {
+		pcm[i * 2 + 0] = tmp[0][i];
+		pcm[i * 2 + 1] = tmp[1][i];
+	}
+
+}
+
+static void decoder_free(struct container_decoder * dec) {
+	free(dec->state);
+}
+
+static int write_all(int fd, const void * data, size_t len) {
+	const uint8_t * ptr = data;
+	while (len > 0) {
+		ssize_t rv;
+		if ((rv = write(fd, ptr, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		ptr += rv;
+		len -= rv;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void * data, size_t len, uint64_t offset) {
+	uint8_t * ptr = data;
+	while (len > 0) {
+		ssize_t rv;
+		if ((rv = pread(fd, ptr, len, offset)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (rv == 0)
+			return errno = EBADMSG, -1;
+		ptr += rv;
+		offset += rv;
+		len -= rv;
+	}
+	return 0;
+}
+
+openaptx_container_writer * openaptx_container_writer_new(int fd, enum openaptx_codec codec, short endian,
+                                                          unsigned int rate, unsigned int interval) {
+
+	struct openaptx_container_writer * w;
+
+	if (container_codec(codec) == NULL || rate == 0 || interval == 0)
+		return errno = EINVAL, NULL;
+	/* swapped apt-X HD codewords lose information */
+	if (codec == OPENAPTX_CODEC_APTX_HD && endian)
+		return errno = ENOTSUP, NULL;
+
+	if ((w = calloc(1, sizeof(*w))) == NULL)
+		return NULL;
+
+	w->fd = fd;
+	if (decoder_init(&w->dec, codec, endian) == -1) {
+		free(w);
+		return NULL;
+	}
+
+	w->block_size = 2 * w->dec.codec->codeword_size;
+	w->snapshot_size = decoder_snapshot_size(&w->dec);
+	w->chunk_blocks = (uint64_t)rate * interval / 1000 / 4;
+	if (w->chunk_blocks == 0)
+		w->chunk_blocks = 1;
+
+	if ((w->snapshot = malloc(w->snapshot_size)) == NULL)
+		goto fail;
+
+	uint8_t header[CONTAINER_HEADER_SIZE] = { 0 };
+	uint8_t * ptr = header;
+	memcpy(ptr, CONTAINER_MAGIC, 8);
+	ptr = put_uint16(ptr + 8, CONTAINER_VERSION);
+	*ptr++ = codec;
+	*ptr++ = endian ? 1 : 0;
+	ptr = put_uint32(ptr, rate);
+	ptr = put_uint32(ptr, w->chunk_blocks);
+	ptr = put_uint32(ptr, w->block_size);
+	ptr = put_uint32(ptr, w->snapshot_size);
+
+	if (write_all(fd, header, sizeof(header)) == -1)
+		goto fail;
+	w->offset = sizeof(header);
+
+	return w;
+
+fail:
+	decoder_free(&w->dec);
+	free(w->snapshot);
+	free(w);
+	return NULL;
+}
+
+/**
+ * Start new chunk with the snapshot of the current decoder state. */
+static int writer_chunk_begin(openaptx_container_writer * w) {
+
+	if (w->index_len == w->index_size) {
+		const size_t size = w->index_size == 0 ? 64 : w->index_size * 2;
+		struct container_index * tmp;
+		if ((tmp = realloc(w->index, size * sizeof(*tmp))) == NULL)
+			return -1;
+		w->index = tmp;
+		w->index_size = size;
+	}
+
+	decoder_snapshot(&w->dec, w->snapshot);
+	if (write_all(w->fd, w->snapshot, w->snapshot_size) == -1)
+		return -1;
+
+	w->index[w->index_len].frame = (uint64_t)w->total_blocks * 4;
+	w->index[w->index_len].offset = w->offset;
+	w->index_len++;
+
+	w->offset += w->snapshot_size;
+	w->blocks = 0;
+	return 0;
+}
+
+ssize_t openaptx_container_write(openaptx_container_writer * w, const uint8_t * data, size_t len) {
+
+	size_t blocks = len / w->block_size;
+	size_t consumed = 0;
+
+	while (blocks > 0) {
+
+		if (w->index_len == 0 || w->blocks == w->chunk_blocks)
+			if (writer_chunk_begin(w) == -1)
+				return -1;
+
+		size_t n = w->chunk_blocks - w->blocks;
+		if (n > blocks)
+			n = blocks;
+
+		if (write_all(w->fd, data, n * w->block_size) == -1)
+			return -1;
+
+		/* keep the decoder in sync for the next snapshot */
+		for (size_t i = 0; i < n; i++) {
+			int32_t pcm[4 * 2];
+			decoder_decode(&w->dec, &data[i * w->block_size], pcm);
+		}
+
+		data += n * w->block_size;
+		consumed += n * w->block_size;
+		w->offset += n * w->block_size;
+		w->total_blocks += n;
+		w->blocks += n;
+		blocks -= n;
+
+	}
+
+	return consumed;
+}
+
+int openaptx_container_writer_close(openaptx_container_writer * w) {
+
+	int rv = 0;
+	const uint64_t index_offset = w->offset;
+
+	for (size_t i = 0; i < w->index_len; i++) {
+		uint8_t entry[CONTAINER_INDEX_ENTRY_SIZE];
+		put_uint64(put_uint64(entry, w->index[i].frame), w->index[i].offset);
+		if ((rv = write_all(w->fd, entry, sizeof(entry))) == -1)
+			goto final;
+	}
+
+	uint8_t trailer[CONTAINER_TRAILER_SIZE];
+	uint8_t * ptr = put_uint64(put_uint64(trailer, index_offset), w->total_blocks);
+	memcpy(ptr, CONTAINER_INDEX_MAGIC, 8);
+	rv = write_all(w->fd, trailer, sizeof(trailer));
+
+final:
+	decoder_free(&w->dec);
+	free(w->snapshot);
+	free(w->index);
+	free(w);
+	return rv;
+}
+
+static int reader_load(openaptx_container_reader * r) {
+
+	struct stat st;
+	if (fstat(r->fd, &st) == -1)
+		return -1;
+	if (!S_ISREG(st.st_mode))
+		return errno = ESPIPE, -1;
+
+	uint8_t header[CONTAINER_HEADER_SIZE];
+	uint8_t trailer[CONTAINER_TRAILER_SIZE];
+	if ((size_t)st.st_size < sizeof(header) + sizeof(trailer))
+		return errno = EBADMSG, -1;
+	if (read_all(r->fd, header, sizeof(header), 0) == -1 ||
+	    read_all(r->fd, trailer, sizeof(trailer), st.st_size - sizeof(trailer)) == -1)
+		return -1;
+
+	if (memcmp(header, CONTAINER_MAGIC, 8) != 0 ||
+	    memcmp(&trailer[16], CONTAINER_INDEX_MAGIC, 8) != 0)
+		return errno = EBADMSG, -1;
+	if (get_uint16(&header[8]) != CONTAINER_VERSION)
+		return errno = ENOTSUP, -1;
+
+	r->codec = header[10];
+	const short endian = header[11];
+	r->rate = get_uint32(&header[12]);
+	r->chunk_blocks = get_uint32(&header[16]);
+	r->block_size = get_uint32(&header[20]);
+	r->snapshot_size = get_uint32(&header[24]);
+
+	if (container_codec(r->codec) == NULL || (r->codec == OPENAPTX_CODEC_APTX_HD && endian))
+		return errno = EBADMSG, -1;
+	if (decoder_init(&r->dec, r->codec, endian) == -1)
+		return -1;
+
+	if (r->chunk_blocks == 0 ||
+	    r->block_size != 2 * r->dec.codec->codeword_size ||
+	    r->snapshot_size != decoder_snapshot_size(&r->dec))
+		return errno = EBADMSG, -1;
+
+	const uint64_t index_offset = get_uint64(&trailer[0]);
+	const uint64_t total_blocks = get_uint64(&trailer[8]);
+	const uint64_t index_len = (total_blocks + r->chunk_blocks - 1) / r->chunk_blocks;
+	if (index_offset + index_len * CONTAINER_INDEX_ENTRY_SIZE + sizeof(trailer) != (uint64_t)st.st_size)
+		return errno = EBADMSG, -1;
+
+	r->total_blocks = total_blocks;
+	r->index_len = index_len;
+	if ((r->index = calloc(index_len + 1, sizeof(*r->index))) == NULL)
+		return -1;
+
+	uint64_t offset = sizeof(header);
+	for (size_t i = 0; i < index_len; i++) {
+
+		uint8_t entry[CONTAINER_INDEX_ENTRY_SIZE];
+		if (read_all(r->fd, entry, sizeof(entry), index_offset + i * sizeof(entry)) == -1)
+			return -1;
+
+		r->index[i].frame = get_uint64(&entry[0]);
+		r->index[i].offset = get_uint64(&entry[8]);
+
+		/* chunks are stored one after another */
+		const size_t blocks = i + 1 < index_len ? r->chunk_blocks : total_blocks - i * r->chunk_blocks;
+		if (r->index[i].frame != (uint64_t)i * r->chunk_blocks * 4 || r->index[i].offset != offset)
+			return errno = EBADMSG, -1;
+		offset += r->snapshot_size + blocks * r->block_size;
+
+	}
+
+	if (offset != index_offset)
+		return errno = EBADMSG, -1;
+
+	return 0;
+}
+
+openaptx_container_reader * openaptx_container_reader_new(int fd) {
+
+	struct openaptx_container_reader * r;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+
+	r->fd = fd;
+	r->pcm_offset = 4;
+
+	if (reader_load(r) == -1 ||
+	    (r->buffer = malloc(CONTAINER_READ_BLOCKS * r->block_size)) == NULL) {
+		openaptx_container_reader_free(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+void openaptx_container_reader_free(openaptx_container_reader * r) {
+	if (r == NULL)
+		return;
+	decoder_free(&r->dec);
+	free(r->index);
+	free(r->buffer);
+	free(r);
+}
+
+enum openaptx_codec openaptx_container_codec(openaptx_container_reader * r) {
+	return r->codec;
+}
+
+unsigned int openaptx_container_rate(openaptx_container_reader * r) {
+	return r->rate;
+}
+
+size_t openaptx_container_frames(openaptx_container_reader * r) {
+	return r->total_blocks * 4;
+}
+
+/**
+ * Decode blocks from the current position up to the end of the chunk.
+ *
+ * @param pcm Buffer for decoded samples or NULL, if they are not needed.
+ * @return The number of decoded blocks or -1 on error. */
+static ssize_t reader_decode(openaptx_container_reader * r, size_t blocks, int32_t * pcm) {
+
+	const size_t chunk = r->block / r->chunk_blocks;
+	const size_t offset = r->block % r->chunk_blocks;
+
+	if (blocks > r->chunk_blocks - offset)
+		blocks = r->chunk_blocks - offset;
+	if (blocks > r->total_blocks - r->block)
+		blocks = r->total_blocks - r->block;
+	if (blocks > CONTAINER_READ_BLOCKS)
+		blocks = CONTAINER_READ_BLOCKS;
+
+	const uint64_t pos = r->index[chunk].offset + r->snapshot_size + offset * r->block_size;
+	if (read_all(r->fd, r->buffer, blocks * r->block_size, pos) == -1)
+		return -1;
+
+	int32_t tmp[4 * 2];
+	for (size_t i = 0; i < blocks; i++)
+		decoder_decode(&r->dec, &r->buffer[i * r->block_size], pcm != NULL ? &pcm[i * 4 * 2] : tmp);
+
+	r->block += blocks;
+	return blocks;
+}
+
+int openaptx_container_seek(openaptx_container_reader * r, size_t frame) {
+
+	if (frame > r->total_blocks * 4)
+		return errno = EINVAL, -1;
+
+	const size_t block = frame / 4;
+	const size_t chunk = block / r->chunk_blocks;
+
+	r->pcm_offset = 4;
+	if (block == r->total_blocks) {
+		r->block = block;
+		return 0;
+	}
+
+	uint8_t * snapshot;
+	if ((snapshot = malloc(r->snapshot_size)) == NULL)
+		return -1;
+	if (read_all(r->fd, snapshot, r->snapshot_size, r->index[chunk].offset) == -1) {
+		free(snapshot);
+		return -1;
+	}
+
+	decoder_restore(&r->dec, snapshot);
+	r->block = chunk * r->chunk_blocks;
+	free(snapshot);
+
+	while (r->block < block) {
+		ssize_t rv;
+		if ((rv = reader_decode(r, block - r->block, NULL)) == -1)
+			return -1;
+	}
+
+	/* decode the block with the requested frame */
+	if (frame % 4 != 0) {
+		if (reader_decode(r, 1, r->pcm) == -1)
+			return -1;
+		r->pcm_offset = frame % 4;
+	}
+
+	return 0;
+}
+
+ssize_t openaptx_container_read(openaptx_container_reader * r, int32_t * pcm, size_t frames) {
+
+	size_t decoded = 0;
+
+	while (r->pcm_offset < 4 && decoded < frames) {
+		memcpy(&pcm[decoded * 2], &r->pcm[r->pcm_offset * 2], 2 * sizeof(*pcm));
+		r->pcm_offset++;
+		decoded++;
+	}
+
+	while (frames - decoded >= 4 && r->block < r->total_blocks) {
+		ssize_t rv;
+		if ((rv = reader_decode(r, (frames - decoded) / 4, &pcm[decoded * 2])) == -1)
+			return -1;
+		decoded += rv * 4;
+	}
+
+	/* frames which do not form a whole block */
+	if (decoded < frames && r->block < r->total_blocks) {
+		if (reader_decode(r, 1, r->pcm) == -1)
+			return -1;
+		for (r->pcm_offset = 0; decoded < frames; decoded++, r->pcm_offset++)
+			memcpy(&pcm[decoded * 2], &r->pcm[r->pcm_offset * 2], 2 * sizeof(*pcm));
+	}
+
+	return decoded;
+}
@@ -0,0 +1,575 @@
+/*
+ * [open]aptx - aptx-dispatch.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OPENAPTX_IMPLEMENTATION
+#include "openaptx.h"
+
+#include "wisdom.h"
+
+/* Auto-generated buffers with the apt-X test sound and its encodings.
+ * They are used as an input for the backend calibration. */
+extern unsigned char sample_sonar_wav[], sample_sonar_aptx[], sample_sonar_aptx_hd[];
+extern unsigned int sample_sonar_wav_len, sample_sonar_aptx_len, sample_sonar_aptx_hd_len;
+
+/* Number of 4-sample blocks used for the backend calibration. */
+#define DISPATCH_CALIBRATION_BLOCKS 1024
+/* Maximum size of the calibration output for a single block. */
+#define DISPATCH_CALIBRATION_BLOCK_SIZE (8 * sizeof(int32_t))
+/* Number of timed calibration rounds (the best one is taken). */
+#define DISPATCH_CALIBRATION_ROUNDS 3
+
+#define error(M, ...) fprintf(stderr, "openaptx: dispatch: " M "\n", ##__VA_ARGS__)
+
+enum dispatch_family {
+	DISPATCH_APTX_ENC = 0,
+	DISPATCH_APTX_HD_ENC,
+	DISPATCH_APTX_DEC,
+	DISPATCH_APTX_HD_DEC,
+	DISPATCH_FAMILIES,
+};
+
+#define DISPATCH_FAMILY_IS_HD(f) ((f) == DISPATCH_APTX_HD_ENC || (f) == DISPATCH_APTX_HD_DEC)
+#define DISPATCH_FAMILY_IS_DEC(f) ((f) == DISPATCH_APTX_DEC || (f) == DISPATCH_APTX_HD_DEC)
+
+struct dispatch_backend {
+	const char * name;
+	/* shared objects providing apt-X and apt-X HD API */
+	const char * soname[2];
+};
+
+/* Known backends in the order of the default preference. */
+static const struct dispatch_backend backends[] = {
+	{ "native", { "libaptx-4.2.2.so", "libaptxHD-1.0.0.so" } },
+	{ "ffmpeg", { "libaptx-ffmpeg.so", "libaptx-ffmpeg.so" } },
+	{ "freeaptx", { "libaptx-freeaptx.so", "libaptx-freeaptx.so" } },
+};
+
+static const struct {
+	const char * size;
+	const char * init;
+	const char * destroy;
+	const char * process;
+	const char * build;
+	const char * version;
+	const char * new;
+} dispatch_symbols[DISPATCH_FAMILIES] = {
+	[DISPATCH_APTX_ENC] = { "SizeofAptxbtenc", "aptxbtenc_init", "aptxbtenc_destroy", "aptxbtenc_encodestereo",
+		                    "aptxbtenc_build", "aptxbtenc_version", "NewAptxEnc" },
+	[DISPATCH_APTX_HD_ENC] = { "SizeofAptxhdbtenc", "aptxhdbtenc_init", "aptxhdbtenc_destroy",
+		                       "aptxhdbtenc_encodestereo", "aptxhdbtenc_build", "aptxhdbtenc_version",
+		                       "NewAptxhdEnc" },
+	[DISPATCH_APTX_DEC] = { "SizeofAptxbtdec", "aptxbtdec_init", "aptxbtdec_destroy", "aptxbtdec_decodestereo",
+		                    "aptxbtdec_build", "aptxbtdec_version", NULL },
+	[DISPATCH_APTX_HD_DEC] = { "SizeofAptxhdbtdec", "aptxhdbtdec_init", "aptxhdbtdec_destroy",
+		                       "aptxhdbtdec_decodestereo", "aptxhdbtdec_build", "aptxhdbtdec_version", NULL },
+};
+
+struct dispatch {
+	/* selected backend */
+	const struct dispatch_backend * backend;
+	void * handle;
+	size_t (*size)(void);
+	int (*init)(void *, short);
+	void (*destroy)(void *);
+	union {
+		void * ptr;
+		int (*aptx_enc)(APTXENC, const int32_t[4], const int32_t[4], uint16_t[2]);
+		int (*aptx_hd_enc)(APTXENC, const int32_t[4], const int32_t[4], uint32_t[2]);
+		int (*aptx_dec)(APTXDEC, int32_t[4], int32_t[4], const uint16_t[2]);
+		int (*aptx_hd_dec)(APTXDEC, int32_t[4], int32_t[4], const uint32_t[2]);
+	} process;
+	const char * (*build)(void);
+	const char * (*version)(void);
+	void * (*new)(short);
+};
+
+static struct dispatch dispatch[DISPATCH_FAMILIES];
+
+/* Wisdom keys of the calibrated backends. */
+static const char * const dispatch_wisdom_keys[DISPATCH_FAMILIES] = {
+	[DISPATCH_APTX_ENC] = "dispatch.aptx-encoder",
+	[DISPATCH_APTX_HD_ENC] = "dispatch.aptx-hd-encoder",
+	[DISPATCH_APTX_DEC] = "dispatch.aptx-decoder",
+	[DISPATCH_APTX_HD_DEC] = "dispatch.aptx-hd-decoder",
+};
+
+static const char * dispatch_family_name(enum dispatch_family family) {
+	switch (family) {
+	case DISPATCH_APTX_ENC:
+		return "apt-X encoder";
+	case DISPATCH_APTX_HD_ENC:
+		return "apt-X HD encoder";
+	case DISPATCH_APTX_DEC:
+		return "apt-X decoder";
+	case DISPATCH_APTX_HD_DEC:
+		return "apt-X HD decoder";
+	default:
+		return "";
+	}
+}
+
+static void * dispatch_dlopen(const char * soname) {
+
+	/* Use deep binding, so the backend will not resolve its own
+	 * public symbols (e.g. in NewAptxEnc) to our dispatcher. */
+	const int flags = RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND;
+	void * handle;
+
+	if ((handle = dlopen(soname, flags)) != NULL)
+		return handle;
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", LIBDIR, soname);
+	return dlopen(path, flags);
+}
+
+static int dispatch_load(struct dispatch * d, const struct dispatch_backend * b, enum dispatch_family family) {
+
+	memset(d, 0, sizeof(*d));
+	if ((d->handle = dispatch_dlopen(b->soname[DISPATCH_FAMILY_IS_HD(family)])) == NULL)
+		return -1;
+
+	*(void **)(&d->size) = dlsym(d->handle, dispatch_symbols[family].size);
+	*(void **)(&d->init) = dlsym(d->handle, dispatch_symbols[family].init);
+	*(void **)(&d->destroy) = dlsym(d->handle, dispatch_symbols[family].destroy);
+	d->process.ptr = dlsym(d->handle, dispatch_symbols[family].process);
+	*(void **)(&d->build) = dlsym(d->handle, dispatch_symbols[family].build);
+	*(void **)(&d->version) = dlsym(d->handle, dispatch_symbols[family].version);
+	if (dispatch_symbols[family].new != NULL)
+		*(void **)(&d->new) = dlsym(d->handle, dispatch_symbols[family].new);
+
+	/* Destroy and deprecated constructor are optional. */
+	if (d->size == NULL || d->init == NULL || d->process.ptr == NULL || d->build == NULL || d->version == NULL) {
+		dlclose(d->handle);
+		d->handle = NULL;
+		return -1;
+	}
+
+	d->backend = b;
+	return 0;
+}
+
+static void dispatch_unload(struct dispatch * d) {
+	if (d->handle != NULL)
+		dlclose(d->handle);
+	memset(d, 0, sizeof(*d));
+}
+
+static const uint8_t * dispatch_sample_pcm(size_t * frames) {
+
+	/* Walk through RIFF chunks in order to find the PCM data. */
+	const uint8_t * riff = sample_sonar_wav;
+	size_t offset = 12;
+
+	while (offset + 8 <= sample_sonar_wav_len) {
+		const uint8_t * chunk = &riff[offset];
+		size_t size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (size_t)chunk[7] << 24;
+		if (memcmp(chunk, "data", 4) == 0) {
+			/* 16-bit stereo PCM */
+			*frames = size / 4;
+			return &chunk[8];
+		}
+		offset += 8 + size;
+	}
+
+	*frames = 0;
+	return NULL;
+}
+
+static void dispatch_sample_block(const uint8_t * pcm, size_t block, int shift, int32_t pcmL[4], int32_t pcmR[4]) {
+	const uint8_t * p = &pcm[block * 4 /* samples */ * 4 /* 2 channels * 16bit */];
+	for (size_t i = 0; i < 4; i++) {
+		pcmL[i] = (int16_t)(p[i * 4 + 0] | p[i * 4 + 1] << 8) * (1 << shift);
+		pcmR[i] = (int16_t)(p[i * 4 + 2] | p[i * 4 + 3] << 8) * (1 << shift);
+	}
+}
+
+static double dispatch_elapsed(const struct timespec * t0) {
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * Run calibration encoding or decoding for a given backend.
+ *
+ * Encoders process the test sound PCM and decoders process its apt-X
+ * encoding. The output is checked against the reference buffer if it is
+ * marked as valid, otherwise the output is stored in that buffer.
+ *
+ * @return On success, the best elapsed time in milliseconds is returned.
+ *   If the output is not bit-exact, -1 is returned. */
+static double dispatch_calibrate(const struct dispatch * d, enum dispatch_family family, uint8_t * ref,
+                                 bool ref_valid) {
+
+	const bool hd = DISPATCH_FAMILY_IS_HD(family);
+	const uint8_t * stream = hd ? sample_sonar_aptx_hd : sample_sonar_aptx;
+	const size_t stream_len = hd ? sample_sonar_aptx_hd_len : sample_sonar_aptx_len;
+	const size_t codeword_size = hd ? 3 : 2;
+	const int pcm_shift = hd ? 8 : 0;
+
+	size_t frames;
+	const uint8_t * pcm = dispatch_sample_pcm(&frames);
+	size_t blocks = DISPATCH_CALIBRATION_BLOCKS;
+	if (blocks > frames / 4)
+		blocks = frames / 4;
+	if (blocks > stream_len / codeword_size / 2)
+		blocks = stream_len / codeword_size / 2;
+
+	double best = -1;
+	void * handle;
+
+	if ((handle = malloc(d->size())) == NULL)
+		return -1;
+
+	for (size_t round = 0; round < DISPATCH_CALIBRATION_ROUNDS; round++) {
+
+		if (d->init(handle, 0) != 0)
+			goto fail;
+
+		bool exact = true;
+		struct timespec t0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+
+		for (size_t i = 0; i < blocks; i++) {
+
+			const uint8_t * s = &stream[i * codeword_size * 2];
+			int32_t pcmL[4], pcmR[4];
+			uint8_t out[DISPATCH_CALIBRATION_BLOCK_SIZE];
+			size_t out_len = 0;
+			int rv = 0;
+
+			switch (family) {
+			case DISPATCH_APTX_ENC: {
+				uint16_t code[2];
+				dispatch_sample_block(pcm, i, pcm_shift, pcmL, pcmR);
+				rv = d->process.aptx_enc(handle, pcmL, pcmR, code);
+				out[0] = code[0] >> 8, out[1] = code[0], out[2] = code[1] >> 8, out[3] = code[1];
+				out_len = 4;
+			} break;
+			case DISPATCH_APTX_HD_ENC: {
+				uint32_t code[2];
+				dispatch_sample_block(pcm, i, pcm_shift, pcmL, pcmR);
+				rv = d->process.aptx_hd_enc(handle, pcmL, pcmR, code);
+				out[0] = code[0] >> 16, out[1] = code[0] >> 8, out[2] = code[0];
+				out[3] = code[1] >> 16, out[4] = code[1] >> 8, out[5] = code[1];
+				out_len = 6;
+			} break;
+			case DISPATCH_APTX_DEC: {
+				const uint16_t code[2] = { s[0] << 8 | s[1], s[2] << 8 | s[3] };
+				rv = d->process.aptx_dec(handle, pcmL, pcmR, code);
+			} break;
+			case DISPATCH_APTX_HD_DEC: {
+				const uint32_t code[2] = { s[0] << 16 | s[1] << 8 | s[2], s[3] << 16 | s[4] << 8 | s[5] };
+				rv = d->process.aptx_hd_dec(handle, pcmL, pcmR, code);
+			} break;
+			default:
+				rv = -1;
+			}
+
+			if (DISPATCH_FAMILY_IS_DEC(family)) {
+				memcpy(&out[0], pcmL, sizeof(pcmL));
+				memcpy(&out[sizeof(pcmL)], pcmR, sizeof(pcmR));
+				out_len = sizeof(pcmL) + sizeof(pcmR);
+			}
+
+			uint8_t * r = &ref[i * DISPATCH_CALIBRATION_BLOCK_SIZE];
+			if (rv != 0)
+				exact = false;
+			else if (!ref_valid)
+				memcpy(r, out, out_len);
+			else if (memcmp(r, out, out_len) != 0)
+				exact = false;
+
+		}
+
+		double elapsed = dispatch_elapsed(&t0);
+		if (d->destroy != NULL)
+			d->destroy(handle);
+
+		if (!exact)
+			goto fail;
+		if (best < 0 || elapsed < best)
+			best = elapsed;
+
+		ref_valid = true;
+
+	}
+
+	free(handle);
+	return best;
+
+fail:
+	free(handle);
+	return -1;
+}
+
+static void dispatch_resolve(enum dispatch_family family) {
+
+	const size_t n = sizeof(backends) / sizeof(*backends);
+	const char * name = getenv("OPENAPTX_BACKEND");
+	const char * calibrate = getenv("OPENAPTX_CALIBRATE");
+	struct dispatch * d = &dispatch[family];
+
+	if (name != NULL && name[0] != '\0') {
+		for (size_t i = 0; i < n; i++)
+			if (strcmp(backends[i].name, name) == 0 && dispatch_load(d, &backends[i], family) == 0)
+				return;
+		error("%s: Requested backend not available: %s", dispatch_family_name(family), name);
+	}
+
+	/* Backend selected by the previous calibration on this host. */
+	char wisdom[WISDOM_FIELD_SIZE];
+	if (wisdom_load(dispatch_wisdom_keys[family], wisdom, sizeof(wisdom)) == 0)
+		for (size_t i = 0; i < n; i++)
+			if (strcmp(backends[i].name, wisdom) == 0 && dispatch_load(d, &backends[i], family) == 0)
+				return;
+
+	if (calibrate == NULL || calibrate[0] == '\0' || strcmp(calibrate, "0") == 0) {
+		/* Select the first available backend. */
+		for (size_t i = 0; i < n; i++)
+			if (dispatch_load(d, &backends[i], family) == 0)
+				return;
+		return;
+	}
+
+	/* Output of the first available backend (in the order of preference)
+	 * is used as a reference for checking bit-exactness of the others. */
+	uint8_t * ref;
+	bool ref_valid = false;
+	if ((ref = malloc(DISPATCH_CALIBRATION_BLOCKS * DISPATCH_CALIBRATION_BLOCK_SIZE)) == NULL)
+		return;
+
+	double best = -1;
+	for (size_t i = 0; i < n; i++) {
+
+		struct dispatch tmp;
+		if (dispatch_load(&tmp, &backends[i], family) != 0)
+			continue;
+
+		double elapsed = dispatch_calibrate(&tmp, family, ref, ref_valid);
+		if (elapsed >= 0)
+			ref_valid = true;
+		if (elapsed < 0)
+			error("%s: %s: Not bit-exact", dispatch_family_name(family), backends[i].name);
+		else
+			error("%s: %s: %.3f ms", dispatch_family_name(family), backends[i].name, elapsed);
+
+		if (elapsed >= 0 && (best < 0 || elapsed < best)) {
+			dispatch_unload(d);
+			memcpy(d, &tmp, sizeof(*d));
+			best = elapsed;
+		} else {
+			dispatch_unload(&tmp);
+		}
+
+	}
+
+	if (d->backend != NULL) {
+		error("%s: Selected backend: %s", dispatch_family_name(family), d->backend->name);
+		if (wisdom_store(dispatch_wisdom_keys[family], d->backend->name) == -1)
+			error("%s: Couldn't store wisdom: %s", dispatch_family_name(family), strerror(errno));
+	}
+
+	free(ref);
+}
+
+#define DISPATCH_RESOLVE(family) \
+	static void dispatch_resolve_##family(void) { \
+		dispatch_resolve(family); \
+	}
+
+DISPATCH_RESOLVE(DISPATCH_APTX_ENC)
+DISPATCH_RESOLVE(DISPATCH_APTX_HD_ENC)
+DISPATCH_RESOLVE(DISPATCH_APTX_DEC)
+DISPATCH_RESOLVE(DISPATCH_APTX_HD_DEC)
+
+static pthread_once_t dispatch_once[DISPATCH_FAMILIES] = {
+	PTHREAD_ONCE_INIT,
+	PTHREAD_ONCE_INIT,
+	PTHREAD_ONCE_INIT,
+	PTHREAD_ONCE_INIT,
+};
+
+static void (*const dispatch_resolvers[DISPATCH_FAMILIES])(void) = {
+	[DISPATCH_APTX_ENC] = dispatch_resolve_DISPATCH_APTX_ENC,
+	[DISPATCH_APTX_HD_ENC] = dispatch_resolve_DISPATCH_APTX_HD_ENC,
+	[DISPATCH_APTX_DEC] = dispatch_resolve_DISPATCH_APTX_DEC,
+	[DISPATCH_APTX_HD_DEC] = dispatch_resolve_DISPATCH_APTX_HD_DEC,
+};
+
+static const struct dispatch * dispatch_get(enum dispatch_family family) {
+	pthread_once(&dispatch_once[family], dispatch_resolvers[family]);
+	return &dispatch[family];
+}
+
+static size_t dispatch_size(enum dispatch_family family) {
+	const struct dispatch * d = dispatch_get(family);
+	return d->size != NULL ? d->size() : 0;
+}
+
+static int dispatch_init(enum dispatch_family family, void * handle, short endian) {
+	const struct dispatch * d = dispatch_get(family);
+	if (d->init == NULL)
+		return errno = ENOSYS, -1;
+	return d->init(handle, endian);
+}
+
+static void dispatch_destroy(enum dispatch_family family, void * handle) {
+	const struct dispatch * d = &dispatch[family];
+	if (d->destroy != NULL)
+		d->destroy(handle);
+}
+
+static const char * dispatch_build(enum dispatch_family family) {
+	const struct dispatch * d = dispatch_get(family);
+	return d->build != NULL ? d->build() : PACKAGE_NAME "-dispatch-" PACKAGE_VERSION;
+}
+
+static const char * dispatch_version(enum dispatch_family family) {
+	const struct dispatch * d = dispatch_get(family);
+	return d->version != NULL ? d->version() : PACKAGE_VERSION;
+}
+
+static void * dispatch_new(enum dispatch_family family, short endian) {
+	const struct dispatch * d = dispatch_get(family);
+	if (d->new == NULL)
+		return errno = ENOSYS, NULL;
+	return d->new(endian);
+}
+
+#if ENABLE_APTX_ENCODER_API
+
+APTXENC NewAptxEnc(short endian) {
+	return dispatch_new(DISPATCH_APTX_ENC, endian);
+}
+
+size_t SizeofAptxbtenc(void) {
+	return dispatch_size(DISPATCH_APTX_ENC);
+}
+
+int aptxbtenc_init(APTXENC enc, short endian) {
+	return dispatch_init(DISPATCH_APTX_ENC, enc, endian);
+}
+
+void aptxbtenc_destroy(APTXENC enc) {
+	dispatch_destroy(DISPATCH_APTX_ENC, enc);
+}
+
+int aptxbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]) {
+	/* Backend was resolved by the encoder initialization. */
+	return dispatch[DISPATCH_APTX_ENC].process.aptx_enc(enc, pcmL, pcmR, code);
+}
+
+const char * aptxbtenc_build(void) {
+	return dispatch_build(DISPATCH_APTX_ENC);
+}
+
+const char * aptxbtenc_version(void) {
+	return dispatch_version(DISPATCH_APTX_ENC);
+}
+
+APTXENC NewAptxhdEnc(short endian) {
+	return dispatch_new(DISPATCH_APTX_HD_ENC, endian);
+}
+
+size_t SizeofAptxhdbtenc(void) {
+	return dispatch_size(DISPATCH_APTX_HD_ENC);
+}
+
+int aptxhdbtenc_init(APTXENC enc, short endian) {
+	return dispatch_init(DISPATCH_APTX_HD_ENC, enc, endian);
+}
+
+void aptxhdbtenc_destroy(APTXENC enc) {
+	dispatch_destroy(DISPATCH_APTX_HD_ENC, enc);
+}
+
+int aptxhdbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcmR[4], uint32_t code[2]) {
+	/* Backend was resolved by the encoder initialization. */
+	return dispatch[DISPATCH_APTX_HD_ENC].process.aptx_hd_enc(enc, pcmL, pcmR, code);
+}
+
+const char * aptxhdbtenc_build(void) {
+	return dispatch_build(DISPATCH_APTX_HD_ENC);
+}
+
+const char * aptxhdbtenc_version(void) {
+	return dispatch_version(DISPATCH_APTX_HD_ENC);
+}
+
+#endif /* ENABLE_APTX_ENCODER_API */
+
+#if ENABLE_APTX_DECODER_API
+
+size_t SizeofAptxbtdec(void) {
+	return dispatch_size(DISPATCH_APTX_DEC);
+}
+
+int aptxbtdec_init(APTXDEC dec, short endian) {
+	return dispatch_init(DISPATCH_APTX_DEC, dec, endian);
+}
+
+void aptxbtdec_destroy(APTXDEC dec) {
+	dispatch_destroy(DISPATCH_APTX_DEC, dec);
+}
+
+int aptxbtdec_decodestereo(APTXDEC dec, int32_t pcmL[4], int32_t pcmR[4], const uint16_t code[2]) {
+	/* Backend was resolved by the decoder initialization. */
+	return dispatch[DISPATCH_APTX_DEC].process.aptx_dec(dec, pcmL, pcmR, code);
+}
+
+const char * aptxbtdec_build(void) {
+	return dispatch_build(DISPATCH_APTX_DEC);
+}
+
+const char * aptxbtdec_version(void) {
+	return dispatch_version(DISPATCH_APTX_DEC);
+}
+
+size_t SizeofAptxhdbtdec(void) {
+	return dispatch_size(DISPATCH_APTX_HD_DEC);
+}
+
+int aptxhdbtdec_init(APTXDEC dec, short endian) {
+	return dispatch_init(DISPATCH_APTX_HD_DEC, dec, endian);
+}
+
+void aptxhdbtdec_destroy(APTXDEC dec) {
+	dispatch_destroy(DISPATCH_APTX_HD_DEC, dec);
+}
+
+int aptxhdbtdec_decodestereo(APTXDEC dec, int32_t pcmL[4], int32_t pcmR[4], const uint32_t code[2]) {
+	/* Backend was resolved by the decoder initialization. */
+	return dispatch[DISPATCH_APTX_HD_DEC].process.aptx_hd_dec(dec, pcmL, pcmR, code);
+}
+
+const char * aptxhdbtdec_build(void) {
+	return dispatch_build(DISPATCH_APTX_HD_DEC);
+}
+
+const char * aptxhdbtdec_version(void) {
+	return dispatch_version(DISPATCH_APTX_HD_DEC);
+}
+
+#endif /* ENABLE_APTX_DECODER_API */
@@ -0,0 +1,338 @@
+/*
+ * [open]aptx - aptx-fanout.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openaptx-fanout.h"
+#include "openaptx.h"
+
+#include "stream.h"
+
+/* Number of frames in the apt-X autosync period (8 blocks). */
+#define FANOUT_SYNC_FRAMES 32
+
+struct fanout_packet {
+	/* public part, shall be the first member */
+	struct openaptx_packet pub;
+	atomic_uint refs;
+	uint64_t seq;
+	struct fanout_packet * next;
+	uint8_t data[];
+};
+
+struct openaptx_subscriber {
+	openaptx_fanout * fanout;
+	struct openaptx_subscriber * next;
+	/* sequence number of the next packet to read */
+	uint64_t cursor;
+	size_t max_packets;
+	bool blocking;
+	size_t overruns;
+};
+
+struct openaptx_fanout {
+
+	pthread_mutex_t mutex;
+	pthread_cond_t readable;
+	pthread_cond_t writable;
+	bool closed;
+
+	enum openaptx_codec codec;
+	APTXENC enc;
+
+	/* PCM frames waiting for the packet to be filled */
+	int32_t * pcm;
+	size_t pcm_frames;
+	size_t packet_frames;
+	/* number of blocks encoded so far */
+	uint64_t blocks;
+
+	/* queue of packets not read by all subscribers */
+	struct fanout_packet * head;
+	struct fanout_packet * tail;
+	/* sequence number of the next packet */
+	uint64_t seq;
+
+	struct openaptx_subscriber * subscribers;
+
+};
+
+static void fanout_packet_unref(struct fanout_packet * p) {
+	if (atomic_fetch_sub_explicit(&p->refs, 1, memory_order_acq_rel) == 1)
+		free(p);
+}
+
+openaptx_fanout * openaptx_fanout_new(enum openaptx_codec codec, short endian, size_t packet_frames) {
+
+	struct openaptx_fanout * fanout;
+
+	if (codec != OPENAPTX_CODEC_APTX && codec != OPENAPTX_CODEC_APTX_HD)
+		return errno = EINVAL, NULL;
+
+	if (packet_frames == 0)
+		packet_frames = FANOUT_SYNC_FRAMES;
+	packet_frames = (packet_frames + FANOUT_SYNC_FRAMES - 1) / FANOUT_SYNC_FRAMES * FANOUT_SYNC_FRAMES;
+
+	if ((fanout = calloc(1, sizeof(*fanout))) == NULL)
+		return NULL;
+
+	pthread_mutex_init(&fanout->mutex, NULL);
+	pthread_cond_init(&fanout->readable, NULL);
+	pthread_cond_init(&fanout->writable, NULL);
+
+	fanout->codec = codec;
+	fanout->packet_frames = packet_frames;
+
+	if ((fanout->pcm = malloc(packet_frames * 2 * sizeof(*fanout->pcm))) == NULL)
+		goto fail;
+	if ((fanout->enc = stream_encoder_new(codec, endian)) == NULL)
+		goto fail;
+
+	return fanout;
+
+fail:
+	openaptx_fanout_free(fanout);
+	return NULL;
+}
+
+void openaptx_fanout_free(openaptx_fanout * fanout) {
+
+	if (fanout == NULL)
+		return;
+
+	while (fanout->head != NULL) {
+		struct fanout_packet * p = fanout->head;
+		fanout->head = p->next;
+		fanout_packet_unref(p);
+	}
+
+	stream_encoder_free(fanout->codec, fanout->enc);
+	pthread_cond_destroy(&fanout->writable);
+	pthread_cond_destroy(&fanout->readable);
+	pthread_mutex_destroy(&fanout->mutex);
+	free(fanout->pcm);
+	free(fanout);
+}
+
+void openaptx_fanout_close(openaptx_fanout * fanout) {
+	pthread_mutex_lock(&fanout->mutex);
+	fanout->closed = true;
+	pthread_cond_broadcast(&fanout->readable);
+	pthread_cond_broadcast(&fanout->writable);
+	pthread_mutex_unlock(&fanout->mutex);
+}
+
+/**
+ * Drop packets which were read by all subscribers. */
+static void fanout_trim(openaptx_fanout * fanout) {
+
+	uint64_t cursor = fanout->seq;
+	for (struct openaptx_subscriber * s = fanout->subscribers; s != NULL; s = s->next)
+		if (s->cursor < cursor)
+			cursor = s->cursor;
+
+	while (fanout->head != NULL && fanout->head->seq < cursor) {
+		struct fanout_packet * p = fanout->head;
+		if ((fanout->head = p->next) == NULL)
+			fanout->tail = NULL;
+		fanout_packet_unref(p);
+	}
+
+}
+
+static bool fanout_is_writable(openaptx_fanout * fanout) {
+	for (struct openaptx_subscriber * s = fanout->subscribers; s != NULL; s = s->next)
+		if (s->blocking && fanout->seq - s->cursor >= s->max_packets)
+			return false;
+	return true;
+}
+
+static int fanout_publish(openaptx_fanout * fanout) {
+
+	const size_t blocks = fanout->packet_frames / 4;
+	const size_t size = blocks * 2 * stream_codeword_size(fanout->codec);
+	struct fanout_packet * p;
+
+	if ((p = malloc(sizeof(*p) + size)) == NULL)
+		return -1;
+
+	/* Encoder is used by the writer only, so there is no need to hold
+	 * the lock during the encoding. */
+	if (stream_encode(fanout->codec, fanout->enc, fanout->pcm, fanout->packet_frames, p->data) != 0) {
+		free(p);
+		return errno = EIO, -1;
+	}
+
+	p->pub.data = p->data;
+	p->pub.size = size;
+	p->pub.block = fanout->blocks;
+	atomic_init(&p->refs, 1);
+	p->next = NULL;
+
+	fanout->blocks += blocks;
+	fanout->pcm_frames = 0;
+
+	pthread_mutex_lock(&fanout->mutex);
+
+	while (!fanout->closed && !fanout_is_writable(fanout))
+		pthread_cond_wait(&fanout->writable, &fanout->mutex);
+
+	if (fanout->closed) {
+		pthread_mutex_unlock(&fanout->mutex);
+		free(p);
+		return errno = EPIPE, -1;
+	}
+
+	for (struct openaptx_subscriber * s = fanout->subscribers; s != NULL; s = s->next)
+		if (fanout->seq - s->cursor >= s->max_packets) {
+			s->cursor++;
+			s->overruns++;
+		}
+
+	p->seq = fanout->seq++;
+	if (fanout->tail != NULL)
+		fanout->tail->next = p;
+	else
+		fanout->head = p;
+	fanout->tail = p;
+
+	fanout_trim(fanout);
+	pthread_cond_broadcast(&fanout->readable);
+	pthread_mutex_unlock(&fanout->mutex);
+
+	return 0;
+}
+
+ssize_t openaptx_fanout_write(openaptx_fanout * fanout, const int32_t * pcm, size_t frames) {
+
+	size_t consumed = 0;
+
+	pthread_mutex_lock(&fanout->mutex);
+	const bool closed = fanout->closed;
+	pthread_mutex_unlock(&fanout->mutex);
+
+	if (closed)
+		return errno = EPIPE, -1;
+
+	while (consumed < frames) {
+
+		size_t n = fanout->packet_frames - fanout->pcm_frames;
+		if (n > frames - consumed)
+			n = frames - consumed;
+
+		memcpy(&fanout->pcm[fanout->pcm_frames * 2], &pcm[consumed * 2], n * 2 * sizeof(*pcm));
+		fanout->pcm_frames += n;
+		consumed += n;
+
+		/* Frames of the packet which was not published stay in the buffer,
+		 * so the publishing is retried by the next call. */
+		if (fanout->pcm_frames == fanout->packet_frames && fanout_publish(fanout) != 0)
+			return consumed != 0 ? (ssize_t)consumed : -1;
+
+	}
+
+	return consumed;
+}
+
+openaptx_subscriber * openaptx_fanout_subscribe(openaptx_fanout * fanout, size_t max_packets, bool blocking) {
+
+	struct openaptx_subscriber * sub;
+
+	if (max_packets == 0)
+		return errno = EINVAL, NULL;
+	if ((sub = calloc(1, sizeof(*sub))) == NULL)
+		return NULL;
+
+	sub->fanout = fanout;
+	sub->max_packets = max_packets;
+	sub->blocking = blocking;
+
+	pthread_mutex_lock(&fanout->mutex);
+	/* All packets start at the autosync phase 0, so the subscriber can
+	 * start with the next published packet. */
+	sub->cursor = fanout->seq;
+	sub->next = fanout->subscribers;
+	fanout->subscribers = sub;
+	pthread_mutex_unlock(&fanout->mutex);
+
+	return sub;
+}
+
+void openaptx_fanout_unsubscribe(openaptx_subscriber * sub) {
+
+	if (sub == NULL)
+		return;
+
+	openaptx_fanout * fanout = sub->fanout;
+
+	pthread_mutex_lock(&fanout->mutex);
+	for (struct openaptx_subscriber ** s = &fanout->subscribers; *s != NULL; s = &(*s)->next)
+		if (*s == sub) {
+			*s = sub->next;
+			break;
+		}
+	fanout_trim(fanout);
+	pthread_cond_broadcast(&fanout->writable);
+	pthread_mutex_unlock(&fanout->mutex);
+
+	free(sub);
+}
+
+const struct openaptx_packet * openaptx_fanout_read(openaptx_subscriber * sub, bool wait) {
+
+	openaptx_fanout * fanout = sub->fanout;
+	struct fanout_packet * p;
+
+	pthread_mutex_lock(&fanout->mutex);
+
+	while (sub->cursor == fanout->seq) {
+		if (fanout->closed || !wait) {
+			pthread_mutex_unlock(&fanout->mutex);
+			return errno = fanout->closed ? EPIPE : EAGAIN, NULL;
+		}
+		pthread_cond_wait(&fanout->readable, &fanout->mutex);
+	}
+
+	/* Packets not read by this subscriber are still in the queue. */
+	for (p = fanout->head; p->seq != sub->cursor; p = p->next)
+		continue;
+
+	atomic_fetch_add_explicit(&p->refs, 1, memory_order_relaxed);
+	sub->cursor++;
+
+	fanout_trim(fanout);
+	pthread_cond_broadcast(&fanout->writable);
+	pthread_mutex_unlock(&fanout->mutex);
+
+	return &p->pub;
+}
+
+size_t openaptx_fanout_overruns(openaptx_subscriber * sub) {
+	pthread_mutex_lock(&sub->fanout->mutex);
+	size_t overruns = sub->overruns;
+	pthread_mutex_unlock(&sub->fanout->mutex);
+	return overruns;
+}
+
+void openaptx_packet_unref(const struct openaptx_packet * packet) {
+	if (packet == NULL)
+		return;
+	/* public part is the first member of the internal structure */
+	fanout_packet_unref((struct fanout_packet *)packet);
+}
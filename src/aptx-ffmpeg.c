@@ -14,6 +14,8 @@
 
 #include <endian.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,7 +25,21 @@
 #define OPENAPTX_IMPLEMENTATION
 #include "openaptx.h"
 
+#include "tracepoints.h"
+
+/* Maximum number of cached packets and frames per pool. */
+#define APTX_FFMPEG_POOL_SIZE 8
+
+enum aptx_ffmpeg_pool {
+	APTX_FFMPEG_POOL_ENC = 0,
+	APTX_FFMPEG_POOL_HD_ENC,
+	APTX_FFMPEG_POOL_DEC,
+	APTX_FFMPEG_POOL_HD_DEC,
+	APTX_FFMPEG_POOLS,
+};
+
 struct internal_ctx {
+	enum aptx_ffmpeg_pool pool;
 	AVCodecContext * av_ctx;
 	AVPacket * av_packet;
 	AVFrame * av_frame;
@@ -36,23 +52,112 @@ struct internal_ctx {
 
 #define error(M, ...) fprintf(stderr, "openaptx: ffmpeg apt-X: " M "\n", ##__VA_ARGS__)
 
+/**
+ * Process-wide cache of codec lookups and released packets and frames.
+ *
+ * The AV codec context itself is not cached, because neither apt-X encoder
+ * nor decoder implements flushing. Reusing opened context would carry the
+ * state of the previous stream, which would break bit-exactness. */
+static struct {
+	pthread_mutex_t mutex;
+	const AVCodec * codecs[APTX_FFMPEG_POOLS];
+	AVPacket * av_packets[APTX_FFMPEG_POOLS][APTX_FFMPEG_POOL_SIZE];
+	AVFrame * av_frames[APTX_FFMPEG_POOLS][APTX_FFMPEG_POOL_SIZE];
+	size_t len[APTX_FFMPEG_POOLS];
+} cache = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
 static void __attribute__((constructor)) _init() {
 	avcodec_register_all();
 }
 #endif
 
-static int aptx_ffmpeg_init(struct internal_ctx * ctx, enum AVCodecID codec_id, short endian) {
+static void __attribute__((destructor)) _fini() {
+	for (size_t i = 0; i < APTX_FFMPEG_POOLS; i++)
+		while (cache.len[i] > 0) {
+			cache.len[i]--;
+			av_packet_free(&cache.av_packets[i][cache.len[i]]);
+			av_frame_free(&cache.av_frames[i][cache.len[i]]);
+		}
+}
+
+static const AVCodec * aptx_ffmpeg_find_codec(enum aptx_ffmpeg_pool pool, enum AVCodecID codec_id) {
+
+	const bool encoder = pool == APTX_FFMPEG_POOL_ENC || pool == APTX_FFMPEG_POOL_HD_ENC;
+	const AVCodec * codec;
+
+	pthread_mutex_lock(&cache.mutex);
+	if ((codec = cache.codecs[pool]) == NULL)
+		codec = cache.codecs[pool] = encoder ? avcodec_find_encoder(codec_id) : avcodec_find_decoder(codec_id);
+	pthread_mutex_unlock(&cache.mutex);
+
+	return codec;
+}
+
+/**
+ * Get packet and frame from the pool or allocate new ones. */
+static int aptx_ffmpeg_pool_get(struct internal_ctx * ctx) {
+
+	pthread_mutex_lock(&cache.mutex);
+	if (cache.len[ctx->pool] > 0) {
+		cache.len[ctx->pool]--;
+		ctx->av_packet = cache.av_packets[ctx->pool][cache.len[ctx->pool]];
+		ctx->av_frame = cache.av_frames[ctx->pool][cache.len[ctx->pool]];
+	}
+	pthread_mutex_unlock(&cache.mutex);
+
+	if (ctx->av_packet == NULL && (ctx->av_packet = av_packet_alloc()) == NULL) {
+		error("Packet allocation failed: %s", strerror(ENOMEM));
+		return -ENOMEM;
+	}
+	if (ctx->av_frame == NULL && (ctx->av_frame = av_frame_alloc()) == NULL) {
+		error("Frame allocation failed: %s", strerror(ENOMEM));
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * Return packet and frame to the pool or free them if the pool is full. */
+static void aptx_ffmpeg_pool_put(struct internal_ctx * ctx) {
+
+	if (ctx->av_packet == NULL || ctx->av_frame == NULL)
+		goto final;
+
+	av_packet_unref(ctx->av_packet);
+	/* Encoder frame buffer is reused as it is. */
+	if (ctx->pool == APTX_FFMPEG_POOL_DEC || ctx->pool == APTX_FFMPEG_POOL_HD_DEC)
+		av_frame_unref(ctx->av_frame);
+
+	pthread_mutex_lock(&cache.mutex);
+	if (cache.len[ctx->pool] < APTX_FFMPEG_POOL_SIZE) {
+		cache.av_packets[ctx->pool][cache.len[ctx->pool]] = ctx->av_packet;
+		cache.av_frames[ctx->pool][cache.len[ctx->pool]] = ctx->av_frame;
+		cache.len[ctx->pool]++;
+		ctx->av_packet = NULL;
+		ctx->av_frame = NULL;
+	}
+	pthread_mutex_unlock(&cache.mutex);
+
+final:
+	av_frame_free(&ctx->av_frame);
+	av_packet_free(&ctx->av_packet);
+}
+
+static int aptx_ffmpeg_init(struct internal_ctx * ctx, enum AVCodecID codec_id, bool encoder, short endian) {
 
 	ctx->av_ctx = NULL;
 	ctx->av_packet = NULL;
 	ctx->av_frame = NULL;
 
 	if (codec_id == AV_CODEC_ID_APTX) {
+		ctx->pool = encoder ? APTX_FFMPEG_POOL_ENC : APTX_FFMPEG_POOL_DEC;
 		ctx->shift_hi = endian ? 0 : 8;
 		ctx->shift_lo = endian ? 8 : 0;
 		ctx->magic = endian ? 0xBF4B : 0x4BBF;
 	} else if (codec_id == AV_CODEC_ID_APTX_HD) {
+		ctx->pool = encoder ? APTX_FFMPEG_POOL_HD_ENC : APTX_FFMPEG_POOL_HD_DEC;
 		ctx->shift_hi = endian ? 0 : 16;
 		ctx->shift_lo = endian ? 16 : 0;
 		ctx->magic = endian ? 0xFFBE73 : 0x73BEFF;
@@ -88,10 +193,9 @@ static int aptx_ffmpeg_init_codec(struct internal_ctx * ctx, const AVCodec * cod
 }
 
 static void aptx_ffmpeg_destroy(struct internal_ctx * ctx) {
-	if (ctx != NULL)
+	if (ctx == NULL)
 		return;
-	av_frame_free(&ctx->av_frame);
-	av_packet_free(&ctx->av_packet);
+	aptx_ffmpeg_pool_put(ctx);
 	avcodec_free_context(&ctx->av_ctx);
 }
 
@@ -103,10 +207,10 @@ static int aptx_ffmpeg_enc_init(struct internal_ctx * ctx, enum AVCodecID codec_
 	char errmsg[128];
 	int rv;
 
-	if ((rv = aptx_ffmpeg_init(ctx, codec_id, endian)) != 0)
+	if ((rv = aptx_ffmpeg_init(ctx, codec_id, true, endian)) != 0)
 		return rv;
 
-	if ((codec = avcodec_find_encoder(codec_id)) == NULL) {
+	if ((codec = aptx_ffmpeg_find_codec(ctx->pool, codec_id)) == NULL) {
 		error("Encoder not found: %#x", codec_id);
 		rv = -ESRCH;
 		goto fail;
@@ -115,16 +219,8 @@ static int aptx_ffmpeg_enc_init(struct internal_ctx * ctx, enum AVCodecID codec_
 	if ((rv = aptx_ffmpeg_init_codec(ctx, codec)) != 0)
 		goto fail;
 
-	if ((ctx->av_packet = av_packet_alloc()) == NULL) {
-		error("Packet allocation failed: %s", strerror(ENOMEM));
-		rv = -ENOMEM;
+	if ((rv = aptx_ffmpeg_pool_get(ctx)) != 0)
 		goto fail;
-	}
-	if ((ctx->av_frame = av_frame_alloc()) == NULL) {
-		error("Frame allocation failed: %s", strerror(ENOMEM));
-		rv = -ENOMEM;
-		goto fail;
-	}
 
 	/* Make sure that we can implement Qualcomm API. */
 	if (ctx->av_ctx->frame_size < 4) {
@@ -133,15 +229,20 @@ static int aptx_ffmpeg_enc_init(struct internal_ctx * ctx, enum AVCodecID codec_
 		goto fail;
 	}
 
-	ctx->av_frame->nb_samples = 4;
-	ctx->av_frame->format = ctx->av_ctx->sample_fmt;
-	av_channel_layout_copy(&ctx->av_frame->ch_layout, &ctx->av_ctx->ch_layout);
+	/* Frame taken from the pool has the buffer already allocated. */
+	if (ctx->av_frame->buf[0] == NULL) {
+
+		ctx->av_frame->nb_samples = 4;
+		ctx->av_frame->format = ctx->av_ctx->sample_fmt;
+		av_channel_layout_copy(&ctx->av_frame->ch_layout, &ctx->av_ctx->ch_layout);
+
+		if ((rv = av_frame_get_buffer(ctx->av_frame, 0)) != 0) {
+			av_strerror(rv, errmsg, sizeof(errmsg));
+			error("AV buffer allocation failed: %s", errmsg);
+			rv = -ENOMEM;
+			goto fail;
+		}
 
-	if ((rv = av_frame_get_buffer(ctx->av_frame, 0)) != 0) {
-		av_strerror(rv, errmsg, sizeof(errmsg));
-		error("AV buffer allocation failed: %s", errmsg);
-		rv = -ENOMEM;
-		goto fail;
 	}
 
 	return 0;
@@ -173,6 +274,7 @@ static int aptx_ffmpeg_encode(struct internal_ctx * restrict ctx, const int32_t
 	for (size_t i = 0; i < 4; i++)
 		samples_r[i] = pcmR[i] << pcm_shift;
 
+	OPENAPTX_TRACE2(ffmpeg_frame, ctx, ctx->av_frame->nb_samples);
 	if ((rv = avcodec_send_frame(ctx->av_ctx, ctx->av_frame)) != 0) {
 		av_strerror(rv, errmsg, sizeof(errmsg));
 		error("Send audio frame failed: %s", errmsg);
@@ -187,6 +289,7 @@ static int aptx_ffmpeg_encode(struct internal_ctx * restrict ctx, const int32_t
 		goto fail;
 	}
 
+	OPENAPTX_TRACE2(ffmpeg_packet, ctx, ctx->av_packet->size);
 	if (ctx->av_packet->size != packet_size) {
 		error("Invalid packet size: %d != %d", ctx->av_packet->size, packet_size);
 		rv = -EMSGSIZE;
@@ -218,18 +321,24 @@ size_t SizeofAptxbtenc(void) {
 }
 
 int aptxbtenc_init(APTXENC enc, short endian) {
-	return aptx_ffmpeg_enc_init(enc, AV_CODEC_ID_APTX, endian);
+	int rv = aptx_ffmpeg_enc_init(enc, AV_CODEC_ID_APTX, endian);
+	OPENAPTX_TRACE3(aptx_enc_init, enc, endian, rv);
+	return rv;
 }
 
 void aptxbtenc_destroy(APTXENC enc) {
+	OPENAPTX_TRACE1(aptx_enc_destroy, enc);
 	aptx_ffmpeg_destroy(enc);
 }
 
 int aptxbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]) {
 
 	struct internal_ctx * restrict ctx = enc;
-	if (aptx_ffmpeg_encode(ctx, pcmL, pcmR, 4, 16) != 0)
+	OPENAPTX_TRACE2(aptx_encode_entry, enc, 4);
+	if (aptx_ffmpeg_encode(ctx, pcmL, pcmR, 4, 16) != 0) {
+		OPENAPTX_TRACE2(aptx_encode_exit, enc, 0);
 		return -1;
+	}
 
 	const unsigned int shift_hi = ctx->shift_hi;
 	const unsigned int shift_lo = ctx->shift_lo;
@@ -238,6 +347,7 @@ int aptxbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcm
 	code[1] = data[2] << shift_hi | data[3] << shift_lo;
 
 	av_packet_unref(ctx->av_packet);
+	OPENAPTX_TRACE2(aptx_encode_exit, enc, 4);
 	return 0;
 }
 
@@ -258,18 +368,24 @@ size_t SizeofAptxhdbtenc(void) {
 }
 
 int aptxhdbtenc_init(APTXENC enc, short endian) {
-	return aptx_ffmpeg_enc_init(enc, AV_CODEC_ID_APTX_HD, endian);
+	int rv = aptx_ffmpeg_enc_init(enc, AV_CODEC_ID_APTX_HD, endian);
+	OPENAPTX_TRACE3(aptxhd_enc_init, enc, endian, rv);
+	return rv;
 }
 
 void aptxhdbtenc_destroy(APTXENC enc) {
+	OPENAPTX_TRACE1(aptxhd_enc_destroy, enc);
 	aptx_ffmpeg_destroy(enc);
 }
 
 int aptxhdbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcmR[4], uint32_t code[2]) {
 
 	struct internal_ctx * restrict ctx = enc;
-	if (aptx_ffmpeg_encode(ctx, pcmL, pcmR, 6, 8) != 0)
+	OPENAPTX_TRACE2(aptxhd_encode_entry, enc, 4);
+	if (aptx_ffmpeg_encode(ctx, pcmL, pcmR, 6, 8) != 0) {
+		OPENAPTX_TRACE2(aptxhd_encode_exit, enc, 0);
 		return -1;
+	}
 
 	const uint8_t * data = ctx->av_packet->data;
 	/* Keep endianness swapping bug from apt-X HD. */
@@ -277,6 +393,7 @@ int aptxhdbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t p
 	code[1] = data[3] << 16 | data[4] << 8 | data[5];
 
 	av_packet_unref(ctx->av_packet);
+	OPENAPTX_TRACE2(aptxhd_encode_exit, enc, 4);
 	return 0;
 }
 
@@ -297,10 +414,10 @@ static int aptx_ffmpeg_dec_init(struct internal_ctx * ctx, enum AVCodecID codec_
 	const AVCodec * codec;
 	int rv;
 
-	if ((rv = aptx_ffmpeg_init(ctx, codec_id, endian)) != 0)
+	if ((rv = aptx_ffmpeg_init(ctx, codec_id, false, endian)) != 0)
 		return rv;
 
-	if ((codec = avcodec_find_decoder(codec_id)) == NULL) {
+	if ((codec = aptx_ffmpeg_find_codec(ctx->pool, codec_id)) == NULL) {
 		error("Decoder not found: %#x", codec_id);
 		rv = -ESRCH;
 		goto fail;
@@ -309,16 +426,8 @@ static int aptx_ffmpeg_dec_init(struct internal_ctx * ctx, enum AVCodecID codec_
 	if ((rv = aptx_ffmpeg_init_codec(ctx, codec)) != 0)
 		goto fail;
 
-	if ((ctx->av_packet = av_packet_alloc()) == NULL) {
-		error("Packet allocation failed: %s", strerror(ENOMEM));
-		rv = -ENOMEM;
-		goto fail;
-	}
-	if ((ctx->av_frame = av_frame_alloc()) == NULL) {
-		error("Frame allocation failed: %s", strerror(ENOMEM));
-		rv = -ENOMEM;
+	if ((rv = aptx_ffmpeg_pool_get(ctx)) != 0)
 		goto fail;
-	}
 
 	return 0;
 
@@ -337,6 +446,7 @@ static int aptx_ffmpeg_decode(struct internal_ctx * restrict ctx, int32_t pcmL[r
 	ctx->av_packet->data = (void *)packet;
 	ctx->av_packet->size = packet_size;
 
+	OPENAPTX_TRACE2(ffmpeg_packet, ctx, packet_size);
 	if ((rv = avcodec_send_packet(ctx->av_ctx, ctx->av_packet)) != 0) {
 		av_strerror(rv, errmsg, sizeof(errmsg));
 		error("Send packet failed: %s", errmsg);
@@ -349,6 +459,7 @@ static int aptx_ffmpeg_decode(struct internal_ctx * restrict ctx, int32_t pcmL[r
 		return -ECOMM;
 	}
 
+	OPENAPTX_TRACE2(ffmpeg_frame, ctx, ctx->av_frame->nb_samples);
 	if (ctx->av_frame->ch_layout.nb_channels != 2) {
 		error("Invalid number of channels: %d != %d", ctx->av_frame->ch_layout.nb_channels, 2);
 		return -EMSGSIZE;
@@ -380,10 +491,13 @@ size_t SizeofAptxbtdec(void) {
 }
 
 int aptxbtdec_init(APTXDEC dec, short endian) {
-	return aptx_ffmpeg_dec_init(dec, AV_CODEC_ID_APTX, endian);
+	int rv = aptx_ffmpeg_dec_init(dec, AV_CODEC_ID_APTX, endian);
+	OPENAPTX_TRACE3(aptx_dec_init, dec, endian, rv);
+	return rv;
 }
 
 void aptxbtdec_destroy(APTXDEC dec) {
+	OPENAPTX_TRACE1(aptx_dec_destroy, dec);
 	aptx_ffmpeg_destroy(dec);
 }
 
@@ -405,9 +519,13 @@ int aptxbtdec_decodestereo(APTXDEC dec, int32_t pcmL[4], int32_t pcmR[4], const
 		}
 	}
 
-	if ((rv = aptx_ffmpeg_decode(ctx, pcmL, pcmR, packet, sizeof(packet), 16)) != 0)
+	OPENAPTX_TRACE2(aptx_decode_entry, dec, 4);
+	if ((rv = aptx_ffmpeg_decode(ctx, pcmL, pcmR, packet, sizeof(packet), 16)) != 0) {
+		OPENAPTX_TRACE2(aptx_decode_exit, dec, 0);
 		return errno = -rv, -1;
+	}
 
+	OPENAPTX_TRACE2(aptx_decode_exit, dec, 4);
 	return 0;
 }
 
@@ -424,10 +542,13 @@ size_t SizeofAptxhdbtdec(void) {
 }
 
 int aptxhdbtdec_init(APTXDEC dec, short endian) {
-	return aptx_ffmpeg_dec_init(dec, AV_CODEC_ID_APTX_HD, endian);
+	int rv = aptx_ffmpeg_dec_init(dec, AV_CODEC_ID_APTX_HD, endian);
+	OPENAPTX_TRACE3(aptxhd_dec_init, dec, endian, rv);
+	return rv;
 }
 
 void aptxhdbtdec_destroy(APTXDEC dec) {
+	OPENAPTX_TRACE1(aptxhd_dec_destroy, dec);
 	aptx_ffmpeg_destroy(dec);
 }
 
@@ -450,9 +571,13 @@ int aptxhdbtdec_decodestereo(APTXDEC dec, int32_t pcmL[4], int32_t pcmR[4], cons
 		}
 	}
 
-	if ((rv = aptx_ffmpeg_decode(ctx, pcmL, pcmR, packet, sizeof(packet), 8)) != 0)
+	OPENAPTX_TRACE2(aptxhd_decode_entry, dec, 4);
+	if ((rv = aptx_ffmpeg_decode(ctx, pcmL, pcmR, packet, sizeof(packet), 8)) != 0) {
+		OPENAPTX_TRACE2(aptxhd_decode_exit, dec, 0);
 		return errno = -rv, -1;
+	}
 
+	OPENAPTX_TRACE2(aptxhd_decode_exit, dec, 4);
 	return 0;
 }
 
@@ -26,6 +26,8 @@
 #define OPENAPTX_IMPLEMENTATION
 #include "openaptx.h"
 
+#include "tracepoints.h"
+
 struct internal_ctx {
 	struct aptx_context * ctx;
 	/* codeword swapping */
@@ -52,7 +54,7 @@ static int aptx_freeaptx_init(struct internal_ctx * ctx, int codec_id, short end
 }
 
 static void aptx_freeaptx_destroy(struct internal_ctx * ctx) {
-	if (ctx != NULL)
+	if (ctx == NULL)
 		return;
 	aptx_finish(ctx->ctx);
 }
@@ -75,10 +77,13 @@ size_t SizeofAptxbtenc(void) {
 }
 
 int aptxbtenc_init(APTXENC enc, short endian) {
-	return aptx_freeaptx_init(enc, CODEC_ID_APTX, endian);
+	int rv = aptx_freeaptx_init(enc, CODEC_ID_APTX, endian);
+	OPENAPTX_TRACE3(aptx_enc_init, enc, endian, rv);
+	return rv;
 }
 
 void aptxbtenc_destroy(APTXENC enc) {
+	OPENAPTX_TRACE1(aptx_enc_destroy, enc);
 	aptx_freeaptx_destroy(enc);
 }
 
@@ -92,14 +97,20 @@ int aptxbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcm
 
 	size_t written;
 	struct internal_ctx * ctx = enc;
-	if (aptx_encode(ctx->ctx, pcm, sizeof(pcm), packet, sizeof(packet), &written) != sizeof(pcm))
+	OPENAPTX_TRACE2(aptx_encode_entry, enc, 4);
+	size_t processed = aptx_encode(ctx->ctx, pcm, sizeof(pcm), packet, sizeof(packet), &written);
+	OPENAPTX_TRACE3(freeaptx_packet, ctx, processed, written);
+	if (processed != sizeof(pcm)) {
+		OPENAPTX_TRACE2(aptx_encode_exit, enc, 0);
 		return -1;
+	}
 
 	const unsigned int shift_hi = ctx->shift_hi;
 	const unsigned int shift_lo = ctx->shift_lo;
 	code[0] = packet[0] << shift_hi | packet[1] << shift_lo;
 	code[1] = packet[2] << shift_hi | packet[3] << shift_lo;
 
+	OPENAPTX_TRACE2(aptx_encode_exit, enc, 4);
 	return 0;
 }
 
@@ -120,10 +131,13 @@ size_t SizeofAptxhdbtenc(void) {
 }
 
 int aptxhdbtenc_init(APTXENC enc, short endian) {
-	return aptx_freeaptx_init(enc, CODEC_ID_APTX_HD, endian);
+	int rv = aptx_freeaptx_init(enc, CODEC_ID_APTX_HD, endian);
+	OPENAPTX_TRACE3(aptxhd_enc_init, enc, endian, rv);
+	return rv;
 }
 
 void aptxhdbtenc_destroy(APTXENC enc) {
+	OPENAPTX_TRACE1(aptxhd_enc_destroy, enc);
 	aptx_freeaptx_destroy(enc);
 }
 
@@ -139,13 +153,19 @@ int aptxhdbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t p
 
 	size_t written;
 	struct internal_ctx * ctx = enc;
-	if (aptx_encode(ctx->ctx, pcm, sizeof(pcm), packet, sizeof(packet), &written) != sizeof(pcm))
+	OPENAPTX_TRACE2(aptxhd_encode_entry, enc, 4);
+	size_t processed = aptx_encode(ctx->ctx, pcm, sizeof(pcm), packet, sizeof(packet), &written);
+	OPENAPTX_TRACE3(freeaptx_packet, ctx, processed, written);
+	if (processed != sizeof(pcm)) {
+		OPENAPTX_TRACE2(aptxhd_encode_exit, enc, 0);
 		return -1;
+	}
 
 	/* Keep endianness swapping bug from apt-X HD. */
 	code[0] = packet[0] << 16 | packet[1] << 8 | packet[2];
 	code[1] = packet[3] << 16 | packet[4] << 8 | packet[5];
 
+	OPENAPTX_TRACE2(aptxhd_encode_exit, enc, 4);
 	return 0;
 }
 
@@ -166,10 +186,13 @@ size_t SizeofAptxbtdec(void) {
 }
 
 int aptxbtdec_init(APTXDEC dec, short endian) {
-	return aptx_freeaptx_init(dec, CODEC_ID_APTX, endian);
+	int rv = aptx_freeaptx_init(dec, CODEC_ID_APTX, endian);
+	OPENAPTX_TRACE3(aptx_dec_init, dec, endian, rv);
+	return rv;
 }
 
 void aptxbtdec_destroy(APTXDEC dec) {
+	OPENAPTX_TRACE1(aptx_dec_destroy, dec);
 	aptx_freeaptx_destroy(dec);
 }
 
@@ -182,14 +205,20 @@ int aptxbtdec_decodestereo(APTXDEC dec, int32_t pcmL[4], int32_t pcmR[4], const
 
 	size_t written;
 	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * 2];
-	if (aptx_decode(ctx->ctx, packet, sizeof(packet), pcm, sizeof(pcm), &written) != sizeof(packet))
+	OPENAPTX_TRACE2(aptx_decode_entry, dec, 4);
+	size_t processed = aptx_decode(ctx->ctx, packet, sizeof(packet), pcm, sizeof(pcm), &written);
+	OPENAPTX_TRACE3(freeaptx_packet, ctx, processed, written);
+	if (processed != sizeof(packet)) {
+		OPENAPTX_TRACE2(aptx_decode_exit, dec, 0);
 		return -1;
+	}
 
 	for (size_t i = 0; i < 4; i++)
 		pcmL[i] = (pcm[i * 6 + 0] | pcm[i * 6 + 1] << 8 | pcm[i * 6 + 2] << 16) >> 8;
 	for (size_t i = 0; i < 4; i++)
 		pcmR[i] = (pcm[i * 6 + 3] | pcm[i * 6 + 4] << 8 | pcm[i * 6 + 5] << 16) >> 8;
 
+	OPENAPTX_TRACE2(aptx_decode_exit, dec, 4);
 	return 0;
 }
 
@@ -206,10 +235,13 @@ size_t SizeofAptxhdbtdec(void) {
 }
 
 int aptxhdbtdec_init(APTXDEC dec, short endian) {
-	return aptx_freeaptx_init(dec, CODEC_ID_APTX_HD, endian);
+	int rv = aptx_freeaptx_init(dec, CODEC_ID_APTX_HD, endian);
+	OPENAPTX_TRACE3(aptxhd_dec_init, dec, endian, rv);
+	return rv;
 }
 
 void aptxhdbtdec_destroy(APTXDEC dec) {
+	OPENAPTX_TRACE1(aptxhd_dec_destroy, dec);
 	aptx_freeaptx_destroy(dec);
 }
 
@@ -223,14 +255,20 @@ int aptxhdbtdec_decodestereo(APTXDEC dec, int32_t pcmL[4], int32_t pcmR[4], cons
 
 	size_t written;
 	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * 2];
-	if (aptx_decode(ctx->ctx, packet, sizeof(packet), pcm, sizeof(pcm), &written) != sizeof(packet))
+	OPENAPTX_TRACE2(aptxhd_decode_entry, dec, 4);
+	size_t processed = aptx_decode(ctx->ctx, packet, sizeof(packet), pcm, sizeof(pcm), &written);
+	OPENAPTX_TRACE3(freeaptx_packet, ctx, processed, written);
+	if (processed != sizeof(packet)) {
+		OPENAPTX_TRACE2(aptxhd_decode_exit, dec, 0);
 		return -1;
+	}
 
 	for (size_t i = 0; i < 4; i++)
 		pcmL[i] = pcm[i * 6 + 0] | pcm[i * 6 + 1] << 8 | pcm[i * 6 + 2] << 16;
 	for (size_t i = 0; i < 4; i++)
 		pcmR[i] = pcm[i * 6 + 3] | pcm[i * 6 + 4] << 8 | pcm[i * 6 + 5] << 16;
 
+	OPENAPTX_TRACE2(aptxhd_decode_exit, dec, 4);
 	return 0;
 }
 
@@ -0,0 +1,259 @@
+/*
+ * [open]aptx - aptx-packetizer.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openaptx-packetizer.h"
+#include "openaptx.h"
+
+#include "stream.h"
+
+struct openaptx_packetizer {
+
+	enum openaptx_codec codec;
+	APTXENC enc;
+
+	bool rtp_enabled;
+	struct openaptx_rtp rtp;
+
+	size_t header_size;
+	size_t block_size;
+	/* number of blocks in a complete packet */
+	size_t blocks;
+	/* size of a complete packet */
+	size_t size;
+
+	/* number of bytes written to the current packet */
+	size_t fill;
+	/* frames which do not form a whole block */
+	int32_t carry[4 * 2];
+	size_t carry_frames;
+
+};
+
+openaptx_packetizer * openaptx_packetizer_new(enum openaptx_codec codec, short endian, size_t mtu,
+                                              const struct openaptx_rtp * rtp) {
+
+	struct openaptx_packetizer * p;
+
+	if (codec != OPENAPTX_CODEC_APTX && codec != OPENAPTX_CODEC_APTX_HD)
+		return errno = EINVAL, NULL;
+
+	const size_t header_size = rtp != NULL ? OPENAPTX_RTP_HEADER_SIZE : 0;
+	const size_t block_size = 2 * stream_codeword_size(codec);
+	if (mtu < header_size + block_size)
+		return errno = EINVAL, NULL;
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		return NULL;
+
+	if ((p->enc = stream_encoder_new(codec, endian)) == NULL) {
+		free(p);
+		return NULL;
+	}
+
+	p->codec = codec;
+	p->rtp_enabled = rtp != NULL;
+	if (rtp != NULL)
+		p->rtp = *rtp;
+	p->header_size = header_size;
+	p->block_size = block_size;
+	p->blocks = (mtu - header_size) / block_size;
+	p->size = header_size + p->blocks * block_size;
+
+	return p;
+}
+
+void openaptx_packetizer_free(openaptx_packetizer * p) {
+	if (p == NULL)
+		return;
+	stream_encoder_free(p->codec, p->enc);
+	free(p);
+}
+
+size_t openaptx_packetizer_frames(openaptx_packetizer * p) {
+	return p->blocks * 4;
+}
+
+size_t openaptx_packetizer_size(openaptx_packetizer * p) {
+	return p->size;
+}
+
+/**
+ * Copy data to the given offset of the scattered buffer. */
+static void iov_write(const struct iovec * iov, int iovcnt, size_t offset, const void * data, size_t len) {
+	const uint8_t * src = data;
+	for (int i = 0; i < iovcnt && len > 0; i++) {
+		if (offset >= iov[i].iov_len) {
+			offset -= iov[i].iov_len;
+			continue;
+		}
+		size_t n = iov[i].iov_len - offset;
+		if (n > len)
+			n = len;
+		memcpy((uint8_t *)iov[i].iov_base + offset, src, n);
+		offset = 0;
+		src += n;
+		len -= n;
+	}
+}
+
+static int iov_check(openaptx_packetizer * p, const struct iovec * iov, int iovcnt) {
+	size_t size = 0;
+	for (int i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+	return size >= p->size ? 0 : (errno = EINVAL, -1);
+}
+
+static void packet_begin(openaptx_packetizer * p, const struct iovec * iov, int iovcnt) {
+
+	if (p->rtp_enabled) {
+		const uint16_t seq = p->rtp.seq_number;
+		const uint32_t ts = p->rtp.timestamp;
+		const uint32_t ssrc = p->rtp.ssrc;
+		const uint8_t header[OPENAPTX_RTP_HEADER_SIZE] = {
+			/* version 2, no padding, no extension, no CSRC */
+			0x80, p->rtp.payload_type & 0x7F,
+			seq >> 8, seq,
+			ts >> 24, ts >> 16, ts >> 8, ts,
+			ssrc >> 24, ssrc >> 16, ssrc >> 8, ssrc,
+		};
+		iov_write(iov, iovcnt, 0, header, sizeof(header));
+	}
+
+	p->fill = p->header_size;
+
+}
+
+static void packet_end(openaptx_packetizer * p, size_t frames) {
+	p->rtp.seq_number++;
+	p->rtp.timestamp += frames;
+	p->fill = 0;
+}
+
+/**
+ * Encode single block which might be split between buffers. */
+static int packet_encode_block(openaptx_packetizer * p, const int32_t * pcm, const struct iovec * iov,
+                               int iovcnt) {
+	uint8_t tmp[6];
+	if (stream_encode(p->codec, p->enc, pcm, 4, tmp) != 0)
+		return errno = EIO, -1;
+	iov_write(iov, iovcnt, p->fill, tmp, p->block_size);
+	p->fill += p->block_size;
+	return 0;
+}
+
+ssize_t openaptx_packetizer_writev(openaptx_packetizer * p, const int32_t * pcm, size_t frames,
+                                   const struct iovec * iov, int iovcnt, size_t * len) {
+
+	size_t consumed = 0;
+
+	if (iov_check(p, iov, iovcnt) == -1)
+		return -1;
+
+	*len = 0;
+	if (p->fill == 0)
+		packet_begin(p, iov, iovcnt);
+
+	while (p->fill < p->size) {
+
+		if (p->carry_frames > 0 || frames - consumed < 4) {
+			while (p->carry_frames < 4 && consumed < frames) {
+				p->carry[p->carry_frames * 2 + 0] = pcm[consumed * 2 + 0];
+				p->carry[p->carry_frames * 2 + 1] = pcm[consumed * 2 + 1];
+				p->carry_frames++;
+				consumed++;
+			}
+			if (p->carry_frames < 4)
+				break;
+			if (packet_encode_block(p, p->carry, iov, iovcnt) == -1)
+				return -1;
+			p->carry_frames = 0;
+			continue;
+		}
+
+		/* locate the buffer with the current packet position */
+		size_t offset = p->fill;
+		int i = 0;
+		while (offset >= iov[i].iov_len)
+			offset -= iov[i++].iov_len;
+
+		size_t blocks = (frames - consumed) / 4;
+		if (blocks > (p->size - p->fill) / p->block_size)
+			blocks = (p->size - p->fill) / p->block_size;
+		if (blocks > (iov[i].iov_len - offset) / p->block_size)
+			blocks = (iov[i].iov_len - offset) / p->block_size;
+
+		if (blocks == 0) {
+			if (packet_encode_block(p, &pcm[consumed * 2], iov, iovcnt) == -1)
+				return -1;
+			consumed += 4;
+			continue;
+		}
+
+		/* encode directly into the caller buffer */
+		uint8_t * data = (uint8_t *)iov[i].iov_base + offset;
+		if (stream_encode(p->codec, p->enc, &pcm[consumed * 2], blocks * 4, data) != 0)
+			return errno = EIO, -1;
+		p->fill += blocks * p->block_size;
+		consumed += blocks * 4;
+
+	}
+
+	if (p->fill == p->size) {
+		*len = p->size;
+		packet_end(p, p->blocks * 4);
+	}
+
+	return consumed;
+}
+
+ssize_t openaptx_packetizer_write(openaptx_packetizer * p, const int32_t * pcm, size_t frames,
+                                  void * buffer, size_t size, size_t * len) {
+	const struct iovec iov = { .iov_base = buffer, .iov_len = size };
+	return openaptx_packetizer_writev(p, pcm, frames, &iov, 1, len);
+}
+
+int openaptx_packetizer_flushv(openaptx_packetizer * p, const struct iovec * iov, int iovcnt, size_t * len) {
+
+	*len = 0;
+	/* do not emit packet with the RTP header only */
+	if (p->fill <= p->header_size && p->carry_frames == 0) {
+		p->fill = 0;
+		return 0;
+	}
+
+	if (iov_check(p, iov, iovcnt) == -1)
+		return -1;
+
+	if (p->fill == 0)
+		packet_begin(p, iov, iovcnt);
+
+	size_t frames = (p->fill - p->header_size) / p->block_size * 4;
+
+	if (p->carry_frames > 0) {
+		frames += p->carry_frames;
+		memset(&p->carry[p->carry_frames * 2], 0, (4 - p->carry_frames) * 2 * sizeof(*p->carry));
+		if (packet_encode_block(p, p->carry, iov, iovcnt) == -1)
+			return -1;
+		p->carry_frames = 0;
+	}
+
+	*len = p->fill;
+	packet_end(p, frames);
+	return 0;
+}
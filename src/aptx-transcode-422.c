@@ -0,0 +1,211 @@
+/*
+ * [open]aptx - aptx-transcode-422.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <stdint.h>
+
+#include "aptx422.h"
+
+#include "aptx422/encode.h"
+#include "aptx422/mathex.h"
+#include "aptx422/quantizer.h"
+#include "transcode.h"
+
+static void aptx_init(void * state, short endian) {
+	aptX_encoder_init(state, endian);
+}
+
+static void aptx_decode_channel(aptX_subband_encoder_422 * e, uint16_t code, int32_t subbands[4]) {
+
+	aptX_generate_dither(e);
+
+	e->quantizer[0].unk1 = (int32_t)((uint32_t)code << 25) >> 25;
+	e->quantizer[1].unk1 = (int32_t)((uint32_t)code << 21) >> 28;
+	e->quantizer[2].unk1 = (int32_t)((uint32_t)code << 19) >> 30;
+	e->quantizer[3].unk1 = (int32_t)((uint32_t)code << 16) >> 29;
+
+	/* The lowest bit of the HH subband was replaced with the parity bit, but
+	 * it can be recovered from the parity of the remaining bits. */
+	int32_t parity = 1 & (e->quantizer[0].unk1 ^ e->quantizer[1].unk1 ^ e->quantizer[2].unk1 ^
+	                      e->quantizer[3].unk1 ^ e->dither_sign);
+	e->quantizer[3].unk1 = (e->quantizer[3].unk1 & ~1) | parity;
+
+	aptX_post_encode(e);
+
+	for (size_t i = 0; i < APTX_SUBBANDS; i++)
+		subbands[i] = e->processor[i].filter.unk6;
+
+}
+
+static void aptx_decode(void * state, const uint8_t * data, int32_t subbands[2][4]) {
+
+	aptX_encoder_422 * e = state;
+
+	for (size_t i = 0; i < APTX_CHANNELS; i++, data += 2) {
+		const uint16_t code = (data[0] << 8) | data[1];
+		aptx_decode_channel(&e->encoder[i], (code >> e->shift) | (code << e->shift), subbands[i]);
+	}
+
+}
+
+static void aptx_encode_finish(aptX_encoder_422 * e, uint8_t * data) {
+
+	aptX_insert_sync(&e->encoder[0], &e->encoder[1], &e->sync);
+
+	for (size_t i = 0; i < APTX_CHANNELS; i++) {
+		aptX_post_encode(&e->encoder[i]);
+		const uint16_t tmp = aptX_pack_codeword(&e->encoder[i]);
+		const uint16_t code = (tmp >> e->shift) | (tmp << e->shift);
+		*data++ = code >> 8, *data++ = code;
+	}
+
+}
+
+static void aptx_encode_subbands(void * state, const int32_t subbands[2][4], uint8_t * data) {
+
+	aptX_encoder_422 * e = state;
+
+	for (size_t i = 0; i < APTX_CHANNELS; i++) {
+
+		aptX_subband_encoder_422 * se = &e->encoder[i];
+		int32_t diffs[4];
+
+		aptX_generate_dither(se);
+
+		/* This replaces the QMF analysis in the aptX_encode() function. */
+		for (size_t ii = 0; ii < APTX_SUBBANDS; ii++) {
+			diffs[ii] = subbands[i][ii] - se->processor[ii].filter.unk8;
+			clamp_int24_t(diffs[ii]);
+		}
+
+		aptX_quantize_difference_LL(diffs[0], se->dither[0], se->processor[0].inverter.unk9, &se->quantizer[0]);
+		aptX_quantize_difference_LH(diffs[1], se->dither[1], se->processor[1].inverter.unk9, &se->quantizer[1]);
+		aptX_quantize_difference_HL(diffs[2], se->dither[2], se->processor[2].inverter.unk9, &se->quantizer[2]);
+		aptX_quantize_difference_HH(diffs[3], se->dither[3], se->processor[3].inverter.unk9, &se->quantizer[3]);
+
+	}
+
+	aptx_encode_finish(e, data);
+}
+
+static void aptx_encode_pcm(void * state, const int32_t pcm[2][4], uint8_t * data) {
+
+	aptX_encoder_422 * e = state;
+
+	for (size_t i = 0; i < APTX_CHANNELS; i++) {
+		int32_t pcm16[4];
+		for (size_t ii = 0; ii < 4; ii++) {
+			pcm16[ii] = (pcm[i][ii] + 0x80) >> 8;
+			clip_range(pcm16[ii], INT16_MIN, INT16_MAX);
+		}
+		aptX_encode(pcm16, &e->analyzer[i], &e->encoder[i]);
+	}
+
+	aptx_encode_finish(e, data);
+}
+
+/**
+ * Decoder state of a single channel: the prediction filter and the inverse
+ * quantizer of every subband, and the codeword history used for dithering.
+ * Delay lines of the prediction filters are stored without the copy. */
+static uint8_t * aptx_snapshot_channel(const aptX_subband_encoder_422 * e, uint8_t * data) {
+
+	for (size_t i = 0; i < APTX_SUBBANDS; i++) {
+
+		const aptX_prediction_filter_422 * f = &e->processor[i].filter;
+		const aptX_inverter_422 * inv = &e->processor[i].inverter;
+
+		for (size_t ii = 0; ii < (size_t)f->width; ii++)
+			data = transcode_put_int32(data, f->arr1[ii]);
+		for (size_t ii = 0; ii < (size_t)f->width; ii++)
+			data = transcode_put_int32(data, f->arr2[ii]);
+
+		data = transcode_put_int32(data, f->sign1);
+		data = transcode_put_int32(data, f->sign2);
+		data = transcode_put_int32(data, f->unk2);
+		data = transcode_put_int32(data, f->unk3);
+		data = transcode_put_int32(data, f->i);
+		data = transcode_put_int32(data, f->unk6);
+		data = transcode_put_int32(data, f->unk7);
+		data = transcode_put_int32(data, f->unk8);
+		data = transcode_put_int32(data, inv->unk9);
+		data = transcode_put_int32(data, inv->unk10);
+		data = transcode_put_int32(data, inv->unk11);
+		data = transcode_put_int32(data, e->quantizer[i].unk1);
+
+	}
+
+	return transcode_put_int32(data, e->codeword);
+}
+
+static const uint8_t * aptx_restore_channel(aptX_subband_encoder_422 * e, const uint8_t * data) {
+
+	for (size_t i = 0; i < APTX_SUBBANDS; i++) {
+
+		aptX_prediction_filter_422 * f = &e->processor[i].filter;
+		aptX_inverter_422 * inv = &e->processor[i].inverter;
+
+		for (size_t ii = 0; ii < (size_t)f->width; ii++)
+			f->arr1[ii] = transcode_get_int32(&data);
+		for (size_t ii = 0; ii < (size_t)f->width; ii++) {
+			f->arr2[ii] = transcode_get_int32(&data);
+			f->arr2[ii + f->width] = f->arr2[ii];
+		}
+
+		f->sign1 = transcode_get_int32(&data);
+		f->sign2 = transcode_get_int32(&data);
+		f->unk2 = transcode_get_int32(&data);
+		f->unk3 = transcode_get_int32(&data);
+		f->i = transcode_get_int32(&data);
+		f->unk6 = transcode_get_int32(&data);
+		f->unk7 = transcode_get_int32(&data);
+		f->unk8 = transcode_get_int32(&data);
+		inv->unk9 = transcode_get_int32(&data);
+		inv->unk10 = transcode_get_int32(&data);
+		inv->unk11 = transcode_get_int32(&data);
+		e->quantizer[i].unk1 = transcode_get_int32(&data);
+
+		/* do not trust the filter position read from the file */
+		if (f->i < 0 || f->i >= f->width)
+			f->i = 0;
+
+	}
+
+	e->codeword = transcode_get_int32(&data);
+	return data;
+}
+
+static void aptx_snapshot(const void * state, uint8_t * data) {
+	const aptX_encoder_422 * e = state;
+	for (size_t i = 0; i < APTX_CHANNELS; i++)
+		data = aptx_snapshot_channel(&e->encoder[i], data);
+}
+
+static void aptx_restore(void * state, const uint8_t * data) {
+	aptX_encoder_422 * e = state;
+	for (size_t i = 0; i < APTX_CHANNELS; i++)
+		data = aptx_restore_channel(&e->encoder[i], data);
+}
+
+const struct transcode_codec transcode_codec_aptx = {
+	.size = sizeof(aptX_encoder_422),
+	.codeword_size = 2,
+	.init = aptx_init,
+	.decode = aptx_decode,
+	.encode_subbands = aptx_encode_subbands,
+	.encode_pcm = aptx_encode_pcm,
+	/* filter delay lines (2 x 54 taps) and 12 scalars per subband */
+	.snapshot_size = APTX_CHANNELS * ((2 * 54 + 12 * APTX_SUBBANDS) + 1) * 4,
+	.snapshot = aptx_snapshot,
+	.restore = aptx_restore,
+};
@@ -0,0 +1,205 @@
+/*
+ * [open]aptx - aptx-transcode-hd100.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <stdint.h>
+
+#include "aptxHD100.h"
+
+#include "aptxhd100/encode.h"
+#include "aptxhd100/mathex.h"
+#include "aptxhd100/quantizer.h"
+#include "transcode.h"
+
+static void aptxhd_init(void * state, short endian) {
+	aptXHD_encoder_init(state, endian);
+}
+
+static void aptxhd_decode_channel(aptXHD_subband_encoder_100 * e, uint32_t code, int32_t subbands[4]) {
+
+	aptXHD_generate_dither(e);
+
+	e->quantizer[0].unk1 = (int32_t)(code << 23) >> 23;
+	e->quantizer[1].unk1 = (int32_t)(code << 17) >> 26;
+	e->quantizer[2].unk1 = (int32_t)(code << 13) >> 28;
+	e->quantizer[3].unk1 = (int32_t)(code << 8) >> 27;
+
+	/* The lowest bit of the HH subband was replaced with the parity bit, but
+	 * it can be recovered from the parity of the remaining bits. */
+	int32_t parity = 1 & (e->quantizer[0].unk1 ^ e->quantizer[1].unk1 ^ e->quantizer[2].unk1 ^
+	                      e->quantizer[3].unk1 ^ e->dither_sign);
+	e->quantizer[3].unk1 = (e->quantizer[3].unk1 & ~1) | parity;
+
+	aptXHD_post_encode(e);
+
+	for (size_t i = 0; i < APTXHD_SUBBANDS; i++)
+		subbands[i] = e->processor[i].filter.unk6;
+
+}
+
+static void aptxhd_decode(void * state, const uint8_t * data, int32_t subbands[2][4]) {
+
+	aptXHD_encoder_100 * e = state;
+
+	/* Swapped apt-X HD codewords can not be restored, so the decoder
+	 * state is always initialized with the native byte order. */
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++, data += 3)
+		aptxhd_decode_channel(&e->encoder[i], (data[0] << 16) | (data[1] << 8) | data[2], subbands[i]);
+
+}
+
+static void aptxhd_encode_finish(aptXHD_encoder_100 * e, uint8_t * data) {
+
+	aptXHD_insert_sync(&e->encoder[0], &e->encoder[1], &e->sync);
+
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++) {
+		aptXHD_post_encode(&e->encoder[i]);
+		const uint32_t tmp = aptXHD_pack_codeword(&e->encoder[i]);
+		const uint32_t code = (tmp >> e->shift) | (tmp << e->shift);
+		*data++ = code >> 16, *data++ = code >> 8, *data++ = code;
+	}
+
+}
+
+static void aptxhd_encode_subbands(void * state, const int32_t subbands[2][4], uint8_t * data) {
+
+	aptXHD_encoder_100 * e = state;
+
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++) {
+
+		aptXHD_subband_encoder_100 * se = &e->encoder[i];
+		int32_t diffs[4];
+
+		aptXHD_generate_dither(se);
+
+		/* This replaces the QMF analysis in the aptXHD_encode() function. */
+		for (size_t ii = 0; ii < APTXHD_SUBBANDS; ii++) {
+			diffs[ii] = subbands[i][ii] - se->processor[ii].filter.unk8;
+			clamp_int24_t(diffs[ii]);
+		}
+
+		aptXHD_quantize_difference_LL(diffs[0], se->dither[0], se->processor[0].inverter.unk9, &se->quantizer[0]);
+		aptXHD_quantize_difference_LH(diffs[1], se->dither[1], se->processor[1].inverter.unk9, &se->quantizer[1]);
+		aptXHD_quantize_difference_HL(diffs[2], se->dither[2], se->processor[2].inverter.unk9, &se->quantizer[2]);
+		aptXHD_quantize_difference_HH(diffs[3], se->dither[3], se->processor[3].inverter.unk9, &se->quantizer[3]);
+
+	}
+
+	aptxhd_encode_finish(e, data);
+}
+
+static void aptxhd_encode_pcm(void * state, const int32_t pcm[2][4], uint8_t * data) {
+
+	aptXHD_encoder_100 * e = state;
+
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++)
+		aptXHD_encode(pcm[i], &e->analyzer[i], &e->encoder[i]);
+
+	aptxhd_encode_finish(e, data);
+}
+
+/**
+ * Decoder state of a single channel: the prediction filter and the inverse
+ * quantizer of every subband, and the codeword history used for dithering.
+ * Delay lines of the prediction filters are stored without the copy. */
+static uint8_t * aptxhd_snapshot_channel(const aptXHD_subband_encoder_100 * e, uint8_t * data) {
+
+	for (size_t i = 0; i < APTXHD_SUBBANDS; i++) {
+
+		const aptXHD_prediction_filter_100 * f = &e->processor[i].filter;
+		const aptXHD_inverter_100 * inv = &e->processor[i].inverter;
+
+		for (size_t ii = 0; ii < (size_t)f->width; ii++)
+			data = transcode_put_int32(data, f->arr1[ii]);
+		for (size_t ii = 0; ii < (size_t)f->width; ii++)
+			data = transcode_put_int32(data, f->arr2[ii]);
+
+		data = transcode_put_int32(data, f->sign1);
+		data = transcode_put_int32(data, f->sign2);
+		data = transcode_put_int32(data, f->unk2);
+		data = transcode_put_int32(data, f->unk3);
+		data = transcode_put_int32(data, f->i);
+		data = transcode_put_int32(data, f->unk6);
+		data = transcode_put_int32(data, f->unk7);
+		data = transcode_put_int32(data, f->unk8);
+		data = transcode_put_int32(data, inv->unk9);
+		data = transcode_put_int32(data, inv->unk10);
+		data = transcode_put_int32(data, inv->unk11);
+		data = transcode_put_int32(data, e->quantizer[i].unk1);
+
+	}
+
+	return transcode_put_int32(data, e->codeword);
+}
+
+static const uint8_t * aptxhd_restore_channel(aptXHD_subband_encoder_100 * e, const uint8_t * data) {
+
+	for (size_t i = 0; i < APTXHD_SUBBANDS; i++) {
+
+		aptXHD_prediction_filter_100 * f = &e->processor[i].filter;
+		aptXHD_inverter_100 * inv = &e->processor[i].inverter;
+
+		for (size_t ii = 0; ii < (size_t)f->width; ii++)
+			f->arr1[ii] = transcode_get_int32(&data);
+		for (size_t ii = 0; ii < (size_t)f->width; ii++) {
+			f->arr2[ii] = transcode_get_int32(&data);
+			f->arr2[ii + f->width] = f->arr2[ii];
+		}
+
+		f->sign1 = transcode_get_int32(&data);
+		f->sign2 = transcode_get_int32(&data);
+		f->unk2 = transcode_get_int32(&data);
+		f->unk3 = transcode_get_int32(&data);
+		f->i = transcode_get_int32(&data);
+		f->unk6 = transcode_get_int32(&data);
+		f->unk7 = transcode_get_int32(&data);
+		f->unk8 = transcode_get_int32(&data);
+		inv->unk9 = transcode_get_int32(&data);
+		inv->unk10 = transcode_get_int32(&data);
+		inv->unk11 = transcode_get_int32(&data);
+		e->quantizer[i].unk1 = transcode_get_int32(&data);
+
+		/* do not trust the filter position read from the file */
+		if (f->i < 0 || f->i >= f->width)
+			f->i = 0;
+
+	}
+
+	e->codeword = transcode_get_int32(&data);
+	return data;
+}
+
+static void aptxhd_snapshot(const void * state, uint8_t * data) {
+	const aptXHD_encoder_100 * e = state;
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++)
+		data = aptxhd_snapshot_channel(&e->encoder[i], data);
+}
+
+static void aptxhd_restore(void * state, const uint8_t * data) {
+	aptXHD_encoder_100 * e = state;
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++)
+		data = aptxhd_restore_channel(&e->encoder[i], data);
+}
+
+const struct transcode_codec transcode_codec_aptxhd = {
+	.size = sizeof(aptXHD_encoder_100),
+	.codeword_size = 3,
+	.init = aptxhd_init,
+	.decode = aptxhd_decode,
+	.encode_subbands = aptxhd_encode_subbands,
+	.encode_pcm = aptxhd_encode_pcm,
+	/* filter delay lines (2 x 54 taps) and 12 scalars per subband */
+	.snapshot_size = APTXHD_CHANNELS * ((2 * 54 + 12 * APTXHD_SUBBANDS) + 1) * 4,
+	.snapshot = aptxhd_snapshot,
+	.restore = aptxhd_restore,
+};
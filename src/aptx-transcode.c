@@ -0,0 +1,205 @@
+/*
+ * [open]aptx - aptx-transcode.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "openaptx-transcode.h"
+#include "openaptx.h"
+
+#include "aptx422/params.h"
+#include "transcode.h"
+
+struct openaptx_transcoder {
+	enum openaptx_transcode_mode mode;
+	const struct transcode_codec * src;
+	const struct transcode_codec * dst;
+	void * dec;
+	void * enc;
+	/* synthesis filter banks used by the PCM path */
+	struct transcode_qmf qmf[2];
+};
+
+static int32_t clip_int24(int64_t v) {
+	if (v < -0x800000)
+		return -0x800000;
+	if (v > 0x7FFFFF)
+		return 0x7FFFFF;
+	return v;
+}
+
+static void transcode_qmf_push(struct transcode_qmf_signal * s, int32_t sample) {
+	s->buffer[s->pos] = sample;
+	s->buffer[s->pos + 16] = sample;
+	s->pos = (s->pos + 1) % 16;
+}
+
+static int32_t transcode_qmf_convolution(const struct transcode_qmf_signal * s, const int32_t coeffs[16],
+                                         bool reversed, unsigned int shift) {
+
+	const int32_t * sig = &s->buffer[s->pos];
+	int64_t v = 0;
+
+	for (size_t i = 0; i < 16; i++)
+		v += (int64_t)sig[i] * coeffs[reversed ? 15 - i : i];
+
+	/* right shift with half down rounding */
+	const int64_t rounding = (int64_t)1 << (shift - 1);
+	const int64_t mask = ((int64_t)1 << (shift + 1)) - 1;
+	return clip_int24(((v + rounding) >> shift) - ((v & mask) == rounding));
+}
+
+static void transcode_qmf_polyphase(struct transcode_qmf_signal signal[2], const int32_t coeffs[16],
+                                    unsigned int shift, int32_t low, int32_t high, int32_t samples[2]) {
+	transcode_qmf_push(&signal[0], low - high);
+	transcode_qmf_push(&signal[1], low + high);
+	samples[0] = transcode_qmf_convolution(&signal[0], coeffs, false, shift);
+	samples[1] = transcode_qmf_convolution(&signal[1], coeffs, true, shift);
+}
+
+/**
+ * Join 4 subband samples into 4 PCM samples (24-bit).
+ *
+ * This is the inverse of the QMF analysis tree used by the encoder. */
+void transcode_qmf_synthesis(struct transcode_qmf * qmf, const int32_t subbands[4], int32_t pcm[4]) {
+
+	int32_t tmp[4];
+
+	transcode_qmf_polyphase(qmf->inner[0], aptX_QMF_inner_coeffs, 22, subbands[0], subbands[1], &tmp[0]);
+	transcode_qmf_polyphase(qmf->inner[1], aptX_QMF_inner_coeffs, 22, subbands[2], subbands[3], &tmp[2]);
+
+	transcode_qmf_polyphase(qmf->outer, aptX_QMF_outer_coeffs, 21, tmp[0], tmp[2], &pcm[0]);
+	transcode_qmf_polyphase(qmf->outer, aptX_QMF_outer_coeffs, 21, tmp[1], tmp[3], &pcm[2]);
+
+}
+
+static uint8_t * transcode_qmf_signal_snapshot(const struct transcode_qmf_signal * s, uint8_t * data) {
+	for (size_t i = 0; i < 16; i++)
+		data = transcode_put_int32(data, s->buffer[i]);
+	return transcode_put_int32(data, s->pos);
+}
+
+static const uint8_t * transcode_qmf_signal_restore(struct transcode_qmf_signal * s, const uint8_t * data) {
+	for (size_t i = 0; i < 16; i++) {
+		s->buffer[i] = transcode_get_int32(&data);
+		s->buffer[i + 16] = s->buffer[i];
+	}
+	s->pos = (uint32_t)transcode_get_int32(&data) % 16;
+	return data;
+}
+
+/**
+ * Serialize synthesis filter bank state (TRANSCODE_QMF_SNAPSHOT_SIZE bytes). */
+uint8_t * transcode_qmf_snapshot(const struct transcode_qmf * qmf, uint8_t * data) {
+	data = transcode_qmf_signal_snapshot(&qmf->outer[0], data);
+	data = transcode_qmf_signal_snapshot(&qmf->outer[1], data);
+	for (size_t i = 0; i < 2; i++) {
+		data = transcode_qmf_signal_snapshot(&qmf->inner[i][0], data);
+		data = transcode_qmf_signal_snapshot(&qmf->inner[i][1], data);
+	}
+	return data;
+}
+
+const uint8_t * transcode_qmf_restore(struct transcode_qmf * qmf, const uint8_t * data) {
+	data = transcode_qmf_signal_restore(&qmf->outer[0], data);
+	data = transcode_qmf_signal_restore(&qmf->outer[1], data);
+	for (size_t i = 0; i < 2; i++) {
+		data = transcode_qmf_signal_restore(&qmf->inner[i][0], data);
+		data = transcode_qmf_signal_restore(&qmf->inner[i][1], data);
+	}
+	return data;
+}
+
+static const struct transcode_codec * transcode_codec(enum openaptx_codec codec) {
+	switch (codec) {
+	case OPENAPTX_CODEC_APTX:
+		return &transcode_codec_aptx;
+	case OPENAPTX_CODEC_APTX_HD:
+		return &transcode_codec_aptxhd;
+	default:
+		return NULL;
+	}
+}
+
+openaptx_transcoder * openaptx_transcoder_new(enum openaptx_codec src, short src_endian, enum openaptx_codec dst,
+                                              short dst_endian, enum openaptx_transcode_mode mode) {
+
+	struct openaptx_transcoder * t;
+
+	if (transcode_codec(src) == NULL || transcode_codec(dst) == NULL)
+		return errno = EINVAL, NULL;
+	if (mode != OPENAPTX_TRANSCODE_SUBBAND && mode != OPENAPTX_TRANSCODE_PCM)
+		return errno = EINVAL, NULL;
+	/* swapped apt-X HD codewords lose information */
+	if (src == OPENAPTX_CODEC_APTX_HD && src_endian)
+		return errno = ENOTSUP, NULL;
+
+	if ((t = calloc(1, sizeof(*t))) == NULL)
+		return NULL;
+
+	t->mode = mode;
+	t->src = transcode_codec(src);
+	t->dst = transcode_codec(dst);
+
+	if ((t->dec = malloc(t->src->size)) == NULL ||
+	    (t->enc = malloc(t->dst->size)) == NULL) {
+		openaptx_transcoder_free(t);
+		return NULL;
+	}
+
+	t->src->init(t->dec, src_endian);
+	t->dst->init(t->enc, dst_endian);
+
+	return t;
+}
+
+void openaptx_transcoder_free(openaptx_transcoder * t) {
+	if (t == NULL)
+		return;
+	free(t->dec);
+	free(t->enc);
+	free(t);
+}
+
+ssize_t openaptx_transcode(openaptx_transcoder * t, const uint8_t * input, size_t len, uint8_t * output,
+                           size_t output_len, size_t * written) {
+
+	const size_t isize = 2 * t->src->codeword_size;
+	const size_t osize = 2 * t->dst->codeword_size;
+
+	size_t blocks = len / isize;
+	if (blocks > output_len / osize)
+		blocks = output_len / osize;
+
+	for (size_t i = 0; i < blocks; i++, input += isize, output += osize) {
+
+		int32_t subbands[2][4];
+		t->src->decode(t->dec, input, subbands);
+
+		if (t->mode == OPENAPTX_TRANSCODE_SUBBAND) {
+			t->dst->encode_subbands(t->enc, subbands, output);
+			continue;
+		}
+
+		int32_t pcm[2][4];
+		transcode_qmf_synthesis(&t->qmf[0], subbands[0], pcm[0]);
+		transcode_qmf_synthesis(&t->qmf[1], subbands[1], pcm[1]);
+		t->dst->encode_pcm(t->enc, pcm, output);
+
+	}
+
+	*written = blocks * osize;
+	return blocks * isize;
+}
@@ -10,6 +10,7 @@
 
 #include "encode.h"
 
+#include "params.h"
 #include "processor.h"
 #include "qmf.h"
 #include "quantizer.h"
@@ -91,3 +92,35 @@ void aptX_post_encode(aptX_subband_encoder_422 * e) {
 	aptX_process_subband(e->quantizer[2].unk1, e->dither[2], &e->processor[2].filter, &e->processor[2].inverter);
 	aptX_process_subband(e->quantizer[3].unk1, e->dither[3], &e->processor[3].filter, &e->processor[3].inverter);
 }
+
+void aptX_encoder_init(aptX_encoder_422 * e, short endian) {
+
+	/* zeroed without memset(), so the encoder does not depend on libc */
+	for (unsigned char * p = (unsigned char *)e, * end = p + sizeof(*e); p != end; p++)
+		*p = 0;
+	e->shift = endian ? 8 : 0;
+	e->sync = 7;
+
+	for (size_t i = 0; i < APTX_CHANNELS; i++)
+		for (size_t ii = 0; ii < APTX_SUBBANDS; ii++) {
+
+			e->encoder[i].processor[ii].filter.width = aptX_params_422[ii].filter_width;
+			e->encoder[i].processor[ii].filter.sign1 = 1;
+			e->encoder[i].processor[ii].filter.sign2 = 1;
+			e->encoder[i].processor[ii].filter.subband_param_unk3_2 = aptX_params_422[ii].filter_width;
+			e->encoder[i].processor[ii].filter.subband_param_unk3_3 = aptX_params_422[ii].filter_width;
+			e->encoder[i].processor[ii].inverter.subband_param_p1 = aptX_params_422[ii].p1;
+			e->encoder[i].processor[ii].inverter.subband_param_bit16_sl1 = aptX_params_422[ii].bit16_sl1;
+			e->encoder[i].processor[ii].inverter.subband_param_dith16_sf1 = aptX_params_422[ii].dith16_sf1;
+			e->encoder[i].processor[ii].inverter.subband_param_incr16 = aptX_params_422[ii].incr16;
+			e->encoder[i].processor[ii].inverter.subband_param_unk1 = aptX_params_422[ii].unk1;
+			e->encoder[i].processor[ii].inverter.subband_param_unk2 = aptX_params_422[ii].unk2;
+			e->encoder[i].processor[ii].inverter.log = aptX_IQuant_log_table;
+
+			e->encoder[i].quantizer[ii].subband_param_bits = aptX_params_422[ii].bits;
+			e->encoder[i].quantizer[ii].subband_param_p1 = aptX_params_422[ii].p1;
+			e->encoder[i].quantizer[ii].subband_param_bit16_sl1 = aptX_params_422[ii].bit16_sl1;
+			e->encoder[i].quantizer[ii].subband_param_p3 = aptX_params_422[ii].p3;
+			e->encoder[i].quantizer[ii].subband_param_mLamb16 = aptX_params_422[ii].mLamb16;
+		}
+}
@@ -29,6 +29,8 @@ void aptX_encode(const int32_t pcm[4], aptX_QMF_analyzer_422 * qmf, aptX_subband
 
 void aptX_post_encode(aptX_subband_encoder_422 * e);
 
+void aptX_encoder_init(aptX_encoder_422 * e, short endian);
+
 #ifdef __cplusplus
 }
 #endif
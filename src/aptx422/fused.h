@@ -0,0 +1,30 @@
+/*
+ * [open]aptx - fused.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_APTX244_FUSED_H_
+#define OPENAPTX_APTX244_FUSED_H_
+
+#include <stdbool.h>
+
+#include "aptx422.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void aptX_encode_fused(aptX_encoder_422 * e, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]);
+
+bool aptX_encode_fused_guarded(aptX_encoder_422 * e, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
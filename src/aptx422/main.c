@@ -15,65 +15,227 @@
 #include "aptx422.h"
 #include "openaptx.h"
 
-#include <stdlib.h>
-#include <string.h>
+#if !FREESTANDING
+#	include <pthread.h>
+#	include <stdbool.h>
+#	include <stdio.h>
+#	include <stdlib.h>
+#	include <string.h>
+#	include <time.h>
+#endif
 
 #include "encode.h"
+#include "fused.h"
 #include "params.h"
+#include "../tracepoints.h"
+#if !FREESTANDING
+#	include "../wisdom.h"
+#endif
+
+/* Wisdom key of the selected encoding kernel. */
+#define KERNEL_WISDOM_KEY "aptx-4.2.2.encoder"
+/* Number of 4-sample blocks used for the kernel tuning. */
+#define KERNEL_TUNE_BLOCKS 4096
+/* Number of timed tuning rounds (the best one is taken). */
+#define KERNEL_TUNE_ROUNDS 3
+
+typedef void (*aptX_encode_kernel)(aptX_encoder_422 * e, const int32_t pcmL[4], const int32_t pcmR[4],
+                                   uint16_t code[2]);
+
+#if !FREESTANDING
 
 static aptX_encoder_422 aptX_encoder;
 
-int aptxbtenc_init(APTXENC enc, short endian) {
+/**
+ * Encoding path with separate QMF analysis, quantization and prediction
+ * stages. It is the reference for the bit-exactness check. */
+static void aptX_encode_staged(aptX_encoder_422 * e, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]) {
+
+	uint16_t tmp;
+
+	aptX_encode(pcmL, &e->analyzer[0], &e->encoder[0]);
+	aptX_encode(pcmR, &e->analyzer[1], &e->encoder[1]);
+	aptX_insert_sync(&e->encoder[0], &e->encoder[1], &e->sync);
+
+	aptX_post_encode(&e->encoder[0]);
+	aptX_post_encode(&e->encoder[1]);
+
+	tmp = aptX_pack_codeword(&e->encoder[0]);
+	code[0] = (tmp >> e->shift) | (tmp << e->shift);
+	tmp = aptX_pack_codeword(&e->encoder[1]);
+	code[1] = (tmp >> e->shift) | (tmp << e->shift);
+}
+
+#endif
+
+static void aptX_encode_guarded(aptX_encoder_422 * e, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]) {
+	aptX_encode_fused_guarded(e, pcmL, pcmR, code);
+}
+
+#if !FREESTANDING
+
+/* Available encoding kernels, the reference one goes first. */
+static const struct {
+	const char * name;
+	aptX_encode_kernel encode;
+} kernels[] = {
+	{ "staged", aptX_encode_staged },
+	{ "fused", aptX_encode_fused },
+	{ "guarded", aptX_encode_guarded },
+};
+
+static aptX_encode_kernel kernel = aptX_encode_guarded;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Generate tuning signal: tones with noise, in every fourth part with
+ * the gain high enough to exercise the clamping paths. */
+static void kernel_tune_signal(int32_t * pcmL, int32_t * pcmR, size_t samples) {
+	uint32_t seed = 0x12345678;
+	int32_t phaseL = 0, phaseR = 0;
+	for (size_t i = 0; i < samples; i++) {
+		seed = seed * 1664525 + 1013904223;
+		/* triangle waves of different periods */
+		phaseL = (phaseL + 1021) & 0xFFFF;
+		phaseR = (phaseR + 3187) & 0xFFFF;
+		const int32_t triL = (phaseL < 0x8000 ? phaseL : 0xFFFF - phaseL) - 0x4000;
+		const int32_t triR = (phaseR < 0x8000 ? phaseR : 0xFFFF - phaseR) - 0x4000;
+		const int32_t gain = (i / 16384) % 4 == 3 ? 4 : 1;
+		pcmL[i] = gain * (triL + ((int32_t)seed >> 22));
+		pcmR[i] = gain * (triR / 2 + ((int32_t)seed >> 19));
+	}
+}
+
+static double kernel_elapsed(const struct timespec * t0) {
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * Benchmark all kernels and select the fastest bit-exact one. */
+static int kernel_tune(void) {
+
+	const size_t blocks = KERNEL_TUNE_BLOCKS;
+	int32_t * pcm = malloc(blocks * 8 * sizeof(*pcm));
+	uint16_t * ref = malloc(blocks * 2 * sizeof(*ref));
+	uint16_t * code = malloc(blocks * 2 * sizeof(*code));
+	aptX_encoder_422 * e_ref = malloc(sizeof(*e_ref));
+	aptX_encoder_422 * e = malloc(sizeof(*e));
+	int selected = -1;
+
+	if (pcm == NULL || ref == NULL || code == NULL || e_ref == NULL || e == NULL)
+		goto final;
+
+	int32_t * pcmL = pcm;
+	int32_t * pcmR = pcm + blocks * 4;
+	kernel_tune_signal(pcmL, pcmR, blocks * 4);
+
+	double best = -1;
+	for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
 
-	aptX_encoder_422 * e = (aptX_encoder_422 *)enc;
-
-	memset(e, 0, sizeof(*e));
-	e->shift = endian ? 8 : 0;
-	e->sync = 7;
-
-	for (size_t i = 0; i < APTX_CHANNELS; i++)
-		for (size_t ii = 0; ii < APTX_SUBBANDS; ii++) {
-
-			e->encoder[i].processor[ii].filter.width = aptX_params_422[ii].filter_width;
-			e->encoder[i].processor[ii].filter.sign1 = 1;
-			e->encoder[i].processor[ii].filter.sign2 = 1;
-			e->encoder[i].processor[ii].filter.subband_param_unk3_2 = aptX_params_422[ii].filter_width;
-			e->encoder[i].processor[ii].filter.subband_param_unk3_3 = aptX_params_422[ii].filter_width;
-			e->encoder[i].processor[ii].inverter.subband_param_p1 = aptX_params_422[ii].p1;
-			e->encoder[i].processor[ii].inverter.subband_param_bit16_sl1 = aptX_params_422[ii].bit16_sl1;
-			e->encoder[i].processor[ii].inverter.subband_param_dith16_sf1 = aptX_params_422[ii].dith16_sf1;
-			e->encoder[i].processor[ii].inverter.subband_param_incr16 = aptX_params_422[ii].incr16;
-			e->encoder[i].processor[ii].inverter.subband_param_unk1 = aptX_params_422[ii].unk1;
-			e->encoder[i].processor[ii].inverter.subband_param_unk2 = aptX_params_422[ii].unk2;
-			e->encoder[i].processor[ii].inverter.log = aptX_IQuant_log_table;
-
-			e->encoder[i].quantizer[ii].subband_param_bits = aptX_params_422[ii].bits;
-			e->encoder[i].quantizer[ii].subband_param_p1 = aptX_params_422[ii].p1;
-			e->encoder[i].quantizer[ii].subband_param_bit16_sl1 = aptX_params_422[ii].bit16_sl1;
-			e->encoder[i].quantizer[ii].subband_param_p3 = aptX_params_422[ii].p3;
-			e->encoder[i].quantizer[ii].subband_param_mLamb16 = aptX_params_422[ii].mLamb16;
+		double elapsed = -1;
+		bool exact = true;
+
+		for (size_t round = 0; round < KERNEL_TUNE_ROUNDS; round++) {
+			struct timespec t0;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			aptX_encoder_init(e, 0);
+			for (size_t i = 0; i < blocks; i++)
+				kernels[k].encode(e, &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]);
+			const double t = kernel_elapsed(&t0);
+			if (elapsed < 0 || t < elapsed)
+				elapsed = t;
+		}
+
+		if (k == 0) {
+			memcpy(ref, code, blocks * 2 * sizeof(*ref));
+			memcpy(e_ref, e, sizeof(*e_ref));
+		} else if (memcmp(ref, code, blocks * 2 * sizeof(*ref)) != 0 || memcmp(e_ref, e, sizeof(*e)) != 0) {
+			exact = false;
 		}
 
+		if (!exact)
+			fprintf(stderr, "openaptx: aptx-4.2.2: tune: %s: Not bit-exact\n", kernels[k].name);
+		else
+			fprintf(stderr, "openaptx: aptx-4.2.2: tune: %s: %.3f ms\n", kernels[k].name, elapsed);
+
+		if (exact && (best < 0 || elapsed < best)) {
+			selected = k;
+			best = elapsed;
+		}
+
+	}
+
+final:
+	free(pcm);
+	free(ref);
+	free(code);
+	free(e_ref);
+	free(e);
+	return selected;
+}
+
+/**
+ * Select the encoding kernel.
+ *
+ * The kernel recorded in the wisdom file is used if available. Otherwise,
+ * if the OPENAPTX_TUNE environment variable is set, all kernels are timed
+ * and the result is stored in the wisdom file. */
+static void kernel_select(void) {
+
+	const size_t n = sizeof(kernels) / sizeof(*kernels);
+	char name[WISDOM_FIELD_SIZE];
+	int selected;
+
+	if (wisdom_load(KERNEL_WISDOM_KEY, name, sizeof(name)) == 0)
+		for (size_t i = 0; i < n; i++)
+			if (strcmp(kernels[i].name, name) == 0) {
+				kernel = kernels[i].encode;
+				return;
+			}
+
+	if (!wisdom_tune_requested("OPENAPTX_TUNE"))
+		return;
+	if ((selected = kernel_tune()) == -1)
+		return;
+
+	kernel = kernels[selected].encode;
+	fprintf(stderr, "openaptx: aptx-4.2.2: tune: Selected kernel: %s\n", kernels[selected].name);
+	if (wisdom_store(KERNEL_WISDOM_KEY, kernels[selected].name) == -1)
+		fprintf(stderr, "openaptx: aptx-4.2.2: Couldn't store wisdom: %s\n", strerror(errno));
+
+}
+
+#endif
+
+int aptxbtenc_init(APTXENC enc, short endian) {
+#if !FREESTANDING
+	pthread_once(&kernel_once, kernel_select);
+#endif
+	aptX_encoder_init((aptX_encoder_422 *)enc, endian);
+	OPENAPTX_TRACE3(aptx_enc_init, enc, endian, 0);
 	return 0;
 }
 
 int aptxbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcmR[4], uint16_t code[2]) {
 
 	aptX_encoder_422 * enc_ = (aptX_encoder_422 *)enc;
-	uint16_t tmp;
-
-	aptX_encode(pcmL, &enc_->analyzer[0], &enc_->encoder[0]);
-	aptX_encode(pcmR, &enc_->analyzer[1], &enc_->encoder[1]);
-	aptX_insert_sync(&enc_->encoder[0], &enc_->encoder[1], &enc_->sync);
 
-	aptX_post_encode(&enc_->encoder[0]);
-	aptX_post_encode(&enc_->encoder[1]);
+	OPENAPTX_TRACE2(aptx_encode_entry, enc, 4);
 
-	tmp = aptX_pack_codeword(&enc_->encoder[0]);
-	code[0] = (tmp >> enc_->shift) | (tmp << enc_->shift);
-	tmp = aptX_pack_codeword(&enc_->encoder[1]);
-	code[1] = (tmp >> enc_->shift) | (tmp << enc_->shift);
+#if FREESTANDING
+	/* The freestanding build has no kernel selection (it would require libc
+	 * and mutable static state). The default kernel is called directly, so
+	 * the call graph has no indirect calls and the stack usage is bounded. */
+	aptX_encode_guarded(enc_, pcmL, pcmR, code);
+#else
+	kernel(enc_, pcmL, pcmR, code);
+#endif
+	/* sync state after the sync insertion in the encoded block */
+	OPENAPTX_TRACE2(aptx_sync, enc, enc_->sync);
 
+	OPENAPTX_TRACE2(aptx_encode_exit, enc, 4);
 	return 0;
 }
 
@@ -86,10 +248,14 @@ const char * aptxbtenc_version(void) {
 }
 
 size_t SizeofAptxbtenc(void) {
-	return sizeof(aptX_encoder);
+	return sizeof(aptX_encoder_422);
 }
 
+#if !FREESTANDING
+
 APTXENC NewAptxEnc(short endian) {
 	aptxbtenc_init(&aptX_encoder, endian);
 	return &aptX_encoder;
 }
+
+#endif
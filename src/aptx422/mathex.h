@@ -11,6 +11,25 @@
 #ifndef OPENAPTX_APTX244_MATHEX_H_
 #define OPENAPTX_APTX244_MATHEX_H_
 
+#include <stdint.h>
+
+/*
+ * Arithmetic path selection. On 32-bit targets, 64-bit multiplication of
+ * values which are held in 64-bit variables is compiled into three 32-bit
+ * multiplications (plus carry handling), even if both operands fit in 32
+ * bits. With MATHEX_ARITH32 set, such operands are narrowed explicitly, so
+ * the single 32x32->64 multiplication instruction is used. This path is
+ * selected by default on targets with 32-bit pointers, but it can be forced
+ * either way with the -DMATHEX_ARITH32=0|1 compiler flag.
+ */
+#if !defined(MATHEX_ARITH32)
+#	if UINTPTR_MAX == UINT32_MAX
+#		define MATHEX_ARITH32 1
+#	else
+#		define MATHEX_ARITH32 0
+#	endif
+#endif
+
 #define INT24_MIN (-8388607 - 1)
 #define INT24_MAX (8388607)
 
@@ -34,6 +53,24 @@
  * Right shift integer by 32 bits with half down rounding. */
 #define rshift32(v) ((((v) + 0x80000000) >> 32) - ((uint32_t)(v) == 0x80000000))
 
+#if MATHEX_ARITH32
+/**
+ * Multiply integers which fit in 32 bits into a 64-bit product. */
+static inline int64_t mul32x32(int32_t a, int32_t b) {
+#	if defined(__GNUC__)
+	/* The compiler removes the narrowing if it can prove that the value fits
+	 * in 32 bits, but then it does not use the widening multiplication for
+	 * the value held in 64-bit variable. Make the operand opaque for it. */
+	__asm__("" : "+r"(a));
+#	endif
+	return (int64_t)a * b;
+}
+#else
+/**
+ * Multiply integers which fit in 32 bits into a 64-bit product. */
+#	define mul32x32(a, b) ((int64_t)(a) * (b))
+#endif
+
 /**
  * Clip value to the [lo, up] range. */
 #define clip_range(v, lo, up) \
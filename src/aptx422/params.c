@@ -25,47 +25,134 @@ const int32_t aptX_QMF_inner_coeffs[16] = {
 	985888, -226954, 39048,  11990, -14203,  4966,   973,     -1268,
 };
 
-const int32_t aptX_dq7bit16_sl1[65] = {
-	-9948,   9948,    29860,   49808,   69822,   89926,   110144,  130502,  151026,  171738,  192666,  213832,  235264,
-	256982,  279014,  301384,  324118,  347244,  370790,  394782,  419250,  444226,  469742,  495832,  522536,  549890,
-	577936,  606720,  636290,  666700,  698006,  730270,  763562,  797958,  833538,  870398,  908640,  948376,  989740,
-	1032874, 1077948, 1125150, 1174700, 1226850, 1281900, 1340196, 1402156, 1468282, 1539182, 1615610, 1698514, 1789098,
-	1888944, 2000168, 2125700, 2269750, 2438670, 2642660, 2899462, 3243240, 3746078, 4535138, 5664098, 7102424, 8897462,
-};
-const int32_t aptX_dq7dith16_sf1[65] = {
-	9948,  9948,  9962,  9988,  10026, 10078,  10142,  10218,  10306,  10408,  10520,  10646,  10784,
-	10934, 11098, 11274, 11462, 11664, 11880,  12112,  12358,  12618,  12898,  13194,  13510,  13844,
-	14202, 14582, 14988, 15422, 15884, 16380,  16912,  17484,  18098,  18762,  19480,  20258,  21106,
-	22030, 23044, 24158, 25390, 26760, 28290,  30008,  31954,  34172,  36728,  39700,  43202,  47382,
-	52462, 58762, 66770, 77280, 91642, 112348, 144452, 199326, 303512, 485546, 643414, 794914, 1000124,
-};
-const int32_t aptX_dq7mLamb16[65] = {
-	0,     -4,    -7,    -10,   -13,   -16,   -19,    -22,    -26,    -28,    -32,    -35,    -38,
-	-41,   -44,   -47,   -51,   -54,   -58,   -62,    -65,    -70,    -74,    -79,    -84,    -90,
-	-95,   -102,  -109,  -116,  -124,  -133,  -143,   -154,   -166,   -180,   -195,   -212,   -231,
-	-254,  -279,  -308,  -343,  -383,  -430,  -487,   -555,   -639,   -743,   -876,   -1045,  -1270,
-	-1575, -2002, -2628, -3591, -5177, -8026, -13719, -26047, -45509, -39467, -37875, -51303, 0,
-};
-const int32_t aptX_q7incr16[65] = {
-	0,   -21, -19, -17, -15, -12, -10, -8,  -6,  -4,  -1,  1,   3,   6,   8,   10,  13,  15,  18,  20,  23,  26,
-	29,  31,  34,  37,  40,  43,  47,  50,  53,  57,  60,  64,  68,  72,  76,  80,  85,  89,  94,  99,  105, 110,
-	116, 123, 129, 136, 144, 152, 161, 171, 182, 194, 207, 223, 241, 263, 291, 328, 382, 467, 522, 522, 522,
-};
+/*
+ * Quantization tables with one X(sl1, sf1, mLamb, incr) entry per level,
+ * i.e. bit16_sl1, dith16_sf1, mLamb16 and incr16 coefficients of that level.
+ * Both layouts are generated from them: column tables, which are referenced
+ * by the encoder state and used by the quantization level search, and row
+ * tables used by the quantizer and the inverter, so a single lookup brings
+ * in all coefficients of the given level (4 levels per cache line).
+ */
+
+#define APTX_COLUMN_SL1(sl1, sf1, mLamb, incr) sl1,
+#define APTX_COLUMN_SF1(sl1, sf1, mLamb, incr) sf1,
+#define APTX_COLUMN_MLAMB(sl1, sf1, mLamb, incr) mLamb,
+#define APTX_COLUMN_INCR(sl1, sf1, mLamb, incr) incr,
+#define APTX_ROW(sl1, sf1, mLamb, incr) { sl1, sf1, mLamb, incr },
+
+#define APTX_Q7_TABLE(X)             \
+	X(  -9948,    9948,      0,   0) \
+	X(   9948,    9948,     -4, -21) \
+	X(  29860,    9962,     -7, -19) \
+	X(  49808,    9988,    -10, -17) \
+	X(  69822,   10026,    -13, -15) \
+	X(  89926,   10078,    -16, -12) \
+	X( 110144,   10142,    -19, -10) \
+	X( 130502,   10218,    -22,  -8) \
+	X( 151026,   10306,    -26,  -6) \
+	X( 171738,   10408,    -28,  -4) \
+	X( 192666,   10520,    -32,  -1) \
+	X( 213832,   10646,    -35,   1) \
+	X( 235264,   10784,    -38,   3) \
+	X( 256982,   10934,    -41,   6) \
+	X( 279014,   11098,    -44,   8) \
+	X( 301384,   11274,    -47,  10) \
+	X( 324118,   11462,    -51,  13) \
+	X( 347244,   11664,    -54,  15) \
+	X( 370790,   11880,    -58,  18) \
+	X( 394782,   12112,    -62,  20) \
+	X( 419250,   12358,    -65,  23) \
+	X( 444226,   12618,    -70,  26) \
+	X( 469742,   12898,    -74,  29) \
+	X( 495832,   13194,    -79,  31) \
+	X( 522536,   13510,    -84,  34) \
+	X( 549890,   13844,    -90,  37) \
+	X( 577936,   14202,    -95,  40) \
+	X( 606720,   14582,   -102,  43) \
+	X( 636290,   14988,   -109,  47) \
+	X( 666700,   15422,   -116,  50) \
+	X( 698006,   15884,   -124,  53) \
+	X( 730270,   16380,   -133,  57) \
+	X( 763562,   16912,   -143,  60) \
+	X( 797958,   17484,   -154,  64) \
+	X( 833538,   18098,   -166,  68) \
+	X( 870398,   18762,   -180,  72) \
+	X( 908640,   19480,   -195,  76) \
+	X( 948376,   20258,   -212,  80) \
+	X( 989740,   21106,   -231,  85) \
+	X(1032874,   22030,   -254,  89) \
+	X(1077948,   23044,   -279,  94) \
+	X(1125150,   24158,   -308,  99) \
+	X(1174700,   25390,   -343, 105) \
+	X(1226850,   26760,   -383, 110) \
+	X(1281900,   28290,   -430, 116) \
+	X(1340196,   30008,   -487, 123) \
+	X(1402156,   31954,   -555, 129) \
+	X(1468282,   34172,   -639, 136) \
+	X(1539182,   36728,   -743, 144) \
+	X(1615610,   39700,   -876, 152) \
+	X(1698514,   43202,  -1045, 161) \
+	X(1789098,   47382,  -1270, 171) \
+	X(1888944,   52462,  -1575, 182) \
+	X(2000168,   58762,  -2002, 194) \
+	X(2125700,   66770,  -2628, 207) \
+	X(2269750,   77280,  -3591, 223) \
+	X(2438670,   91642,  -5177, 241) \
+	X(2642660,  112348,  -8026, 263) \
+	X(2899462,  144452, -13719, 291) \
+	X(3243240,  199326, -26047, 328) \
+	X(3746078,  303512, -45509, 382) \
+	X(4535138,  485546, -39467, 467) \
+	X(5664098,  643414, -37875, 522) \
+	X(7102424,  794914, -51303, 522) \
+	X(8897462, 1000124,      0, 522)
+
+const int32_t aptX_dq7bit16_sl1[65] = { APTX_Q7_TABLE(APTX_COLUMN_SL1) };
+const int32_t aptX_dq7dith16_sf1[65] = { APTX_Q7_TABLE(APTX_COLUMN_SF1) };
+const int32_t aptX_dq7mLamb16[65] = { APTX_Q7_TABLE(APTX_COLUMN_MLAMB) };
+const int32_t aptX_q7incr16[65] = { APTX_Q7_TABLE(APTX_COLUMN_INCR) };
+const aptX_quantizer_row_422 aptX_q7rows16[65] __attribute__((aligned(64))) = { APTX_Q7_TABLE(APTX_ROW) };
+
+#define APTX_Q4_TABLE(X)              \
+	X( -89806,   89806,       0,   0) \
+	X(  89806,   89806,   -2271, -14) \
+	X( 278502,   98890,   -4514,   6) \
+	X( 494338,  116946,   -7803,  29) \
+	X( 759442,  148158,  -14339,  58) \
+	X(1113112,  205512,  -32047,  96) \
+	X(1652322,  333698, -100135, 154) \
+	X(2720256,  734236, -250365, 270) \
+	X(5190186, 1735696,       0, 521)
+
+const int32_t aptX_dq4bit16_sl1[9] = { APTX_Q4_TABLE(APTX_COLUMN_SL1) };
+const int32_t aptX_dq4dith16_sf1[9] = { APTX_Q4_TABLE(APTX_COLUMN_SF1) };
+const int32_t aptX_dq4mLamb16[9] = { APTX_Q4_TABLE(APTX_COLUMN_MLAMB) };
+const int32_t aptX_q4incr16[9] = { APTX_Q4_TABLE(APTX_COLUMN_INCR) };
+const aptX_quantizer_row_422 aptX_q4rows16[9] __attribute__((aligned(64))) = { APTX_Q4_TABLE(APTX_ROW) };
+
+#define APTX_Q3_TABLE(X)              \
+	X(-163006,  163006,       0,   0) \
+	X( 163006,  163006,  -13423,  -8) \
+	X( 542708,  216698,  -36113,  33) \
+	X(1120554,  361148, -206598,  95) \
+	X(2669238, 1187538,       0, 262)
 
-const int32_t aptX_dq4bit16_sl1[9] = { -89806, 89806, 278502, 494338, 759442, 1113112, 1652322, 2720256, 5190186 };
-const int32_t aptX_dq4dith16_sf1[9] = { 89806, 89806, 98890, 116946, 148158, 205512, 333698, 734236, 1735696 };
-const int32_t aptX_dq4mLamb16[9] = { 0, -2271, -4514, -7803, -14339, -32047, -100135, -250365, 0 };
-const int32_t aptX_q4incr16[9] = { 0, -14, 6, 29, 58, 96, 154, 270, 521 };
+const int32_t aptX_dq3bit16_sl1[5] = { APTX_Q3_TABLE(APTX_COLUMN_SL1) };
+const int32_t aptX_dq3dith16_sf1[5] = { APTX_Q3_TABLE(APTX_COLUMN_SF1) };
+const int32_t aptX_dq3mLamb16[5] = { APTX_Q3_TABLE(APTX_COLUMN_MLAMB) };
+const int32_t aptX_q3incr16[5] = { APTX_Q3_TABLE(APTX_COLUMN_INCR) };
+const aptX_quantizer_row_422 aptX_q3rows16[5] __attribute__((aligned(64))) = { APTX_Q3_TABLE(APTX_ROW) };
 
-const int32_t aptX_dq3bit16_sl1[5] = { -163006, 163006, 542708, 1120554, 2669238 };
-const int32_t aptX_dq3dith16_sf1[5] = { 163006, 163006, 216698, 361148, 1187538 };
-const int32_t aptX_dq3mLamb16[5] = { 0, -13423, -36113, -206598, 0 };
-const int32_t aptX_q3incr16[5] = { 0, -8, 33, 95, 262 };
+#define APTX_Q2_TABLE(X)            \
+	X(-194080, 194080,      0,   0) \
+	X( 194080, 194080, -77081, -33) \
+	X( 890562, 502402,      0, 136)
 
-const int32_t aptX_dq2bit16_sl1[3] = { -194080, 194080, 890562 };
-const int32_t aptX_dq2dith16_sf1[3] = { 194080, 194080, 502402 };
-const int32_t aptX_dq2mLamb16[3] = { 0, -77081, 0 };
-const int32_t aptX_q2incr16[3] = { 0, -33, 136 };
+const int32_t aptX_dq2bit16_sl1[3] = { APTX_Q2_TABLE(APTX_COLUMN_SL1) };
+const int32_t aptX_dq2dith16_sf1[3] = { APTX_Q2_TABLE(APTX_COLUMN_SF1) };
+const int32_t aptX_dq2mLamb16[3] = { APTX_Q2_TABLE(APTX_COLUMN_MLAMB) };
+const int32_t aptX_q2incr16[3] = { APTX_Q2_TABLE(APTX_COLUMN_INCR) };
+const aptX_quantizer_row_422 aptX_q2rows16[3] __attribute__((aligned(64))) = { APTX_Q2_TABLE(APTX_ROW) };
 
 const aptX_subband_params_422 aptX_params_422[] = {
 	[APTX_SUBBAND_LL] = { NULL, aptX_dq7bit16_sl1, NULL, aptX_dq7dith16_sf1, aptX_dq7mLamb16, aptX_q7incr16, 7, 0x11FF,
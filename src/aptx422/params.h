@@ -13,6 +13,15 @@
 
 #include "aptx422.h"
 
+/**
+ * Quantizer and inverter coefficients of a single quantization level. */
+typedef struct aptX_quantizer_row_422_t {
+	int32_t bit16_sl1;
+	int32_t dith16_sf1;
+	int32_t mLamb16;
+	int32_t incr16;
+} aptX_quantizer_row_422;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,24 +35,45 @@ extern const int32_t aptX_dq7bit16_sl1[65];
 extern const int32_t aptX_dq7dith16_sf1[65];
 extern const int32_t aptX_dq7mLamb16[65];
 extern const int32_t aptX_q7incr16[65];
+extern const aptX_quantizer_row_422 aptX_q7rows16[65];
 
 extern const int32_t aptX_dq4bit16_sl1[9];
 extern const int32_t aptX_dq4dith16_sf1[9];
 extern const int32_t aptX_dq4mLamb16[9];
 extern const int32_t aptX_q4incr16[9];
+extern const aptX_quantizer_row_422 aptX_q4rows16[9];
 
 extern const int32_t aptX_dq3bit16_sl1[5];
 extern const int32_t aptX_dq3dith16_sf1[5];
 extern const int32_t aptX_dq3mLamb16[5];
 extern const int32_t aptX_q3incr16[5];
+extern const aptX_quantizer_row_422 aptX_q3rows16[5];
 
 extern const int32_t aptX_dq2bit16_sl1[3];
 extern const int32_t aptX_dq2dith16_sf1[3];
 extern const int32_t aptX_dq2mLamb16[3];
 extern const int32_t aptX_q2incr16[3];
+extern const aptX_quantizer_row_422 aptX_q2rows16[3];
 
 extern const aptX_subband_params_422 aptX_params_422[APTX_SUBBANDS];
 
+/**
+ * Get the row table for the column table referenced by the encoder state.
+ *
+ * NULL is returned for tables which are not ours, e.g. when the state was
+ * initialized by the vendor library. */
+static inline const aptX_quantizer_row_422 * aptX_quantizer_rows(const int32_t * sl1) {
+	if (sl1 == aptX_dq7bit16_sl1)
+		return aptX_q7rows16;
+	if (sl1 == aptX_dq4bit16_sl1)
+		return aptX_q4rows16;
+	if (sl1 == aptX_dq3bit16_sl1)
+		return aptX_q3rows16;
+	if (sl1 == aptX_dq2bit16_sl1)
+		return aptX_q2rows16;
+	return NULL;
+}
+
 #ifdef __cplusplus
 }
 #endif
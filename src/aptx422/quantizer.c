@@ -11,18 +11,22 @@
 #include "quantizer.h"
 
 #include "mathex.h"
+#include "params.h"
 #include "search.h"
 
-static void aptX_quantize_difference(int32_t diff, int32_t dither, int32_t quant, aptX_quantizer_422 * q) {
+static void aptX_quantize_difference(int32_t diff, int32_t dither, int32_t quant,
+                                     const aptX_quantizer_row_422 * rows, aptX_quantizer_422 * q) {
 
-	int32_t sl1_0 = q->subband_param_bit16_sl1[q->unk1];
-	int32_t sl1_1 = q->subband_param_bit16_sl1[q->unk1 + 1];
+	/* rows of the adjacent levels are in the same or next cache line */
+	const aptX_quantizer_row_422 * row = &rows[q->unk1];
+	int32_t sl1_0 = row[0].bit16_sl1;
+	int32_t sl1_1 = row[1].bit16_sl1;
 	int32_t sl1_d = (sl1_1 - sl1_0) * (diff < 0 ? -1 : 1);
 
 	int32_t dt2 = rshift32(((int64_t)dither * dither) >> 7);
 	clamp_int24_t(dt2);
 
-	int32_t v1 = rshift23((int64_t)(0x800000 - dt2) * q->subband_param_mLamb16[q->unk1]);
+	int32_t v1 = rshift23(mul32x32(0x800000 - dt2, row[0].mLamb16));
 	int32_t v2 = rshift32((int64_t)dither * sl1_d) + ((sl1_0 + sl1_1) >> 1) + v1;
 	clamp_int24_t(v2);
 
@@ -46,20 +50,20 @@ static void aptX_quantize_difference(int32_t diff, int32_t dither, int32_t quant
 
 void aptX_quantize_difference_LL(int32_t diff, int32_t dither, int32_t x, aptX_quantizer_422 * q) {
 	q->unk1 = aptX_search_LL(abs32(diff) >> 4, x, q->subband_param_bit16_sl1);
-	aptX_quantize_difference(diff, dither, x, q);
+	aptX_quantize_difference(diff, dither, x, aptX_q7rows16, q);
 }
 
 void aptX_quantize_difference_LH(int32_t diff, int32_t dither, int32_t x, aptX_quantizer_422 * q) {
 	q->unk1 = aptX_search_LH(abs32(diff) >> 4, x, q->subband_param_bit16_sl1);
-	aptX_quantize_difference(diff, dither, x, q);
+	aptX_quantize_difference(diff, dither, x, aptX_q4rows16, q);
 }
 
 void aptX_quantize_difference_HL(int32_t diff, int32_t dither, int32_t x, aptX_quantizer_422 * q) {
 	q->unk1 = aptX_search_HL(abs32(diff) >> 4, x, q->subband_param_bit16_sl1);
-	aptX_quantize_difference(diff, dither, x, q);
+	aptX_quantize_difference(diff, dither, x, aptX_q2rows16, q);
 }
 
 void aptX_quantize_difference_HH(int32_t diff, int32_t dither, int32_t x, aptX_quantizer_422 * q) {
 	q->unk1 = aptX_search_HH(abs32(diff) >> 4, x, q->subband_param_bit16_sl1);
-	aptX_quantize_difference(diff, dither, x, q);
+	aptX_quantize_difference(diff, dither, x, aptX_q3rows16, q);
 }
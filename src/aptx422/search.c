@@ -10,6 +10,8 @@
 
 #include "search.h"
 
+#include "mathex.h"
+
 static size_t aptX_search_quant_coeff(uint32_t a, int32_t x, const int32_t * data, size_t size) {
 
 	/* Search for a quantization coefficient (?) which will maximize the 24-bit
@@ -20,7 +22,7 @@ static size_t aptX_search_quant_coeff(uint32_t a, int32_t x, const int32_t * dat
 	size_t i = 0;
 
 	for (size_t n = size / 2; n > 0; n /= 2)
-		if (xx * data[i + n] <= aa)
+		if (mul32x32(xx, data[i + n]) <= aa)
 			i += n;
 
 	return i;
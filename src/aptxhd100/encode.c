@@ -10,6 +10,7 @@
 
 #include "encode.h"
 
+#include "params.h"
 #include "processor.h"
 #include "qmf.h"
 #include "quantizer.h"
@@ -91,3 +92,38 @@ void aptXHD_post_encode(aptXHD_subband_encoder_100 * e) {
 	aptXHD_process_subband(e->quantizer[2].unk1, e->dither[2], &e->processor[2].filter, &e->processor[2].inverter);
 	aptXHD_process_subband(e->quantizer[3].unk1, e->dither[3], &e->processor[3].filter, &e->processor[3].inverter);
 }
+
+void aptXHD_encoder_init(aptXHD_encoder_100 * e, short endian) {
+
+	/* zeroed without memset(), so the encoder does not depend on libc */
+	for (unsigned char * p = (unsigned char *)e, * end = p + sizeof(*e); p != end; p++)
+		*p = 0;
+	/* XXX: It seems that the logic responsible for byte swapping was copied
+	 *      from the non-HD library version. So, when swapping is enabled the
+	 *      result is a bloody mess... */
+	e->shift = endian ? 8 : 0;
+	e->sync = 7;
+
+	for (size_t i = 0; i < APTXHD_CHANNELS; i++)
+		for (size_t ii = 0; ii < APTXHD_SUBBANDS; ii++) {
+
+			e->encoder[i].processor[ii].filter.width = aptXHD_params_100[ii].filter_width;
+			e->encoder[i].processor[ii].filter.sign1 = 1;
+			e->encoder[i].processor[ii].filter.sign2 = 1;
+			e->encoder[i].processor[ii].filter.subband_param_unk3_2 = aptXHD_params_100[ii].filter_width;
+			e->encoder[i].processor[ii].filter.subband_param_unk3_3 = aptXHD_params_100[ii].filter_width;
+			e->encoder[i].processor[ii].inverter.subband_param_p1 = aptXHD_params_100[ii].p1;
+			e->encoder[i].processor[ii].inverter.subband_param_bit16_sl1 = aptXHD_params_100[ii].bit16_sl1;
+			e->encoder[i].processor[ii].inverter.subband_param_dith16_sf1 = aptXHD_params_100[ii].dith16_sf1;
+			e->encoder[i].processor[ii].inverter.subband_param_incr16 = aptXHD_params_100[ii].incr16;
+			e->encoder[i].processor[ii].inverter.subband_param_unk1 = aptXHD_params_100[ii].unk1;
+			e->encoder[i].processor[ii].inverter.subband_param_unk2 = aptXHD_params_100[ii].unk2;
+			e->encoder[i].processor[ii].inverter.log = aptXHD_IQuant_log_table;
+
+			e->encoder[i].quantizer[ii].subband_param_bits = aptXHD_params_100[ii].bits;
+			e->encoder[i].quantizer[ii].subband_param_p1 = aptXHD_params_100[ii].p1;
+			e->encoder[i].quantizer[ii].subband_param_bit16_sl1 = aptXHD_params_100[ii].bit16_sl1;
+			e->encoder[i].quantizer[ii].subband_param_p3 = aptXHD_params_100[ii].p3;
+			e->encoder[i].quantizer[ii].subband_param_mLamb16 = aptXHD_params_100[ii].mLamb16;
+		}
+}
@@ -29,6 +29,8 @@ void aptXHD_encode(const int32_t pcm[4], aptXHD_QMF_analyzer_100 * qmf, aptXHD_s
 
 void aptXHD_post_encode(aptXHD_subband_encoder_100 * e);
 
+void aptXHD_encoder_init(aptXHD_encoder_100 * e, short endian);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,465 @@
+/*
+ * fused.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "fused.h"
+
+#include "mathex.h"
+#include "params.h"
+
+/**
+ * Sub-band parameters resolved at compile time.
+ *
+ * The staged encoder reads parameter tables via pointers stored in the
+ * encoder state. Here, all stages are inlined with a constant sub-band
+ * index, so table addresses, sizes and filter widths are folded. The
+ * level search uses the column table, the rest uses the row table. */
+static const struct {
+	const int32_t * sl1;
+	const aptXHD_quantizer_row_100 * rows;
+	size_t size;
+	int32_t unk1;
+	int32_t unk2;
+	int32_t width;
+} params[APTXHD_SUBBANDS] = {
+	[APTXHD_SUBBAND_LL] = { aptXHD_dq9bit24_sl1, aptXHD_q9rows24, 257, 0x11FF, -20, 24 },
+	[APTXHD_SUBBAND_LH] = { aptXHD_dq6bit24_sl1, aptXHD_q6rows24, 33, 0x14FF, -23, 12 },
+	[APTXHD_SUBBAND_HL] = { aptXHD_dq4bit24_sl1, aptXHD_q4rows24, 9, 0x16FF, -25, 6 },
+	[APTXHD_SUBBAND_HH] = { aptXHD_dq5bit24_sl1, aptXHD_q5rows24, 17, 0x15FF, -24, 12 },
+};
+
+/* Upper bound of the inverse quantization result before scaling, i.e.
+ * max(|sl1| / 2 + |sf1| / 2) + 2 over all sub-band tables (5968108). */
+#define IQUANT_BOUND 0x5C0000
+
+/**
+ * QMF coefficients in the reversed order.
+ *
+ * With these, convolution with the delayed samples is a forward dot
+ * product, the same as for the second QMF branch. */
+static const int32_t QMF_outer_coeffs_r[16] = {
+	-897, 688, 3511, -10043, 8478, 27611, -160481, 697128, 2801966, -585547, 269973, -121026, 43626, -9611, -413, 730,
+};
+static const int32_t QMF_inner_coeffs_r[16] = {
+	-1268,  973,     4966,   -14203, 11990,  39048,   -226954, 985888,
+	3962579, -828088, 381799, -171156, 61697, -13592, -584,    1033,
+};
+
+/* Hot quantizer state kept in registers between stages. */
+struct fused_quantizer {
+	int32_t unk1;
+	int32_t unk2;
+	int32_t unk3;
+};
+
+struct fused_channel {
+	struct fused_quantizer q[APTXHD_SUBBANDS];
+	int32_t dither[APTXHD_SUBBANDS];
+	int32_t dither_sign;
+};
+
+#define always_inline inline __attribute__((always_inline))
+
+/**
+ * Clamp signed integer to 24 bits, unless saturation was ruled out. */
+#define fused_clamp_int24_t(exact, v) \
+	do { \
+		if (exact) \
+			clamp_int24_t(v); \
+	} while (0)
+
+static always_inline void fused_dither(aptXHD_subband_encoder_100 * e, struct fused_channel * c) {
+
+	e->codeword = 16 * e->codeword + ((8 * (c->q[2].unk1 & 1) + 2 * (c->q[1].unk1 & 2) + (c->q[0].unk1 & 3)) << 8);
+
+	int64_t a = (int64_t)0x4F1BBB * (e->codeword >> 7);
+	int32_t b = ((a >> 24) & 0xFFFFFF) + (a & 0xFFFFFF);
+	int32_t d = ((a & 0xFFFFFF) >> 22) + b * 4;
+
+	c->dither[0] = d << 23;
+	c->dither[1] = d << 18;
+	c->dither[2] = d << 13;
+	c->dither[3] = d << 8;
+	c->dither_sign = (b >> 23) & 1;
+}
+
+static always_inline void fused_conv_outer(const int32_t * s1, const int32_t * s2, int32_t * out_a,
+                                           int32_t * out_b) {
+
+	int64_t f1 = 0;
+	int64_t f2 = 0;
+
+	for (size_t i = 0; i < 16; i++) {
+		f1 += (int64_t)QMF_outer_coeffs_r[i] * s1[i];
+		f2 += (int64_t)aptXHD_QMF_outer_coeffs[i] * s2[i];
+	}
+
+	f1 = rshift23(f1);
+	f2 = rshift23(f2);
+	clamp_int24_t(f1);
+	clamp_int24_t(f2);
+
+	int32_t r1 = f2 + f1;
+	int32_t r2 = f2 - f1;
+	clamp_int24_t(r1);
+	clamp_int24_t(r2);
+
+	*out_a = r1;
+	*out_b = r2;
+}
+
+static always_inline void fused_conv_inner(const int32_t * s1, const int32_t * s2, int32_t * out_a,
+                                           int32_t * out_b) {
+
+	int64_t f1 = 0;
+	int64_t f2 = 0;
+
+	for (size_t i = 0; i < 16; i++) {
+		f1 += (int64_t)QMF_inner_coeffs_r[i] * s1[i];
+		f2 += (int64_t)aptXHD_QMF_inner_coeffs[i] * s2[i];
+	}
+
+	/* with 24-bit samples and the sum of absolute coefficients
+	 * below 2^23, these results always fit in 24 bits */
+	f1 = rshift23(f1);
+	f2 = rshift23(f2);
+
+	int32_t r1 = f2 + f1;
+	int32_t r2 = f2 - f1;
+	clamp_int24_t(r1);
+	clamp_int24_t(r2);
+
+	*out_a = r1;
+	*out_b = r2;
+}
+
+/**
+ * Check whether the input block and all QMF delay lines are digital silence.
+ * The second half of every delay line is a copy of the first one. */
+static always_inline bool fused_qmf_silent(const aptXHD_QMF_analyzer_100 * qmf, const int32_t pcm[4]) {
+	int32_t x = pcm[0] | pcm[1] | pcm[2] | pcm[3];
+	for (size_t i = 0; i < 16; i++)
+		x |= qmf->outer[0][i] | qmf->outer[1][i];
+	for (size_t i = 0; i < 16; i++)
+		x |= qmf->inner[0][i] | qmf->inner[1][i] | qmf->inner[2][i] | qmf->inner[3][i];
+	return x == 0;
+}
+
+static always_inline void fused_qmf(aptXHD_QMF_analyzer_100 * qmf, const int32_t pcm[4], int32_t subbands[4]) {
+
+	int32_t a, b, c, d;
+	size_t io = qmf->i_outer;
+	size_t ii = qmf->i_inner;
+
+	/* Convolutions of zeros are zeros, so in silence the filter bank only
+	 * advances its delay line positions. Rest of the encoder has to run,
+	 * because the sync bit keeps the predictor state in motion. */
+	if (fused_qmf_silent(qmf, pcm)) {
+		subbands[0] = subbands[1] = subbands[2] = subbands[3] = 0;
+		qmf->i_outer = (io + 2) % 16;
+		qmf->i_inner = (ii + 1) % 16;
+		return;
+	}
+
+	qmf->outer[0][io + 0] = qmf->outer[0][io + 16] = pcm[0];
+	qmf->outer[1][io + 0] = qmf->outer[1][io + 16] = pcm[1];
+	io = (io + 1) % 16;
+	fused_conv_outer(&qmf->outer[0][io], &qmf->outer[1][io], &a, &b);
+
+	qmf->outer[0][io + 0] = qmf->outer[0][io + 16] = pcm[2];
+	qmf->outer[1][io + 0] = qmf->outer[1][io + 16] = pcm[3];
+	io = (io + 1) % 16;
+	fused_conv_outer(&qmf->outer[0][io], &qmf->outer[1][io], &c, &d);
+
+	qmf->inner[2][ii + 0] = qmf->inner[2][ii + 16] = a;
+	qmf->inner[0][ii + 0] = qmf->inner[0][ii + 16] = c;
+	qmf->inner[1][ii + 0] = qmf->inner[1][ii + 16] = b;
+	qmf->inner[3][ii + 0] = qmf->inner[3][ii + 16] = d;
+	ii = (ii + 1) % 16;
+
+	fused_conv_inner(&qmf->inner[2][ii], &qmf->inner[0][ii], &subbands[0], &subbands[1]);
+	fused_conv_inner(&qmf->inner[1][ii], &qmf->inner[3][ii], &subbands[2], &subbands[3]);
+
+	qmf->i_outer = io;
+	qmf->i_inner = ii;
+}
+
+static always_inline void fused_quantize(const size_t sb, int32_t diff, int32_t dither, int32_t quant,
+                                         struct fused_quantizer * q) {
+
+	const int32_t * sl1 = params[sb].sl1;
+
+	int32_t absdiff = abs32(diff);
+	clamp_int24_t(absdiff);
+
+	/* binary search of the quantization coefficient */
+	int64_t aa = (int64_t)(uint32_t)(absdiff >> 4) << 32;
+	int64_t xx = quant << 8;
+	size_t i = 0;
+	for (size_t n = params[sb].size / 2; n > 0; n /= 2)
+		if (mul32x32(xx, sl1[i + n]) <= aa)
+			i += n;
+
+	const aptXHD_quantizer_row_100 * row = &params[sb].rows[i];
+	int32_t sl1_0 = row[0].bit24_sl1;
+	int32_t sl1_1 = row[1].bit24_sl1;
+	int32_t sl1_d = (sl1_1 - sl1_0) * (diff < 0 ? -1 : 1);
+
+	int32_t dt2 = rshift32(((int64_t)dither * dither) >> 7);
+	clamp_int24_t(dt2);
+
+	int32_t v1 = rshift23(mul32x32(0x800000 - dt2, row[0].mLamb24));
+	int32_t v2 = rshift32((int64_t)dither * sl1_d) + ((sl1_0 + sl1_1) >> 1) + v1;
+	clamp_int24_t(v2);
+
+	int32_t v3 = rshift32((int64_t)(v2 << 4) * (quant * -1 << 8)) + absdiff;
+	int32_t unk3 = ((v3 + 4) >> 3) - ((uint8_t)(v3 << 5) == 0x80);
+	int32_t unk1 = i;
+	int32_t unk2 = i - 1;
+
+	if (unk3 < 0) {
+		unk2 = i;
+		unk1 = i - 1;
+		unk3 = -unk3;
+	}
+
+	if (diff < 0) {
+		unk1 = ~unk1;
+		unk2 = ~unk2;
+	}
+
+	q->unk1 = unk1;
+	q->unk2 = unk2;
+	q->unk3 = unk3;
+}
+
+static always_inline void fused_encode(aptXHD_subband_encoder_100 * e, aptXHD_QMF_analyzer_100 * qmf,
+                                       const int32_t pcm[4], struct fused_channel * c) {
+
+	int32_t subbands[4];
+
+	fused_dither(e, c);
+	fused_qmf(qmf, pcm, subbands);
+
+	for (size_t sb = 0; sb < APTXHD_SUBBANDS; sb++) {
+		int32_t diff = subbands[sb] - e->processor[sb].filter.unk8;
+		clamp_int24_t(diff);
+		fused_quantize(sb, diff, c->dither[sb], e->processor[sb].inverter.unk9, &c->q[sb]);
+	}
+}
+
+static always_inline void fused_insert_sync(struct fused_channel * c1, struct fused_channel * c2, int32_t * sync) {
+
+	int x = 1 & (c1->q[0].unk1 ^ c2->q[0].unk1 ^ c1->q[1].unk1 ^ c2->q[1].unk1 ^ c1->q[2].unk1 ^ c2->q[2].unk1 ^
+	             c1->q[3].unk1 ^ c2->q[3].unk1 ^ c1->dither_sign ^ c2->dither_sign);
+
+	if (x != ((1 >> *sync) & 1)) {
+
+		const size_t map[APTXHD_SUBBANDS] = { 1, 2, 0, 3 };
+		struct fused_quantizer * q = &c2->q[map[0]];
+
+		for (size_t i = 0; i < APTXHD_SUBBANDS; i++)
+			if (c2->q[map[i]].unk3 < q->unk3)
+				q = &c2->q[map[i]];
+		for (size_t i = 0; i < APTXHD_SUBBANDS; i++)
+			if (c1->q[map[i]].unk3 < q->unk3)
+				q = &c1->q[map[i]];
+
+		q->unk1 = q->unk2;
+	}
+
+	*sync = (*sync - 1) & 7;
+}
+
+static always_inline void fused_process_subband(const bool exact, const size_t sb, int32_t a, int32_t dither,
+                                                aptXHD_prediction_filter_100 * f, aptXHD_inverter_100 * inv) {
+
+	/* inverse quantization */
+
+	size_t i_ = (a < 0 ? ~a : a) + 1;
+	const aptXHD_quantizer_row_100 * row = &params[sb].rows[i_];
+	int32_t sl1 = (a < 0 ? -1 : 1) * row->bit24_sl1;
+
+	int64_t tmp64 = (int64_t)dither * row->dith24_sf1;
+	/* the result is bounded by the quantization tables to IQUANT_BOUND */
+	tmp64 = rshift32(((int64_t)sl1 << 31) + tmp64);
+	int32_t unk11 = mul32x32(tmp64, inv->unk9) >> 19;
+	fused_clamp_int24_t(exact, unk11);
+	inv->unk11 = unk11;
+
+	int32_t unk10 = rshift15(32620 * inv->unk10 + (row->incr24 << 15));
+	clip_range(unk10, 0, params[sb].unk1);
+	inv->unk10 = unk10;
+
+	int shift = -3 - params[sb].unk2 - (unk10 >> 8);
+	inv->unk9 = aptXHD_IQuant_log_table[(unk10 >> 3) & 0x1F] >> shift;
+
+	/* adaptation of the prediction coefficients */
+
+	int32_t sign1 = f->sign1;
+	int32_t sign2 = f->sign2;
+
+	int32_t tmp = f->unk7 + unk11;
+	f->sign2 = f->sign1;
+	if (tmp < 0) {
+		sign1 *= -1;
+		sign2 *= -1;
+		f->sign1 = -1;
+	}
+	else {
+		if (tmp == 0) {
+			sign1 = 0;
+			sign2 = 0;
+		}
+		f->sign1 = 1;
+	}
+
+	int32_t unk2 = f->unk2;
+	int32_t unk3 = f->unk3;
+
+	tmp = -1 * unk2 * sign1;
+	tmp = ((tmp + 1) >> 1) - ((tmp & 3) == 1);
+	clip_range(tmp, -0x100000, 0x100000);
+
+	unk3 = 254 * unk3 + 0x800000 * sign2 + (tmp >> 4 << 8);
+	unk3 = rshift8(unk3);
+	clip_range(unk3, -0x300000, 0x300000);
+
+	unk2 = 255 * unk2 + 0xC00000 * sign1;
+	unk2 = rshift8(unk2);
+	clip_range(unk2, -(0x3C0000 - unk3), 0x3C0000 - unk3);
+
+	/* prediction filtering */
+
+	const size_t width = params[sb].width;
+
+	int32_t tmp1 = unk11 + f->unk8;
+	fused_clamp_int24_t(exact, tmp1);
+
+	int64_t x1 = (int64_t)unk3 * f->unk6;
+	int64_t x2 = (int64_t)tmp1 * unk2;
+	int32_t tmp2 = (x1 + x2) >> 22;
+	clamp_int24_t(tmp2);
+
+	int32_t v1 = 128;
+	int32_t v2 = 128;
+	if (unk11) {
+		v1 = ((unk11 >> 31) & 0x01000000) - 8388480;
+		v2 = ((unk11 >> 31) & 0xFF000000) + 8388736;
+	}
+
+	const size_t fi = f->i;
+	size_t q = fi + width;
+	int64_t sum = 0;
+	int64_t c = unk11;
+
+	for (size_t i = 0; i < width; i++, q--) {
+		int32_t arr1 = f->arr1[i];
+		int32_t t = (f->arr2[q] >= 0 ? v2 : v1) - arr1;
+		arr1 += (t >> 8) - (((uint32_t)t) << 23 == 0x80000000);
+		f->arr1[i] = arr1;
+		sum += mul32x32(c, arr1);
+		c = f->arr2[q];
+	}
+
+	int32_t unk7 = sum >> 22;
+	clamp_int24_t(unk7);
+	int32_t unk8 = unk7 + tmp2;
+	clamp_int24_t(unk8);
+
+	f->unk2 = unk2;
+	f->unk3 = unk3;
+	f->unk6 = tmp1;
+	f->unk7 = unk7;
+	f->unk8 = unk8;
+
+	const size_t ni = (fi + 1) % width;
+	f->i = ni;
+	f->arr2[ni] = unk11;
+	f->arr2[ni + width] = unk11;
+}
+
+static always_inline void fused_post_encode(const bool exact, const size_t sb, aptXHD_subband_encoder_100 * e,
+                                            const struct fused_channel * c) {
+	fused_process_subband(exact, sb, c->q[sb].unk1, c->dither[sb], &e->processor[sb].filter,
+	                      &e->processor[sb].inverter);
+	e->quantizer[sb].unk1 = c->q[sb].unk1;
+	e->quantizer[sb].unk2 = c->q[sb].unk2;
+	e->quantizer[sb].unk3 = c->q[sb].unk3;
+	e->dither[sb] = c->dither[sb];
+}
+
+static always_inline uint32_t fused_pack(aptXHD_subband_encoder_100 * e, const struct fused_channel * c) {
+
+	e->dither_sign = c->dither_sign;
+
+	int x = 1 & (c->q[0].unk1 ^ c->q[1].unk1 ^ c->q[2].unk1 ^ c->q[3].unk1 ^ c->dither_sign);
+	return ((c->q[0].unk1 & 0x1FF) << 0) | ((c->q[1].unk1 & 0x3F) << 9) | ((c->q[2].unk1 & 0x0F) << 15) |
+	       (((c->q[3].unk1 & 0x1E) | x) << 19);
+}
+
+static always_inline void fused_kernel(const bool exact, aptXHD_encoder_100 * e, const int32_t pcmL[4],
+                                       const int32_t pcmR[4], uint32_t code[2]) {
+
+	struct fused_channel c[APTXHD_CHANNELS];
+
+	/* codeword history is updated with the previous quantizer output */
+	for (size_t ch = 0; ch < APTXHD_CHANNELS; ch++)
+		for (size_t sb = 0; sb < APTXHD_SUBBANDS; sb++)
+			c[ch].q[sb].unk1 = e->encoder[ch].quantizer[sb].unk1;
+
+	fused_encode(&e->encoder[0], &e->analyzer[0], pcmL, &c[0]);
+	fused_encode(&e->encoder[1], &e->analyzer[1], pcmR, &c[1]);
+	fused_insert_sync(&c[0], &c[1], &e->sync);
+
+	/* channels are interleaved, so their independent filter updates overlap */
+	for (size_t sb = 0; sb < APTXHD_SUBBANDS; sb++)
+		for (size_t ch = 0; ch < APTXHD_CHANNELS; ch++)
+			fused_post_encode(exact, sb, &e->encoder[ch], &c[ch]);
+
+	uint32_t tmp;
+	tmp = fused_pack(&e->encoder[0], &c[0]);
+	code[0] = (tmp >> e->shift) | (tmp << e->shift);
+	tmp = fused_pack(&e->encoder[1], &c[1]);
+	code[1] = (tmp >> e->shift) | (tmp << e->shift);
+
+}
+
+/**
+ * Check whether the predictor input can saturate in this block.
+ *
+ * The inverse quantization result scaled with the current step size is
+ * added to the previous prediction. If the sum of their bounds fits in
+ * 24 bits for every sub-band, the block can be processed without clamping
+ * the scaled result and the predictor input. */
+static always_inline bool fused_guard(const aptXHD_subband_encoder_100 * e) {
+	for (size_t sb = 0; sb < APTXHD_SUBBANDS; sb++) {
+		const int32_t unk8 = e->processor[sb].filter.unk8;
+		const int64_t unk11 = (((int64_t)IQUANT_BOUND * e->processor[sb].inverter.unk9) >> 19) + 1;
+		if (unk11 + abs32(unk8) > INT24_MAX)
+			return false;
+	}
+	return true;
+}
+
+void aptXHD_encode_fused(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4], uint32_t code[2]) {
+	fused_kernel(true, e, pcmL, pcmR, code);
+}
+
+bool aptXHD_encode_fused_guarded(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4],
+                                 uint32_t code[2]) {
+
+	if (fused_guard(&e->encoder[0]) && fused_guard(&e->encoder[1])) {
+		fused_kernel(false, e, pcmL, pcmR, code);
+		return true;
+	}
+
+	fused_kernel(true, e, pcmL, pcmR, code);
+	return false;
+}
@@ -0,0 +1,31 @@
+/*
+ * fused.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_APTXHD100_FUSED_H_
+#define OPENAPTX_APTXHD100_FUSED_H_
+
+#include <stdbool.h>
+
+#include "aptxHD100.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void aptXHD_encode_fused(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4], uint32_t code[2]);
+
+bool aptXHD_encode_fused_guarded(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4],
+                                 uint32_t code[2]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,67 +15,229 @@
 #include "aptxHD100.h"
 #include "openaptx.h"
 
-#include <string.h>
+#if !FREESTANDING
+#	include <pthread.h>
+#	include <stdbool.h>
+#	include <stdio.h>
+#	include <stdlib.h>
+#	include <string.h>
+#	include <time.h>
+#endif
 
 #include "encode.h"
+#include "fused.h"
 #include "params.h"
+#include "../tracepoints.h"
+#if !FREESTANDING
+#	include "../wisdom.h"
+#endif
+
+/* Wisdom key of the selected encoding kernel. */
+#define KERNEL_WISDOM_KEY "aptxHD-1.0.0.encoder"
+/* Number of 4-sample blocks used for the kernel tuning. */
+#define KERNEL_TUNE_BLOCKS 4096
+/* Number of timed tuning rounds (the best one is taken). */
+#define KERNEL_TUNE_ROUNDS 3
+
+typedef void (*aptXHD_encode_kernel)(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4],
+                                     uint32_t code[2]);
+
+#if !FREESTANDING
 
 static aptXHD_encoder_100 aptXHD_encoder;
 
-int aptxhdbtenc_init(APTXENC enc, short endian) {
+/**
+ * Encoding path with separate QMF analysis, quantization and prediction
+ * stages. It is the reference for the bit-exactness check. */
+static void aptXHD_encode_staged(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4],
+                                 uint32_t code[2]) {
+
+	uint32_t tmp;
+
+	aptXHD_encode(pcmL, &e->analyzer[0], &e->encoder[0]);
+	aptXHD_encode(pcmR, &e->analyzer[1], &e->encoder[1]);
+	aptXHD_insert_sync(&e->encoder[0], &e->encoder[1], &e->sync);
+
+	aptXHD_post_encode(&e->encoder[0]);
+	aptXHD_post_encode(&e->encoder[1]);
+
+	tmp = aptXHD_pack_codeword(&e->encoder[0]);
+	code[0] = (tmp >> e->shift) | (tmp << e->shift);
+	tmp = aptXHD_pack_codeword(&e->encoder[1]);
+	code[1] = (tmp >> e->shift) | (tmp << e->shift);
+}
+
+#endif
+
+static void aptXHD_encode_guarded(aptXHD_encoder_100 * e, const int32_t pcmL[4], const int32_t pcmR[4],
+                                  uint32_t code[2]) {
+	aptXHD_encode_fused_guarded(e, pcmL, pcmR, code);
+}
+
+#if !FREESTANDING
+
+/* Available encoding kernels, the reference one goes first. */
+static const struct {
+	const char * name;
+	aptXHD_encode_kernel encode;
+} kernels[] = {
+	{ "staged", aptXHD_encode_staged },
+	{ "fused", aptXHD_encode_fused },
+	{ "guarded", aptXHD_encode_guarded },
+};
+
+static aptXHD_encode_kernel kernel = aptXHD_encode_guarded;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Generate tuning signal: tones with noise, in every fourth part with
+ * the gain high enough to exercise the clamping paths. */
+static void kernel_tune_signal(int32_t * pcmL, int32_t * pcmR, size_t samples) {
+	uint32_t seed = 0x12345678;
+	int32_t phaseL = 0, phaseR = 0;
+	for (size_t i = 0; i < samples; i++) {
+		seed = seed * 1664525 + 1013904223;
+		/* triangle waves of different periods */
+		phaseL = (phaseL + 1021) & 0xFFFF;
+		phaseR = (phaseR + 3187) & 0xFFFF;
+		const int32_t triL = (phaseL < 0x8000 ? phaseL : 0xFFFF - phaseL) - 0x4000;
+		const int32_t triR = (phaseR < 0x8000 ? phaseR : 0xFFFF - phaseR) - 0x4000;
+		const int32_t gain = (i / 16384) % 4 == 3 ? 4 : 1;
+		pcmL[i] = gain * (triL + ((int32_t)seed >> 22)) * 256;
+		pcmR[i] = gain * (triR / 2 + ((int32_t)seed >> 19)) * 256;
+	}
+}
+
+static double kernel_elapsed(const struct timespec * t0) {
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * Benchmark all kernels and select the fastest bit-exact one. */
+static int kernel_tune(void) {
+
+	const size_t blocks = KERNEL_TUNE_BLOCKS;
+	int32_t * pcm = malloc(blocks * 8 * sizeof(*pcm));
+	uint32_t * ref = malloc(blocks * 2 * sizeof(*ref));
+	uint32_t * code = malloc(blocks * 2 * sizeof(*code));
+	aptXHD_encoder_100 * e_ref = malloc(sizeof(*e_ref));
+	aptXHD_encoder_100 * e = malloc(sizeof(*e));
+	int selected = -1;
+
+	if (pcm == NULL || ref == NULL || code == NULL || e_ref == NULL || e == NULL)
+		goto final;
+
+	int32_t * pcmL = pcm;
+	int32_t * pcmR = pcm + blocks * 4;
+	kernel_tune_signal(pcmL, pcmR, blocks * 4);
+
+	double best = -1;
+	for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
 
-	aptXHD_encoder_100 * e = (aptXHD_encoder_100 *)enc;
-
-	memset(e, 0, sizeof(*e));
-	/* XXX: It seems that the logic responsible for byte swapping was copied
-	 *      from the non-HD library version. So, when swapping is enabled the
-	 *      result is a bloody mess... */
-	e->shift = endian ? 8 : 0;
-	e->sync = 7;
-
-	for (size_t i = 0; i < APTXHD_CHANNELS; i++)
-		for (size_t ii = 0; ii < APTXHD_SUBBANDS; ii++) {
-
-			e->encoder[i].processor[ii].filter.width = aptXHD_params_100[ii].filter_width;
-			e->encoder[i].processor[ii].filter.sign1 = 1;
-			e->encoder[i].processor[ii].filter.sign2 = 1;
-			e->encoder[i].processor[ii].filter.subband_param_unk3_2 = aptXHD_params_100[ii].filter_width;
-			e->encoder[i].processor[ii].filter.subband_param_unk3_3 = aptXHD_params_100[ii].filter_width;
-			e->encoder[i].processor[ii].inverter.subband_param_p1 = aptXHD_params_100[ii].p1;
-			e->encoder[i].processor[ii].inverter.subband_param_bit16_sl1 = aptXHD_params_100[ii].bit16_sl1;
-			e->encoder[i].processor[ii].inverter.subband_param_dith16_sf1 = aptXHD_params_100[ii].dith16_sf1;
-			e->encoder[i].processor[ii].inverter.subband_param_incr16 = aptXHD_params_100[ii].incr16;
-			e->encoder[i].processor[ii].inverter.subband_param_unk1 = aptXHD_params_100[ii].unk1;
-			e->encoder[i].processor[ii].inverter.subband_param_unk2 = aptXHD_params_100[ii].unk2;
-			e->encoder[i].processor[ii].inverter.log = aptXHD_IQuant_log_table;
-
-			e->encoder[i].quantizer[ii].subband_param_bits = aptXHD_params_100[ii].bits;
-			e->encoder[i].quantizer[ii].subband_param_p1 = aptXHD_params_100[ii].p1;
-			e->encoder[i].quantizer[ii].subband_param_bit16_sl1 = aptXHD_params_100[ii].bit16_sl1;
-			e->encoder[i].quantizer[ii].subband_param_p3 = aptXHD_params_100[ii].p3;
-			e->encoder[i].quantizer[ii].subband_param_mLamb16 = aptXHD_params_100[ii].mLamb16;
+		double elapsed = -1;
+		bool exact = true;
+
+		for (size_t round = 0; round < KERNEL_TUNE_ROUNDS; round++) {
+			struct timespec t0;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			aptXHD_encoder_init(e, 0);
+			for (size_t i = 0; i < blocks; i++)
+				kernels[k].encode(e, &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]);
+			const double t = kernel_elapsed(&t0);
+			if (elapsed < 0 || t < elapsed)
+				elapsed = t;
+		}
+
+		if (k == 0) {
+			memcpy(ref, code, blocks * 2 * sizeof(*ref));
+			memcpy(e_ref, e, sizeof(*e_ref));
+		} else if (memcmp(ref, code, blocks * 2 * sizeof(*ref)) != 0 || memcmp(e_ref, e, sizeof(*e)) != 0) {
+			exact = false;
 		}
 
+		if (!exact)
+			fprintf(stderr, "openaptx: aptxHD-1.0.0: tune: %s: Not bit-exact\n", kernels[k].name);
+		else
+			fprintf(stderr, "openaptx: aptxHD-1.0.0: tune: %s: %.3f ms\n", kernels[k].name, elapsed);
+
+		if (exact && (best < 0 || elapsed < best)) {
+			selected = k;
+			best = elapsed;
+		}
+
+	}
+
+final:
+	free(pcm);
+	free(ref);
+	free(code);
+	free(e_ref);
+	free(e);
+	return selected;
+}
+
+/**
+ * Select the encoding kernel.
+ *
+ * The kernel recorded in the wisdom file is used if available. Otherwise,
+ * if the OPENAPTX_TUNE environment variable is set, all kernels are timed
+ * and the result is stored in the wisdom file. */
+static void kernel_select(void) {
+
+	const size_t n = sizeof(kernels) / sizeof(*kernels);
+	char name[WISDOM_FIELD_SIZE];
+	int selected;
+
+	if (wisdom_load(KERNEL_WISDOM_KEY, name, sizeof(name)) == 0)
+		for (size_t i = 0; i < n; i++)
+			if (strcmp(kernels[i].name, name) == 0) {
+				kernel = kernels[i].encode;
+				return;
+			}
+
+	if (!wisdom_tune_requested("OPENAPTX_TUNE"))
+		return;
+	if ((selected = kernel_tune()) == -1)
+		return;
+
+	kernel = kernels[selected].encode;
+	fprintf(stderr, "openaptx: aptxHD-1.0.0: tune: Selected kernel: %s\n", kernels[selected].name);
+	if (wisdom_store(KERNEL_WISDOM_KEY, kernels[selected].name) == -1)
+		fprintf(stderr, "openaptx: aptxHD-1.0.0: Couldn't store wisdom: %s\n", strerror(errno));
+
+}
+
+#endif
+
+int aptxhdbtenc_init(APTXENC enc, short endian) {
+#if !FREESTANDING
+	pthread_once(&kernel_once, kernel_select);
+#endif
+	aptXHD_encoder_init((aptXHD_encoder_100 *)enc, endian);
+	OPENAPTX_TRACE3(aptxhd_enc_init, enc, endian, 0);
 	return 0;
 }
 
 int aptxhdbtenc_encodestereo(APTXENC enc, const int32_t pcmL[4], const int32_t pcmR[4], uint32_t code[2]) {
 
 	aptXHD_encoder_100 * enc_ = (aptXHD_encoder_100 *)enc;
-	uint32_t tmp;
-
-	aptXHD_encode(pcmL, &enc_->analyzer[0], &enc_->encoder[0]);
-	aptXHD_encode(pcmR, &enc_->analyzer[1], &enc_->encoder[1]);
-	aptXHD_insert_sync(&enc_->encoder[0], &enc_->encoder[1], &enc_->sync);
 
-	aptXHD_post_encode(&enc_->encoder[0]);
-	aptXHD_post_encode(&enc_->encoder[1]);
+	OPENAPTX_TRACE2(aptxhd_encode_entry, enc, 4);
 
-	tmp = aptXHD_pack_codeword(&enc_->encoder[0]);
-	code[0] = (tmp >> enc_->shift) | (tmp << enc_->shift);
-	tmp = aptXHD_pack_codeword(&enc_->encoder[1]);
-	code[1] = (tmp >> enc_->shift) | (tmp << enc_->shift);
+#if FREESTANDING
+	/* The freestanding build has no kernel selection (it would require libc
+	 * and mutable static state). The default kernel is called directly, so
+	 * the call graph has no indirect calls and the stack usage is bounded. */
+	aptXHD_encode_guarded(enc_, pcmL, pcmR, code);
+#else
+	kernel(enc_, pcmL, pcmR, code);
+#endif
+	/* sync state after the sync insertion in the encoded block */
+	OPENAPTX_TRACE2(aptxhd_sync, enc, enc_->sync);
 
+	OPENAPTX_TRACE2(aptxhd_encode_exit, enc, 4);
 	return 0;
 }
 
@@ -88,10 +250,14 @@ const char * aptxhdbtenc_version(void) {
 }
 
 size_t SizeofAptxhdbtenc(void) {
-	return sizeof(aptXHD_encoder);
+	return sizeof(aptXHD_encoder_100);
 }
 
+#if !FREESTANDING
+
 APTXENC NewAptxhdEnc(short endian) {
 	aptxhdbtenc_init(&aptXHD_encoder, endian);
 	return &aptXHD_encoder;
 }
+
+#endif
@@ -25,132 +25,368 @@ const int32_t aptXHD_QMF_inner_coeffs[16] = {
 	985888, -226954, 39048,  11990, -14203,  4966,   973,     -1268,
 };
 
-const int32_t aptXHD_dq9bit24_sl1[257] = {
-	-2436,   2436,    7308,    12180,   17054,    21930,   26806,   31686,   36566,   41450,   46338,   51230,
-	56124,   61024,   65928,   70836,   75750,    80670,   85598,   90530,   95470,   100418,  105372,  110336,
-	115308,  120288,  125278,  130276,  135286,   140304,  145334,  150374,  155426,  160490,  165566,  170654,
-	175756,  180870,  185998,  191138,  196294,   201466,  206650,  211850,  217068,  222300,  227548,  232814,
-	238096,  243396,  248714,  254050,  259406,   264778,  270172,  275584,  281018,  286470,  291944,  297440,
-	302956,  308496,  314056,  319640,  325248,   330878,  336532,  342212,  347916,  353644,  359398,  365178,
-	370986,  376820,  382680,  388568,  394486,   400430,  406404,  412408,  418442,  424506,  430600,  436726,
-	442884,  449074,  455298,  461554,  467844,   474168,  480528,  486922,  493354,  499820,  506324,  512866,
-	519446,  526064,  532722,  539420,  546160,   552940,  559760,  566624,  573532,  580482,  587478,  594520,
-	601606,  608740,  615920,  623148,  630426,   637754,  645132,  652560,  660042,  667576,  675164,  682808,
-	690506,  698262,  706074,  713946,  721876,   729868,  737920,  746036,  754216,  762460,  770770,  779148,
-	787594,  796108,  804694,  813354,  822086,   830892,  839774,  848736,  857776,  866896,  876100,  885386,
-	894758,  904218,  913766,  923406,  933138,   942964,  952886,  962908,  973030,  983254,  993582,  1004020,
-	1014566, 1025224, 1035996, 1046886, 1057894,  1069026, 1080284, 1091670, 1103186, 1114838, 1126628, 1138558,
-	1150634, 1162858, 1175236, 1187768, 1200462,  1213320, 1226346, 1239548, 1252928, 1266490, 1280242, 1294188,
-	1308334, 1322688, 1337252, 1352034, 1367044,  1382284, 1397766, 1413494, 1429478, 1445728, 1462252, 1479058,
-	1496158, 1513562, 1531280, 1549326, 1567710,  1586446, 1605550, 1625034, 1644914, 1665208, 1685932, 1707108,
-	1728754, 1750890, 1773542, 1796732, 1820488,  1844840, 1869816, 1895452, 1921780, 1948842, 1976680, 2005338,
-	2034868, 2065322, 2096766, 2129260, 2162880,  2197708, 2233832, 2271352, 2310384, 2351050, 2393498, 2437886,
-	2484404, 2533262, 2584710, 2639036, 2696578,  2757738, 2822998, 2892940, 2968278, 3049896, 3138912, 3236760,
-	3345312, 3467068, 3605434, 3765154, 3952904,  4177962, 4452178, 4787134, 5187290, 5647128, 6159120, 6720518,
-	7332904, 8000032, 8726664, 9518152, 10380372,
-};
-const int32_t aptXHD_dq9dith24_sf1[257] = {
-	2436,   2436,   2436,   2436,   2438,   2438,  2438,   2440,   2442,   2442,   2444,   2446,   2448,   2450,
-	2454,   2456,   2458,   2462,   2464,   2468,  2472,   2476,   2480,   2484,   2488,   2492,   2498,   2502,
-	2506,   2512,   2518,   2524,   2528,   2534,  2540,   2548,   2554,   2560,   2568,   2574,   2582,   2588,
-	2596,   2604,   2612,   2620,   2628,   2636,  2646,   2654,   2664,   2672,   2682,   2692,   2702,   2712,
-	2722,   2732,   2742,   2752,   2764,   2774,  2786,   2798,   2810,   2822,   2834,   2846,   2858,   2870,
-	2884,   2896,   2910,   2924,   2938,   2952,  2966,   2980,   2994,   3010,   3024,   3040,   3056,   3070,
-	3086,   3104,   3120,   3136,   3154,   3170,  3188,   3206,   3224,   3242,   3262,   3280,   3300,   3320,
-	3338,   3360,   3380,   3400,   3422,   3442,  3464,   3486,   3508,   3532,   3554,   3578,   3602,   3626,
-	3652,   3676,   3702,   3728,   3754,   3780,  3808,   3836,   3864,   3892,   3920,   3950,   3980,   4010,
-	4042,   4074,   4106,   4138,   4172,   4206,  4240,   4276,   4312,   4348,   4384,   4422,   4460,   4500,
-	4540,   4580,   4622,   4664,   4708,   4752,  4796,   4842,   4890,   4938,   4986,   5036,   5086,   5138,
-	5192,   5246,   5300,   5358,   5416,   5474,  5534,   5596,   5660,   5726,   5792,   5860,   5930,   6002,
-	6074,   6150,   6226,   6306,   6388,   6470,  6556,   6644,   6736,   6828,   6924,   7022,   7124,   7228,
-	7336,   7448,   7562,   7680,   7802,   7928,  8058,   8192,   8332,   8476,   8624,   8780,   8940,   9106,
-	9278,   9458,   9644,   9840,   10042,  10252, 10472,  10702,  10942,  11194,  11458,  11734,  12024,  12328,
-	12648,  12986,  13342,  13720,  14118,  14540, 14990,  15466,  15976,  16520,  17102,  17726,  18398,  19124,
-	19908,  20760,  21688,  22702,  23816,  25044, 26404,  27922,  29622,  31540,  33720,  36222,  39116,  42502,
-	46514,  51334,  57218,  64536,  73830,  85890, 101860, 123198, 151020, 183936, 216220, 243618, 268374, 293022,
-	319362, 347768, 378864, 412626, 449596,
-};
-const int32_t aptXHD_dq9mLamb24[257] = {
-	0,     0,     0,     -1,    0,     0,     -1,    -1,    0,     -1,    -1,    -1,    -1,    -1,    -1,    -1,
-	-1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -2,    -1,    -1,    -2,    -2,    -2,    -1,
-	-2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -2,    -3,
-	-2,    -3,    -2,    -3,    -3,    -3,    -3,    -3,    -3,    -3,    -3,    -3,    -3,    -3,    -3,    -3,
-	-3,    -3,    -3,    -3,    -3,    -4,    -3,    -4,    -4,    -4,    -4,    -4,    -4,    -4,    -4,    -4,
-	-4,    -4,    -4,    -4,    -5,    -4,    -4,    -5,    -4,    -5,    -5,    -5,    -5,    -5,    -5,    -5,
-	-5,    -5,    -6,    -5,    -5,    -6,    -5,    -6,    -6,    -6,    -6,    -6,    -6,    -6,    -6,    -7,
-	-6,    -7,    -7,    -7,    -7,    -7,    -7,    -7,    -7,    -7,    -8,    -8,    -8,    -8,    -8,    -8,
-	-8,    -9,    -9,    -9,    -9,    -9,    -9,    -9,    -10,   -10,   -10,   -10,   -10,   -11,   -11,   -11,
-	-11,   -11,   -12,   -12,   -12,   -12,   -13,   -13,   -13,   -14,   -14,   -14,   -15,   -15,   -15,   -15,
-	-16,   -16,   -17,   -17,   -17,   -18,   -18,   -18,   -19,   -19,   -20,   -21,   -21,   -22,   -22,   -23,
-	-23,   -24,   -25,   -26,   -26,   -27,   -28,   -29,   -30,   -31,   -32,   -33,   -34,   -35,   -36,   -37,
-	-39,   -40,   -42,   -43,   -45,   -47,   -49,   -51,   -53,   -55,   -58,   -60,   -63,   -66,   -69,   -73,
-	-76,   -80,   -85,   -89,   -95,   -100,  -106,  -113,  -119,  -128,  -136,  -146,  -156,  -168,  -182,  -196,
-	-213,  -232,  -254,  -279,  -307,  -340,  -380,  -425,  -480,  -545,  -626,  -724,  -847,  -1003, -1205, -1471,
-	-1830, -2324, -3015, -3993, -5335, -6956, -8229, -8071, -6850, -6189, -6162, -6585, -7102, -7774, -8441, -9243,
-	0,
-};
-const int32_t aptXHD_q9incr24[257] = {
-	0,   -22, -21, -21, -20, -20, -19, -19, -18, -18, -17, -17, -16, -16, -15, -14, -14, -13, -13, -12, -12, -11,
-	-11, -10, -10, -9,  -9,  -8,  -7,  -7,  -6,  -6,  -5,  -5,  -4,  -4,  -3,  -3,  -2,  -1,  -1,  0,   0,   1,
-	1,   2,   2,   3,   4,   4,   5,   5,   6,   6,   7,   8,   8,   9,   9,   10,  11,  11,  12,  12,  13,  14,
-	14,  15,  15,  16,  17,  17,  18,  19,  19,  20,  20,  21,  22,  22,  23,  24,  24,  25,  26,  26,  27,  28,
-	28,  29,  30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  38,  39,  40,  41,  41,  42,  43,  44,
-	44,  45,  46,  47,  48,  48,  49,  50,  51,  52,  52,  53,  54,  55,  56,  57,  58,  58,  59,  60,  61,  62,
-	63,  64,  65,  66,  67,  68,  69,  69,  70,  71,  72,  73,  74,  75,  77,  78,  79,  80,  81,  82,  83,  84,
-	85,  86,  87,  89,  90,  91,  92,  93,  94,  96,  97,  98,  99,  101, 102, 103, 105, 106, 107, 109, 110, 112,
-	113, 115, 116, 118, 119, 121, 122, 124, 125, 127, 129, 130, 132, 134, 136, 137, 139, 141, 143, 145, 147, 149,
-	151, 153, 155, 158, 160, 162, 164, 167, 169, 172, 174, 177, 180, 182, 185, 188, 191, 194, 197, 201, 204, 208,
-	211, 215, 219, 223, 227, 232, 236, 241, 246, 251, 257, 263, 269, 275, 283, 290, 298, 307, 317, 327, 339, 352,
-	367, 384, 404, 429, 458, 494, 522, 522, 522, 522, 522, 522, 522, 522, 522,
-};
+/*
+ * Quantization tables with one X(sl1, sf1, mLamb, incr) entry per level,
+ * i.e. bit24_sl1, dith24_sf1, mLamb24 and incr24 coefficients of that level.
+ * Both layouts are generated from them: column tables, which are referenced
+ * by the encoder state and used by the quantization level search, and row
+ * tables used by the quantizer and the inverter, so a single lookup brings
+ * in all coefficients of the given level (4 levels per cache line).
+ */
 
-const int32_t aptXHD_dq6bit24_sl1[33] = {
-	-21236,  21236,   63830,   106798,  150386,  194832,  240376,  287258,  335726,  386034,  438460,
-	493308,  550924,  611696,  676082,  744626,  817986,  896968,  982580,  1076118, 1179278, 1294344,
-	1424504, 1574386, 1751090, 1966260, 2240868, 2617662, 3196432, 4176450, 5658260, 7671068, 10380372,
-};
-const int32_t aptXHD_dq6dith24_sf1[33] = {
-	21236, 21236, 21360, 21608,  21978,  22468,  23076,  23806,  24660,  25648,   26778,
-	28070, 29544, 31228, 33158,  35386,  37974,  41008,  44606,  48934,  54226,   60840,
-	69320, 80564, 96140, 119032, 155576, 221218, 357552, 622468, 859344, 1153464, 1555840,
-};
-const int32_t aptXHD_dq6mLamb24[33] = {
-	0,     -31,   -62,   -93,   -123,   -152,   -183,   -214,   -247,   -283,    -323,
-	-369,  -421,  -483,  -557,  -647,   -759,   -900,   -1082,  -1323,  -1654,   -2120,
-	-2811, -3894, -5723, -9136, -16411, -34084, -66229, -59219, -73530, -100594, 0,
-};
-const int32_t aptXHD_q6incr24[33] = {
-	0,  -21, -16, -12, -7,  -2,  3,   8,   13,  19,  24,  30,  36,  43,  50,  57,  65,
-	74, 83,  93,  104, 117, 131, 147, 166, 189, 219, 259, 322, 427, 521, 521, 521,
-};
+#define APTXHD_COLUMN_SL1(sl1, sf1, mLamb, incr) sl1,
+#define APTXHD_COLUMN_SF1(sl1, sf1, mLamb, incr) sf1,
+#define APTXHD_COLUMN_MLAMB(sl1, sf1, mLamb, incr) mLamb,
+#define APTXHD_COLUMN_INCR(sl1, sf1, mLamb, incr) incr,
+#define APTXHD_ROW(sl1, sf1, mLamb, incr) { sl1, sf1, mLamb, incr },
 
-const int32_t aptXHD_dq5bit24_sl1[17] = {
-	-45754,  45754,   138496,  234896,  337336,  448310,  570738,  708380,  866534,
-	1053262, 1281958, 1577438, 1993050, 2665984, 3900982, 5902844, 8897462,
-};
-const int32_t aptXHD_dq5dith24_sf1[17] = {
-	45754,  45754,  46988,  49412,  53026,  57950,  64478,   73164,   84988,
-	101740, 126958, 168522, 247092, 425842, 809154, 1192708, 1801910,
-};
-const int32_t aptXHD_dq5mLamb24[17] = {
-	0, -309, -606, -904, -1231, -1632, -2172, -2956, -4188, -6305, -10391, -19643, -44688, -95828, -95889, -152301, 0,
-};
-const int32_t aptXHD_q5incr24[17] = {
-	0, -18, -8, 2, 13, 25, 38, 53, 70, 90, 115, 147, 192, 264, 398, 521, 521,
-};
+#define APTXHD_Q9_TABLE(X)          \
+	X(   -2436,   2436,     0,   0) \
+	X(    2436,   2436,     0, -22) \
+	X(    7308,   2436,     0, -21) \
+	X(   12180,   2436,    -1, -21) \
+	X(   17054,   2438,     0, -20) \
+	X(   21930,   2438,     0, -20) \
+	X(   26806,   2438,    -1, -19) \
+	X(   31686,   2440,    -1, -19) \
+	X(   36566,   2442,     0, -18) \
+	X(   41450,   2442,    -1, -18) \
+	X(   46338,   2444,    -1, -17) \
+	X(   51230,   2446,    -1, -17) \
+	X(   56124,   2448,    -1, -16) \
+	X(   61024,   2450,    -1, -16) \
+	X(   65928,   2454,    -1, -15) \
+	X(   70836,   2456,    -1, -14) \
+	X(   75750,   2458,    -1, -14) \
+	X(   80670,   2462,    -1, -13) \
+	X(   85598,   2464,    -1, -13) \
+	X(   90530,   2468,    -1, -12) \
+	X(   95470,   2472,    -1, -12) \
+	X(  100418,   2476,    -1, -11) \
+	X(  105372,   2480,    -1, -11) \
+	X(  110336,   2484,    -1, -10) \
+	X(  115308,   2488,    -1, -10) \
+	X(  120288,   2492,    -2,  -9) \
+	X(  125278,   2498,    -1,  -9) \
+	X(  130276,   2502,    -1,  -8) \
+	X(  135286,   2506,    -2,  -7) \
+	X(  140304,   2512,    -2,  -7) \
+	X(  145334,   2518,    -2,  -6) \
+	X(  150374,   2524,    -1,  -6) \
+	X(  155426,   2528,    -2,  -5) \
+	X(  160490,   2534,    -2,  -5) \
+	X(  165566,   2540,    -2,  -4) \
+	X(  170654,   2548,    -2,  -4) \
+	X(  175756,   2554,    -2,  -3) \
+	X(  180870,   2560,    -2,  -3) \
+	X(  185998,   2568,    -2,  -2) \
+	X(  191138,   2574,    -2,  -1) \
+	X(  196294,   2582,    -2,  -1) \
+	X(  201466,   2588,    -2,   0) \
+	X(  206650,   2596,    -2,   0) \
+	X(  211850,   2604,    -2,   1) \
+	X(  217068,   2612,    -2,   1) \
+	X(  222300,   2620,    -2,   2) \
+	X(  227548,   2628,    -2,   2) \
+	X(  232814,   2636,    -3,   3) \
+	X(  238096,   2646,    -2,   4) \
+	X(  243396,   2654,    -3,   4) \
+	X(  248714,   2664,    -2,   5) \
+	X(  254050,   2672,    -3,   5) \
+	X(  259406,   2682,    -3,   6) \
+	X(  264778,   2692,    -3,   6) \
+	X(  270172,   2702,    -3,   7) \
+	X(  275584,   2712,    -3,   8) \
+	X(  281018,   2722,    -3,   8) \
+	X(  286470,   2732,    -3,   9) \
+	X(  291944,   2742,    -3,   9) \
+	X(  297440,   2752,    -3,  10) \
+	X(  302956,   2764,    -3,  11) \
+	X(  308496,   2774,    -3,  11) \
+	X(  314056,   2786,    -3,  12) \
+	X(  319640,   2798,    -3,  12) \
+	X(  325248,   2810,    -3,  13) \
+	X(  330878,   2822,    -3,  14) \
+	X(  336532,   2834,    -3,  14) \
+	X(  342212,   2846,    -3,  15) \
+	X(  347916,   2858,    -3,  15) \
+	X(  353644,   2870,    -4,  16) \
+	X(  359398,   2884,    -3,  17) \
+	X(  365178,   2896,    -4,  17) \
+	X(  370986,   2910,    -4,  18) \
+	X(  376820,   2924,    -4,  19) \
+	X(  382680,   2938,    -4,  19) \
+	X(  388568,   2952,    -4,  20) \
+	X(  394486,   2966,    -4,  20) \
+	X(  400430,   2980,    -4,  21) \
+	X(  406404,   2994,    -4,  22) \
+	X(  412408,   3010,    -4,  22) \
+	X(  418442,   3024,    -4,  23) \
+	X(  424506,   3040,    -4,  24) \
+	X(  430600,   3056,    -4,  24) \
+	X(  436726,   3070,    -4,  25) \
+	X(  442884,   3086,    -5,  26) \
+	X(  449074,   3104,    -4,  26) \
+	X(  455298,   3120,    -4,  27) \
+	X(  461554,   3136,    -5,  28) \
+	X(  467844,   3154,    -4,  28) \
+	X(  474168,   3170,    -5,  29) \
+	X(  480528,   3188,    -5,  30) \
+	X(  486922,   3206,    -5,  30) \
+	X(  493354,   3224,    -5,  31) \
+	X(  499820,   3242,    -5,  32) \
+	X(  506324,   3262,    -5,  33) \
+	X(  512866,   3280,    -5,  33) \
+	X(  519446,   3300,    -5,  34) \
+	X(  526064,   3320,    -5,  35) \
+	X(  532722,   3338,    -6,  35) \
+	X(  539420,   3360,    -5,  36) \
+	X(  546160,   3380,    -5,  37) \
+	X(  552940,   3400,    -6,  38) \
+	X(  559760,   3422,    -5,  38) \
+	X(  566624,   3442,    -6,  39) \
+	X(  573532,   3464,    -6,  40) \
+	X(  580482,   3486,    -6,  41) \
+	X(  587478,   3508,    -6,  41) \
+	X(  594520,   3532,    -6,  42) \
+	X(  601606,   3554,    -6,  43) \
+	X(  608740,   3578,    -6,  44) \
+	X(  615920,   3602,    -6,  44) \
+	X(  623148,   3626,    -7,  45) \
+	X(  630426,   3652,    -6,  46) \
+	X(  637754,   3676,    -7,  47) \
+	X(  645132,   3702,    -7,  48) \
+	X(  652560,   3728,    -7,  48) \
+	X(  660042,   3754,    -7,  49) \
+	X(  667576,   3780,    -7,  50) \
+	X(  675164,   3808,    -7,  51) \
+	X(  682808,   3836,    -7,  52) \
+	X(  690506,   3864,    -7,  52) \
+	X(  698262,   3892,    -7,  53) \
+	X(  706074,   3920,    -8,  54) \
+	X(  713946,   3950,    -8,  55) \
+	X(  721876,   3980,    -8,  56) \
+	X(  729868,   4010,    -8,  57) \
+	X(  737920,   4042,    -8,  58) \
+	X(  746036,   4074,    -8,  58) \
+	X(  754216,   4106,    -8,  59) \
+	X(  762460,   4138,    -9,  60) \
+	X(  770770,   4172,    -9,  61) \
+	X(  779148,   4206,    -9,  62) \
+	X(  787594,   4240,    -9,  63) \
+	X(  796108,   4276,    -9,  64) \
+	X(  804694,   4312,    -9,  65) \
+	X(  813354,   4348,    -9,  66) \
+	X(  822086,   4384,   -10,  67) \
+	X(  830892,   4422,   -10,  68) \
+	X(  839774,   4460,   -10,  69) \
+	X(  848736,   4500,   -10,  69) \
+	X(  857776,   4540,   -10,  70) \
+	X(  866896,   4580,   -11,  71) \
+	X(  876100,   4622,   -11,  72) \
+	X(  885386,   4664,   -11,  73) \
+	X(  894758,   4708,   -11,  74) \
+	X(  904218,   4752,   -11,  75) \
+	X(  913766,   4796,   -12,  77) \
+	X(  923406,   4842,   -12,  78) \
+	X(  933138,   4890,   -12,  79) \
+	X(  942964,   4938,   -12,  80) \
+	X(  952886,   4986,   -13,  81) \
+	X(  962908,   5036,   -13,  82) \
+	X(  973030,   5086,   -13,  83) \
+	X(  983254,   5138,   -14,  84) \
+	X(  993582,   5192,   -14,  85) \
+	X( 1004020,   5246,   -14,  86) \
+	X( 1014566,   5300,   -15,  87) \
+	X( 1025224,   5358,   -15,  89) \
+	X( 1035996,   5416,   -15,  90) \
+	X( 1046886,   5474,   -15,  91) \
+	X( 1057894,   5534,   -16,  92) \
+	X( 1069026,   5596,   -16,  93) \
+	X( 1080284,   5660,   -17,  94) \
+	X( 1091670,   5726,   -17,  96) \
+	X( 1103186,   5792,   -17,  97) \
+	X( 1114838,   5860,   -18,  98) \
+	X( 1126628,   5930,   -18,  99) \
+	X( 1138558,   6002,   -18, 101) \
+	X( 1150634,   6074,   -19, 102) \
+	X( 1162858,   6150,   -19, 103) \
+	X( 1175236,   6226,   -20, 105) \
+	X( 1187768,   6306,   -21, 106) \
+	X( 1200462,   6388,   -21, 107) \
+	X( 1213320,   6470,   -22, 109) \
+	X( 1226346,   6556,   -22, 110) \
+	X( 1239548,   6644,   -23, 112) \
+	X( 1252928,   6736,   -23, 113) \
+	X( 1266490,   6828,   -24, 115) \
+	X( 1280242,   6924,   -25, 116) \
+	X( 1294188,   7022,   -26, 118) \
+	X( 1308334,   7124,   -26, 119) \
+	X( 1322688,   7228,   -27, 121) \
+	X( 1337252,   7336,   -28, 122) \
+	X( 1352034,   7448,   -29, 124) \
+	X( 1367044,   7562,   -30, 125) \
+	X( 1382284,   7680,   -31, 127) \
+	X( 1397766,   7802,   -32, 129) \
+	X( 1413494,   7928,   -33, 130) \
+	X( 1429478,   8058,   -34, 132) \
+	X( 1445728,   8192,   -35, 134) \
+	X( 1462252,   8332,   -36, 136) \
+	X( 1479058,   8476,   -37, 137) \
+	X( 1496158,   8624,   -39, 139) \
+	X( 1513562,   8780,   -40, 141) \
+	X( 1531280,   8940,   -42, 143) \
+	X( 1549326,   9106,   -43, 145) \
+	X( 1567710,   9278,   -45, 147) \
+	X( 1586446,   9458,   -47, 149) \
+	X( 1605550,   9644,   -49, 151) \
+	X( 1625034,   9840,   -51, 153) \
+	X( 1644914,  10042,   -53, 155) \
+	X( 1665208,  10252,   -55, 158) \
+	X( 1685932,  10472,   -58, 160) \
+	X( 1707108,  10702,   -60, 162) \
+	X( 1728754,  10942,   -63, 164) \
+	X( 1750890,  11194,   -66, 167) \
+	X( 1773542,  11458,   -69, 169) \
+	X( 1796732,  11734,   -73, 172) \
+	X( 1820488,  12024,   -76, 174) \
+	X( 1844840,  12328,   -80, 177) \
+	X( 1869816,  12648,   -85, 180) \
+	X( 1895452,  12986,   -89, 182) \
+	X( 1921780,  13342,   -95, 185) \
+	X( 1948842,  13720,  -100, 188) \
+	X( 1976680,  14118,  -106, 191) \
+	X( 2005338,  14540,  -113, 194) \
+	X( 2034868,  14990,  -119, 197) \
+	X( 2065322,  15466,  -128, 201) \
+	X( 2096766,  15976,  -136, 204) \
+	X( 2129260,  16520,  -146, 208) \
+	X( 2162880,  17102,  -156, 211) \
+	X( 2197708,  17726,  -168, 215) \
+	X( 2233832,  18398,  -182, 219) \
+	X( 2271352,  19124,  -196, 223) \
+	X( 2310384,  19908,  -213, 227) \
+	X( 2351050,  20760,  -232, 232) \
+	X( 2393498,  21688,  -254, 236) \
+	X( 2437886,  22702,  -279, 241) \
+	X( 2484404,  23816,  -307, 246) \
+	X( 2533262,  25044,  -340, 251) \
+	X( 2584710,  26404,  -380, 257) \
+	X( 2639036,  27922,  -425, 263) \
+	X( 2696578,  29622,  -480, 269) \
+	X( 2757738,  31540,  -545, 275) \
+	X( 2822998,  33720,  -626, 283) \
+	X( 2892940,  36222,  -724, 290) \
+	X( 2968278,  39116,  -847, 298) \
+	X( 3049896,  42502, -1003, 307) \
+	X( 3138912,  46514, -1205, 317) \
+	X( 3236760,  51334, -1471, 327) \
+	X( 3345312,  57218, -1830, 339) \
+	X( 3467068,  64536, -2324, 352) \
+	X( 3605434,  73830, -3015, 367) \
+	X( 3765154,  85890, -3993, 384) \
+	X( 3952904, 101860, -5335, 404) \
+	X( 4177962, 123198, -6956, 429) \
+	X( 4452178, 151020, -8229, 458) \
+	X( 4787134, 183936, -8071, 494) \
+	X( 5187290, 216220, -6850, 522) \
+	X( 5647128, 243618, -6189, 522) \
+	X( 6159120, 268374, -6162, 522) \
+	X( 6720518, 293022, -6585, 522) \
+	X( 7332904, 319362, -7102, 522) \
+	X( 8000032, 347768, -7774, 522) \
+	X( 8726664, 378864, -8441, 522) \
+	X( 9518152, 412626, -9243, 522) \
+	X(10380372, 449596,     0, 522)
 
-const int32_t aptXHD_dq4bit24_sl1[9] = {
-	-95044, 95044, 295844, 528780, 821332, 1226438, 1890540, 3344850, 6450664,
-};
-const int32_t aptXHD_dq4dith24_sf1[9] = {
-	95044, 95044, 105754, 127180, 165372, 39736, 424366, 1029946, 2075866,
-};
-const int32_t aptXHD_dq4mLamb24[9] = {
-	0, -2678, -5357, -9548, 31409, -96158, -151395, -261480, 0,
-};
-const int32_t aptXHD_q4incr24[9] = {
-	0, -17, 5, 30, 62, 105, 177, 334, 518,
-};
+const int32_t aptXHD_dq9bit24_sl1[257] = { APTXHD_Q9_TABLE(APTXHD_COLUMN_SL1) };
+const int32_t aptXHD_dq9dith24_sf1[257] = { APTXHD_Q9_TABLE(APTXHD_COLUMN_SF1) };
+const int32_t aptXHD_dq9mLamb24[257] = { APTXHD_Q9_TABLE(APTXHD_COLUMN_MLAMB) };
+const int32_t aptXHD_q9incr24[257] = { APTXHD_Q9_TABLE(APTXHD_COLUMN_INCR) };
+const aptXHD_quantizer_row_100 aptXHD_q9rows24[257] __attribute__((aligned(64))) = { APTXHD_Q9_TABLE(APTXHD_ROW) };
+
+#define APTXHD_Q6_TABLE(X)             \
+	X(  -21236,   21236,       0,   0) \
+	X(   21236,   21236,     -31, -21) \
+	X(   63830,   21360,     -62, -16) \
+	X(  106798,   21608,     -93, -12) \
+	X(  150386,   21978,    -123,  -7) \
+	X(  194832,   22468,    -152,  -2) \
+	X(  240376,   23076,    -183,   3) \
+	X(  287258,   23806,    -214,   8) \
+	X(  335726,   24660,    -247,  13) \
+	X(  386034,   25648,    -283,  19) \
+	X(  438460,   26778,    -323,  24) \
+	X(  493308,   28070,    -369,  30) \
+	X(  550924,   29544,    -421,  36) \
+	X(  611696,   31228,    -483,  43) \
+	X(  676082,   33158,    -557,  50) \
+	X(  744626,   35386,    -647,  57) \
+	X(  817986,   37974,    -759,  65) \
+	X(  896968,   41008,    -900,  74) \
+	X(  982580,   44606,   -1082,  83) \
+	X( 1076118,   48934,   -1323,  93) \
+	X( 1179278,   54226,   -1654, 104) \
+	X( 1294344,   60840,   -2120, 117) \
+	X( 1424504,   69320,   -2811, 131) \
+	X( 1574386,   80564,   -3894, 147) \
+	X( 1751090,   96140,   -5723, 166) \
+	X( 1966260,  119032,   -9136, 189) \
+	X( 2240868,  155576,  -16411, 219) \
+	X( 2617662,  221218,  -34084, 259) \
+	X( 3196432,  357552,  -66229, 322) \
+	X( 4176450,  622468,  -59219, 427) \
+	X( 5658260,  859344,  -73530, 521) \
+	X( 7671068, 1153464, -100594, 521) \
+	X(10380372, 1555840,       0, 521)
+
+const int32_t aptXHD_dq6bit24_sl1[33] = { APTXHD_Q6_TABLE(APTXHD_COLUMN_SL1) };
+const int32_t aptXHD_dq6dith24_sf1[33] = { APTXHD_Q6_TABLE(APTXHD_COLUMN_SF1) };
+const int32_t aptXHD_dq6mLamb24[33] = { APTXHD_Q6_TABLE(APTXHD_COLUMN_MLAMB) };
+const int32_t aptXHD_q6incr24[33] = { APTXHD_Q6_TABLE(APTXHD_COLUMN_INCR) };
+const aptXHD_quantizer_row_100 aptXHD_q6rows24[33] __attribute__((aligned(64))) = { APTXHD_Q6_TABLE(APTXHD_ROW) };
+
+#define APTXHD_Q5_TABLE(X)            \
+	X( -45754,   45754,       0,   0) \
+	X(  45754,   45754,    -309, -18) \
+	X( 138496,   46988,    -606,  -8) \
+	X( 234896,   49412,    -904,   2) \
+	X( 337336,   53026,   -1231,  13) \
+	X( 448310,   57950,   -1632,  25) \
+	X( 570738,   64478,   -2172,  38) \
+	X( 708380,   73164,   -2956,  53) \
+	X( 866534,   84988,   -4188,  70) \
+	X(1053262,  101740,   -6305,  90) \
+	X(1281958,  126958,  -10391, 115) \
+	X(1577438,  168522,  -19643, 147) \
+	X(1993050,  247092,  -44688, 192) \
+	X(2665984,  425842,  -95828, 264) \
+	X(3900982,  809154,  -95889, 398) \
+	X(5902844, 1192708, -152301, 521) \
+	X(8897462, 1801910,       0, 521)
+
+const int32_t aptXHD_dq5bit24_sl1[17] = { APTXHD_Q5_TABLE(APTXHD_COLUMN_SL1) };
+const int32_t aptXHD_dq5dith24_sf1[17] = { APTXHD_Q5_TABLE(APTXHD_COLUMN_SF1) };
+const int32_t aptXHD_dq5mLamb24[17] = { APTXHD_Q5_TABLE(APTXHD_COLUMN_MLAMB) };
+const int32_t aptXHD_q5incr24[17] = { APTXHD_Q5_TABLE(APTXHD_COLUMN_INCR) };
+const aptXHD_quantizer_row_100 aptXHD_q5rows24[17] __attribute__((aligned(64))) = { APTXHD_Q5_TABLE(APTXHD_ROW) };
+
+#define APTXHD_Q4_TABLE(X)            \
+	X( -95044,   95044,       0,   0) \
+	X(  95044,   95044,   -2678, -17) \
+	X( 295844,  105754,   -5357,   5) \
+	X( 528780,  127180,   -9548,  30) \
+	X( 821332,  165372,   31409,  62) \
+	X(1226438,   39736,  -96158, 105) \
+	X(1890540,  424366, -151395, 177) \
+	X(3344850, 1029946, -261480, 334) \
+	X(6450664, 2075866,       0, 518)
+
+const int32_t aptXHD_dq4bit24_sl1[9] = { APTXHD_Q4_TABLE(APTXHD_COLUMN_SL1) };
+const int32_t aptXHD_dq4dith24_sf1[9] = { APTXHD_Q4_TABLE(APTXHD_COLUMN_SF1) };
+const int32_t aptXHD_dq4mLamb24[9] = { APTXHD_Q4_TABLE(APTXHD_COLUMN_MLAMB) };
+const int32_t aptXHD_q4incr24[9] = { APTXHD_Q4_TABLE(APTXHD_COLUMN_INCR) };
+const aptXHD_quantizer_row_100 aptXHD_q4rows24[9] __attribute__((aligned(64))) = { APTXHD_Q4_TABLE(APTXHD_ROW) };
 
 const aptXHD_subband_params_100 aptXHD_params_100[] = {
 	[APTXHD_SUBBAND_LL] = { NULL, aptXHD_dq9bit24_sl1, NULL, aptXHD_dq9dith24_sf1, aptXHD_dq9mLamb24, aptXHD_q9incr24,
@@ -13,6 +13,15 @@
 
 #include "aptxHD100.h"
 
+/**
+ * Quantizer and inverter coefficients of a single quantization level. */
+typedef struct aptXHD_quantizer_row_100_t {
+	int32_t bit24_sl1;
+	int32_t dith24_sf1;
+	int32_t mLamb24;
+	int32_t incr24;
+} aptXHD_quantizer_row_100;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,24 +35,45 @@ extern const int32_t aptXHD_dq9bit24_sl1[257];
 extern const int32_t aptXHD_dq9dith24_sf1[257];
 extern const int32_t aptXHD_dq9mLamb24[257];
 extern const int32_t aptXHD_q9incr24[257];
+extern const aptXHD_quantizer_row_100 aptXHD_q9rows24[257];
 
 extern const int32_t aptXHD_dq6bit24_sl1[33];
 extern const int32_t aptXHD_dq6dith24_sf1[33];
 extern const int32_t aptXHD_dq6mLamb24[33];
 extern const int32_t aptXHD_q6incr24[33];
+extern const aptXHD_quantizer_row_100 aptXHD_q6rows24[33];
 
 extern const int32_t aptXHD_dq5bit24_sl1[17];
 extern const int32_t aptXHD_dq5dith24_sf1[17];
 extern const int32_t aptXHD_dq5mLamb24[17];
 extern const int32_t aptXHD_q5incr24[17];
+extern const aptXHD_quantizer_row_100 aptXHD_q5rows24[17];
 
 extern const int32_t aptXHD_dq4bit24_sl1[9];
 extern const int32_t aptXHD_dq4dith24_sf1[9];
 extern const int32_t aptXHD_dq4mLamb24[9];
 extern const int32_t aptXHD_q4incr24[9];
+extern const aptXHD_quantizer_row_100 aptXHD_q4rows24[9];
 
 extern const aptXHD_subband_params_100 aptXHD_params_100[APTXHD_SUBBANDS];
 
+/**
+ * Get the row table for the column table referenced by the encoder state.
+ *
+ * NULL is returned for tables which are not ours, e.g. when the state was
+ * initialized by the vendor library. */
+static inline const aptXHD_quantizer_row_100 * aptXHD_quantizer_rows(const int32_t * sl1) {
+	if (sl1 == aptXHD_dq9bit24_sl1)
+		return aptXHD_q9rows24;
+	if (sl1 == aptXHD_dq6bit24_sl1)
+		return aptXHD_q6rows24;
+	if (sl1 == aptXHD_dq5bit24_sl1)
+		return aptXHD_q5rows24;
+	if (sl1 == aptXHD_dq4bit24_sl1)
+		return aptXHD_q4rows24;
+	return NULL;
+}
+
 #ifdef __cplusplus
 }
 #endif
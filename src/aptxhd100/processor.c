@@ -11,19 +11,30 @@
 #include "processor.h"
 
 #include "mathex.h"
+#include "params.h"
 
 void aptXHD_invert_quantization(int32_t a, int32_t dither, aptXHD_inverter_100 * i) {
 
 	size_t i_ = (a < 0 ? ~a : a) + 1;
-	int32_t sl1 = (a < 0 ? -1 : 1) * i->subband_param_bit16_sl1[i_];
+	const aptXHD_quantizer_row_100 * rows = aptXHD_quantizer_rows(i->subband_param_bit16_sl1);
+	aptXHD_quantizer_row_100 row;
+	if (rows != NULL) {
+		row = rows[i_];
+	} else {
+		row.bit24_sl1 = i->subband_param_bit16_sl1[i_];
+		row.dith24_sf1 = i->subband_param_dith16_sf1[i_];
+		row.incr24 = i->subband_param_incr16[i_];
+	}
+
+	int32_t sl1 = (a < 0 ? -1 : 1) * row.bit24_sl1;
 
-	int64_t tmp = (int64_t)dither * i->subband_param_dith16_sf1[i_];
+	int64_t tmp = (int64_t)dither * row.dith24_sf1;
 	tmp = rshift32(((int64_t)sl1 << 31) + tmp);
 	clamp_int24_t(tmp);
-	i->unk11 = (tmp * i->unk9) >> 19;
+	i->unk11 = mul32x32(tmp, i->unk9) >> 19;
 	clamp_int24_t(i->unk11);
 
-	i->unk10 = rshift15(32620 * i->unk10 + (i->subband_param_incr16[i_] << 15));
+	i->unk10 = rshift15(32620 * i->unk10 + (row.incr24 << 15));
 	clip_range(i->unk10, 0, i->subband_param_unk1);
 
 	int shift = -3 - i->subband_param_unk2 - (i->unk10 >> 8);
@@ -60,7 +71,7 @@ void aptXHD_prediction_filtering(int32_t a, aptXHD_prediction_filter_100 * f) {
 			tmp = v1 - f->arr1[i];
 
 		f->arr1[i] += (tmp >> 8) - (((uint32_t)tmp) << 23 == 0x80000000);
-		sum += c * f->arr1[i];
+		sum += mul32x32(c, f->arr1[i]);
 		c = f->arr2[q];
 	}
 
@@ -11,18 +11,22 @@
 #include "quantizer.h"
 
 #include "mathex.h"
+#include "params.h"
 #include "search.h"
 
-static void aptXHD_quantize_difference(int32_t diff, int32_t dither, int32_t quant, aptXHD_quantizer_100 * q) {
+static void aptXHD_quantize_difference(int32_t diff, int32_t dither, int32_t quant,
+                                       const aptXHD_quantizer_row_100 * rows, aptXHD_quantizer_100 * q) {
 
-	int32_t sl1_0 = q->subband_param_bit16_sl1[q->unk1];
-	int32_t sl1_1 = q->subband_param_bit16_sl1[q->unk1 + 1];
+	/* rows of the adjacent levels are in the same or next cache line */
+	const aptXHD_quantizer_row_100 * row = &rows[q->unk1];
+	int32_t sl1_0 = row[0].bit24_sl1;
+	int32_t sl1_1 = row[1].bit24_sl1;
 	int32_t sl1_d = (sl1_1 - sl1_0) * (diff < 0 ? -1 : 1);
 
 	int32_t dt2 = rshift32(((int64_t)dither * dither) >> 7);
 	clamp_int24_t(dt2);
 
-	int32_t v1 = rshift23((int64_t)(0x800000 - dt2) * q->subband_param_mLamb16[q->unk1]);
+	int32_t v1 = rshift23(mul32x32(0x800000 - dt2, row[0].mLamb24));
 	int32_t v2 = rshift32((int64_t)dither * sl1_d) + ((sl1_0 + sl1_1) >> 1) + v1;
 	clamp_int24_t(v2);
 
@@ -51,26 +55,26 @@ void aptXHD_quantize_difference_LL(int32_t diff, int32_t dither, int32_t x, aptX
 	int absdiff = abs32(diff);
 	clamp_int24_t(absdiff);
 	q->unk1 = aptXHD_search_LL(absdiff >> 4, x, q->subband_param_bit16_sl1);
-	aptXHD_quantize_difference(diff, dither, x, q);
+	aptXHD_quantize_difference(diff, dither, x, aptXHD_q9rows24, q);
 }
 
 void aptXHD_quantize_difference_LH(int32_t diff, int32_t dither, int32_t x, aptXHD_quantizer_100 * q) {
 	int absdiff = abs32(diff);
 	clamp_int24_t(absdiff);
 	q->unk1 = aptXHD_search_LH(absdiff >> 4, x, q->subband_param_bit16_sl1);
-	aptXHD_quantize_difference(diff, dither, x, q);
+	aptXHD_quantize_difference(diff, dither, x, aptXHD_q6rows24, q);
 }
 
 void aptXHD_quantize_difference_HL(int32_t diff, int32_t dither, int32_t x, aptXHD_quantizer_100 * q) {
 	int absdiff = abs32(diff);
 	clamp_int24_t(absdiff);
 	q->unk1 = aptXHD_search_HL(absdiff >> 4, x, q->subband_param_bit16_sl1);
-	aptXHD_quantize_difference(diff, dither, x, q);
+	aptXHD_quantize_difference(diff, dither, x, aptXHD_q4rows24, q);
 }
 
 void aptXHD_quantize_difference_HH(int32_t diff, int32_t dither, int32_t x, aptXHD_quantizer_100 * q) {
 	int absdiff = abs32(diff);
 	clamp_int24_t(absdiff);
 	q->unk1 = aptXHD_search_HH(absdiff >> 4, x, q->subband_param_bit16_sl1);
-	aptXHD_quantize_difference(diff, dither, x, q);
+	aptXHD_quantize_difference(diff, dither, x, aptXHD_q5rows24, q);
 }
@@ -0,0 +1,127 @@
+/*
+ * [open]aptx - codeword.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_CODEWORD_H_
+#define OPENAPTX_CODEWORD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#	include <tmmintrin.h>
+#	define CODEWORD_X86 1
+#endif
+
+/*
+ * Conversion between codewords and the wire stream, in which codewords
+ * are stored from the most significant byte: 2 bytes per apt-X codeword
+ * and 3 bytes per apt-X HD codeword. Long runs are converted 8 codewords
+ * at a time with byte shuffles, the remainder with scalar code, so these
+ * functions can be used for a single block as well.
+ */
+
+#if CODEWORD_X86
+
+static inline void codeword_pack16_sse2(uint8_t * data, const uint16_t * code, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)&code[i]);
+		_mm_storeu_si128((__m128i *)&data[i * 2], _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+}
+
+static inline void codeword_unpack16_sse2(uint16_t * code, const uint8_t * data, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)&data[i * 2]);
+		_mm_storeu_si128((__m128i *)&code[i], _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+}
+
+__attribute__((target("ssse3"))) static inline void codeword_pack24_ssse3(uint8_t * data, const uint32_t * code,
+                                                                          size_t n) {
+
+	/* 8 codewords from two vectors go to 16 + 8 bytes of the stream */
+	const __m128i mask_a = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m128i mask_b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 1, 0, 6);
+	const __m128i mask_b2 = _mm_setr_epi8(5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1);
+
+	for (size_t i = 0; i < n; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)&code[i]);
+		const __m128i b = _mm_loadu_si128((const __m128i *)&code[i + 4]);
+		const __m128i lo = _mm_or_si128(_mm_shuffle_epi8(a, mask_a), _mm_shuffle_epi8(b, mask_b1));
+		_mm_storeu_si128((__m128i *)&data[i * 3], lo);
+		_mm_storel_epi64((__m128i *)&data[i * 3 + 16], _mm_shuffle_epi8(b, mask_b2));
+	}
+
+}
+
+__attribute__((target("ssse3"))) static inline void codeword_unpack24_ssse3(uint32_t * code, const uint8_t * data,
+                                                                            size_t n) {
+
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+
+	for (size_t i = 0; i < n; i += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)&data[i * 3]);
+		const __m128i y = _mm_loadl_epi64((const __m128i *)&data[i * 3 + 16]);
+		_mm_storeu_si128((__m128i *)&code[i], _mm_shuffle_epi8(x, mask));
+		_mm_storeu_si128((__m128i *)&code[i + 4], _mm_shuffle_epi8(_mm_alignr_epi8(y, x, 12), mask));
+	}
+
+}
+
+#endif
+
+/**
+ * Serialize apt-X codewords into the stream. */
+static inline void codeword_pack16(uint8_t * data, const uint16_t * code, size_t n) {
+	size_t i = 0;
+#if CODEWORD_X86
+	codeword_pack16_sse2(data, code, i = n & ~(size_t)7);
+#endif
+	for (data += i * 2; i < n; i++)
+		*data++ = code[i] >> 8, *data++ = code[i];
+}
+
+/**
+ * Deserialize apt-X codewords from the stream. */
+static inline void codeword_unpack16(uint16_t * code, const uint8_t * data, size_t n) {
+	size_t i = 0;
+#if CODEWORD_X86
+	codeword_unpack16_sse2(code, data, i = n & ~(size_t)7);
+#endif
+	for (data += i * 2; i < n; i++, data += 2)
+		code[i] = data[0] << 8 | data[1];
+}
+
+/**
+ * Serialize apt-X HD codewords (lower 24 bits) into the stream. */
+static inline void codeword_pack24(uint8_t * data, const uint32_t * code, size_t n) {
+	size_t i = 0;
+#if CODEWORD_X86
+	if (n >= 8 && __builtin_cpu_supports("ssse3"))
+		codeword_pack24_ssse3(data, code, i = n & ~(size_t)7);
+#endif
+	for (data += i * 3; i < n; i++)
+		*data++ = code[i] >> 16, *data++ = code[i] >> 8, *data++ = code[i];
+}
+
+/**
+ * Deserialize apt-X HD codewords from the stream. */
+static inline void codeword_unpack24(uint32_t * code, const uint8_t * data, size_t n) {
+	size_t i = 0;
+#if CODEWORD_X86
+	if (n >= 8 && __builtin_cpu_supports("ssse3"))
+		codeword_unpack24_ssse3(code, data, i = n & ~(size_t)7);
+#endif
+	for (data += i * 3; i < n; i++, data += 3)
+		code[i] = data[0] << 16 | data[1] << 8 | data[2];
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * [open]aptx - daemon.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_DAEMON_H_
+#define OPENAPTX_DAEMON_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "openaptx.h"
+
+/* Environment variable with the path of the daemon socket. */
+#define DAEMON_SOCKET_ENV "OPENAPTX_SOCKET"
+#define DAEMON_SOCKET_NAME "openaptx.sock"
+
+#define DAEMON_SHM_MAGIC 0x4F415054 /* "OAPT" */
+#define DAEMON_SHM_VERSION 1
+
+/* Limits for the ring capacities requested by clients. */
+#define DAEMON_RING_FRAMES_MIN 32
+#define DAEMON_RING_FRAMES_MAX (1024 * 1024)
+
+enum daemon_request_type {
+	/* Open new encoding stream. The request is sent with three file
+	 * descriptors: the shared memory (memfd), the eventfd used to notify
+	 * the daemon and the eventfd used to notify the client. */
+	DAEMON_REQUEST_OPEN = 1,
+	/* Get the statistics of all streams as a text. */
+	DAEMON_REQUEST_STATS,
+};
+
+struct daemon_request {
+	uint32_t type;
+	uint32_t codec;
+	int32_t endian;
+	/* capacity of the PCM ring in stereo frames (multiple of 4) */
+	uint32_t pcm_frames;
+};
+
+struct daemon_response {
+	/* 0 on success, errno value otherwise */
+	int32_t error;
+};
+
+/**
+ * Single-producer single-consumer ring indexes.
+ *
+ * Positions are monotonic counters. The ring capacity is not stored in
+ * the shared memory, so the daemon does not depend on values which can
+ * be modified by the client. */
+struct daemon_ring {
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+};
+
+struct daemon_stats {
+	/* encoded PCM frames */
+	_Atomic uint64_t frames;
+	/* time spent on encoding */
+	_Atomic uint64_t encode_ns;
+	/* maximum number of PCM frames waiting for encoding */
+	_Atomic uint64_t pcm_queued_max;
+};
+
+/**
+ * Shared memory layout.
+ *
+ * The header is followed by the PCM ring (interleaved stereo int32_t
+ * samples) and the codeword ring (stream serialized as by the encoder
+ * cache and fan-out). */
+struct daemon_shm {
+	uint32_t magic;
+	uint32_t version;
+	/* PCM ring in frames, written by the client */
+	struct daemon_ring pcm;
+	/* codeword ring in bytes, written by the daemon */
+	struct daemon_ring code;
+	struct daemon_stats stats;
+};
+
+/**
+ * Get the number of bytes of the codeword ring. */
+static inline size_t daemon_code_size(uint32_t codec, size_t pcm_frames) {
+	/* 2 bytes per apt-X codeword, 3 bytes per apt-X HD codeword */
+	return pcm_frames / 4 * 2 * (codec == OPENAPTX_CODEC_APTX_HD ? 3 : 2);
+}
+
+static inline size_t daemon_shm_size(uint32_t codec, size_t pcm_frames) {
+	return sizeof(struct daemon_shm) + pcm_frames * 2 * sizeof(int32_t) + daemon_code_size(codec, pcm_frames);
+}
+
+static inline int32_t * daemon_shm_pcm(struct daemon_shm * shm) {
+	return (int32_t *)&shm[1];
+}
+
+static inline uint8_t * daemon_shm_code(struct daemon_shm * shm, size_t pcm_frames) {
+	return (uint8_t *)&daemon_shm_pcm(shm)[pcm_frames * 2];
+}
+
+/**
+ * Get the default path of the daemon socket. */
+static inline void daemon_socket_path(char * path, size_t size) {
+	const char * tmp;
+	if ((tmp = getenv(DAEMON_SOCKET_ENV)) != NULL)
+		snprintf(path, size, "%s", tmp);
+	else if ((tmp = getenv("XDG_RUNTIME_DIR")) != NULL)
+		snprintf(path, size, "%s/" DAEMON_SOCKET_NAME, tmp);
+	else
+		snprintf(path, size, "/tmp/" DAEMON_SOCKET_NAME);
+}
+
+#endif
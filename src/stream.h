@@ -0,0 +1,106 @@
+/*
+ * [open]aptx - stream.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_STREAM_H_
+#define OPENAPTX_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "openaptx.h"
+
+#include "codeword.h"
+
+/**
+ * Get the number of bytes of a single codeword in the stream. */
+static inline size_t stream_codeword_size(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? 3 : 2;
+}
+
+/**
+ * Allocate and initialize encoder for a given codec variant. */
+static inline APTXENC stream_encoder_new(enum openaptx_codec codec, short endian) {
+
+	const bool hd = codec == OPENAPTX_CODEC_APTX_HD;
+	APTXENC enc;
+
+	if ((enc = malloc(hd ? SizeofAptxhdbtenc() : SizeofAptxbtenc())) == NULL)
+		return NULL;
+	if ((hd ? aptxhdbtenc_init(enc, endian) : aptxbtenc_init(enc, endian)) != 0) {
+		free(enc);
+		return NULL;
+	}
+
+	return enc;
+}
+
+/**
+ * Destroy and free encoder allocated with stream_encoder_new(). */
+static inline void stream_encoder_free(enum openaptx_codec codec, APTXENC enc) {
+	if (enc == NULL)
+		return;
+	if (codec == OPENAPTX_CODEC_APTX_HD && aptxhdbtenc_destroy != NULL)
+		aptxhdbtenc_destroy(enc);
+	if (codec == OPENAPTX_CODEC_APTX && aptxbtenc_destroy != NULL)
+		aptxbtenc_destroy(enc);
+	free(enc);
+}
+
+/* number of blocks encoded before codewords are serialized */
+#define STREAM_ENCODE_BLOCKS 64
+
+/**
+ * Encode interleaved stereo PCM into the stream.
+ *
+ * Codewords are serialized from the most significant byte. If the number of
+ * frames is not a multiple of 4, the last block is zero-padded.
+ *
+ * @return On success 0 is returned. Otherwise, -1 is returned. */
+static inline int stream_encode(enum openaptx_codec codec, APTXENC enc, const int32_t * pcm, size_t frames,
+                                uint8_t * data) {
+
+	const bool hd = codec == OPENAPTX_CODEC_APTX_HD;
+	uint32_t code24[STREAM_ENCODE_BLOCKS * 2];
+	uint16_t code16[STREAM_ENCODE_BLOCKS * 2];
+	int rv = 0;
+
+	for (size_t i = 0; i < frames && rv == 0;) {
+
+		size_t blocks;
+		for (blocks = 0; blocks < STREAM_ENCODE_BLOCKS && i < frames; blocks++, i += 4) {
+
+			int32_t pcmL[4] = { 0 }, pcmR[4] = { 0 };
+			for (size_t ii = 0; ii < 4 && i + ii < frames; ii++) {
+				pcmL[ii] = pcm[(i + ii) * 2 + 0];
+				pcmR[ii] = pcm[(i + ii) * 2 + 1];
+			}
+
+			if ((hd ? aptxhdbtenc_encodestereo(enc, pcmL, pcmR, &code24[blocks * 2]) :
+			          aptxbtenc_encodestereo(enc, pcmL, pcmR, &code16[blocks * 2])) != 0) {
+				rv = -1;
+				break;
+			}
+
+		}
+
+		if (hd)
+			codeword_pack24(data, code24, blocks * 2);
+		else
+			codeword_pack16(data, code16, blocks * 2);
+		data += blocks * 2 * stream_codeword_size(codec);
+
+	}
+
+	return rv;
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * [open]aptx - tracepoints.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_TRACEPOINTS_H_
+#define OPENAPTX_TRACEPOINTS_H_
+
+/**
+ * Static tracepoints (USDT) for the "openaptx" provider.
+ *
+ * When enabled, every tracepoint is compiled into a single nop instruction
+ * and a note in the ELF file, which can be attached with perf, bpftrace or
+ * SystemTap. Otherwise, tracepoints are compiled out completely.
+ *
+ * The aptx_sync and aptxhd_sync tracepoints are not fired at the sync
+ * insertion itself, which is a part of every encoding kernel, but at the end
+ * of the encoded block. Their argument is the sync state of the block, which
+ * is changed by the sync insertion only. */
+
+#if ENABLE_USDT
+#	include <sys/sdt.h>
+#	define OPENAPTX_TRACE1(name, a1) DTRACE_PROBE1(openaptx, name, a1)
+#	define OPENAPTX_TRACE2(name, a1, a2) DTRACE_PROBE2(openaptx, name, a1, a2)
+#	define OPENAPTX_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(openaptx, name, a1, a2, a3)
+#else
+#	define OPENAPTX_TRACE1(name, a1) ((void)0)
+#	define OPENAPTX_TRACE2(name, a1, a2) ((void)0)
+#	define OPENAPTX_TRACE3(name, a1, a2, a3) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * [open]aptx - transcode.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_TRANSCODE_PRIVATE_H_
+#define OPENAPTX_TRANSCODE_PRIVATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Subband interface of the reverse-engineered codec library.
+ *
+ * The decoder reuses the encoder state, because the inverse quantization
+ * and prediction state of the decoder is exactly the same as the state kept
+ * by the encoder for its own reconstruction. */
+struct transcode_codec {
+	/* size of the codec state */
+	size_t size;
+	/* number of bytes of a single serialized codeword */
+	size_t codeword_size;
+	void (*init)(void * state, short endian);
+	/* decode single block into subband samples of both channels */
+	void (*decode)(void * state, const uint8_t * data, int32_t subbands[2][4]);
+	/* encode subband samples of both channels into single block */
+	void (*encode_subbands)(void * state, const int32_t subbands[2][4], uint8_t * data);
+	/* encode 24-bit PCM samples of both channels into single block */
+	void (*encode_pcm)(void * state, const int32_t pcm[2][4], uint8_t * data);
+	/* number of bytes of the serialized decoder state */
+	size_t snapshot_size;
+	/* serialize the part of the state used by the decoder */
+	void (*snapshot)(const void * state, uint8_t * data);
+	/* restore the decoder state on top of the initialized state */
+	void (*restore)(void * state, const uint8_t * data);
+};
+
+/**
+ * Store 32-bit integer in the little-endian byte order. */
+static inline uint8_t * transcode_put_int32(uint8_t * data, int32_t v) {
+	const uint32_t u = v;
+	*data++ = u, *data++ = u >> 8, *data++ = u >> 16, *data++ = u >> 24;
+	return data;
+}
+
+/**
+ * Load 32-bit integer stored in the little-endian byte order. */
+static inline int32_t transcode_get_int32(const uint8_t ** data) {
+	const uint8_t * ptr = *data;
+	*data += 4;
+	return (int32_t)(ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+}
+
+extern const struct transcode_codec transcode_codec_aptx;
+extern const struct transcode_codec transcode_codec_aptxhd;
+
+struct transcode_qmf_signal {
+	int32_t buffer[32];
+	size_t pos;
+};
+
+/**
+ * QMF synthesis filter bank of a single channel. */
+struct transcode_qmf {
+	struct transcode_qmf_signal outer[2];
+	struct transcode_qmf_signal inner[2][2];
+};
+
+void transcode_qmf_synthesis(struct transcode_qmf * qmf, const int32_t subbands[4], int32_t pcm[4]);
+
+#define TRANSCODE_QMF_SNAPSHOT_SIZE (6 * (16 + 1) * 4)
+uint8_t * transcode_qmf_snapshot(const struct transcode_qmf * qmf, uint8_t * data);
+const uint8_t * transcode_qmf_restore(struct transcode_qmf * qmf, const uint8_t * data);
+
+#endif
@@ -0,0 +1,482 @@
+/*
+ * [open]aptx - wavfile.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_WAVFILE_H_
+#define OPENAPTX_WAVFILE_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Minimal reader and writer of stereo WAV and RF64 files used by the
+ * command line utilities.
+ *
+ * Input file is mapped into memory and samples are converted straight
+ * from the mapping into the planar 32-bit buffers consumed by the codec,
+ * so there is no intermediate copy and no per-sample library call. Output
+ * is converted into a large buffer which is written with a single write
+ * call. All samples are stored in the little-endian order regardless of
+ * the host endianness.
+ *
+ * Sample values on the codec side are signed integers with the given
+ * number of bits (16 for apt-X and 24 for apt-X HD, at most 32) stored
+ * on 4 bytes.
+ */
+
+enum wavfile_format {
+	WAVFILE_S16,
+	WAVFILE_S24,
+	WAVFILE_S32,
+	WAVFILE_F32,
+};
+
+/* Size of the output buffer in bytes. */
+#define WAVFILE_BUFFER_SIZE (256 * 1024)
+
+/* Size of the header written by the writer. */
+#define WAVFILE_HEADER_SIZE 80
+
+struct wavfile {
+	/* memory mapping of the whole file */
+	void * map;
+	size_t map_size;
+	/* true if file has RIFF/WAVE or RF64 header */
+	bool wave;
+	enum wavfile_format format;
+	unsigned int channels;
+	unsigned int rate;
+	/* interleaved samples */
+	const uint8_t * data;
+	size_t frames;
+};
+
+struct wavfile_writer {
+	int fd;
+	/* position of the header in the output or -1 if not seekable */
+	off_t offset;
+	enum wavfile_format format;
+	unsigned int rate;
+	/* number of PCM data bytes written so far */
+	uint64_t size;
+	/* true if the header was written */
+	bool header;
+	uint8_t * buffer;
+	size_t len;
+};
+
+static inline size_t wavfile_sample_size(enum wavfile_format format) {
+	static const size_t sizes[] = { 2, 3, 4, 4 };
+	return sizes[format];
+}
+
+static inline uint16_t wavfile_le16(const uint8_t * p) {
+	return p[0] | p[1] << 8;
+}
+
+static inline uint32_t wavfile_le32(const uint8_t * p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t wavfile_le64(const uint8_t * p) {
+	return wavfile_le32(p) | (uint64_t)wavfile_le32(p + 4) << 32;
+}
+
+static inline uint8_t * wavfile_put16(uint8_t * p, uint16_t v) {
+	p[0] = v, p[1] = v >> 8;
+	return p + 2;
+}
+
+static inline uint8_t * wavfile_put32(uint8_t * p, uint32_t v) {
+	p[0] = v, p[1] = v >> 8, p[2] = v >> 16, p[3] = v >> 24;
+	return p + 4;
+}
+
+static inline uint8_t * wavfile_put64(uint8_t * p, uint64_t v) {
+	return wavfile_put32(wavfile_put32(p, v), v >> 32);
+}
+
+/**
+ * Parse the RIFF/WAVE or RF64 header of the mapped file.
+ *
+ * @return On success, 0 is returned. Otherwise, -1 is returned and errno
+ *   is set to indicate the error. */
+static inline int wavfile_parse(struct wavfile * wf) {
+
+	const uint8_t * p = wf->map;
+	const uint8_t * end = p + wf->map_size;
+	const bool rf64 = memcmp(p, "RF64", 4) == 0;
+	uint64_t data_size64 = 0;
+	unsigned int tag = 0;
+	unsigned int bits = 0;
+	unsigned int align = 0;
+
+	for (p += 12; end - p >= 8;) {
+
+		const uint32_t chunk_size = wavfile_le32(p + 4);
+		const uint8_t * chunk = p + 8;
+		const size_t avail = end - chunk;
+
+		if (memcmp(p, "ds64", 4) == 0 && chunk_size >= 24 && avail >= 24)
+			data_size64 = wavfile_le64(chunk + 8);
+		else if (memcmp(p, "fmt ", 4) == 0 && chunk_size >= 16 && avail >= 16) {
+			tag = wavfile_le16(chunk);
+			wf->channels = wavfile_le16(chunk + 2);
+			wf->rate = wavfile_le32(chunk + 4);
+			align = wavfile_le16(chunk + 12);
+			bits = wavfile_le16(chunk + 14);
+			/* WAVE_FORMAT_EXTENSIBLE, format tag is in the sub-format GUID */
+			if (tag == 0xFFFE && chunk_size >= 40 && avail >= 40)
+				tag = wavfile_le16(chunk + 24);
+		}
+		else if (memcmp(p, "data", 4) == 0) {
+
+			/* samples are read as interleaved stereo frames */
+			if (wf->channels != 2 || align == 0)
+				return errno = ENOTSUP, -1;
+
+			if (tag == 1 && bits == 16 && align == wf->channels * 2)
+				wf->format = WAVFILE_S16;
+			else if (tag == 1 && bits == 24 && align == wf->channels * 3)
+				wf->format = WAVFILE_S24;
+			/* 24-bit samples in 32-bit containers are left-justified */
+			else if (tag == 1 && bits > 16 && bits <= 32 && align == wf->channels * 4)
+				wf->format = WAVFILE_S32;
+			else if (tag == 3 && bits == 32 && align == wf->channels * 4)
+				wf->format = WAVFILE_F32;
+			else
+				return errno = ENOTSUP, -1;
+
+			/* size is unknown for streamed files */
+			uint64_t size = rf64 && chunk_size == 0xFFFFFFFF ? data_size64 : chunk_size;
+			if (size == 0 || size == 0xFFFFFFFF || size > avail)
+				size = avail;
+
+			wf->data = chunk;
+			wf->frames = size / align;
+			return 0;
+		}
+
+		if (chunk_size > avail)
+			break;
+		/* chunks are padded to even size */
+		p = chunk + chunk_size + (chunk_size & 1);
+
+	}
+
+	return errno = EBADMSG, -1;
+}
+
+/**
+ * Map the audio file into memory.
+ *
+ * File without the WAV header is treated as a raw 2-channel S16 LE stream
+ * at 44100 Hz, in which case the wave field is set to false.
+ *
+ * @return On success, 0 is returned. If file can not be mapped (e.g. it is
+ *   a pipe) or the header is not supported, -1 is returned and errno is set
+ *   to indicate the error. */
+static inline int wavfile_open(struct wavfile * wf, int fd) {
+
+	struct stat st;
+	memset(wf, 0, sizeof(*wf));
+
+	if (fstat(fd, &st) == -1)
+		return -1;
+	if (!S_ISREG(st.st_mode))
+		return errno = ENODEV, -1;
+	if ((uint64_t)st.st_size > SIZE_MAX)
+		return errno = EFBIG, -1;
+
+	wf->format = WAVFILE_S16;
+	wf->channels = 2;
+	wf->rate = 44100;
+
+	if ((wf->map_size = st.st_size) == 0)
+		return 0;
+
+	if ((wf->map = mmap(NULL, wf->map_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		wf->map = NULL;
+		return -1;
+	}
+
+	madvise(wf->map, wf->map_size, MADV_SEQUENTIAL);
+
+	const uint8_t * p = wf->map;
+	if (wf->map_size >= 12 && (memcmp(p, "RIFF", 4) == 0 || memcmp(p, "RF64", 4) == 0) &&
+	    memcmp(p + 8, "WAVE", 4) == 0) {
+		wf->wave = true;
+		if (wavfile_parse(wf) == -1) {
+			const int err = errno;
+			munmap(wf->map, wf->map_size);
+			wf->map = NULL;
+			return errno = err, -1;
+		}
+		return 0;
+	}
+
+	wf->data = wf->map;
+	wf->frames = wf->map_size / 4;
+	return 0;
+}
+
+static inline void wavfile_close(struct wavfile * wf) {
+	if (wf->map != NULL)
+		munmap(wf->map, wf->map_size);
+	wf->map = NULL;
+}
+
+/**
+ * Convert interleaved stereo samples into planar buffers.
+ *
+ * @param bits Number of bits of the output samples. */
+static inline void wavfile_convert(enum wavfile_format format, const uint8_t * data, size_t frames,
+                                   int32_t * pcmL, int32_t * pcmR, unsigned int bits) {
+	switch (format) {
+	case WAVFILE_S16:
+		for (size_t i = 0; i < frames; i++, data += 4) {
+			/* sign-extend to 32 bits first, so the value can be shifted either way */
+			const int32_t l = (int16_t)wavfile_le16(data) * 65536;
+			const int32_t r = (int16_t)wavfile_le16(data + 2) * 65536;
+			pcmL[i] = l >> (32 - bits);
+			pcmR[i] = r >> (32 - bits);
+		}
+		break;
+	case WAVFILE_S24:
+		for (size_t i = 0; i < frames; i++, data += 6) {
+			const int32_t l = (int32_t)(data[0] << 8 | data[1] << 16 | (uint32_t)data[2] << 24);
+			const int32_t r = (int32_t)(data[3] << 8 | data[4] << 16 | (uint32_t)data[5] << 24);
+			pcmL[i] = l >> (32 - bits);
+			pcmR[i] = r >> (32 - bits);
+		}
+		break;
+	case WAVFILE_S32:
+		for (size_t i = 0; i < frames; i++, data += 8) {
+			pcmL[i] = (int32_t)wavfile_le32(data) >> (32 - bits);
+			pcmR[i] = (int32_t)wavfile_le32(data + 4) >> (32 - bits);
+		}
+		break;
+	case WAVFILE_F32: {
+		const float scale = 1 << (bits - 1);
+		for (size_t i = 0; i < frames; i++) {
+			for (size_t ch = 0; ch < 2; ch++, data += 4) {
+				const uint32_t u = wavfile_le32(data);
+				float x;
+				memcpy(&x, &u, sizeof(x));
+				x *= scale;
+				/* saturate (also NaN) before conversion to integer */
+				if (!(x > -scale))
+					x = -scale;
+				if (x > scale - 1)
+					x = scale - 1;
+				const int32_t v = x < 0 ? x - 0.5f : x + 0.5f;
+				(ch == 0 ? pcmL : pcmR)[i] = v;
+			}
+		}
+	} break;
+	}
+}
+
+/**
+ * Read frames from the mapped file into planar buffers.
+ *
+ * @return The number of converted frames. */
+static inline size_t wavfile_read(const struct wavfile * wf, size_t offset, int32_t * pcmL, int32_t * pcmR,
+                                  size_t frames, unsigned int bits) {
+	if (offset >= wf->frames)
+		return 0;
+	if (frames > wf->frames - offset)
+		frames = wf->frames - offset;
+	const size_t frame_size = 2 * wavfile_sample_size(wf->format);
+	wavfile_convert(wf->format, wf->data + offset * frame_size, frames, pcmL, pcmR, bits);
+	return frames;
+}
+
+static inline int wavfile_write_all(int fd, const uint8_t * data, size_t len) {
+	while (len > 0) {
+		ssize_t rv;
+		if ((rv = write(fd, data, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += rv;
+		len -= rv;
+	}
+	return 0;
+}
+
+/**
+ * Fill the WAV header for the given data size.
+ *
+ * The header has a JUNK chunk which is replaced by the ds64 chunk when
+ * the data does not fit in the 32-bit RIFF size field (RF64). The size of
+ * UINT64_MAX means unknown size, e.g. when writing to a pipe. */
+static inline void wavfile_header(uint8_t * header, enum wavfile_format format, unsigned int rate, uint64_t size) {
+
+	const bool rf64 = size != UINT64_MAX && size > 0xFFFFFFFF - WAVFILE_HEADER_SIZE;
+	const size_t sample_size = wavfile_sample_size(format);
+	uint8_t * p = header;
+
+	memcpy(p, rf64 ? "RF64" : "RIFF", 4);
+	p = wavfile_put32(p + 4, rf64 || size == UINT64_MAX ? 0xFFFFFFFF : size + WAVFILE_HEADER_SIZE - 8);
+	memcpy(p, "WAVE", 4);
+
+	memcpy(p += 4, rf64 ? "ds64" : "JUNK", 4);
+	p = wavfile_put32(p + 4, 28);
+	p = wavfile_put64(p, rf64 ? size + WAVFILE_HEADER_SIZE - 8 : 0);
+	p = wavfile_put64(p, rf64 ? size : 0);
+	p = wavfile_put64(p, rf64 ? size / (2 * sample_size) : 0);
+	p = wavfile_put32(p, 0);
+
+	memcpy(p, "fmt ", 4);
+	p = wavfile_put32(p + 4, 16);
+	p = wavfile_put16(p, format == WAVFILE_F32 ? 3 : 1);
+	p = wavfile_put16(p, 2);
+	p = wavfile_put32(p, rate);
+	p = wavfile_put32(p, rate * 2 * sample_size);
+	p = wavfile_put16(p, 2 * sample_size);
+	p = wavfile_put16(p, 8 * sample_size);
+
+	memcpy(p, "data", 4);
+	wavfile_put32(p + 4, rf64 || size == UINT64_MAX ? 0xFFFFFFFF : size);
+}
+
+/**
+ * Initialize the writer.
+ *
+ * @param header If false, raw samples without the WAV header are written.
+ * @return On success, 0 is returned. Otherwise, -1 is returned and errno
+ *   is set to indicate the error. */
+static inline int wavfile_writer_init(struct wavfile_writer * w, int fd, enum wavfile_format format,
+                                      unsigned int rate, bool header) {
+
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	w->format = format;
+	w->rate = rate;
+	w->header = header;
+	w->offset = lseek(fd, 0, SEEK_CUR);
+
+	if ((w->buffer = malloc(WAVFILE_BUFFER_SIZE)) == NULL)
+		return -1;
+
+	if (header) {
+		/* size is patched on close if the output is seekable */
+		wavfile_header(w->buffer, format, rate, UINT64_MAX);
+		w->len = WAVFILE_HEADER_SIZE;
+	}
+
+	return 0;
+}
+
+static inline int wavfile_writer_flush(struct wavfile_writer * w) {
+	const size_t len = w->len;
+	w->len = 0;
+	return wavfile_write_all(w->fd, w->buffer, len);
+}
+
+/**
+ * Write frames from planar buffers.
+ *
+ * @param bits Number of bits of the input samples.
+ * @return On success, 0 is returned. Otherwise, -1 is returned and errno
+ *   is set to indicate the error. */
+static inline int wavfile_write(struct wavfile_writer * w, const int32_t * pcmL, const int32_t * pcmR,
+                                size_t frames, unsigned int bits) {
+
+	const size_t frame_size = 2 * wavfile_sample_size(w->format);
+
+	while (frames > 0) {
+
+		if (w->len + frame_size > WAVFILE_BUFFER_SIZE && wavfile_writer_flush(w) == -1)
+			return -1;
+
+		size_t n = (WAVFILE_BUFFER_SIZE - w->len) / frame_size;
+		if (n > frames)
+			n = frames;
+
+		uint8_t * p = w->buffer + w->len;
+		switch (w->format) {
+		case WAVFILE_S16:
+			for (size_t i = 0; i < n; i++, p += 4) {
+				wavfile_put16(p, pcmL[i] >> (bits - 16));
+				wavfile_put16(p + 2, pcmR[i] >> (bits - 16));
+			}
+			break;
+		case WAVFILE_S24:
+			for (size_t i = 0; i < n; i++, p += 6) {
+				const uint32_t l = (uint32_t)pcmL[i] << (32 - bits);
+				const uint32_t r = (uint32_t)pcmR[i] << (32 - bits);
+				p[0] = l >> 8, p[1] = l >> 16, p[2] = l >> 24;
+				p[3] = r >> 8, p[4] = r >> 16, p[5] = r >> 24;
+			}
+			break;
+		case WAVFILE_S32:
+			for (size_t i = 0; i < n; i++, p += 8) {
+				wavfile_put32(p, (uint32_t)pcmL[i] << (32 - bits));
+				wavfile_put32(p + 4, (uint32_t)pcmR[i] << (32 - bits));
+			}
+			break;
+		case WAVFILE_F32: {
+			const float scale = 1.0f / (1 << (bits - 1));
+			for (size_t i = 0; i < n; i++, p += 8) {
+				const float l = pcmL[i] * scale, r = pcmR[i] * scale;
+				uint32_t u;
+				memcpy(&u, &l, sizeof(u));
+				wavfile_put32(p, u);
+				memcpy(&u, &r, sizeof(u));
+				wavfile_put32(p + 4, u);
+			}
+		} break;
+		}
+
+		w->len += n * frame_size;
+		w->size += n * frame_size;
+		pcmL += n;
+		pcmR += n;
+		frames -= n;
+
+	}
+
+	return 0;
+}
+
+/**
+ * Flush buffered samples, update the header and release resources.
+ *
+ * The header is updated only if the output is seekable, otherwise the
+ * size fields are left as unknown, which is understood by most readers.
+ *
+ * @return On success, 0 is returned. Otherwise, -1 is returned and errno
+ *   is set to indicate the error. */
+static inline int wavfile_writer_close(struct wavfile_writer * w) {
+
+	int rv = wavfile_writer_flush(w);
+
+	if (rv == 0 && w->header && w->offset != -1 && lseek(w->fd, w->offset, SEEK_SET) == w->offset) {
+		uint8_t header[WAVFILE_HEADER_SIZE];
+		wavfile_header(header, w->format, w->rate, w->size);
+		rv = wavfile_write_all(w->fd, header, sizeof(header));
+		lseek(w->fd, 0, SEEK_END);
+	}
+
+	free(w->buffer);
+	w->buffer = NULL;
+	return rv;
+}
+
+#endif
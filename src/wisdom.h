@@ -0,0 +1,206 @@
+/*
+ * [open]aptx - wisdom.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_WISDOM_H_
+#define OPENAPTX_WISDOM_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Persistent storage of the auto-tuning results (wisdom).
+ *
+ * The wisdom file is a text file with one "HOST KEY VALUE" entry per line,
+ * where HOST identifies the CPU on which the value was measured, so the
+ * same file can be shared between hosts (e.g. with NFS home directory).
+ * Entries for other hosts are preserved on update. The file location is
+ * taken from the OPENAPTX_WISDOM environment variable (empty value turns
+ * the wisdom off), then $XDG_CACHE_HOME/openaptx/wisdom and finally from
+ * $HOME/.cache/openaptx/wisdom.
+ *
+ * All functions are static, because every library which uses the wisdom
+ * has to have its own copy in order not to interpose symbols.
+ */
+
+/* Maximum length of the host identifier, key or value. */
+#define WISDOM_FIELD_SIZE 128
+/* Maximum length of the wisdom file path. */
+#define WISDOM_PATH_SIZE 4096
+
+/**
+ * Check whether the tuning was requested via environment variable. */
+static inline bool wisdom_tune_requested(const char * env) {
+	const char * value = getenv(env);
+	return value != NULL && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+/**
+ * Get the location of the wisdom file.
+ *
+ * @return On success, the path is returned. If wisdom is not available,
+ *   NULL is returned. */
+static inline const char * wisdom_path(char * path, size_t size) {
+
+	const char * env;
+	int len;
+
+	if ((env = getenv("OPENAPTX_WISDOM")) != NULL)
+		len = snprintf(path, size, "%s", env);
+	else if ((env = getenv("XDG_CACHE_HOME")) != NULL && env[0] != '\0')
+		len = snprintf(path, size, "%s/openaptx/wisdom", env);
+	else if ((env = getenv("HOME")) != NULL && env[0] != '\0')
+		len = snprintf(path, size, "%s/.cache/openaptx/wisdom", env);
+	else
+		return NULL;
+
+	if (len <= 0 || (size_t)len >= size)
+		return NULL;
+	return path;
+}
+
+/**
+ * Get the identifier of the host CPU.
+ *
+ * It is the CPU model name with white spaces replaced by underscores. */
+static inline const char * wisdom_host(char * host, size_t size) {
+
+	snprintf(host, size, "unknown");
+
+	FILE * f;
+	if ((f = fopen("/proc/cpuinfo", "r")) == NULL)
+		return host;
+
+	char line[256];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char * value;
+		if (strncmp(line, "model name", 10) != 0 || (value = strchr(line, ':')) == NULL)
+			continue;
+		for (value++; *value == ' ' || *value == '\t'; value++)
+			continue;
+		value[strcspn(value, "\r\n")] = '\0';
+		if (value[0] == '\0')
+			break;
+		snprintf(host, size, "%s", value);
+		for (char * c = host; *c != '\0'; c++)
+			if (*c == ' ' || *c == '\t')
+				*c = '_';
+		break;
+	}
+
+	fclose(f);
+	return host;
+}
+
+/**
+ * Parse single wisdom line into host, key and value fields. */
+static inline bool wisdom_parse(const char * line, char * host, char * key, char * value) {
+	/* the width has to match WISDOM_FIELD_SIZE - 1 */
+	return line[0] != '#' && sscanf(line, "%127s %127s %127s", host, key, value) == 3;
+}
+
+/**
+ * Look up the wisdom entry for the current host.
+ *
+ * @return On success, the value is stored in the given buffer and 0 is
+ *   returned. If entry was not found, -1 is returned and errno is set. */
+static inline int wisdom_load(const char * key, char * value, size_t size) {
+
+	char path[WISDOM_PATH_SIZE];
+	char host[WISDOM_FIELD_SIZE];
+	FILE * f;
+
+	if (wisdom_path(path, sizeof(path)) == NULL || path[0] == '\0')
+		return errno = ENOENT, -1;
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+
+	wisdom_host(host, sizeof(host));
+
+	char line[3 * WISDOM_FIELD_SIZE];
+	char h[WISDOM_FIELD_SIZE], k[WISDOM_FIELD_SIZE], v[WISDOM_FIELD_SIZE];
+	int rv = -1;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (wisdom_parse(line, h, k, v) && strcmp(h, host) == 0 && strcmp(k, key) == 0) {
+			snprintf(value, size, "%s", v);
+			rv = 0;
+		}
+
+	fclose(f);
+	if (rv == -1)
+		errno = ENOENT;
+	return rv;
+}
+
+/**
+ * Create parent directories of the given path. */
+static inline void wisdom_mkdirs(const char * path) {
+	char tmp[WISDOM_PATH_SIZE];
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for (char * c = strchr(tmp + 1, '/'); c != NULL; c = strchr(c + 1, '/')) {
+		*c = '\0';
+		mkdir(tmp, 0755);
+		*c = '/';
+	}
+}
+
+/**
+ * Store the wisdom entry for the current host.
+ *
+ * The file is rewritten (via a temporary file and rename, so concurrent
+ * readers see either the old or the new content) with the previous entry
+ * for the same host and key replaced.
+ *
+ * @return On success, 0 is returned. Otherwise, -1 is returned and errno
+ *   is set to indicate the error. */
+static inline int wisdom_store(const char * key, const char * value) {
+
+	char path[WISDOM_PATH_SIZE];
+	char tmp[WISDOM_PATH_SIZE + 32];
+	char host[WISDOM_FIELD_SIZE];
+	FILE * src, * dst;
+
+	if (wisdom_path(path, sizeof(path)) == NULL || path[0] == '\0')
+		return errno = ENOENT, -1;
+
+	wisdom_host(host, sizeof(host));
+	wisdom_mkdirs(path);
+
+	snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+	if ((dst = fopen(tmp, "w")) == NULL)
+		return -1;
+
+	fprintf(dst, "# [open]aptx wisdom: HOST KEY VALUE\n");
+	if ((src = fopen(path, "r")) != NULL) {
+		char line[3 * WISDOM_FIELD_SIZE];
+		char h[WISDOM_FIELD_SIZE], k[WISDOM_FIELD_SIZE], v[WISDOM_FIELD_SIZE];
+		while (fgets(line, sizeof(line), src) != NULL)
+			if (wisdom_parse(line, h, k, v) && !(strcmp(h, host) == 0 && strcmp(k, key) == 0))
+				fprintf(dst, "%s %s %s\n", h, k, v);
+		fclose(src);
+	}
+
+	fprintf(dst, "%s %s %s\n", host, key, value);
+
+	if (fclose(dst) != 0 || rename(tmp, path) != 0) {
+		const int err = errno;
+		unlink(tmp);
+		return errno = err, -1;
+	}
+
+	return 0;
+}
+
+#endif
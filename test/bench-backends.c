@@ -0,0 +1,386 @@
+/*
+ * bench-backends.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "openaptx.h"
+
+/* Maximum number of compared backends. */
+#define MAX_BACKENDS 8
+/* Sampling rate used for the real-time factor. */
+#define SAMPLE_RATE 48000
+
+enum family {
+	APTX_ENC = 0,
+	APTX_HD_ENC,
+	APTX_DEC,
+	APTX_HD_DEC,
+	FAMILIES,
+};
+
+#define FAMILY_IS_HD(f) ((f) == APTX_HD_ENC || (f) == APTX_HD_DEC)
+#define FAMILY_IS_DEC(f) ((f) == APTX_DEC || (f) == APTX_HD_DEC)
+
+static const struct {
+	const char * name;
+	const char * size;
+	const char * init;
+	const char * destroy;
+	const char * process;
+} symbols[FAMILIES] = {
+	[APTX_ENC] = { "apt-X encoder", "SizeofAptxbtenc", "aptxbtenc_init", "aptxbtenc_destroy",
+		           "aptxbtenc_encodestereo" },
+	[APTX_HD_ENC] = { "apt-X HD encoder", "SizeofAptxhdbtenc", "aptxhdbtenc_init", "aptxhdbtenc_destroy",
+		              "aptxhdbtenc_encodestereo" },
+	[APTX_DEC] = { "apt-X decoder", "SizeofAptxbtdec", "aptxbtdec_init", "aptxbtdec_destroy",
+		           "aptxbtdec_decodestereo" },
+	[APTX_HD_DEC] = { "apt-X HD decoder", "SizeofAptxhdbtdec", "aptxhdbtdec_init", "aptxhdbtdec_destroy",
+		              "aptxhdbtdec_decodestereo" },
+};
+
+struct backend {
+	char name[32];
+	/* shared objects providing apt-X and apt-X HD API */
+	char soname[2][128];
+};
+
+struct api {
+	void * handle;
+	size_t (*size)(void);
+	int (*init)(void *, short);
+	void (*destroy)(void *);
+	union {
+		void * ptr;
+		int (*aptx_enc)(APTXENC, const int32_t[4], const int32_t[4], uint16_t[2]);
+		int (*aptx_hd_enc)(APTXENC, const int32_t[4], const int32_t[4], uint32_t[2]);
+		int (*aptx_dec)(APTXDEC, int32_t[4], int32_t[4], const uint16_t[2]);
+		int (*aptx_hd_dec)(APTXDEC, int32_t[4], int32_t[4], const uint32_t[2]);
+	} process;
+};
+
+struct result {
+	bool available;
+	size_t handle_size;
+	size_t heap_size;
+	double total_ms;
+	double p50_ns;
+	double p99_ns;
+	double max_ns;
+	/* encoded codewords or decoded PCM samples */
+	int32_t * output;
+	size_t output_len;
+};
+
+static int api_load(struct api * api, const struct backend * b, enum family family) {
+
+	memset(api, 0, sizeof(*api));
+	/* Use deep binding, so backends exporting the same public
+	 * symbols will not interfere with each other. */
+	if ((api->handle = dlopen(b->soname[FAMILY_IS_HD(family)], RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND)) == NULL)
+		return -1;
+
+	*(void **)(&api->size) = dlsym(api->handle, symbols[family].size);
+	*(void **)(&api->init) = dlsym(api->handle, symbols[family].init);
+	*(void **)(&api->destroy) = dlsym(api->handle, symbols[family].destroy);
+	api->process.ptr = dlsym(api->handle, symbols[family].process);
+
+	if (api->size == NULL || api->init == NULL || api->process.ptr == NULL || api->size() == 0) {
+		dlclose(api->handle);
+		return -1;
+	}
+
+	return 0;
+}
+
+static size_t heap_in_use(void) {
+	return mallinfo2().uordblks;
+}
+
+static double elapsed_ns(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static int cmp_double(const void * a, const void * b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Generate deterministic stereo test signal: a mix of tones and noise. */
+static void generate(int32_t * pcm, size_t frames, bool hd) {
+	const double scale = hd ? 8388607 : 32767;
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < frames; i++) {
+		seed = seed * 1664525 + 1013904223;
+		const double noise = ((int32_t)seed >> 8) / 8388608.0;
+		pcm[i * 2 + 0] = scale * (0.35 * sin(0.0785 * i) + 0.15 * sin(0.817 * i) + 0.02 * noise);
+		pcm[i * 2 + 1] = scale * (0.30 * sin(0.1963 * i) + 0.10 * sin(1.948 * i) + 0.02 * noise);
+	}
+}
+
+/**
+ * Process single block with the given API.
+ *
+ * For encoders the input are 8 PCM samples and the output are 2 codewords.
+ * For decoders it is the other way around. */
+static int process(const struct api * api, enum family family, void * handle, const int32_t * in, int32_t * out) {
+	switch (family) {
+	case APTX_ENC: {
+		const int32_t pcmL[4] = { in[0], in[2], in[4], in[6] };
+		const int32_t pcmR[4] = { in[1], in[3], in[5], in[7] };
+		uint16_t code[2];
+		int rv = api->process.aptx_enc(handle, pcmL, pcmR, code);
+		out[0] = code[0], out[1] = code[1];
+		return rv;
+	}
+	case APTX_HD_ENC: {
+		const int32_t pcmL[4] = { in[0], in[2], in[4], in[6] };
+		const int32_t pcmR[4] = { in[1], in[3], in[5], in[7] };
+		uint32_t code[2];
+		int rv = api->process.aptx_hd_enc(handle, pcmL, pcmR, code);
+		out[0] = code[0], out[1] = code[1];
+		return rv;
+	}
+	case APTX_DEC: {
+		const uint16_t code[2] = { in[0], in[1] };
+		int32_t pcmL[4], pcmR[4];
+		int rv = api->process.aptx_dec(handle, pcmL, pcmR, code);
+		for (size_t i = 0; i < 4; i++)
+			out[i * 2 + 0] = pcmL[i], out[i * 2 + 1] = pcmR[i];
+		return rv;
+	}
+	case APTX_HD_DEC: {
+		const uint32_t code[2] = { in[0], in[1] };
+		int32_t pcmL[4], pcmR[4];
+		int rv = api->process.aptx_hd_dec(handle, pcmL, pcmR, code);
+		for (size_t i = 0; i < 4; i++)
+			out[i * 2 + 0] = pcmL[i], out[i * 2 + 1] = pcmR[i];
+		return rv;
+	}
+	default:
+		return -1;
+	}
+}
+
+static int bench(const struct api * api, enum family family, const int32_t * input, size_t blocks,
+                 struct result * r) {
+
+	const size_t in_len = FAMILY_IS_DEC(family) ? 2 : 8;
+	const size_t out_len = FAMILY_IS_DEC(family) ? 8 : 2;
+	void * handle = NULL;
+	double * samples;
+	int rv = -1;
+
+	r->handle_size = api->size();
+	r->output_len = blocks * out_len;
+	if ((r->output = malloc(r->output_len * sizeof(*r->output))) == NULL)
+		return -1;
+	if ((samples = malloc(blocks * sizeof(*samples))) == NULL)
+		return -1;
+	if ((handle = malloc(r->handle_size)) == NULL)
+		goto final;
+
+	/* Warm-up the backend, so one-time allocations (e.g. lookup
+	 * caches) will not be accounted as the per-handle memory. */
+	if (api->init(handle, 0) != 0 || process(api, family, handle, input, r->output) != 0)
+		goto final;
+	if (api->destroy != NULL)
+		api->destroy(handle);
+
+	const size_t heap = heap_in_use();
+	if (api->init(handle, 0) != 0)
+		goto final;
+
+	struct timespec t0, t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t i = 0; i < blocks; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (process(api, family, handle, &input[i * in_len], &r->output[i * out_len]) != 0)
+			goto final;
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		samples[i] = elapsed_ns(&t1, &t2);
+		if (i == 0)
+			/* include allocations done while processing the first block */
+			r->heap_size = heap_in_use() - heap;
+	}
+	r->total_ms = elapsed_ns(&t0, &t2) / 1e6;
+
+	qsort(samples, blocks, sizeof(*samples), cmp_double);
+	r->p50_ns = samples[blocks / 2];
+	r->p99_ns = samples[blocks * 99 / 100];
+	r->max_ns = samples[blocks - 1];
+	r->available = true;
+	rv = 0;
+
+final:
+	if (handle != NULL && api->destroy != NULL)
+		api->destroy(handle);
+	free(handle);
+	free(samples);
+	return rv;
+}
+
+static void print_matrix(enum family family, const struct backend * backends, size_t count,
+                         const struct result * results, size_t blocks) {
+
+	printf("%s (%zu blocks)\n", symbols[family].name, blocks);
+	printf("  %-10s %8s %8s %12s %9s %9s %9s  |", "backend", "handle", "heap", "throughput", "p50", "p99", "max");
+	for (size_t i = 0; i < count; i++)
+		printf(" %10.10s", backends[i].name);
+	printf("\n");
+
+	for (size_t i = 0; i < count; i++) {
+
+		const struct result * r = &results[i];
+		if (!r->available) {
+			printf("  %-10s not available\n", backends[i].name);
+			continue;
+		}
+
+		const double rt = blocks * 4.0 / SAMPLE_RATE / (r->total_ms / 1e3);
+		printf("  %-10s %6zu B %6zu B %10.1fx %6.0f ns %6.0f ns %6.0f ns  |", backends[i].name, r->handle_size,
+		       r->heap_size, rt, r->p50_ns, r->p99_ns, r->max_ns);
+
+		for (size_t ii = 0; ii < count; ii++) {
+			if (!results[ii].available) {
+				printf(" %10s", "-");
+				continue;
+			}
+			size_t n;
+			for (n = 0; n < r->output_len; n++)
+				if (r->output[n] != results[ii].output[n])
+					break;
+			if (n == r->output_len)
+				printf(" %10s", "equal");
+			else {
+				char tmp[32];
+				snprintf(tmp, sizeof(tmp), "blk %zu", n / (FAMILY_IS_DEC(family) ? 8 : 2));
+				printf(" %10s", tmp);
+			}
+		}
+
+		printf("\n");
+	}
+
+	printf("\n");
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hs:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	struct backend backends[MAX_BACKENDS] = {
+		{ "native", { "libaptx-4.2.2.so", "libaptxHD-1.0.0.so" } },
+		{ "ffmpeg", { "libaptx-ffmpeg.so", "libaptx-ffmpeg.so" } },
+		{ "freeaptx", { "libaptx-freeaptx.so", "libaptx-freeaptx.so" } },
+	};
+	size_t backends_count = 3;
+	size_t seconds = 10;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]... [NAME=LIB[,LIBHD]]...\n"
+			       "\nCompare apt-X / apt-X HD backends: throughput, per-call latency,\n"
+			       "memory per handle and output equality. By default, backends built\n"
+			       "with the runtime dispatcher are compared.\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -s, --seconds=NUM\tlength of the test signal\n",
+			       argv[0]);
+			return EXIT_SUCCESS;
+		case 's':
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (optind < argc) {
+		/* custom list of backends */
+		backends_count = 0;
+		for (int i = optind; i < argc && backends_count < MAX_BACKENDS; i++) {
+			struct backend * b = &backends[backends_count++];
+			char * lib, * lib_hd;
+			if ((lib = strchr(argv[i], '=')) == NULL) {
+				fprintf(stderr, "Invalid backend specification: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			*lib++ = '\0';
+			if ((lib_hd = strchr(lib, ',')) != NULL)
+				*lib_hd++ = '\0';
+			snprintf(b->name, sizeof(b->name), "%s", argv[i]);
+			snprintf(b->soname[0], sizeof(b->soname[0]), "%s", lib);
+			snprintf(b->soname[1], sizeof(b->soname[1]), "%s", lib_hd != NULL ? lib_hd : lib);
+		}
+	}
+
+	if (seconds == 0)
+		seconds = 1;
+
+	const size_t blocks = seconds * SAMPLE_RATE / 4;
+	int32_t * pcm[2], * codes[2] = { NULL, NULL };
+	if ((pcm[0] = malloc(blocks * 8 * sizeof(int32_t))) == NULL ||
+	    (pcm[1] = malloc(blocks * 8 * sizeof(int32_t))) == NULL)
+		return EXIT_FAILURE;
+	generate(pcm[0], blocks * 4, false);
+	generate(pcm[1], blocks * 4, true);
+
+	for (enum family family = 0; family < FAMILIES; family++) {
+
+		struct result results[MAX_BACKENDS] = { 0 };
+		const bool hd = FAMILY_IS_HD(family);
+		const int32_t * input = FAMILY_IS_DEC(family) ? codes[hd] : pcm[hd];
+
+		for (size_t i = 0; i < backends_count; i++) {
+			struct api api;
+			if (input == NULL || api_load(&api, &backends[i], family) != 0)
+				continue;
+			if (bench(&api, family, input, blocks, &results[i]) != 0)
+				results[i].available = false;
+			dlclose(api.handle);
+		}
+
+		print_matrix(family, backends, backends_count, results, blocks);
+
+		for (size_t i = 0; i < backends_count; i++) {
+			/* Decoders of all backends process the stream produced
+			 * by the first available encoder. */
+			if (!FAMILY_IS_DEC(family) && results[i].available && codes[hd] == NULL) {
+				codes[hd] = results[i].output;
+				continue;
+			}
+			free(results[i].output);
+		}
+
+	}
+
+	free(codes[0]);
+	free(codes[1]);
+	free(pcm[0]);
+	free(pcm[1]);
+	return EXIT_SUCCESS;
+}
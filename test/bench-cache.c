@@ -0,0 +1,329 @@
+/*
+ * bench-cache.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx-cache.h"
+#include "openaptx.h"
+
+#include "../src/stream.h"
+#include "signals.h"
+
+/* Layout of the slot table in the cache file (see aptx-cache.c), used to
+ * corrupt entries of the cache. */
+#define CACHE_HEADER_SIZE 32
+#define CACHE_SLOT_SIZE 56
+#define CACHE_SLOT_OFFSET 24
+
+struct clip {
+	const int32_t * pcm;
+	size_t frames;
+	uint8_t * data;
+	size_t size;
+};
+
+static const char * codec_name(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+static double elapsed_ms(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * Encode clip directly with a freshly initialized encoder. */
+static int clip_encode(enum openaptx_codec codec, struct clip * c) {
+
+	APTXENC enc;
+	int rv;
+
+	c->size = (c->frames + 3) / 4 * 2 * stream_codeword_size(codec);
+	if ((c->data = malloc(c->size)) == NULL || (enc = stream_encoder_new(codec, 0)) == NULL)
+		return -1;
+
+	rv = stream_encode(codec, enc, c->pcm, c->frames, c->data);
+	stream_encoder_free(codec, enc);
+	return rv;
+}
+
+/**
+ * Check whether the cached clip is identical to the directly encoded one.
+ *
+ * The data is released in any case. */
+static bool clip_check(openaptx_cache * cache, const struct clip * c, const uint8_t * data, size_t size) {
+	const bool exact = data != NULL && size == c->size && memcmp(data, c->data, size) == 0;
+	openaptx_cache_release(cache, data);
+	return exact;
+}
+
+static bool clip_lookup(openaptx_cache * cache, enum openaptx_codec codec, const struct clip * c) {
+	size_t size = 0;
+	const uint8_t * data = openaptx_cache_lookup(cache, codec, 0, c->pcm, c->frames, &size);
+	return clip_check(cache, c, data, size);
+}
+
+static bool clip_store(openaptx_cache * cache, enum openaptx_codec codec, const struct clip * c) {
+	size_t size = 0;
+	const uint8_t * data = openaptx_cache_encode(cache, codec, 0, c->pcm, c->frames, &size);
+	return clip_check(cache, c, data, size);
+}
+
+static bool clip_missing(openaptx_cache * cache, enum openaptx_codec codec, const struct clip * c) {
+	size_t size;
+	return openaptx_cache_lookup(cache, codec, 0, c->pcm, c->frames, &size) == NULL && errno == ENOENT;
+}
+
+/**
+ * Overwrite the offset of the encoded stream stored in the given slot. */
+static int slot_corrupt(const char * path, size_t slot, uint64_t offset) {
+	int fd;
+	if ((fd = open(path, O_WRONLY)) == -1)
+		return -1;
+	const off_t pos = CACHE_HEADER_SIZE + slot * CACHE_SLOT_SIZE + CACHE_SLOT_OFFSET;
+	const ssize_t len = pwrite(fd, &offset, sizeof(offset), pos);
+	close(fd);
+	return len == sizeof(offset) ? 0 : -1;
+}
+
+static void report(const char * check, bool ok, size_t * errors) {
+	printf("  %-44s %s\n", check, ok ? "ok" : "FAILED");
+	if (!ok)
+		(*errors)++;
+}
+
+static int bench(const char * path, enum openaptx_codec codec, const int32_t * pcm, size_t clips_count,
+                 size_t clip_frames) {
+
+	struct clip * clips = calloc(clips_count, sizeof(*clips));
+	openaptx_cache * cache = NULL;
+	struct timespec t0, t1, t2, t3;
+	size_t errors = 0;
+	size_t capacity = 0;
+	size_t size;
+	int rv = -1;
+
+	if (clips == NULL)
+		goto fail;
+
+	for (size_t i = 0; i < clips_count; i++) {
+		struct clip * c = &clips[i];
+		/* clips of various lengths, not all of them made of whole blocks */
+		c->pcm = &pcm[i * clip_frames / 2 * 2];
+		c->frames = clip_frames - i * 7;
+		if (clip_encode(codec, c) == -1)
+			goto fail;
+		capacity += c->size;
+	}
+
+	unlink(path);
+	if ((cache = openaptx_cache_open(path, capacity)) == NULL)
+		goto fail;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	bool exact = true;
+	for (size_t i = 0; i < clips_count; i++)
+		exact &= clip_store(cache, codec, &clips[i]);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	bool exact_lookup = true;
+	for (size_t i = 0; i < clips_count; i++)
+		exact_lookup &= clip_lookup(cache, codec, &clips[i]);
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	openaptx_cache_close(cache);
+	if ((cache = openaptx_cache_open(path, capacity)) == NULL)
+		goto fail;
+
+	bool exact_reopen = true;
+	for (size_t i = 0; i < clips_count; i++)
+		exact_reopen &= clip_lookup(cache, codec, &clips[i]);
+
+	clock_gettime(CLOCK_MONOTONIC, &t3);
+
+	printf("%-9s %6zu %10.2f %10.2f %10.2f\n", codec_name(codec), clips_count, elapsed_ms(&t0, &t1),
+	       elapsed_ms(&t1, &t2), elapsed_ms(&t2, &t3));
+	report("encode is identical to direct encode", exact, &errors);
+	report("lookup is identical to direct encode", exact_lookup, &errors);
+	report("lookup after reopen is identical", exact_reopen, &errors);
+
+	/* The cache with the space for 3 clips (the first one is the largest),
+	 * where the least recently used one has to be evicted. */
+	openaptx_cache_close(cache);
+	unlink(path);
+	if ((cache = openaptx_cache_open(path, clips[0].size * 3)) == NULL)
+		goto fail;
+
+	for (size_t i = 0; i < 3; i++)
+		clip_store(cache, codec, &clips[i]);
+	/* make the second clip the least recently used one */
+	clip_lookup(cache, codec, &clips[0]);
+	bool evicted = clip_store(cache, codec, &clips[3]);
+	evicted &= clip_missing(cache, codec, &clips[1]);
+	evicted &= clip_lookup(cache, codec, &clips[0]);
+	evicted &= clip_lookup(cache, codec, &clips[2]);
+	evicted &= clip_lookup(cache, codec, &clips[3]);
+	report("least recently used clip is evicted", evicted, &errors);
+
+	/* Pinned clips can not be evicted, so the cache is full. */
+	openaptx_cache_close(cache);
+	unlink(path);
+	if ((cache = openaptx_cache_open(path, clips[0].size * 3)) == NULL)
+		goto fail;
+
+	const uint8_t * pinned[3];
+	for (size_t i = 0; i < 3; i++)
+		pinned[i] = openaptx_cache_encode(cache, codec, 0, clips[i].pcm, clips[i].frames, &size);
+	bool pinning = openaptx_cache_encode(cache, codec, 0, clips[4].pcm, clips[4].frames, &size) == NULL &&
+	               errno == ENOSPC;
+	for (size_t i = 0; i < 3; i++)
+		pinning &= pinned[i] != NULL && memcmp(pinned[i], clips[i].data, clips[i].size) == 0;
+	openaptx_cache_release(cache, pinned[1]);
+	pinning &= clip_store(cache, codec, &clips[4]);
+	pinning &= clip_missing(cache, codec, &clips[1]);
+	openaptx_cache_release(cache, pinned[0]);
+	openaptx_cache_release(cache, pinned[2]);
+	report("pinned clips are not evicted", pinning, &errors);
+
+	/* Slots are taken in order, so the first 3 clips are in slots 0-2. */
+	openaptx_cache_close(cache);
+	unlink(path);
+	if ((cache = openaptx_cache_open(path, clips[0].size * 3)) == NULL)
+		goto fail;
+	for (size_t i = 0; i < 3; i++)
+		clip_store(cache, codec, &clips[i]);
+	openaptx_cache_close(cache);
+
+	cache = NULL;
+	if (slot_corrupt(path, 1, clips[0].size * 3) == -1 ||
+	    (cache = openaptx_cache_open(path, clips[0].size * 3)) == NULL)
+		goto fail;
+	bool dropped = clip_missing(cache, codec, &clips[1]);
+	dropped &= clip_lookup(cache, codec, &clips[0]);
+	dropped &= clip_lookup(cache, codec, &clips[2]);
+	report("entry outside of the data region is dropped", dropped, &errors);
+
+	openaptx_cache_close(cache);
+	cache = NULL;
+	if (slot_corrupt(path, 2, 0) == -1 || (cache = openaptx_cache_open(path, clips[0].size * 3)) == NULL)
+		goto fail;
+	bool reset = clip_missing(cache, codec, &clips[0]);
+	reset &= clip_missing(cache, codec, &clips[2]);
+	report("cache with overlapping entries is reset", reset, &errors);
+
+	rv = errors == 0 ? 0 : -1;
+	goto final;
+
+fail:
+	fprintf(stderr, "Error: %s: Couldn't prepare cache: %s\n", codec_name(codec), strerror(errno));
+
+final:
+	openaptx_cache_close(cache);
+	if (clips != NULL)
+		for (size_t i = 0; i < clips_count; i++)
+			free(clips[i].data);
+	free(clips);
+	unlink(path);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hc:f:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "clips", required_argument, NULL, 'c' },
+		{ "frames", required_argument, NULL, 'f' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t clips = 64;
+	size_t frames = 48000;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -c, --clips=NUM\tnumber of cached clips (default: %zu)\n"
+			       "  -f, --frames=NUM\tlength of the longest clip (default: %zu)\n",
+			       argv[0], clips, frames);
+			return EXIT_SUCCESS;
+		case 'c' /* --clips=NUM */:
+			clips = strtoul(optarg, NULL, 10);
+			break;
+		case 'f' /* --frames=NUM */:
+			frames = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (clips < 5 || clips > 1024 || frames < clips * 7 + 4) {
+		fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	/* clips are overlapping parts of a single signal */
+	const size_t signal_frames = (clips + 1) * frames / 2;
+	int32_t * pcmL = malloc(signal_frames * sizeof(*pcmL));
+	int32_t * pcmR = malloc(signal_frames * sizeof(*pcmR));
+	int32_t * pcm = malloc(signal_frames * 2 * sizeof(*pcm));
+	char path[] = "/tmp/openaptx-cache-XXXXXX";
+	int rv = EXIT_FAILURE;
+	int fd;
+
+	if (pcmL == NULL || pcmR == NULL || pcm == NULL) {
+		fprintf(stderr, "Error: Couldn't allocate signal: %s\n", strerror(errno));
+		goto final;
+	}
+
+	if ((fd = mkstemp(path)) == -1) {
+		fprintf(stderr, "Error: Couldn't create temporary file: %s\n", strerror(errno));
+		goto final;
+	}
+	close(fd);
+
+	printf("%-9s %6s %10s %10s %10s\n", "codec", "clips", "encode[ms]", "lookup[ms]", "reopen[ms]");
+
+	rv = EXIT_SUCCESS;
+	signal_generate(SIGNAL_PINK, pcmL, pcmR, signal_frames, 16);
+	for (size_t i = 0; i < signal_frames; i++)
+		pcm[i * 2 + 0] = pcmL[i], pcm[i * 2 + 1] = pcmR[i];
+	if (bench(path, OPENAPTX_CODEC_APTX, pcm, clips, frames) == -1)
+		rv = EXIT_FAILURE;
+
+	signal_generate(SIGNAL_PINK, pcmL, pcmR, signal_frames, 24);
+	for (size_t i = 0; i < signal_frames; i++)
+		pcm[i * 2 + 0] = pcmL[i], pcm[i * 2 + 1] = pcmR[i];
+	if (bench(path, OPENAPTX_CODEC_APTX_HD, pcm, clips, frames) == -1)
+		rv = EXIT_FAILURE;
+
+final:
+	free(pcmL);
+	free(pcmR);
+	free(pcm);
+	return rv;
+}
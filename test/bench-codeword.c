@@ -0,0 +1,178 @@
+/*
+ * bench-codeword.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/codeword.h"
+
+static double elapsed_ns(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+/* Byte by byte conversion, as it was done by every caller. */
+
+static void ref_pack16(uint8_t * data, const uint16_t * code, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		data[i * 2 + 0] = code[i] >> 8, data[i * 2 + 1] = code[i];
+}
+
+static void ref_unpack16(uint16_t * code, const uint8_t * data, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		code[i] = data[i * 2 + 0] << 8 | data[i * 2 + 1];
+}
+
+static void ref_pack24(uint8_t * data, const uint32_t * code, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		data[i * 3 + 0] = code[i] >> 16, data[i * 3 + 1] = code[i] >> 8, data[i * 3 + 2] = code[i];
+}
+
+static void ref_unpack24(uint32_t * code, const uint8_t * data, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		code[i] = data[i * 3 + 0] << 16 | data[i * 3 + 1] << 8 | data[i * 3 + 2];
+}
+
+/**
+ * Compare kernels with the reference for all lengths up to the given one.
+ * Buffers are guarded, so writes past the end are detected as well. */
+static int verify(size_t max) {
+
+	const size_t size = (max + 16) * 4;
+	uint32_t * code24 = malloc(size), * ref24 = malloc(size);
+	uint16_t * code16 = malloc(size), * ref16 = malloc(size);
+	uint8_t * data = malloc(size), * ref = malloc(size);
+	int rv = 0;
+
+	uint32_t seed = 0xC0DE;
+	for (size_t n = 0; n <= max; n++) {
+
+		for (size_t i = 0; i < n; i++) {
+			seed = seed * 1664525 + 1013904223;
+			ref24[i] = seed >> 8;
+			ref16[i] = seed >> 16;
+		}
+
+		memset(data, 0xAA, size);
+		memset(ref, 0xAA, size);
+		codeword_pack16(data, ref16, n);
+		ref_pack16(ref, ref16, n);
+		if (memcmp(data, ref, size) != 0)
+			rv = -1, fprintf(stderr, "Error: pack16 mismatch: n=%zu\n", n);
+
+		memset(code16, 0xAA, size);
+		memcpy(ref16 + n, code16 + n, size - n * sizeof(*ref16));
+		codeword_unpack16(code16, ref, n);
+		if (memcmp(code16, ref16, size) != 0)
+			rv = -1, fprintf(stderr, "Error: unpack16 mismatch: n=%zu\n", n);
+
+		memset(data, 0xAA, size);
+		memset(ref, 0xAA, size);
+		codeword_pack24(data, ref24, n);
+		ref_pack24(ref, ref24, n);
+		if (memcmp(data, ref, size) != 0)
+			rv = -1, fprintf(stderr, "Error: pack24 mismatch: n=%zu\n", n);
+
+		memset(code24, 0xAA, size);
+		memcpy(ref24 + n, code24 + n, size - n * sizeof(*ref24));
+		codeword_unpack24(code24, ref, n);
+		if (memcmp(code24, ref24, size) != 0)
+			rv = -1, fprintf(stderr, "Error: unpack24 mismatch: n=%zu\n", n);
+
+	}
+
+	free(code24);
+	free(ref24);
+	free(code16);
+	free(ref16);
+	free(data);
+	free(ref);
+	return rv;
+}
+
+#define BENCH(name, fn, dst, src)                                                                                      \
+	do {                                                                                                               \
+		struct timespec t0, t1;                                                                                        \
+		double best = 1e18;                                                                                            \
+		for (size_t r = 0; r < rounds; r++) {                                                                          \
+			clock_gettime(CLOCK_MONOTONIC, &t0);                                                                       \
+			fn(dst, src, n);                                                                                           \
+			clock_gettime(CLOCK_MONOTONIC, &t1);                                                                       \
+			if (elapsed_ns(&t0, &t1) < best)                                                                           \
+				best = elapsed_ns(&t0, &t1);                                                                           \
+		}                                                                                                              \
+		printf("%-16s %8.3f ns/codeword\n", name, best / n);                                                          \
+	} while (0)
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hn:r:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "codewords", required_argument, NULL, 'n' },
+		{ "rounds", required_argument, NULL, 'r' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t n = 4096;
+	size_t rounds = 2000;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -n, --codewords=NUM\tnumber of codewords per call (default: %zu)\n"
+			       "  -r, --rounds=NUM\tnumber of measurement rounds (default: %zu)\n",
+			       argv[0], n, rounds);
+			return EXIT_SUCCESS;
+		case 'n' /* --codewords=NUM */:
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 'r' /* --rounds=NUM */:
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (n == 0 || rounds == 0) {
+		fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	if (verify(256) != 0)
+		return EXIT_FAILURE;
+
+	uint32_t * code24 = calloc(n, sizeof(*code24));
+	uint16_t * code16 = calloc(n, sizeof(*code16));
+	uint8_t * data = calloc(n, 3);
+
+	BENCH("pack16 (bytes)", ref_pack16, data, code16);
+	BENCH("pack16", codeword_pack16, data, code16);
+	BENCH("unpack16 (bytes)", ref_unpack16, code16, data);
+	BENCH("unpack16", codeword_unpack16, code16, data);
+	BENCH("pack24 (bytes)", ref_pack24, data, code24);
+	BENCH("pack24", codeword_pack24, data, code24);
+	BENCH("unpack24 (bytes)", ref_unpack24, code24, data);
+	BENCH("unpack24", codeword_unpack24, code24, data);
+
+	free(code24);
+	free(code16);
+	free(data);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+/*
+ * bench-coro.cpp
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "openaptx-coro.hpp"
+
+extern "C" {
+#include "signals.h"
+}
+
+/* number of allocations made with the global operator new */
+static size_t allocations = 0;
+
+void * operator new(size_t size) {
+	allocations++;
+	if (void * ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+/* Replacement deallocation functions are not inlined, otherwise GCC would
+ * warn about free() called on the pointer returned by the operator new. */
+
+__attribute__((noinline)) void operator delete(void * ptr) noexcept {
+	std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void * ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+/**
+ * Single-threaded executor with a fixed-size FIFO run queue, so it does
+ * not allocate by itself. */
+struct executor {
+	struct schedule_awaiter {
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> h) noexcept { ex.queue[ex.tail++ % ex.queue.size()] = h; }
+		void await_resume() const noexcept {}
+		executor & ex;
+	};
+	/* suspend the coroutine and resume it from the run loop */
+	schedule_awaiter schedule() noexcept { return { *this }; }
+	void run() {
+		while (head != tail)
+			queue[head++ % queue.size()].resume();
+	}
+	std::array<std::coroutine_handle<>, 16> queue;
+	size_t head = 0;
+	size_t tail = 0;
+};
+
+/**
+ * Coroutine which starts immediately and is not awaited by anyone. */
+struct detached {
+	struct promise_type {
+		detached get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+struct stats {
+	size_t chunks = 0;
+	/* chunks produced since the last request of the consumer */
+	size_t pulled = 0;
+	/* maximum number of chunks produced for a single request, which is 1
+	 * unless chunks are so small that they do not complete any block */
+	size_t pulled_max = 0;
+	size_t allocations = 0;
+	size_t codewords = 0;
+};
+
+/**
+ * Capture source which delivers chunks of varying size, so blocks are
+ * split between chunks. Every chunk is delivered via the executor, as if
+ * it was completed by the I/O. */
+static openaptx::generator<openaptx::pcm_chunk> capture(executor & ex, const std::vector<int32_t> & pcmL,
+                                                        const std::vector<int32_t> & pcmR, size_t chunk,
+                                                        stats & st) {
+	size_t seed = 0xC0DE;
+	for (size_t i = 0; i < pcmL.size();) {
+		co_await ex.schedule();
+		seed = seed * 1664525 + 1013904223;
+		size_t frames = chunk - 3 + (seed >> 16) % 7;
+		if (frames > pcmL.size() - i)
+			frames = pcmL.size() - i;
+		st.chunks++;
+		if (++st.pulled > st.pulled_max)
+			st.pulled_max = st.pulled;
+		co_yield { std::span(&pcmL[i], frames), std::span(&pcmR[i], frames) };
+		i += frames;
+	}
+}
+
+template <openaptx_codec Codec>
+static detached consume(executor & ex, openaptx::basic_encoder<Codec> & enc, const std::vector<int32_t> & pcmL,
+                        const std::vector<int32_t> & pcmR, size_t chunk,
+                        std::vector<typename openaptx::codec_traits<Codec>::code_type> & out, stats & st) {
+	auto stage = openaptx::encode_stage(enc, capture(ex, pcmL, pcmR, chunk, st));
+	size_t warmup = 0;
+	for (;;) {
+		st.pulled = 0;
+		const auto * code = co_await stage.next();
+		if (code == nullptr)
+			break;
+		std::copy(code->begin(), code->end(), &out[st.codewords]);
+		st.codewords += code->size();
+		/* the buffer grows during the first chunks only */
+		if (++warmup == 16)
+			st.allocations = allocations;
+	}
+	st.allocations = allocations - st.allocations;
+}
+
+template <openaptx_codec Codec> static const char * codec_name() {
+	return Codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+template <openaptx_codec Codec> static int bench(size_t frames, size_t chunk) {
+
+	using code_type = typename openaptx::codec_traits<Codec>::code_type;
+	const unsigned int bits = Codec == OPENAPTX_CODEC_APTX_HD ? 24 : 16;
+
+	std::vector<int32_t> pcmL(frames), pcmR(frames);
+	signal_generate(SIGNAL_PINK, pcmL.data(), pcmR.data(), frames, bits);
+
+	std::vector<code_type> code_direct(frames / 2), code_coro(frames / 2);
+
+	auto t0 = std::chrono::steady_clock::now();
+	openaptx::basic_encoder<Codec> enc_direct;
+	enc_direct.encode(pcmL.data(), pcmR.data(), frames, code_direct.data());
+	const double t_direct = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	executor ex;
+	stats st;
+	t0 = std::chrono::steady_clock::now();
+	openaptx::basic_encoder<Codec> enc_coro;
+	consume<Codec>(ex, enc_coro, pcmL, pcmR, chunk, code_coro, st);
+	ex.run();
+	const double t_coro = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	const bool exact = st.codewords == code_coro.size() && code_direct == code_coro;
+	std::printf("%-9s %10.2f %10.2f %8zu %8zu %8zu %s\n", codec_name<Codec>(), t_direct, t_coro, st.chunks,
+	            st.pulled_max, st.allocations, exact ? "exact" : "MISMATCH");
+	return exact && st.allocations == 0 ? 0 : -1;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hc:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "chunk", required_argument, NULL, 'c' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t chunk = 128;
+	size_t seconds = 10;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			std::printf("Usage:\n"
+			            "  %s [OPTION]...\n"
+			            "\nOptions:\n"
+			            "  -h, --help\t\tprint this help and exit\n"
+			            "  -c, --chunk=NUM\taverage number of frames per chunk (default: %zu)\n"
+			            "  -s, --seconds=NUM\tsignal duration (default: %zu)\n",
+			            argv[0], chunk, seconds);
+			return EXIT_SUCCESS;
+		case 'c' /* --chunk=NUM */:
+			chunk = std::strtoul(optarg, NULL, 10);
+			break;
+		case 's' /* --seconds=NUM */:
+			seconds = std::strtoul(optarg, NULL, 10);
+			break;
+		default:
+			std::fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (chunk < 4 || seconds == 0) {
+		std::fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	/* whole blocks only, so both paths encode the same number of frames */
+	const size_t frames = seconds * 48000 / 4 * 4;
+
+	std::printf("%-9s %10s %10s %8s %8s %8s\n", "codec", "direct[ms]", "coro[ms]", "chunks", "pulled",
+	            "allocs");
+	int rv = EXIT_SUCCESS;
+	if (bench<OPENAPTX_CODEC_APTX>(frames, chunk) == -1)
+		rv = EXIT_FAILURE;
+	if (bench<OPENAPTX_CODEC_APTX_HD>(frames, chunk) == -1)
+		rv = EXIT_FAILURE;
+
+	return rv;
+}
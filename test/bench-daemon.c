@@ -0,0 +1,269 @@
+/*
+ * bench-daemon.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx-client.h"
+#include "openaptx.h"
+
+#include "../src/daemon.h"
+#include "../src/stream.h"
+#include "signals.h"
+
+#define SAMPLING_RATE 48000
+
+static const char * codec_name(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+static double elapsed_ms(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * Start the daemon and wait until it accepts connections.
+ *
+ * @return On success, the PID of the daemon is returned. Otherwise, -1 is
+ *   returned and the error message is printed. */
+static pid_t daemon_start(const char * daemon, const char * path) {
+
+	pid_t pid;
+	if ((pid = fork()) == -1) {
+		fprintf(stderr, "Error: Couldn't fork: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (pid == 0) {
+		execl(daemon, daemon, "--socket", path, "--jobs", "2", NULL);
+		fprintf(stderr, "Error: Couldn't execute daemon: %s: %s\n", daemon, strerror(errno));
+		_exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < 500; i++) {
+		openaptx_client * c;
+		if ((c = openaptx_client_open(path, OPENAPTX_CODEC_APTX, 0, DAEMON_RING_FRAMES_MIN)) != NULL) {
+			openaptx_client_close(c);
+			return pid;
+		}
+		if (waitpid(pid, NULL, WNOHANG) == pid) {
+			fprintf(stderr, "Error: Daemon terminated prematurely\n");
+			return -1;
+		}
+		usleep(10000);
+	}
+
+	fprintf(stderr, "Error: Couldn't connect to daemon: %s\n", strerror(errno));
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return -1;
+}
+
+static int daemon_stop(pid_t pid) {
+	int status;
+	kill(pid, SIGTERM);
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		fprintf(stderr, "Error: Daemon did not terminate gracefully\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int bench(const char * path, enum openaptx_codec codec, size_t frames, size_t ring, size_t chunk) {
+
+	const unsigned int bits = codec == OPENAPTX_CODEC_APTX_HD ? 24 : 16;
+	const size_t stream_size = frames / 4 * 2 * stream_codeword_size(codec);
+
+	int32_t * pcmL = malloc(frames * sizeof(*pcmL));
+	int32_t * pcmR = malloc(frames * sizeof(*pcmR));
+	int32_t * pcm = malloc(frames * 2 * sizeof(*pcm));
+	uint8_t * stream_direct = malloc(stream_size);
+	uint8_t * stream_daemon = malloc(stream_size);
+	openaptx_client * c = NULL;
+	APTXENC enc = NULL;
+	int rv = -1;
+
+	if (pcmL == NULL || pcmR == NULL || pcm == NULL || stream_direct == NULL || stream_daemon == NULL ||
+	    (enc = stream_encoder_new(codec, 0)) == NULL) {
+		fprintf(stderr, "Error: Couldn't initialize: %s\n", strerror(errno));
+		goto final;
+	}
+
+	signal_generate(SIGNAL_PINK, pcmL, pcmR, frames, bits);
+	for (size_t i = 0; i < frames; i++) {
+		pcm[i * 2 + 0] = pcmL[i];
+		pcm[i * 2 + 1] = pcmR[i];
+	}
+
+	struct timespec t0, t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (stream_encode(codec, enc, pcm, frames, stream_direct) != 0) {
+		fprintf(stderr, "Error: Couldn't encode PCM samples\n");
+		goto final;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if ((c = openaptx_client_open(path, codec, 0, ring)) == NULL) {
+		fprintf(stderr, "Error: Couldn't open stream: %s\n", strerror(errno));
+		goto final;
+	}
+
+	uint32_t seed = 0xDAE0;
+	size_t written = 0;
+	size_t len = 0;
+
+	/* Writes do not wait, because this is a single-threaded client which
+	 * has to read the encoded stream in order to make room in the rings. */
+	while (len < stream_size) {
+
+		ssize_t n = 0;
+
+		if (written < frames) {
+			seed = seed * 1664525 + 1013904223;
+			size_t count = 1 + (seed >> 8) % (chunk * 2);
+			if (count > frames - written)
+				count = frames - written;
+			if ((n = openaptx_client_write(c, &pcm[written * 2], count, false)) == -1) {
+				fprintf(stderr, "Error: Couldn't write PCM samples: %s\n", strerror(errno));
+				goto final;
+			}
+			written += n;
+		}
+
+		/* wait for the daemon only if the write has not made any progress */
+		ssize_t rlen;
+		if ((rlen = openaptx_client_read(c, &stream_daemon[len], stream_size - len, n == 0)) == -1) {
+			fprintf(stderr, "Error: Couldn't read encoded stream: %s\n", strerror(errno));
+			goto final;
+		}
+		len += rlen;
+
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	struct openaptx_client_stats stats;
+	openaptx_client_stats(c, &stats);
+
+	const bool exact = stats.frames == frames && memcmp(stream_direct, stream_daemon, stream_size) == 0;
+	printf("%-9s %6zu %10.2f %10.2f %10.2f %8zu %s\n", codec_name(codec), ring, elapsed_ms(&t0, &t1),
+	       elapsed_ms(&t1, &t2), stats.encode_ns / 1e6, stats.pcm_queued_max, exact ? "exact" : "MISMATCH");
+
+	rv = exact ? 0 : -1;
+
+final:
+	openaptx_client_close(c);
+	stream_encoder_free(codec, enc);
+	free(pcmL);
+	free(pcmR);
+	free(pcm);
+	free(stream_direct);
+	free(stream_daemon);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hc:d:r:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "chunk", required_argument, NULL, 'c' },
+		{ "daemon", required_argument, NULL, 'd' },
+		{ "ring", required_argument, NULL, 'r' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	const char * daemon = APTXD_PATH;
+	size_t chunk = 128;
+	size_t ring = 1024;
+	size_t seconds = 10;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -c, --chunk=NUM\taverage number of frames per write (default: %zu)\n"
+			       "  -d, --daemon=PATH\tpath to the aptxd executable (default: %s)\n"
+			       "  -r, --ring=NUM\tcapacity of the PCM ring (default: %zu)\n"
+			       "  -s, --seconds=NUM\tsignal duration (default: %zu)\n",
+			       argv[0], chunk, daemon, ring, seconds);
+			return EXIT_SUCCESS;
+		case 'c' /* --chunk=NUM */:
+			chunk = strtoul(optarg, NULL, 10);
+			break;
+		case 'd' /* --daemon=PATH */:
+			daemon = optarg;
+			break;
+		case 'r' /* --ring=NUM */:
+			ring = strtoul(optarg, NULL, 10);
+			break;
+		case 's' /* --seconds=NUM */:
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (chunk == 0 || seconds == 0) {
+		fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	char dir[] = "/tmp/openaptx-XXXXXX";
+	char path[sizeof(dir) + 16];
+	if (mkdtemp(dir) == NULL) {
+		fprintf(stderr, "Error: Couldn't create temporary directory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), "%s/aptxd.sock", dir);
+
+	pid_t pid;
+	if ((pid = daemon_start(daemon, path)) == -1) {
+		unlink(path);
+		rmdir(dir);
+		return EXIT_FAILURE;
+	}
+
+	/* whole blocks only, so the daemon encodes all frames */
+	const size_t frames = seconds * SAMPLING_RATE / 4 * 4;
+
+	printf("%-9s %6s %10s %10s %10s %8s\n", "codec", "ring", "direct[ms]", "daemon[ms]", "encode[ms]", "queued");
+
+	int rv = EXIT_SUCCESS;
+	if (bench(path, OPENAPTX_CODEC_APTX, frames, ring, chunk) == -1)
+		rv = EXIT_FAILURE;
+	if (bench(path, OPENAPTX_CODEC_APTX_HD, frames, ring, chunk) == -1)
+		rv = EXIT_FAILURE;
+
+	if (daemon_stop(pid) == -1)
+		rv = EXIT_FAILURE;
+
+	unlink(path);
+	rmdir(dir);
+	return rv;
+}
@@ -0,0 +1,359 @@
+/*
+ * bench-fanout.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx-fanout.h"
+#include "openaptx.h"
+
+#include "../src/stream.h"
+#include "signals.h"
+
+#define SAMPLING_RATE 48000
+/* Number of blocks in the apt-X autosync period. */
+#define SYNC_BLOCKS 8
+
+struct reader {
+	pthread_t thread;
+	openaptx_subscriber * sub;
+	/* size of the encoded block */
+	size_t block_size;
+	/* position of the first received block */
+	uint64_t block;
+	uint8_t * stream;
+	size_t stream_len;
+	size_t packets;
+	/* set if received packets were not contiguous */
+	bool gap;
+};
+
+struct writer {
+	pthread_t thread;
+	openaptx_fanout * fanout;
+	const int32_t * pcm;
+	size_t packet_frames;
+	size_t packets;
+	atomic_size_t written;
+	int err;
+};
+
+static const char * codec_name(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+static double elapsed_ms(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * Read all packets until the end of the stream. */
+static void * reader_thread(void * arg) {
+	struct reader * r = arg;
+
+	const struct openaptx_packet * packet;
+	while ((packet = openaptx_fanout_read(r->sub, true)) != NULL) {
+		if (r->packets++ == 0)
+			r->block = packet->block;
+		if (packet->block != r->block + r->stream_len / r->block_size)
+			r->gap = true;
+		memcpy(&r->stream[r->stream_len], packet->data, packet->size);
+		r->stream_len += packet->size;
+		openaptx_packet_unref(packet);
+	}
+
+	return NULL;
+}
+
+/**
+ * Write one packet at a time, so the progress of the writer is visible. */
+static void * writer_thread(void * arg) {
+	struct writer * w = arg;
+
+	for (size_t i = 0; i < w->packets; i++) {
+		if (openaptx_fanout_write(w->fanout, &w->pcm[i * w->packet_frames * 2], w->packet_frames) == -1) {
+			w->err = errno;
+			break;
+		}
+		atomic_fetch_add(&w->written, 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * Wait until the writer has written the given number of packets and check
+ * that it does not write more. */
+static bool writer_held(struct writer * w, size_t packets) {
+	for (size_t i = 0; i < 100 && atomic_load(&w->written) < packets; i++)
+		usleep(10000);
+	usleep(50000);
+	return atomic_load(&w->written) == packets;
+}
+
+static void report(const char * check, bool ok, size_t * errors) {
+	printf("  %-44s %s\n", check, ok ? "ok" : "FAILED");
+	if (!ok)
+		(*errors)++;
+}
+
+/**
+ * Check that blocking subscribers hold the writer, while non-blocking ones
+ * lose the oldest packets. */
+static bool bench_hold(enum openaptx_codec codec, const int32_t * pcm, size_t packet_frames) {
+
+	/* The fourth packet is consumed but not published when the stream is
+	 * closed, so the fifth write reports the error. */
+	struct writer w = { .pcm = pcm, .packet_frames = packet_frames, .packets = 5 };
+	openaptx_subscriber * sub_blocking = NULL;
+	openaptx_subscriber * sub_dropping = NULL;
+	bool held = false;
+
+	if ((w.fanout = openaptx_fanout_new(codec, 0, packet_frames)) == NULL ||
+	    (sub_blocking = openaptx_fanout_subscribe(w.fanout, 2, true)) == NULL ||
+	    (sub_dropping = openaptx_fanout_subscribe(w.fanout, 1, false)) == NULL) {
+		fprintf(stderr, "Error: Couldn't initialize: %s\n", strerror(errno));
+		goto final;
+	}
+
+	atomic_init(&w.written, 0);
+	if ((errno = pthread_create(&w.thread, NULL, writer_thread, &w)) != 0) {
+		fprintf(stderr, "Error: Couldn't create writer thread: %s\n", strerror(errno));
+		goto final;
+	}
+
+	/* The third packet waits for the blocking subscriber. */
+	held = writer_held(&w, 2) && openaptx_fanout_overruns(sub_dropping) == 1;
+
+	const struct openaptx_packet * packet;
+	if ((packet = openaptx_fanout_read(sub_blocking, false)) == NULL)
+		held = false;
+	openaptx_packet_unref(packet);
+
+	held &= writer_held(&w, 3) && openaptx_fanout_overruns(sub_dropping) == 2;
+
+	openaptx_fanout_close(w.fanout);
+	pthread_join(w.thread, NULL);
+	held &= atomic_load(&w.written) == 4 && w.err == EPIPE;
+
+final:
+	openaptx_fanout_unsubscribe(sub_blocking);
+	openaptx_fanout_unsubscribe(sub_dropping);
+	openaptx_fanout_free(w.fanout);
+	return held;
+}
+
+static int bench(enum openaptx_codec codec, size_t frames, size_t packet_frames, size_t chunk) {
+
+	const unsigned int bits = codec == OPENAPTX_CODEC_APTX_HD ? 24 : 16;
+	const size_t block_size = 2 * stream_codeword_size(codec);
+	const size_t stream_size = frames / 4 * block_size;
+
+	int32_t * pcmL = malloc(frames * sizeof(*pcmL));
+	int32_t * pcmR = malloc(frames * sizeof(*pcmR));
+	int32_t * pcm = malloc(frames * 2 * sizeof(*pcm));
+	uint8_t * stream_direct = malloc(stream_size);
+	struct reader early = { .block_size = block_size, .stream = malloc(stream_size) };
+	struct reader late = { .block_size = block_size, .stream = malloc(stream_size) };
+	openaptx_subscriber * sub_dropping = NULL;
+	openaptx_fanout * fanout = NULL;
+	bool early_running = false;
+	bool late_running = false;
+	size_t errors = 0;
+	APTXENC enc = NULL;
+	int rv = -1;
+
+	if (pcmL == NULL || pcmR == NULL || pcm == NULL || stream_direct == NULL || early.stream == NULL ||
+	    late.stream == NULL || (enc = stream_encoder_new(codec, 0)) == NULL ||
+	    (fanout = openaptx_fanout_new(codec, 0, packet_frames)) == NULL ||
+	    (early.sub = openaptx_fanout_subscribe(fanout, 4, true)) == NULL ||
+	    (sub_dropping = openaptx_fanout_subscribe(fanout, 2, false)) == NULL) {
+		fprintf(stderr, "Error: Couldn't initialize: %s\n", strerror(errno));
+		goto final;
+	}
+
+	/* packet size is rounded up to the autosync period */
+	packet_frames = (packet_frames + SYNC_BLOCKS * 4 - 1) / (SYNC_BLOCKS * 4) * (SYNC_BLOCKS * 4);
+	const size_t packets = frames / packet_frames;
+
+	signal_generate(SIGNAL_PINK, pcmL, pcmR, frames, bits);
+	for (size_t i = 0; i < frames; i++) {
+		pcm[i * 2 + 0] = pcmL[i];
+		pcm[i * 2 + 1] = pcmR[i];
+	}
+
+	struct timespec t0, t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (stream_encode(codec, enc, pcm, frames, stream_direct) != 0) {
+		fprintf(stderr, "Error: Couldn't encode PCM samples\n");
+		goto final;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if ((errno = pthread_create(&early.thread, NULL, reader_thread, &early)) != 0) {
+		fprintf(stderr, "Error: Couldn't create reader thread: %s\n", strerror(errno));
+		goto final;
+	}
+	early_running = true;
+
+	uint32_t seed = 0xFA0;
+	for (size_t i = 0; i < frames;) {
+
+		/* the late subscriber joins in the middle of a packet */
+		if (!late_running && i >= frames / 2) {
+			if ((late.sub = openaptx_fanout_subscribe(fanout, 4, true)) == NULL ||
+			    (errno = pthread_create(&late.thread, NULL, reader_thread, &late)) != 0) {
+				fprintf(stderr, "Error: Couldn't subscribe: %s\n", strerror(errno));
+				goto final;
+			}
+			late_running = true;
+		}
+
+		seed = seed * 1664525 + 1013904223;
+		size_t n = 1 + (seed >> 8) % (chunk * 2);
+		if (n > frames - i)
+			n = frames - i;
+
+		ssize_t consumed;
+		if ((consumed = openaptx_fanout_write(fanout, &pcm[i * 2], n)) == -1) {
+			fprintf(stderr, "Error: Couldn't write PCM samples: %s\n", strerror(errno));
+			goto final;
+		}
+		i += consumed;
+
+	}
+
+	openaptx_fanout_close(fanout);
+	pthread_join(early.thread, NULL);
+	pthread_join(late.thread, NULL);
+	early_running = late_running = false;
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	/* the non-blocking subscriber has never read, so it keeps the newest packets */
+	const struct openaptx_packet * packet;
+	bool newest = true;
+	size_t pending = 0;
+	while ((packet = openaptx_fanout_read(sub_dropping, false)) != NULL) {
+		newest &= packet->block == (packets - 2 + pending++) * packet_frames / 4;
+		openaptx_packet_unref(packet);
+	}
+	const size_t overruns = openaptx_fanout_overruns(sub_dropping);
+
+	printf("%-9s %6zu %8zu %10.2f %10.2f %8zu\n", codec_name(codec), packet_frames, packets, elapsed_ms(&t0, &t1),
+	       elapsed_ms(&t1, &t2), overruns);
+
+	const bool exact = early.packets == packets && !early.gap &&
+	                   early.stream_len == packets * packet_frames / 4 * block_size &&
+	                   memcmp(early.stream, stream_direct, early.stream_len) == 0;
+	const bool exact_late = late.packets > 0 && !late.gap && late.block != 0 && late.block % SYNC_BLOCKS == 0 &&
+	                        memcmp(late.stream, &stream_direct[late.block * block_size], late.stream_len) == 0;
+
+	report("packets are identical to direct encode", exact, &errors);
+	report("late subscriber starts at autosync period", exact_late, &errors);
+	report("non-blocking subscriber counts overruns", newest && pending == 2 && overruns == packets - 2, &errors);
+	report("blocking subscriber holds the writer", bench_hold(codec, pcm, packet_frames), &errors);
+
+	rv = errors == 0 ? 0 : -1;
+
+final:
+	if (early_running || late_running) {
+		openaptx_fanout_close(fanout);
+		if (early_running)
+			pthread_join(early.thread, NULL);
+		if (late_running)
+			pthread_join(late.thread, NULL);
+	}
+	openaptx_fanout_unsubscribe(early.sub);
+	openaptx_fanout_unsubscribe(late.sub);
+	openaptx_fanout_unsubscribe(sub_dropping);
+	openaptx_fanout_free(fanout);
+	stream_encoder_free(codec, enc);
+	free(pcmL);
+	free(pcmR);
+	free(pcm);
+	free(stream_direct);
+	free(early.stream);
+	free(late.stream);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hc:p:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "chunk", required_argument, NULL, 'c' },
+		{ "packet", required_argument, NULL, 'p' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t chunk = 128;
+	size_t packet = 160;
+	size_t seconds = 10;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -c, --chunk=NUM\taverage number of frames per write (default: %zu)\n"
+			       "  -p, --packet=NUM\tnumber of frames per packet (default: %zu)\n"
+			       "  -s, --seconds=NUM\tsignal duration (default: %zu)\n",
+			       argv[0], chunk, packet, seconds);
+			return EXIT_SUCCESS;
+		case 'c' /* --chunk=NUM */:
+			chunk = strtoul(optarg, NULL, 10);
+			break;
+		case 'p' /* --packet=NUM */:
+			packet = strtoul(optarg, NULL, 10);
+			break;
+		case 's' /* --seconds=NUM */:
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	/* at least 4 packets in each half of the stream */
+	if (chunk == 0 || packet == 0 || seconds * SAMPLING_RATE < (packet + SYNC_BLOCKS * 4) * 8) {
+		fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	/* whole blocks only, the last incomplete packet is discarded */
+	const size_t frames = seconds * SAMPLING_RATE / 4 * 4;
+
+	printf("%-9s %6s %8s %10s %10s %8s\n", "codec", "packet", "packets", "direct[ms]", "fanout[ms]", "overruns");
+
+	int rv = EXIT_SUCCESS;
+	if (bench(OPENAPTX_CODEC_APTX, frames, packet, chunk) == -1)
+		rv = EXIT_FAILURE;
+	if (bench(OPENAPTX_CODEC_APTX_HD, frames, packet, chunk) == -1)
+		rv = EXIT_FAILURE;
+
+	return rv;
+}
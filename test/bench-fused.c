@@ -0,0 +1,321 @@
+/*
+ * bench-fused.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "signals.h"
+
+#if APTXHD
+#	include "aptxHD100.h"
+#	include "../src/aptxhd100/encode.h"
+#	include "../src/aptxhd100/fused.h"
+#	include "../src/aptxhd100/mathex.h"
+#	define _codec_name_ "apt-X HD"
+#	define _sample_bits_ 24
+#	define _encoder_t_ aptXHD_encoder_100
+#	define _codeword_t_ uint32_t
+#	define _encoder_init_ aptXHD_encoder_init
+#	define _encode_ aptXHD_encode
+#	define _insert_sync_ aptXHD_insert_sync
+#	define _post_encode_ aptXHD_post_encode
+#	define _pack_codeword_ aptXHD_pack_codeword
+#	define _encode_fused_ aptXHD_encode_fused
+#	define _encode_fused_guarded_ aptXHD_encode_fused_guarded
+#else
+#	include "aptx422.h"
+#	include "../src/aptx422/encode.h"
+#	include "../src/aptx422/fused.h"
+#	include "../src/aptx422/mathex.h"
+#	define _codec_name_ "apt-X"
+#	define _sample_bits_ 16
+#	define _encoder_t_ aptX_encoder_422
+#	define _codeword_t_ uint16_t
+#	define _encoder_init_ aptX_encoder_init
+#	define _encode_ aptX_encode
+#	define _insert_sync_ aptX_insert_sync
+#	define _post_encode_ aptX_post_encode
+#	define _pack_codeword_ aptX_pack_codeword
+#	define _encode_fused_ aptX_encode_fused
+#	define _encode_fused_guarded_ aptX_encode_fused_guarded
+#endif
+
+typedef void (*encode_func)(_encoder_t_ * e, const int32_t pcmL[4], const int32_t pcmR[4], _codeword_t_ code[2]);
+
+/**
+ * Encoding path used before the fused kernel was introduced. */
+static void encode_staged(_encoder_t_ * e, const int32_t pcmL[4], const int32_t pcmR[4], _codeword_t_ code[2]) {
+
+	_codeword_t_ tmp;
+
+	_encode_(pcmL, &e->analyzer[0], &e->encoder[0]);
+	_encode_(pcmR, &e->analyzer[1], &e->encoder[1]);
+	_insert_sync_(&e->encoder[0], &e->encoder[1], &e->sync);
+
+	_post_encode_(&e->encoder[0]);
+	_post_encode_(&e->encoder[1]);
+
+	tmp = _pack_codeword_(&e->encoder[0]);
+	code[0] = (tmp >> e->shift) | (tmp << e->shift);
+	tmp = _pack_codeword_(&e->encoder[1]);
+	code[1] = (tmp >> e->shift) | (tmp << e->shift);
+}
+
+static size_t fast_blocks = 0;
+
+static void encode_guarded(_encoder_t_ * e, const int32_t pcmL[4], const int32_t pcmR[4], _codeword_t_ code[2]) {
+	if (_encode_fused_guarded_(e, pcmL, pcmR, code))
+		fast_blocks++;
+}
+
+/**
+ * Calculate FNV-1a hash of the encoded stream, so the output of builds with
+ * different arithmetic paths (or for different targets) can be compared. */
+static uint32_t checksum(const _codeword_t_ * code, size_t n) {
+	uint32_t hash = 2166136261;
+	for (size_t i = 0; i < n; i++)
+		hash = (hash ^ code[i]) * 16777619;
+	return hash;
+}
+
+static double elapsed_us(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+/**
+ * Generate test signal: a mix of tones, noise and overdriven parts, so
+ * also the clamping paths are exercised. */
+static void generate(int32_t * pcmL, int32_t * pcmR, size_t samples) {
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < samples; i++) {
+		seed = seed * 1664525 + 1013904223;
+		const double noise = ((int32_t)seed >> 8) / 8388608.0;
+		const double gain = (i / 48000) % 4 == 3 ? 4.0 : 1.0;
+		pcmL[i] = gain * 8388607 * (0.35 * sin(0.0785 * i) + 0.15 * sin(0.817 * i) + 0.02 * noise);
+		pcmR[i] = gain * 8388607 * (0.30 * sin(0.1963 * i) + 0.10 * sin(1.948 * i) + 0.20 * noise);
+#if !APTXHD
+		pcmL[i] /= 256;
+		pcmR[i] /= 256;
+#endif
+	}
+}
+
+/**
+ * Load raw interleaved stereo S16LE PCM as the test signal. */
+static size_t load(const char * path, int32_t ** pcmL, int32_t ** pcmR) {
+
+	FILE * f;
+	if ((f = fopen(path, "rb")) == NULL)
+		return 0;
+
+	size_t samples = 0;
+	int16_t frame[2];
+	int32_t * l = NULL, * r = NULL;
+	while (fread(frame, sizeof(frame), 1, f) == 1) {
+		if (samples % 4096 == 0) {
+			int32_t * tmp;
+			if ((tmp = realloc(l, (samples + 4096) * sizeof(*l))) == NULL)
+				break;
+			l = tmp;
+			if ((tmp = realloc(r, (samples + 4096) * sizeof(*r))) == NULL)
+				break;
+			r = tmp;
+		}
+		l[samples] = frame[0];
+		r[samples] = frame[1];
+#if APTXHD
+		l[samples] *= 256;
+		r[samples] *= 256;
+#endif
+		samples++;
+	}
+
+	fclose(f);
+	*pcmL = l;
+	*pcmR = r;
+	return samples / 4;
+}
+
+static double run(encode_func encode, short endian, const int32_t * pcmL, const int32_t * pcmR, size_t blocks,
+                  _codeword_t_ * code, _encoder_t_ * e) {
+
+	struct timespec t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	_encoder_init_(e, endian);
+	for (size_t i = 0; i < blocks; i++)
+		encode(e, &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return elapsed_us(&t0, &t1);
+}
+
+/**
+ * Check that fused kernels are bit-exact with the staged encoder. */
+static int verify(const char * label, const int32_t * pcmL, const int32_t * pcmR, size_t blocks,
+                  _codeword_t_ * code_staged, _codeword_t_ * code_fused, _encoder_t_ * e_staged, _encoder_t_ * e_fused) {
+
+	int ret = 0;
+	const encode_func fused[] = { _encode_fused_, encode_guarded };
+	const char * names[] = { "fused", "guarded" };
+	for (size_t k = 0; k < 2 * 2; k++) {
+		const short endian = k % 2;
+		run(encode_staged, endian, pcmL, pcmR, blocks, code_staged, e_staged);
+		run(fused[k / 2], endian, pcmL, pcmR, blocks, code_fused, e_fused);
+		for (size_t i = 0; i < blocks; i++)
+			if (memcmp(&code_staged[i * 2], &code_fused[i * 2], 2 * sizeof(*code_fused)) != 0) {
+				fprintf(stderr, "Codeword mismatch: %s %s endian=%d block=%zu\n", label, names[k / 2], endian, i);
+				ret = -1;
+				break;
+			}
+		if (memcmp(e_staged, e_fused, sizeof(*e_fused)) != 0) {
+			fprintf(stderr, "Encoder state mismatch: %s %s endian=%d\n", label, names[k / 2], endian);
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hn:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "loops", required_argument, NULL, 'n' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t nloops = 10;
+	size_t seconds = 10;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]... [FILE]\n"
+			       "\nCompare fused encoding kernel with the staged encoder. If FILE with\n"
+			       "raw stereo S16LE PCM is given, it is used as the test signal. Bit-exactness\n"
+			       "is also verified with the signal corpus, with and without silence gaps.\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -n, --loops=NUM\tnumber of timing rounds\n"
+			       "  -s, --seconds=NUM\tduration of the test signal\n",
+			       argv[0]);
+			return EXIT_SUCCESS;
+		case 'n':
+			nloops = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (nloops == 0)
+		nloops = 1;
+	if (seconds == 0)
+		seconds = 1;
+
+	size_t blocks = seconds * 48000 / 4;
+	int32_t * pcmL = NULL;
+	int32_t * pcmR = NULL;
+
+	if (optind < argc) {
+		if ((blocks = load(argv[optind], &pcmL, &pcmR)) == 0) {
+			fprintf(stderr, "Couldn't load PCM: %s\n", argv[optind]);
+			return EXIT_FAILURE;
+		}
+	}
+	else {
+		pcmL = malloc(blocks * 4 * sizeof(*pcmL));
+		pcmR = malloc(blocks * 4 * sizeof(*pcmR));
+		if (pcmL != NULL && pcmR != NULL)
+			generate(pcmL, pcmR, blocks * 4);
+	}
+
+	_codeword_t_ * code_staged = malloc(blocks * 2 * sizeof(*code_staged));
+	_codeword_t_ * code_fused = malloc(blocks * 2 * sizeof(*code_fused));
+	_encoder_t_ * e_staged = malloc(sizeof(*e_staged));
+	_encoder_t_ * e_fused = malloc(sizeof(*e_fused));
+
+	if (pcmL == NULL || pcmR == NULL || code_staged == NULL || code_fused == NULL || e_staged == NULL ||
+	    e_fused == NULL) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	int ret = EXIT_SUCCESS;
+	if (verify("test-signal", pcmL, pcmR, blocks, code_staged, code_fused, e_staged, e_fused) == -1)
+		ret = EXIT_FAILURE;
+
+	/* Verify also with the signal corpus. Every signal is verified twice, the
+	 * second time with digital silence gaps, so the transitions between the
+	 * silent and non-silent encoder paths are exercised in both directions. */
+	const size_t corpus_blocks = blocks < 12000 ? blocks : 12000;
+	int32_t * corpusL = malloc(corpus_blocks * 4 * sizeof(*corpusL));
+	int32_t * corpusR = malloc(corpus_blocks * 4 * sizeof(*corpusR));
+	for (size_t c = 0; corpusL != NULL && corpusR != NULL && c < SIGNAL_CLASSES; c++) {
+		signal_generate(c, corpusL, corpusR, corpus_blocks * 4, _sample_bits_);
+		if (verify(signal_class_name(c), corpusL, corpusR, corpus_blocks, code_staged, code_fused, e_staged,
+		           e_fused) == -1)
+			ret = EXIT_FAILURE;
+		for (size_t i = 0; i < corpus_blocks; i++)
+			if (i % 1000 >= 500) {
+				memset(&corpusL[i * 4], 0, 4 * sizeof(*corpusL));
+				memset(&corpusR[i * 4], 0, 4 * sizeof(*corpusR));
+			}
+		char label[32];
+		snprintf(label, sizeof(label), "%s-gaps", signal_class_name(c));
+		if (verify(label, corpusL, corpusR, corpus_blocks, code_staged, code_fused, e_staged, e_fused) == -1)
+			ret = EXIT_FAILURE;
+	}
+	free(corpusL);
+	free(corpusR);
+
+	double us_staged = INFINITY, us_fused = INFINITY, us_guarded = INFINITY;
+	for (size_t n = 0; n < nloops; n++) {
+		double us;
+		if ((us = run(encode_staged, 0, pcmL, pcmR, blocks, code_staged, e_staged)) < us_staged)
+			us_staged = us;
+		if ((us = run(_encode_fused_, 0, pcmL, pcmR, blocks, code_fused, e_fused)) < us_fused)
+			us_fused = us;
+		fast_blocks = 0;
+		if ((us = run(encode_guarded, 0, pcmL, pcmR, blocks, code_fused, e_fused)) < us_guarded)
+			us_guarded = us;
+	}
+
+	const double ns = 1e3 / blocks;
+	printf("%s (%zu blocks, bit-exact: %s)\n", _codec_name_, blocks, ret == EXIT_SUCCESS ? "yes" : "NO");
+	printf("  staged encoder  time: %9.0f us (%6.1f ns/blk)\n", us_staged, us_staged * ns);
+	printf("  fused kernel    time: %9.0f us (%6.1f ns/blk)\n", us_fused, us_fused * ns);
+	printf("  guarded kernel  time: %9.0f us (%6.1f ns/blk)\n", us_guarded, us_guarded * ns);
+	printf("  clamp-free blocks: %.1f%%\n", 100.0 * fast_blocks / blocks);
+	printf("  speedup: %.2fx (fused), %.2fx (guarded)\n", us_staged / us_fused, us_staged / us_guarded);
+	printf("  arithmetic path: %s\n", MATHEX_ARITH32 ? "32-bit" : "64-bit");
+	printf("  stream checksum: %08x\n", checksum(code_staged, blocks * 2));
+
+	free(pcmL);
+	free(pcmR);
+	free(code_staged);
+	free(code_fused);
+	free(e_staged);
+	free(e_fused);
+	return ret;
+}
@@ -0,0 +1,141 @@
+/*
+ * bench-hpp.cpp
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <vector>
+
+#include "openaptx.hpp"
+
+extern "C" {
+#include "signals.h"
+}
+
+template <openaptx_codec Codec> static const char * codec_name() {
+	return Codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+/**
+ * Encode interleaved PCM with the C API, the way most call sites do. */
+template <openaptx_codec Codec>
+static double encode_c(const std::vector<int32_t> & pcm,
+                       std::vector<typename openaptx::codec_traits<Codec>::code_type> & code) {
+	using traits = openaptx::codec_traits<Codec>;
+	const auto t0 = std::chrono::steady_clock::now();
+	APTXENC enc = std::malloc(traits::encoder_size());
+	traits::encoder_init(enc, 0);
+	for (size_t i = 0; i < code.size() / 2; i++) {
+		int32_t pcmL[4], pcmR[4];
+		for (size_t ii = 0; ii < 4; ii++) {
+			pcmL[ii] = pcm[(i * 4 + ii) * 2 + 0];
+			pcmR[ii] = pcm[(i * 4 + ii) * 2 + 1];
+		}
+		traits::encode(enc, pcmL, pcmR, &code[i * 2]);
+	}
+	traits::encoder_destroy(enc);
+	std::free(enc);
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+/**
+ * Encode planar PCM with the C++ API. The state is allocated from the
+ * monotonic buffer on the stack, and the encoder is moved once, in order
+ * to check that the moved-from handler does not release the state. */
+template <openaptx_codec Codec>
+static double encode_hpp(const std::vector<int32_t> & pcmL, const std::vector<int32_t> & pcmR,
+                         std::vector<typename openaptx::codec_traits<Codec>::code_type> & code) {
+	std::array<std::byte, 8192> buffer;
+	std::pmr::monotonic_buffer_resource mr(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+	const auto t0 = std::chrono::steady_clock::now();
+	openaptx::basic_encoder<Codec> tmp(0, &mr);
+	auto enc = std::move(tmp);
+	enc.encode(std::span(pcmL), std::span(pcmR), std::span(code));
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template <openaptx_codec Codec> static int bench(size_t frames) {
+
+	using code_type = typename openaptx::codec_traits<Codec>::code_type;
+	const unsigned int bits = Codec == OPENAPTX_CODEC_APTX_HD ? 24 : 16;
+
+	std::vector<int32_t> pcmL(frames), pcmR(frames), pcm(frames * 2);
+	signal_generate(SIGNAL_PINK, pcmL.data(), pcmR.data(), frames, bits);
+	for (size_t i = 0; i < frames; i++) {
+		pcm[i * 2 + 0] = pcmL[i];
+		pcm[i * 2 + 1] = pcmR[i];
+	}
+
+	std::vector<code_type> code_c(frames / 2), code_hpp(frames / 2);
+	const double t_c = encode_c<Codec>(pcm, code_c);
+	const double t_hpp = encode_hpp<Codec>(pcmL, pcmR, code_hpp);
+	const bool exact = code_c == code_hpp;
+
+	/* decoder is not available with all backends */
+	std::vector<int32_t> decL(frames), decR(frames);
+	long blocks = -1;
+	try {
+		openaptx::basic_decoder<Codec> dec;
+		blocks = dec.decode(std::span<const code_type>(code_hpp), std::span(decL), std::span(decR));
+	} catch (const std::system_error & e) {
+		std::fprintf(stderr, "Warning: %s\n", e.what());
+	}
+
+	std::printf("%-9s %10.2f %10.2f %10ld %s\n", codec_name<Codec>(), t_c, t_hpp, blocks,
+	            exact ? "exact" : "MISMATCH");
+	return exact ? 0 : -1;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hs:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t seconds = 10;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			std::printf("Usage:\n"
+			            "  %s [OPTION]...\n"
+			            "\nOptions:\n"
+			            "  -h, --help\t\tprint this help and exit\n"
+			            "  -s, --seconds=NUM\tsignal duration (default: %zu)\n",
+			            argv[0], seconds);
+			return EXIT_SUCCESS;
+		case 's' /* --seconds=NUM */:
+			seconds = std::strtoul(optarg, NULL, 10);
+			break;
+		default:
+			std::fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	const size_t frames = seconds * 48000;
+
+	std::printf("%-9s %10s %10s %10s\n", "codec", "C [ms]", "C++ [ms]", "decoded");
+	int rv = EXIT_SUCCESS;
+	if (bench<OPENAPTX_CODEC_APTX>(frames) == -1)
+		rv = EXIT_FAILURE;
+	if (bench<OPENAPTX_CODEC_APTX_HD>(frames) == -1)
+		rv = EXIT_FAILURE;
+
+	return rv;
+}
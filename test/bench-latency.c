@@ -0,0 +1,567 @@
+/*
+ * bench-latency.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "openaptx.h"
+
+/* Maximum number of compared backends. */
+#define MAX_BACKENDS 8
+/* Maximum number of measured packet sizes. */
+#define MAX_PACKETS 8
+/* Maximum number of background load threads. */
+#define MAX_JOBS 64
+/* Sampling rate used for reporting delay in milliseconds. */
+#define SAMPLE_RATE 48000
+
+/* Length of the delay probe signals in frames. */
+#define PROBE_FRAMES 8192
+/* Position of the impulse in the probe signal. */
+#define PROBE_OFFSET 1024
+/* Maximum detected delay in frames. */
+#define PROBE_MAX_DELAY 2048
+
+static const struct {
+	const char * name;
+	const char * enc_size;
+	const char * enc_init;
+	const char * enc_destroy;
+	const char * encode;
+	const char * dec_size;
+	const char * dec_init;
+	const char * dec_destroy;
+	const char * decode;
+} symbols[2] = {
+	{ "apt-X", "SizeofAptxbtenc", "aptxbtenc_init", "aptxbtenc_destroy", "aptxbtenc_encodestereo",
+	  "SizeofAptxbtdec", "aptxbtdec_init", "aptxbtdec_destroy", "aptxbtdec_decodestereo" },
+	{ "apt-X HD", "SizeofAptxhdbtenc", "aptxhdbtenc_init", "aptxhdbtenc_destroy", "aptxhdbtenc_encodestereo",
+	  "SizeofAptxhdbtdec", "aptxhdbtdec_init", "aptxhdbtdec_destroy", "aptxhdbtdec_decodestereo" },
+};
+
+struct backend {
+	char name[32];
+	/* shared objects providing apt-X and apt-X HD API */
+	char soname[2][128];
+};
+
+struct api {
+	bool hd;
+	/* libraries providing the encoder and the decoder */
+	void * handle[2];
+	char decoder[32];
+	size_t (*enc_size)(void);
+	int (*enc_init)(void *, short);
+	void (*enc_destroy)(void *);
+	union {
+		void * ptr;
+		int (*aptx)(APTXENC, const int32_t[4], const int32_t[4], uint16_t[2]);
+		int (*aptx_hd)(APTXENC, const int32_t[4], const int32_t[4], uint32_t[2]);
+	} encode;
+	size_t (*dec_size)(void);
+	int (*dec_init)(void *, short);
+	void (*dec_destroy)(void *);
+	union {
+		void * ptr;
+		int (*aptx)(APTXDEC, int32_t[4], int32_t[4], const uint16_t[2]);
+		int (*aptx_hd)(APTXDEC, int32_t[4], int32_t[4], const uint32_t[2]);
+	} decode;
+};
+
+/**
+ * Encoder and decoder instances connected back to back. */
+struct codec {
+	const struct api * api;
+	void * enc;
+	void * dec;
+};
+
+struct load {
+	pthread_t thread;
+	const struct api * api;
+	const int32_t * pcm;
+	size_t frames;
+	atomic_bool * stop;
+	int err;
+};
+
+static void * dlopen_deep(const char * soname) {
+	/* Use deep binding, so backends exporting the same public
+	 * symbols will not interfere with each other. */
+	return dlopen(soname, RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+}
+
+static int api_load_encoder(struct api * api, const struct backend * b, bool hd) {
+
+	memset(api, 0, sizeof(*api));
+	api->hd = hd;
+
+	if ((api->handle[0] = dlopen_deep(b->soname[hd])) == NULL)
+		return -1;
+
+	*(void **)(&api->enc_size) = dlsym(api->handle[0], symbols[hd].enc_size);
+	*(void **)(&api->enc_init) = dlsym(api->handle[0], symbols[hd].enc_init);
+	*(void **)(&api->enc_destroy) = dlsym(api->handle[0], symbols[hd].enc_destroy);
+	api->encode.ptr = dlsym(api->handle[0], symbols[hd].encode);
+
+	if (api->enc_size == NULL || api->enc_init == NULL || api->encode.ptr == NULL || api->enc_size() == 0) {
+		dlclose(api->handle[0]);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int api_load_decoder(struct api * api, const struct backend * b) {
+
+	const bool hd = api->hd;
+	if ((api->handle[1] = dlopen_deep(b->soname[hd])) == NULL)
+		return -1;
+
+	*(void **)(&api->dec_size) = dlsym(api->handle[1], symbols[hd].dec_size);
+	*(void **)(&api->dec_init) = dlsym(api->handle[1], symbols[hd].dec_init);
+	*(void **)(&api->dec_destroy) = dlsym(api->handle[1], symbols[hd].dec_destroy);
+	api->decode.ptr = dlsym(api->handle[1], symbols[hd].decode);
+
+	if (api->dec_size == NULL || api->dec_init == NULL || api->decode.ptr == NULL || api->dec_size() == 0) {
+		dlclose(api->handle[1]);
+		api->handle[1] = NULL;
+		return -1;
+	}
+
+	snprintf(api->decoder, sizeof(api->decoder), "%s", b->name);
+	return 0;
+}
+
+static void api_free(struct api * api) {
+	for (size_t i = 0; i < 2; i++)
+		if (api->handle[i] != NULL)
+			dlclose(api->handle[i]);
+}
+
+static void codec_free(struct codec * c) {
+	if (c->enc != NULL && c->api->enc_destroy != NULL)
+		c->api->enc_destroy(c->enc);
+	if (c->dec != NULL && c->api->dec_destroy != NULL)
+		c->api->dec_destroy(c->dec);
+	free(c->enc);
+	free(c->dec);
+	c->enc = c->dec = NULL;
+}
+
+static int codec_init(struct codec * c, const struct api * api) {
+
+	c->api = api;
+	c->enc = malloc(api->enc_size());
+	c->dec = malloc(api->dec_size());
+
+	if (c->enc == NULL || c->dec == NULL || api->enc_init(c->enc, 0) != 0 || api->dec_init(c->dec, 0) != 0) {
+		codec_free(c);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Encode and decode interleaved stereo PCM.
+ *
+ * The number of frames shall be a multiple of 4. */
+static int codec_process(const struct codec * c, const int32_t * in, int32_t * out, size_t frames) {
+
+	for (size_t n = 0; n < frames; n += 4, in += 8, out += 8) {
+
+		const int32_t pcmL[4] = { in[0], in[2], in[4], in[6] };
+		const int32_t pcmR[4] = { in[1], in[3], in[5], in[7] };
+		int32_t outL[4], outR[4];
+		int rv;
+
+		if (c->api->hd) {
+			uint32_t code[2];
+			if ((rv = c->api->encode.aptx_hd(c->enc, pcmL, pcmR, code)) == 0)
+				rv = c->api->decode.aptx_hd(c->dec, outL, outR, code);
+		}
+		else {
+			uint16_t code[2];
+			if ((rv = c->api->encode.aptx(c->enc, pcmL, pcmR, code)) == 0)
+				rv = c->api->decode.aptx(c->dec, outL, outR, code);
+		}
+
+		if (rv != 0)
+			return -1;
+
+		for (size_t i = 0; i < 4; i++)
+			out[i * 2 + 0] = outL[i], out[i * 2 + 1] = outR[i];
+
+	}
+
+	return 0;
+}
+
+static double elapsed_ns(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static int cmp_double(const void * a, const void * b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Generate stereo impulse at the probe offset. */
+static void generate_impulse(int32_t * pcm, size_t frames, double scale) {
+	memset(pcm, 0, frames * 2 * sizeof(*pcm));
+	pcm[PROBE_OFFSET * 2 + 0] = pcm[PROBE_OFFSET * 2 + 1] = scale / 2;
+}
+
+/**
+ * Generate stereo linear chirp from 20 Hz to 20 kHz starting at the probe
+ * offset. The chirp is faded in and out to avoid clicks. */
+static void generate_chirp(int32_t * pcm, size_t frames, double scale) {
+	memset(pcm, 0, frames * 2 * sizeof(*pcm));
+	const size_t len = frames - PROBE_OFFSET - PROBE_MAX_DELAY;
+	const double f0 = 20.0 / SAMPLE_RATE, f1 = 20000.0 / SAMPLE_RATE;
+	for (size_t i = 0; i < len; i++) {
+		const double t = (double)i / len;
+		const double phase = 2 * M_PI * (f0 * i + (f1 - f0) * i * t / 2);
+		const double fade = fmin(1.0, fmin(t, 1.0 - t) * 20);
+		pcm[(PROBE_OFFSET + i) * 2 + 0] = pcm[(PROBE_OFFSET + i) * 2 + 1] = scale / 2 * fade * sin(phase);
+	}
+}
+
+/**
+ * Find the delay of the left channel of the output.
+ *
+ * The delay is the lag with the maximum cross-correlation between the input
+ * and the output. For the impulse it is the position of the peak. */
+static ssize_t find_delay(const int32_t * in, const int32_t * out, size_t frames) {
+
+	ssize_t delay = -1;
+	double max = 0;
+
+	for (size_t lag = 0; lag < PROBE_MAX_DELAY; lag++) {
+		double sum = 0;
+		for (size_t i = 0; i + lag < frames; i++)
+			sum += (double)in[i * 2] * out[(i + lag) * 2];
+		if (sum > max) {
+			max = sum;
+			delay = lag;
+		}
+	}
+
+	return delay;
+}
+
+static int measure_delay(const struct api * api, void (*generate)(int32_t *, size_t, double), ssize_t * delay) {
+
+	const double scale = api->hd ? 8388607 : 32767;
+	struct codec c;
+	int rv = -1;
+
+	int32_t * in = malloc(PROBE_FRAMES * 2 * sizeof(*in));
+	int32_t * out = malloc(PROBE_FRAMES * 2 * sizeof(*out));
+	if (in == NULL || out == NULL)
+		goto fail;
+
+	generate(in, PROBE_FRAMES, scale);
+
+	if (codec_init(&c, api) != 0)
+		goto fail;
+	rv = codec_process(&c, in, out, PROBE_FRAMES);
+	codec_free(&c);
+
+	if (rv == 0)
+		*delay = find_delay(in, out, PROBE_FRAMES);
+
+fail:
+	free(in);
+	free(out);
+	return rv;
+}
+
+static void * load_thread(void * arg) {
+
+	struct load * l = arg;
+	struct codec c;
+
+	if ((l->err = codec_init(&c, l->api)) != 0)
+		return NULL;
+
+	int32_t * out;
+	if ((out = malloc(l->frames * 2 * sizeof(*out))) == NULL) {
+		l->err = -1;
+		goto final;
+	}
+
+	while (!atomic_load_explicit(l->stop, memory_order_relaxed))
+		if ((l->err = codec_process(&c, l->pcm, out, l->frames)) != 0)
+			break;
+
+	free(out);
+
+final:
+	codec_free(&c);
+	return NULL;
+}
+
+/**
+ * Measure wall-clock time of the encode/decode round trip of a packet. */
+static int measure_packet(const struct api * api, const int32_t * pcm, size_t frames, size_t packets,
+                          double stats[3]) {
+
+	struct codec c;
+	double * samples;
+	int32_t * out;
+	int rv = -1;
+
+	samples = malloc(packets * sizeof(*samples));
+	out = malloc(frames * 2 * sizeof(*out));
+	if (samples == NULL || out == NULL || codec_init(&c, api) != 0)
+		goto fail;
+
+	/* warm-up caches and branch predictors */
+	if (codec_process(&c, pcm, out, frames) != 0)
+		goto final;
+
+	for (size_t i = 0; i < packets; i++) {
+		struct timespec t0, t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (codec_process(&c, pcm, out, frames) != 0)
+			goto final;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		samples[i] = elapsed_ns(&t0, &t1);
+	}
+
+	qsort(samples, packets, sizeof(*samples), cmp_double);
+	stats[0] = samples[packets / 2];
+	stats[1] = samples[packets * 99 / 100];
+	stats[2] = samples[packets - 1];
+	rv = 0;
+
+final:
+	codec_free(&c);
+fail:
+	free(samples);
+	free(out);
+	return rv;
+}
+
+static void bench(const struct api * api, const char * name, const size_t * sizes, size_t sizes_count,
+                  size_t packets, size_t jobs) {
+
+	const double scale = api->hd ? 8388607 : 32767;
+	const size_t max_frames = sizes[sizes_count - 1];
+	struct load load[MAX_JOBS];
+	atomic_bool stop = false;
+	ssize_t delay[2] = { -1, -1 };
+
+	printf("  %s (decoder: %s)\n", name, api->decoder);
+
+	if (measure_delay(api, generate_impulse, &delay[0]) != 0 || measure_delay(api, generate_chirp, &delay[1]) != 0) {
+		printf("    processing error\n");
+		return;
+	}
+
+	for (size_t i = 0; i < 2; i++) {
+		const char * probe = i == 0 ? "impulse" : "chirp";
+		if (delay[i] == -1)
+			printf("    algorithmic delay (%s): not detected\n", probe);
+		else
+			printf("    algorithmic delay (%s): %zd samples (%.2f ms)\n", probe, delay[i],
+			       1e3 * delay[i] / SAMPLE_RATE);
+	}
+
+	int32_t * pcm;
+	if ((pcm = malloc(max_frames * 2 * sizeof(*pcm))) == NULL)
+		return;
+	/* noise-like signal, so all quantizer paths are exercised */
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < max_frames * 2; i++) {
+		seed = seed * 1664525 + 1013904223;
+		pcm[i] = scale / 2 * (((int32_t)seed >> 8) / 8388608.0);
+	}
+
+	size_t started = 0;
+	for (; started < jobs; started++) {
+		struct load * l = &load[started];
+		*l = (struct load){ .api = api, .pcm = pcm, .frames = max_frames, .stop = &stop };
+		if (pthread_create(&l->thread, NULL, load_thread, l) != 0)
+			break;
+	}
+
+	printf("    %8s %12s %12s %12s %10s\n", "packet", "p50", "p99", "max", "real-time");
+	for (size_t i = 0; i < sizes_count; i++) {
+		double stats[3];
+		if (measure_packet(api, pcm, sizes[i], packets, stats) != 0) {
+			printf("    %8zu processing error\n", sizes[i]);
+			continue;
+		}
+		/* ratio of the packet duration to the median processing time */
+		const double rt = 1e9 * sizes[i] / SAMPLE_RATE / stats[0];
+		printf("    %8zu %9.1f us %9.1f us %9.1f us %9.1fx\n", sizes[i], stats[0] / 1e3, stats[1] / 1e3,
+		       stats[2] / 1e3, rt);
+	}
+
+	atomic_store(&stop, true);
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(load[i].thread, NULL);
+		if (load[i].err != 0)
+			printf("    load thread %zu: processing error\n", i);
+	}
+
+	free(pcm);
+}
+
+static int parse_sizes(const char * str, size_t * sizes, size_t * count) {
+
+	*count = 0;
+	while (*str != '\0' && *count < MAX_PACKETS) {
+		char * end;
+		size_t frames = strtoul(str, &end, 10);
+		if (end == str || frames == 0)
+			return -1;
+		/* codec processes PCM in blocks of 4 frames */
+		sizes[(*count)++] = (frames + 3) / 4 * 4;
+		str = *end == ',' ? end + 1 : end;
+	}
+
+	if (*count == 0)
+		return -1;
+
+	/* keep sizes sorted, so the last one is the largest */
+	for (size_t i = 1; i < *count; i++)
+		for (size_t j = i; j > 0 && sizes[j - 1] > sizes[j]; j--) {
+			size_t tmp = sizes[j];
+			sizes[j] = sizes[j - 1];
+			sizes[j - 1] = tmp;
+		}
+
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hj:n:p:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "packets", required_argument, NULL, 'n' },
+		{ "packet-size", required_argument, NULL, 'p' },
+		{ 0, 0, 0, 0 },
+	};
+
+	struct backend backends[MAX_BACKENDS] = {
+		{ "native", { "libaptx-4.2.2.so", "libaptxHD-1.0.0.so" } },
+		{ "ffmpeg", { "libaptx-ffmpeg.so", "libaptx-ffmpeg.so" } },
+		{ "freeaptx", { "libaptx-freeaptx.so", "libaptx-freeaptx.so" } },
+	};
+	size_t backends_count = 3;
+	size_t sizes[MAX_PACKETS] = { 4, 128, 1024 };
+	size_t sizes_count = 3;
+	size_t packets = 1000;
+	size_t jobs = 0;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]... [NAME=LIB[,LIBHD]]...\n"
+			       "\nMeasure end-to-end latency of apt-X / apt-X HD backends: algorithmic\n"
+			       "delay of the encoder and decoder pair (detected with an impulse and\n"
+			       "a chirp), and wall-clock processing time of a packet. Backends which\n"
+			       "do not provide decoder are paired with the first available decoder.\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\t\tprint this help and exit\n"
+			       "  -j, --jobs=NUM\t\tnumber of concurrent background streams\n"
+			       "  -n, --packets=NUM\t\tnumber of measured packets\n"
+			       "  -p, --packet-size=NUM[,...]\tpacket sizes in PCM frames\n",
+			       argv[0]);
+			return EXIT_SUCCESS;
+		case 'j':
+			if ((jobs = strtoul(optarg, NULL, 10)) > MAX_JOBS)
+				jobs = MAX_JOBS;
+			break;
+		case 'n':
+			packets = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			if (parse_sizes(optarg, sizes, &sizes_count) != 0) {
+				fprintf(stderr, "Invalid packet sizes: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (optind < argc) {
+		/* custom list of backends */
+		backends_count = 0;
+		for (int i = optind; i < argc && backends_count < MAX_BACKENDS; i++) {
+			struct backend * b = &backends[backends_count++];
+			char * lib, * lib_hd;
+			if ((lib = strchr(argv[i], '=')) == NULL) {
+				fprintf(stderr, "Invalid backend specification: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			*lib++ = '\0';
+			if ((lib_hd = strchr(lib, ',')) != NULL)
+				*lib_hd++ = '\0';
+			snprintf(b->name, sizeof(b->name), "%s", argv[i]);
+			snprintf(b->soname[0], sizeof(b->soname[0]), "%s", lib);
+			snprintf(b->soname[1], sizeof(b->soname[1]), "%s", lib_hd != NULL ? lib_hd : lib);
+		}
+	}
+
+	if (packets == 0)
+		packets = 1;
+
+	for (size_t hd = 0; hd < 2; hd++) {
+
+		printf("%s (%zu packets, %zu background streams)\n", symbols[hd].name, packets, jobs);
+
+		for (size_t i = 0; i < backends_count; i++) {
+
+			struct api api;
+			if (api_load_encoder(&api, &backends[i], hd) != 0) {
+				printf("  %s: not available\n", backends[i].name);
+				continue;
+			}
+
+			/* prefer decoder from the same backend */
+			int err = api_load_decoder(&api, &backends[i]);
+			for (size_t ii = 0; err != 0 && ii < backends_count; ii++)
+				if (ii != i)
+					err = api_load_decoder(&api, &backends[ii]);
+
+			if (err != 0)
+				printf("  %s: decoder not available\n", backends[i].name);
+			else
+				bench(&api, backends[i].name, sizes, sizes_count, packets, jobs);
+
+			api_free(&api);
+		}
+
+		printf("\n");
+	}
+
+	return EXIT_SUCCESS;
+}
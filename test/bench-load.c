@@ -0,0 +1,569 @@
+/*
+ * bench-load.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx.h"
+
+/* Maximum number of compared backends. */
+#define MAX_BACKENDS 8
+/* Maximum number of entries in the list options. */
+#define MAX_STEPS 16
+/* Maximum number of simulated sinks. */
+#define MAX_STREAMS 1024
+
+static const struct {
+	const char * name;
+	const char * enc_size;
+	const char * enc_init;
+	const char * enc_destroy;
+	const char * encode;
+} symbols[2] = {
+	{ "apt-X", "SizeofAptxbtenc", "aptxbtenc_init", "aptxbtenc_destroy", "aptxbtenc_encodestereo" },
+	{ "apt-X HD", "SizeofAptxhdbtenc", "aptxhdbtenc_init", "aptxhdbtenc_destroy", "aptxhdbtenc_encodestereo" },
+};
+
+static const char * models[] = { "stream", "pool", "single" };
+
+enum model {
+	/* every sink is served by its own thread */
+	MODEL_STREAM,
+	/* sinks are distributed between a fixed number of threads */
+	MODEL_POOL,
+	/* all sinks are served by a single thread */
+	MODEL_SINGLE,
+};
+
+struct backend {
+	char name[32];
+	/* shared objects providing apt-X and apt-X HD API */
+	char soname[2][128];
+};
+
+struct api {
+	bool hd;
+	void * handle;
+	size_t (*enc_size)(void);
+	int (*enc_init)(void *, short);
+	void (*enc_destroy)(void *);
+	union {
+		void * ptr;
+		int (*aptx)(APTXENC, const int32_t[4], const int32_t[4], uint16_t[2]);
+		int (*aptx_hd)(APTXENC, const int32_t[4], const int32_t[4], uint32_t[2]);
+	} encode;
+};
+
+/**
+ * Parameters shared by all sinks of a single simulation run. */
+struct run {
+	const struct api * api;
+	/* interleaved stereo PCM, looped by every sink */
+	const int32_t * pcm;
+	size_t pcm_frames;
+	/* PCM frames per packet */
+	size_t frames;
+	/* packet period in nanoseconds */
+	double period;
+	/* number of packets per sink */
+	size_t packets;
+	/* release time of the first packet */
+	struct timespec start;
+};
+
+/**
+ * Virtual A2DP sink with its own encoder. */
+struct sink {
+	void * enc;
+	/* position in the PCM signal */
+	size_t offset;
+	/* release time offset of the first packet */
+	double phase;
+	/* index of the next packet */
+	size_t packet;
+	/* packets which were not encoded before the next packet was due */
+	size_t missed;
+	/* CPU time spent in the encoder */
+	double cpu_ns;
+	/* time from the packet release to the end of encoding */
+	double * latency;
+	size_t processed;
+};
+
+struct worker {
+	pthread_t thread;
+	const struct run * run;
+	struct sink * sinks;
+	size_t count;
+	int err;
+};
+
+static void * dlopen_deep(const char * soname) {
+	/* Use deep binding, so backends exporting the same public
+	 * symbols will not interfere with each other. */
+	return dlopen(soname, RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+}
+
+static int api_load(struct api * api, const struct backend * b, bool hd) {
+
+	memset(api, 0, sizeof(*api));
+	api->hd = hd;
+
+	if ((api->handle = dlopen_deep(b->soname[hd])) == NULL)
+		return -1;
+
+	*(void **)(&api->enc_size) = dlsym(api->handle, symbols[hd].enc_size);
+	*(void **)(&api->enc_init) = dlsym(api->handle, symbols[hd].enc_init);
+	*(void **)(&api->enc_destroy) = dlsym(api->handle, symbols[hd].enc_destroy);
+	api->encode.ptr = dlsym(api->handle, symbols[hd].encode);
+
+	if (api->enc_size == NULL || api->enc_init == NULL || api->encode.ptr == NULL || api->enc_size() == 0) {
+		dlclose(api->handle);
+		return -1;
+	}
+
+	return 0;
+}
+
+static double timespec_ns(const struct timespec * ts) {
+	return ts->tv_sec * 1e9 + ts->tv_nsec;
+}
+
+static struct timespec ns_timespec(double ns) {
+	const long long v = ns;
+	return (struct timespec){ .tv_sec = v / 1000000000, .tv_nsec = v % 1000000000 };
+}
+
+static double now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return timespec_ns(&ts);
+}
+
+static int cmp_double(const void * a, const void * b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Encode one packet of interleaved stereo PCM.
+ *
+ * The number of frames shall be a multiple of 4. */
+static int encode_packet(const struct run * r, struct sink * s) {
+
+	for (size_t n = 0; n < r->frames; n += 4) {
+
+		const int32_t * in = &r->pcm[s->offset * 2];
+		const int32_t pcmL[4] = { in[0], in[2], in[4], in[6] };
+		const int32_t pcmR[4] = { in[1], in[3], in[5], in[7] };
+		int rv;
+
+		if (r->api->hd) {
+			uint32_t code[2];
+			rv = r->api->encode.aptx_hd(s->enc, pcmL, pcmR, code);
+		}
+		else {
+			uint16_t code[2];
+			rv = r->api->encode.aptx(s->enc, pcmL, pcmR, code);
+		}
+
+		if (rv != 0)
+			return -1;
+
+		if ((s->offset += 4) >= r->pcm_frames)
+			s->offset = 0;
+
+	}
+
+	return 0;
+}
+
+/**
+ * Serve sinks assigned to the worker in the earliest-deadline-first order.
+ *
+ * A packet is released every period. If the previous packet of the sink was
+ * not encoded by that time, the packet is counted as missed. Packets which
+ * could not even be started before their deadline are dropped, the same way
+ * as an A2DP source drops stale audio. */
+static void * worker_thread(void * arg) {
+
+	struct worker * w = arg;
+	const struct run * r = w->run;
+	const double start = timespec_ns(&r->start);
+
+	for (;;) {
+
+		struct sink * s = NULL;
+		double release = 0;
+		for (size_t i = 0; i < w->count; i++) {
+			struct sink * tmp = &w->sinks[i];
+			if (tmp->packet == r->packets)
+				continue;
+			const double t = start + tmp->phase + tmp->packet * r->period;
+			if (s == NULL || t < release)
+				s = tmp, release = t;
+		}
+
+		if (s == NULL)
+			break;
+
+		const struct timespec ts = ns_timespec(release);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+			continue;
+
+		const double deadline = release + r->period;
+		s->packet++;
+
+		if (now_ns(CLOCK_MONOTONIC) >= deadline) {
+			s->missed++;
+			continue;
+		}
+
+		const double cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+		if ((w->err = encode_packet(r, s)) != 0)
+			break;
+		const double done = now_ns(CLOCK_MONOTONIC);
+		s->cpu_ns += now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+		s->latency[s->processed++] = done - release;
+		if (done > deadline)
+			s->missed++;
+
+	}
+
+	return NULL;
+}
+
+/**
+ * Simulate given number of sinks and print the summary line. */
+static int simulate(struct run * r, size_t streams, enum model model, size_t workers) {
+
+	struct sink * sinks = calloc(streams, sizeof(*sinks));
+	struct worker * w = NULL;
+	double * latency = NULL;
+	size_t started = 0;
+	int rv = -1;
+
+	if (sinks == NULL)
+		goto final;
+
+	for (size_t i = 0; i < streams; i++) {
+		struct sink * s = &sinks[i];
+		/* spread releases over the period and signal positions over the PCM,
+		 * so sinks neither wake up at once nor encode the same audio */
+		s->phase = r->period * i / streams;
+		s->offset = r->pcm_frames / streams * i / 4 * 4;
+		if ((s->latency = malloc(r->packets * sizeof(*s->latency))) == NULL ||
+		    (s->enc = malloc(r->api->enc_size())) == NULL)
+			goto final;
+		if (r->api->enc_init(s->enc, 0) != 0) {
+			free(s->enc);
+			s->enc = NULL;
+			goto final;
+		}
+	}
+
+	if (model == MODEL_STREAM)
+		workers = streams;
+	else if (model == MODEL_SINGLE)
+		workers = 1;
+	if (workers > streams)
+		workers = streams;
+
+	if ((w = calloc(workers, sizeof(*w))) == NULL)
+		goto final;
+
+	/* assign contiguous ranges, so phases of sinks of a worker are spread
+	 * over the part of the period, not over the whole period */
+	for (size_t i = 0; i < workers; i++) {
+		const size_t first = streams * i / workers;
+		w[i].run = r;
+		w[i].sinks = &sinks[first];
+		w[i].count = streams * (i + 1) / workers - first;
+	}
+
+	/* give threads time to start before the first release */
+	clock_gettime(CLOCK_MONOTONIC, &r->start);
+	r->start = ns_timespec(timespec_ns(&r->start) + 50e6);
+
+	for (; started < workers; started++)
+		if (pthread_create(&w[started].thread, NULL, worker_thread, &w[started]) != 0)
+			break;
+
+	bool failed = started != workers;
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(w[i].thread, NULL);
+		if (w[i].err != 0)
+			failed = true;
+	}
+
+	if (failed) {
+		printf("    %7zu processing error\n", streams);
+		goto final;
+	}
+
+	size_t processed = 0, missed = 0;
+	double cpu = 0;
+	for (size_t i = 0; i < streams; i++) {
+		processed += sinks[i].processed;
+		missed += sinks[i].missed;
+		cpu += sinks[i].cpu_ns;
+	}
+
+	if ((latency = malloc((processed + 1) * sizeof(*latency))) == NULL)
+		goto final;
+	size_t n = 0;
+	for (size_t i = 0; i < streams; i++)
+		for (size_t ii = 0; ii < sinks[i].processed; ii++)
+			latency[n++] = sinks[i].latency[ii];
+	qsort(latency, n, sizeof(*latency), cmp_double);
+	if (n == 0)
+		latency[n++] = 0;
+
+	const size_t packets = streams * r->packets;
+	const double wall = r->period * r->packets;
+	printf("    %7zu %7zu %8.3f%% %9.2f%% %9.1f us %9.1f us %9.1f us %9.1f us\n", streams, workers,
+	       100.0 * missed / packets, 100.0 * cpu / streams / wall, latency[n / 2] / 1e3, latency[n * 99 / 100] / 1e3,
+	       latency[n * 999 / 1000] / 1e3, latency[n - 1] / 1e3);
+	rv = missed == 0 ? 0 : 1;
+
+final:
+	for (size_t i = 0; sinks != NULL && i < streams; i++) {
+		if (sinks[i].enc != NULL && r->api->enc_destroy != NULL)
+			r->api->enc_destroy(sinks[i].enc);
+		free(sinks[i].enc);
+		free(sinks[i].latency);
+	}
+	free(sinks);
+	free(latency);
+	free(w);
+	return rv;
+}
+
+static void bench(const struct api * api, const char * name, const size_t * streams, size_t streams_count,
+                  unsigned int rate, double interval, double duration, enum model model, size_t workers) {
+
+	/* codec processes PCM in blocks of 4 frames */
+	size_t frames = (size_t)(rate * interval / 1e3 + 2) / 4 * 4;
+	if (frames == 0)
+		frames = 4;
+
+	struct run r = {
+		.api = api,
+		.pcm_frames = rate,
+		.frames = frames,
+		/* cadence follows the packet duration, so the stream does not drift */
+		.period = 1e9 * frames / rate,
+	};
+
+	if ((r.packets = duration * 1e9 / r.period) == 0)
+		r.packets = 1;
+
+	int32_t * pcm;
+	if ((pcm = malloc(r.pcm_frames * 2 * sizeof(*pcm))) == NULL)
+		return;
+	/* noise-like signal, so all quantizer paths are exercised */
+	const double scale = api->hd ? 8388607 : 32767;
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < r.pcm_frames * 2; i++) {
+		seed = seed * 1664525 + 1013904223;
+		pcm[i] = scale / 2 * (((int32_t)seed >> 8) / 8388608.0);
+	}
+	r.pcm = pcm;
+
+	printf("  %s (%zu frames per packet, %.2f ms period)\n", name, frames, r.period / 1e6);
+	printf("    %7s %7s %9s %10s %12s %12s %12s %12s\n", "streams", "threads", "missed", "cpu/stream", "p50",
+	       "p99", "p99.9", "max");
+
+	for (size_t i = 0; i < streams_count; i++)
+		if (simulate(&r, streams[i], model, workers) == -1)
+			break;
+
+	free(pcm);
+}
+
+static int parse_list(const char * str, size_t * values, size_t * count, size_t max) {
+
+	*count = 0;
+	while (*str != '\0' && *count < MAX_STEPS) {
+		char * end;
+		size_t value = strtoul(str, &end, 10);
+		if (end == str || value == 0 || value > max)
+			return -1;
+		values[(*count)++] = value;
+		str = *end == ',' ? end + 1 : end;
+	}
+
+	return *count == 0 ? -1 : 0;
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hc:d:i:m:r:s:w:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "codec", required_argument, NULL, 'c' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "interval", required_argument, NULL, 'i' },
+		{ "model", required_argument, NULL, 'm' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ "streams", required_argument, NULL, 's' },
+		{ "workers", required_argument, NULL, 'w' },
+		{ 0, 0, 0, 0 },
+	};
+
+	struct backend backends[MAX_BACKENDS] = {
+		{ "native", { "libaptx-4.2.2.so", "libaptxHD-1.0.0.so" } },
+		{ "ffmpeg", { "libaptx-ffmpeg.so", "libaptx-ffmpeg.so" } },
+		{ "freeaptx", { "libaptx-freeaptx.so", "libaptx-freeaptx.so" } },
+	};
+	size_t backends_count = 3;
+	bool codecs[2] = { true, true };
+	size_t streams[MAX_STEPS] = { 1, 2, 4, 8, 16 };
+	size_t streams_count = 5;
+	size_t rates[MAX_STEPS] = { 48000 };
+	size_t rates_count = 1;
+	double duration = 2;
+	double interval = 10;
+	enum model model = MODEL_STREAM;
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]... [NAME=LIB[,LIBHD]]...\n"
+			       "\nSimulate concurrent A2DP sinks, each with its own encoder, which receive\n"
+			       "packets at a fixed cadence. For every number of sinks, report the ratio\n"
+			       "of packets which were not encoded before the next packet was due, the CPU\n"
+			       "time per stream (percentage of one core) and the latency from the packet\n"
+			       "release to the end of encoding.\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\t\tprint this help and exit\n"
+			       "  -c, --codec=NAME\t\tsimulate only 'aptx' or 'aptx-hd' sinks\n"
+			       "  -d, --duration=SEC\t\tsimulated time per number of sinks\n"
+			       "  -i, --interval=MS\t\tpacket period (rounded to whole codec blocks)\n"
+			       "  -m, --model=MODEL\t\tthread model: stream, pool or single\n"
+			       "  -r, --rate=HZ[,...]\t\tsampling rates (e.g. 44100,48000)\n"
+			       "  -s, --streams=NUM[,...]\tnumbers of simulated sinks\n"
+			       "  -w, --workers=NUM\t\tnumber of threads in the pool model\n",
+			       argv[0]);
+			return EXIT_SUCCESS;
+		case 'c':
+			if (strcmp(optarg, "aptx") == 0)
+				codecs[0] = true, codecs[1] = false;
+			else if (strcmp(optarg, "aptx-hd") == 0)
+				codecs[0] = false, codecs[1] = true;
+			else {
+				fprintf(stderr, "Invalid codec: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd':
+			duration = strtod(optarg, NULL);
+			break;
+		case 'i':
+			interval = strtod(optarg, NULL);
+			break;
+		case 'm':
+			for (model = 0; model < sizeof(models) / sizeof(*models); model++)
+				if (strcmp(optarg, models[model]) == 0)
+					break;
+			if (model == sizeof(models) / sizeof(*models)) {
+				fprintf(stderr, "Invalid thread model: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'r':
+			if (parse_list(optarg, rates, &rates_count, 384000) != 0) {
+				fprintf(stderr, "Invalid sampling rates: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			if (parse_list(optarg, streams, &streams_count, MAX_STREAMS) != 0) {
+				fprintf(stderr, "Invalid numbers of streams: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'w':
+			workers = strtol(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (optind < argc) {
+		/* custom list of backends */
+		backends_count = 0;
+		for (int i = optind; i < argc && backends_count < MAX_BACKENDS; i++) {
+			struct backend * b = &backends[backends_count++];
+			char * lib, * lib_hd;
+			if ((lib = strchr(argv[i], '=')) == NULL) {
+				fprintf(stderr, "Invalid backend specification: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			*lib++ = '\0';
+			if ((lib_hd = strchr(lib, ',')) != NULL)
+				*lib_hd++ = '\0';
+			snprintf(b->name, sizeof(b->name), "%s", argv[i]);
+			snprintf(b->soname[0], sizeof(b->soname[0]), "%s", lib);
+			snprintf(b->soname[1], sizeof(b->soname[1]), "%s", lib_hd != NULL ? lib_hd : lib);
+		}
+	}
+
+	if (duration <= 0 || interval <= 0) {
+		fprintf(stderr, "Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	if (workers < 1)
+		workers = 1;
+
+	for (size_t hd = 0; hd < 2; hd++) {
+
+		if (!codecs[hd])
+			continue;
+
+		for (size_t i = 0; i < rates_count; i++) {
+
+			printf("%s %zu Hz (%.1f s per step, thread model: %s)\n", symbols[hd].name, rates[i], duration,
+			       models[model]);
+
+			for (size_t ii = 0; ii < backends_count; ii++) {
+
+				struct api api;
+				if (api_load(&api, &backends[ii], hd) != 0) {
+					printf("  %s: not available\n", backends[ii].name);
+					continue;
+				}
+
+				bench(&api, backends[ii].name, streams, streams_count, rates[i], interval, duration, model,
+				      workers);
+
+				dlclose(api.handle);
+			}
+
+			printf("\n");
+		}
+
+	}
+
+	return EXIT_SUCCESS;
+}
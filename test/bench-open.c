@@ -0,0 +1,165 @@
+/*
+ * bench-open.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "openaptx.h"
+
+/* Number of streams opened at once, e.g. headsets reconnecting in a burst. */
+#define BURST_SIZE 4
+
+struct codec {
+	const char * name;
+	size_t (*size)(void);
+	int (*init)(void *, short);
+	void (*destroy)(void *);
+	/* process the first block, so lazy initialization is included */
+	int (*process)(void *);
+};
+
+static int aptx_encode(void * handle) {
+	static const int32_t pcm[4] = { 0 };
+	uint16_t code[2];
+	return aptxbtenc_encodestereo(handle, pcm, pcm, code);
+}
+
+static int aptxhd_encode(void * handle) {
+	static const int32_t pcm[4] = { 0 };
+	uint32_t code[2];
+	return aptxhdbtenc_encodestereo(handle, pcm, pcm, code);
+}
+
+static int aptx_decode(void * handle) {
+	static const uint16_t code[2] = { 0x4BBF, 0x4BBF };
+	int32_t pcmL[4], pcmR[4];
+	return aptxbtdec_decodestereo(handle, pcmL, pcmR, code);
+}
+
+static int aptxhd_decode(void * handle) {
+	static const uint32_t code[2] = { 0x73BEFF, 0x73BEFF };
+	int32_t pcmL[4], pcmR[4];
+	return aptxhdbtdec_decodestereo(handle, pcmL, pcmR, code);
+}
+
+static const struct codec codecs[] = {
+	{ "apt-X encoder", SizeofAptxbtenc, aptxbtenc_init, aptxbtenc_destroy, aptx_encode },
+	{ "apt-X HD encoder", SizeofAptxhdbtenc, aptxhdbtenc_init, aptxhdbtenc_destroy, aptxhd_encode },
+	{ "apt-X decoder", SizeofAptxbtdec, aptxbtdec_init, aptxbtdec_destroy, aptx_decode },
+	{ "apt-X HD decoder", SizeofAptxhdbtdec, aptxhdbtdec_init, aptxhdbtdec_destroy, aptxhd_decode },
+};
+
+static double elapsed_us(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+static int cmp_double(const void * a, const void * b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static int bench(const struct codec * c, size_t nloops) {
+
+	void * handles[BURST_SIZE] = { NULL };
+	/* number of handles initialized in the current burst */
+	size_t opened = 0;
+	double * samples;
+	int rv = -1;
+
+	const size_t size = c->size();
+	for (size_t i = 0; i < BURST_SIZE; i++)
+		if ((handles[i] = malloc(size)) == NULL)
+			goto fail;
+	if ((samples = malloc(nloops * BURST_SIZE * sizeof(*samples))) == NULL)
+		goto fail;
+
+	for (size_t n = 0; n < nloops; n++) {
+		for (size_t i = 0; i < BURST_SIZE; i++) {
+			struct timespec t0, t1;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			int err;
+			if ((err = c->init(handles[i], 0)) == 0) {
+				opened++;
+				err = c->process(handles[i]);
+			}
+			if (err != 0) {
+				fprintf(stderr, "%s: Couldn't open stream\n", c->name);
+				goto final;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			samples[n * BURST_SIZE + i] = elapsed_us(&t0, &t1);
+		}
+		for (; opened > 0; opened--)
+			c->destroy(handles[opened - 1]);
+	}
+
+	const size_t count = nloops * BURST_SIZE;
+	qsort(samples, count, sizeof(*samples), cmp_double);
+
+	double sum = 0;
+	for (size_t i = 0; i < count; i++)
+		sum += samples[i];
+
+	printf("%-18s mean: %8.2f us  p50: %8.2f us  p99: %8.2f us  max: %8.2f us\n", c->name, sum / count,
+	       samples[count / 2], samples[count * 99 / 100], samples[count - 1]);
+	rv = 0;
+
+final:
+	for (; opened > 0; opened--)
+		c->destroy(handles[opened - 1]);
+	free(samples);
+fail:
+	for (size_t i = 0; i < BURST_SIZE; i++)
+		free(handles[i]);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hn:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "loops", required_argument, NULL, 'n' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t nloops = 1000;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]...\n"
+			       "\nMeasure stream open latency (init and the first block).\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -n, --loops=NUM\tnumber of stream open bursts\n",
+			       argv[0]);
+			return EXIT_SUCCESS;
+		case 'n':
+			nloops = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (nloops == 0)
+		nloops = 1;
+
+	for (size_t i = 0; i < sizeof(codecs) / sizeof(*codecs); i++)
+		if (codecs[i].size() == 0 || bench(&codecs[i], nloops) != 0)
+			printf("%-18s not available\n", codecs[i].name);
+
+	return EXIT_SUCCESS;
+}
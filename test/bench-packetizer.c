@@ -0,0 +1,245 @@
+/*
+ * bench-packetizer.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "openaptx-packetizer.h"
+#include "openaptx.h"
+
+#include "../src/stream.h"
+#include "signals.h"
+
+#define SAMPLING_RATE 48000
+
+static const char * codec_name(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+static double elapsed_ms(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static uint32_t rand_next(uint32_t * seed) {
+	*seed = *seed * 1664525 + 1013904223;
+	return *seed >> 8;
+}
+
+/**
+ * Split the packet buffer into 3 buffers at random offsets, so blocks and
+ * the RTP header are split between buffers as well. */
+static void iov_split(struct iovec iov[3], uint8_t * buffer, size_t size, uint32_t * seed) {
+	const size_t a = rand_next(seed) % (size + 1);
+	const size_t b = rand_next(seed) % (size - a + 1);
+	iov[0] = (struct iovec){ .iov_base = buffer, .iov_len = a };
+	iov[1] = (struct iovec){ .iov_base = buffer + a, .iov_len = b };
+	iov[2] = (struct iovec){ .iov_base = buffer + a + b, .iov_len = size - a - b };
+}
+
+/**
+ * Check the RTP header and append the payload of the packet to the stream. */
+static int packet_collect(const uint8_t * packet, size_t len, bool rtp, const struct openaptx_rtp * state,
+                          size_t packets, size_t frames, uint8_t * stream, size_t * stream_len) {
+
+	size_t offset = 0;
+
+	if (rtp) {
+		const uint16_t seq = packet[2] << 8 | packet[3];
+		const uint32_t ts = (uint32_t)packet[4] << 24 | packet[5] << 16 | packet[6] << 8 | packet[7];
+		if (packet[0] != 0x80 || packet[1] != state->payload_type ||
+		    seq != (uint16_t)(state->seq_number + packets) || ts != (uint32_t)(state->timestamp + frames)) {
+			fprintf(stderr, "Error: Invalid RTP header of packet %zu\n", packets);
+			return -1;
+		}
+		offset = OPENAPTX_RTP_HEADER_SIZE;
+	}
+
+	memcpy(&stream[*stream_len], &packet[offset], len - offset);
+	*stream_len += len - offset;
+	return 0;
+}
+
+static int bench(enum openaptx_codec codec, bool rtp, size_t mtu, size_t frames, size_t chunk) {
+
+	const struct openaptx_rtp rtp_state = { .payload_type = 96, .seq_number = 0xFFF0, .timestamp = 0xFFFFF000,
+		                                    .ssrc = 0xC0DE };
+	const unsigned int bits = codec == OPENAPTX_CODEC_APTX_HD ? 24 : 16;
+	const size_t stream_size = (frames + 3) / 4 * 2 * stream_codeword_size(codec);
+
+	int32_t * pcmL = malloc(frames * sizeof(*pcmL));
+	int32_t * pcmR = malloc(frames * sizeof(*pcmR));
+	int32_t * pcm = malloc(frames * 2 * sizeof(*pcm));
+	uint8_t * stream_direct = malloc(stream_size);
+	uint8_t * stream_packet = malloc(stream_size);
+	uint8_t * packet = malloc(mtu);
+	openaptx_packetizer * p = NULL;
+	APTXENC enc = NULL;
+	int rv = -1;
+
+	if (pcmL == NULL || pcmR == NULL || pcm == NULL || stream_direct == NULL || stream_packet == NULL ||
+	    packet == NULL || (enc = stream_encoder_new(codec, 0)) == NULL ||
+	    (p = openaptx_packetizer_new(codec, 0, mtu, rtp ? &rtp_state : NULL)) == NULL) {
+		fprintf(stderr, "Error: Couldn't initialize: %s\n", strerror(errno));
+		goto final;
+	}
+
+	signal_generate(SIGNAL_PINK, pcmL, pcmR, frames, bits);
+	for (size_t i = 0; i < frames; i++) {
+		pcm[i * 2 + 0] = pcmL[i];
+		pcm[i * 2 + 1] = pcmR[i];
+	}
+
+	struct timespec t0, t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (stream_encode(codec, enc, pcm, frames, stream_direct) != 0) {
+		fprintf(stderr, "Error: Couldn't encode PCM samples\n");
+		goto final;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	const size_t size = openaptx_packetizer_size(p);
+	struct iovec iov[3];
+	uint32_t seed = 0xBEEF;
+	size_t stream_len = 0;
+	size_t packets = 0;
+	/* frames in packets which were already collected */
+	size_t packets_frames = 0;
+	size_t len;
+
+	iov_split(iov, packet, size, &seed);
+	for (size_t i = 0; i < frames;) {
+
+		/* odd chunk sizes, so blocks are split between chunks */
+		size_t n = 1 + rand_next(&seed) % (chunk * 2);
+		if (n > frames - i)
+			n = frames - i;
+
+		ssize_t consumed;
+		if ((consumed = openaptx_packetizer_writev(p, &pcm[i * 2], n, iov, 3, &len)) == -1) {
+			fprintf(stderr, "Error: Couldn't packetize PCM samples: %s\n", strerror(errno));
+			goto final;
+		}
+
+		i += consumed;
+		if (len == 0)
+			continue;
+
+		if (len != size ||
+		    packet_collect(packet, len, rtp, &rtp_state, packets, packets_frames, stream_packet, &stream_len) == -1)
+			goto final;
+
+		packets++;
+		packets_frames += openaptx_packetizer_frames(p);
+		iov_split(iov, packet, size, &seed);
+
+	}
+
+	if (openaptx_packetizer_flushv(p, iov, 3, &len) == -1) {
+		fprintf(stderr, "Error: Couldn't flush packetizer: %s\n", strerror(errno));
+		goto final;
+	}
+
+	if (len != 0) {
+		if (packet_collect(packet, len, rtp, &rtp_state, packets, packets_frames, stream_packet, &stream_len) == -1)
+			goto final;
+		packets++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	const bool exact = stream_len == stream_size && memcmp(stream_direct, stream_packet, stream_size) == 0;
+	printf("%-9s %4s %5zu %8zu %10.2f %10.2f %s\n", codec_name(codec), rtp ? "yes" : "no", mtu, packets,
+	       elapsed_ms(&t0, &t1), elapsed_ms(&t1, &t2), exact ? "exact" : "MISMATCH");
+
+	rv = exact ? 0 : -1;
+
+final:
+	openaptx_packetizer_free(p);
+	stream_encoder_free(codec, enc);
+	free(pcmL);
+	free(pcmR);
+	free(pcm);
+	free(stream_direct);
+	free(stream_packet);
+	free(packet);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hc:m:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "chunk", required_argument, NULL, 'c' },
+		{ "mtu", required_argument, NULL, 'm' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	size_t chunk = 128;
+	size_t mtu = 679;
+	size_t seconds = 10;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -c, --chunk=NUM\taverage number of frames per write (default: %zu)\n"
+			       "  -m, --mtu=NUM\t\tmaximum packet size (default: %zu)\n"
+			       "  -s, --seconds=NUM\tsignal duration (default: %zu)\n",
+			       argv[0], chunk, mtu, seconds);
+			return EXIT_SUCCESS;
+		case 'c' /* --chunk=NUM */:
+			chunk = strtoul(optarg, NULL, 10);
+			break;
+		case 'm' /* --mtu=NUM */:
+			mtu = strtoul(optarg, NULL, 10);
+			break;
+		case 's' /* --seconds=NUM */:
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (chunk == 0 || mtu < OPENAPTX_RTP_HEADER_SIZE + 6 || seconds == 0) {
+		fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	/* the stream does not end on the block boundary, so the flush pads it */
+	const size_t frames = seconds * SAMPLING_RATE + 3;
+
+	printf("%-9s %4s %5s %8s %10s %10s\n", "codec", "rtp", "mtu", "packets", "direct[ms]", "packet[ms]");
+
+	int rv = EXIT_SUCCESS;
+	if (bench(OPENAPTX_CODEC_APTX, false, mtu, frames, chunk) == -1)
+		rv = EXIT_FAILURE;
+	if (bench(OPENAPTX_CODEC_APTX, true, mtu, frames, chunk) == -1)
+		rv = EXIT_FAILURE;
+	if (bench(OPENAPTX_CODEC_APTX_HD, true, mtu, frames, chunk) == -1)
+		rv = EXIT_FAILURE;
+
+	return rv;
+}
@@ -0,0 +1,255 @@
+/*
+ * bench-seek.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx-container.h"
+#include "openaptx.h"
+
+#include "../src/transcode.h"
+#include "signals.h"
+
+#define SAMPLING_RATE 48000
+/* Number of frames decoded after every seek. */
+#define READ_FRAMES 256
+
+struct stream {
+	enum openaptx_codec codec;
+	const struct transcode_codec * ops;
+	uint8_t * data;
+	size_t blocks;
+	/* reference PCM decoded from the beginning of the stream */
+	int32_t * pcm;
+};
+
+static const char * codec_name(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+static double elapsed_us(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+static int cmp_double(const void * a, const void * b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static int encode(struct stream * s, size_t frames) {
+
+	int32_t * pcmL = malloc(frames * sizeof(*pcmL));
+	int32_t * pcmR = malloc(frames * sizeof(*pcmR));
+	void * state = malloc(s->ops->size);
+	const size_t size = 2 * s->ops->codeword_size;
+	int rv = -1;
+
+	s->blocks = frames / 4;
+	if (pcmL == NULL || pcmR == NULL || state == NULL ||
+	    (s->data = malloc(s->blocks * size)) == NULL)
+		goto final;
+
+	signal_generate(SIGNAL_PINK, pcmL, pcmR, frames, 24);
+
+	s->ops->init(state, 0);
+	for (size_t i = 0; i < s->blocks; i++) {
+		int32_t tmp[2][4];
+		memcpy(tmp[0], &pcmL[i * 4], sizeof(tmp[0]));
+		memcpy(tmp[1], &pcmR[i * 4], sizeof(tmp[1]));
+		s->ops->encode_pcm(state, tmp, &s->data[i * size]);
+	}
+
+	rv = 0;
+
+final:
+	free(pcmL);
+	free(pcmR);
+	free(state);
+	return rv;
+}
+
+/**
+ * Decode the stream from the beginning up to the given block. */
+static int decode_prefix(const struct stream * s, size_t blocks, int32_t * pcm) {
+
+	struct transcode_qmf qmf[2] = { 0 };
+	const size_t size = 2 * s->ops->codeword_size;
+	void * state;
+
+	if ((state = malloc(s->ops->size)) == NULL)
+		return -1;
+
+	s->ops->init(state, 0);
+	for (size_t i = 0; i < blocks; i++) {
+		int32_t subbands[2][4], tmp[2][4];
+		s->ops->decode(state, &s->data[i * size], subbands);
+		transcode_qmf_synthesis(&qmf[0], subbands[0], tmp[0]);
+		transcode_qmf_synthesis(&qmf[1], subbands[1], tmp[1]);
+		if (pcm != NULL)
+			for (size_t ii = 0; ii < 4; ii++) {
+				pcm[(i * 4 + ii) * 2 + 0] = tmp[0][ii];
+				pcm[(i * 4 + ii) * 2 + 1] = tmp[1][ii];
+			}
+	}
+
+	free(state);
+	return 0;
+}
+
+static int bench(enum openaptx_codec codec, size_t seconds, unsigned int interval, size_t seeks) {
+
+	struct stream s = {
+		.codec = codec,
+		.ops = codec == OPENAPTX_CODEC_APTX_HD ? &transcode_codec_aptxhd : &transcode_codec_aptx,
+	};
+
+	openaptx_container_writer * w = NULL;
+	openaptx_container_reader * r = NULL;
+	double * t_seek = calloc(seeks, sizeof(*t_seek));
+	double * t_prefix = calloc(seeks, sizeof(*t_prefix));
+	FILE * f = NULL;
+	size_t errors = 0;
+	int rv = -1;
+
+	if (t_seek == NULL || t_prefix == NULL || encode(&s, seconds * SAMPLING_RATE) == -1 ||
+	    (s.pcm = malloc(s.blocks * 4 * 2 * sizeof(*s.pcm))) == NULL || decode_prefix(&s, s.blocks, s.pcm) == -1) {
+		fprintf(stderr, "Error: Couldn't prepare stream: %s\n", strerror(errno));
+		goto final;
+	}
+
+	if ((f = tmpfile()) == NULL ||
+	    (w = openaptx_container_writer_new(fileno(f), codec, 0, SAMPLING_RATE, interval)) == NULL ||
+	    openaptx_container_write(w, s.data, s.blocks * 2 * s.ops->codeword_size) == -1 ||
+	    openaptx_container_writer_close(w) == -1 ||
+	    (r = openaptx_container_reader_new(fileno(f))) == NULL) {
+		fprintf(stderr, "Error: Couldn't create container: %s\n", strerror(errno));
+		goto final;
+	}
+
+	const size_t frames = openaptx_container_frames(r);
+	uint32_t seed = 0x5EEC;
+
+	for (size_t i = 0; i < seeks; i++) {
+
+		int32_t pcm[READ_FRAMES * 2];
+		struct timespec t0, t1, t2;
+		ssize_t n;
+
+		seed = seed * 1664525 + 1013904223;
+		const size_t frame = (uint64_t)seed * (frames - READ_FRAMES) >> 32;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (openaptx_container_seek(r, frame) == -1 ||
+		    (n = openaptx_container_read(r, pcm, READ_FRAMES)) == -1) {
+			fprintf(stderr, "Error: Couldn't seek to %zu: %s\n", frame, strerror(errno));
+			goto final;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		decode_prefix(&s, frame / 4 + READ_FRAMES / 4, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+
+		t_seek[i] = elapsed_us(&t0, &t1);
+		t_prefix[i] = elapsed_us(&t1, &t2);
+
+		if (n != READ_FRAMES || memcmp(pcm, &s.pcm[frame * 2], sizeof(pcm)) != 0) {
+			fprintf(stderr, "Error: %s: Mismatch after seek to frame %zu\n", codec_name(codec), frame);
+			errors++;
+		}
+
+	}
+
+	qsort(t_seek, seeks, sizeof(*t_seek), cmp_double);
+	qsort(t_prefix, seeks, sizeof(*t_prefix), cmp_double);
+
+	const off_t size = lseek(fileno(f), 0, SEEK_END);
+	printf("%-9s %6zu s %5u ms %9.1f kB %9.1f %9.1f %11.1f %11.1f %s\n",
+	       codec_name(codec), seconds, interval, size / 1024.0,
+	       t_seek[seeks / 2], t_seek[seeks * 99 / 100],
+	       t_prefix[seeks / 2], t_prefix[seeks * 99 / 100],
+	       errors == 0 ? "exact" : "MISMATCH");
+
+	rv = errors == 0 ? 0 : -1;
+
+final:
+	openaptx_container_reader_free(r);
+	if (f != NULL)
+		fclose(f);
+	free(s.data);
+	free(s.pcm);
+	free(t_seek);
+	free(t_prefix);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hi:n:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "interval", required_argument, NULL, 'i' },
+		{ "seeks", required_argument, NULL, 'n' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	unsigned int interval = 1000;
+	size_t seconds = 60;
+	size_t seeks = 200;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -i, --interval=MS\tsnapshot interval (default: %u)\n"
+			       "  -n, --seeks=NUM\tnumber of random seeks (default: %zu)\n"
+			       "  -s, --seconds=NUM\tstream duration (default: %zu)\n",
+			       argv[0], interval, seeks, seconds);
+			return EXIT_SUCCESS;
+		case 'i' /* --interval=MS */:
+			interval = strtoul(optarg, NULL, 10);
+			break;
+		case 'n' /* --seeks=NUM */:
+			seeks = strtoul(optarg, NULL, 10);
+			break;
+		case 's' /* --seconds=NUM */:
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (interval == 0 || seeks == 0 || seconds == 0) {
+		fprintf(stderr, "Error: Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Random seek followed by %d frames, latency in us (p50, p99)\n", READ_FRAMES);
+	printf("%-9s %8s %8s %12s %9s %9s %11s %11s\n",
+	       "codec", "length", "interval", "size", "seek-p50", "seek-p99", "prefix-p50", "prefix-p99");
+
+	int rv = EXIT_SUCCESS;
+	if (bench(OPENAPTX_CODEC_APTX, seconds, interval, seeks) == -1)
+		rv = EXIT_FAILURE;
+	if (bench(OPENAPTX_CODEC_APTX_HD, seconds, interval, seeks) == -1)
+		rv = EXIT_FAILURE;
+
+	return rv;
+}
@@ -0,0 +1,309 @@
+/*
+ * bench-transcode.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "openaptx-transcode.h"
+#include "openaptx.h"
+
+#include "../src/transcode.h"
+
+/* Maximal delay between the reference and the decoded signal. */
+#define MAX_LAG 256
+/* Number of frames skipped at the beginning (encoder warm-up). */
+#define SKIP_FRAMES 1024
+
+struct stream {
+	enum openaptx_codec codec;
+	uint8_t * data;
+	size_t blocks;
+};
+
+static const char * codec_name(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X";
+}
+
+static const struct transcode_codec * codec_ops(enum openaptx_codec codec) {
+	return codec == OPENAPTX_CODEC_APTX_HD ? &transcode_codec_aptxhd : &transcode_codec_aptx;
+}
+
+static size_t block_size(enum openaptx_codec codec) {
+	return 2 * codec_ops(codec)->codeword_size;
+}
+
+static double elapsed_us(const struct timespec * t0, const struct timespec * t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+/**
+ * Generate stereo test signal (24-bit): a mix of tones and noise. */
+static void generate(int32_t * pcm, size_t frames) {
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < frames; i++) {
+		seed = seed * 1664525 + 1013904223;
+		const double noise = ((int32_t)seed >> 8) / 8388608.0;
+		pcm[i * 2 + 0] = 8388607 * (0.35 * sin(0.0785 * i) + 0.15 * sin(0.817 * i) + 0.02 * noise);
+		pcm[i * 2 + 1] = 8388607 * (0.30 * sin(0.1963 * i) + 0.10 * sin(1.948 * i) + 0.02 * noise);
+	}
+}
+
+static int encode(const int32_t * pcm, size_t frames, struct stream * s) {
+
+	const struct transcode_codec * ops = codec_ops(s->codec);
+	void * state;
+
+	s->blocks = frames / 4;
+	if ((s->data = malloc(s->blocks * block_size(s->codec))) == NULL)
+		return -1;
+	if ((state = malloc(ops->size)) == NULL)
+		return -1;
+
+	ops->init(state, 0);
+	for (size_t i = 0; i < s->blocks; i++) {
+		int32_t tmp[2][4];
+		for (size_t ii = 0; ii < 4; ii++) {
+			tmp[0][ii] = pcm[(i * 4 + ii) * 2 + 0];
+			tmp[1][ii] = pcm[(i * 4 + ii) * 2 + 1];
+		}
+		ops->encode_pcm(state, tmp, &s->data[i * block_size(s->codec)]);
+	}
+
+	free(state);
+	return 0;
+}
+
+static int decode(const struct stream * s, int32_t * pcm) {
+
+	const struct transcode_codec * ops = codec_ops(s->codec);
+	struct transcode_qmf qmf[2] = { 0 };
+	void * state;
+
+	if ((state = malloc(ops->size)) == NULL)
+		return -1;
+
+	ops->init(state, 0);
+	for (size_t i = 0; i < s->blocks; i++) {
+		int32_t subbands[2][4], tmp[2][4];
+		ops->decode(state, &s->data[i * block_size(s->codec)], subbands);
+		transcode_qmf_synthesis(&qmf[0], subbands[0], tmp[0]);
+		transcode_qmf_synthesis(&qmf[1], subbands[1], tmp[1]);
+		for (size_t ii = 0; ii < 4; ii++) {
+			pcm[(i * 4 + ii) * 2 + 0] = tmp[0][ii];
+			pcm[(i * 4 + ii) * 2 + 1] = tmp[1][ii];
+		}
+	}
+
+	free(state);
+	return 0;
+}
+
+/**
+ * Calculate SNR of the decoded stream for the best alignment. */
+static double snr(const int32_t * ref, const struct stream * s, size_t * lag) {
+
+	const size_t frames = s->blocks * 4;
+	int32_t * pcm;
+
+	if ((pcm = malloc(frames * 2 * sizeof(*pcm))) == NULL || decode(s, pcm) != 0) {
+		free(pcm);
+		return NAN;
+	}
+
+	/* Find the delay using the window at the beginning of the stream. */
+	size_t end = SKIP_FRAMES + 8192;
+	if (end > frames - MAX_LAG)
+		end = frames - MAX_LAG;
+
+	double noise_min = INFINITY;
+	for (size_t l = 0; l <= MAX_LAG; l++) {
+		double noise = 0;
+		for (size_t i = SKIP_FRAMES * 2; i < end * 2; i++) {
+			const double d = (double)pcm[i + l * 2] - ref[i];
+			noise += d * d;
+		}
+		if (noise < noise_min) {
+			noise_min = noise;
+			*lag = l;
+		}
+	}
+
+	double signal = 0, noise = 0;
+	for (size_t i = SKIP_FRAMES * 2; i < (frames - MAX_LAG) * 2; i++) {
+		const double d = (double)pcm[i + *lag * 2] - ref[i];
+		signal += (double)ref[i] * ref[i];
+		noise += d * d;
+	}
+
+	const double snr = 10 * log10(signal / (noise > 0 ? noise : 1));
+
+	free(pcm);
+	return snr;
+}
+
+static int transcode(const struct stream * in, struct stream * out, enum openaptx_transcode_mode mode,
+                     size_t nloops, double * best_us) {
+
+	const size_t size = out->blocks * block_size(out->codec);
+	*best_us = INFINITY;
+
+	for (size_t n = 0; n < nloops; n++) {
+
+		openaptx_transcoder * t;
+		struct timespec t0, t1;
+		size_t written;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if ((t = openaptx_transcoder_new(in->codec, 0, out->codec, 0, mode)) == NULL)
+			return -1;
+		openaptx_transcode(t, in->data, in->blocks * block_size(in->codec), out->data, size, &written);
+		openaptx_transcoder_free(t);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		if (elapsed_us(&t0, &t1) < *best_us)
+			*best_us = elapsed_us(&t0, &t1);
+
+	}
+
+	return 0;
+}
+
+static int bench(const int32_t * pcm, size_t frames, enum openaptx_codec src, enum openaptx_codec dst,
+                 size_t nloops) {
+
+	struct stream in = { .codec = src };
+	struct stream out = { .codec = dst };
+	double us_pcm, us_subband;
+	double snr_pcm, snr_subband;
+	size_t lag_src, lag_pcm, lag_subband;
+
+	if (encode(pcm, frames, &in) != 0)
+		return -1;
+	out.blocks = in.blocks;
+	if ((out.data = malloc(out.blocks * block_size(dst))) == NULL)
+		return -1;
+
+	const double snr_src = snr(pcm, &in, &lag_src);
+
+	if (transcode(&in, &out, OPENAPTX_TRANSCODE_PCM, nloops, &us_pcm) != 0)
+		return -1;
+	snr_pcm = snr(pcm, &out, &lag_pcm);
+
+	if (transcode(&in, &out, OPENAPTX_TRANSCODE_SUBBAND, nloops, &us_subband) != 0)
+		return -1;
+	snr_subband = snr(pcm, &out, &lag_subband);
+
+	const double ns = 1e3 / in.blocks;
+	printf("%s -> %s\n", codec_name(src), codec_name(dst));
+	printf("  source stream        %29s  SNR: %6.2f dB  delay: %3zu\n", "", snr_src, lag_src);
+	printf("  decode + re-encode   time: %9.0f us (%6.1f ns/blk)  SNR: %6.2f dB  delay: %3zu\n", us_pcm,
+	       us_pcm * ns, snr_pcm, lag_pcm);
+	printf("  subband transcoder   time: %9.0f us (%6.1f ns/blk)  SNR: %6.2f dB  delay: %3zu\n", us_subband,
+	       us_subband * ns, snr_subband, lag_subband);
+	printf("  CPU savings: %.1f%%  SNR delta: %+.2f dB  delay delta: %+zd frames\n",
+	       100 * (1 - us_subband / us_pcm), snr_subband - snr_pcm, (ssize_t)lag_subband - (ssize_t)lag_pcm);
+
+	free(in.data);
+	free(out.data);
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hi:n:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "input", required_argument, NULL, 'i' },
+		{ "loops", required_argument, NULL, 'n' },
+		{ 0, 0, 0, 0 },
+	};
+
+	const char * input = NULL;
+	size_t nloops = 10;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]...\n"
+			       "\nCompare subband-domain transcoding with the full decode and re-encode path.\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -i, --input=FILE\traw stereo S16LE PCM (default: synthetic signal)\n"
+			       "  -n, --loops=NUM\tnumber of timing rounds\n",
+			       argv[0]);
+			return EXIT_SUCCESS;
+		case 'i':
+			input = optarg;
+			break;
+		case 'n':
+			nloops = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (nloops == 0)
+		nloops = 1;
+
+	size_t frames = 48000 * 10;
+	int32_t * pcm;
+
+	if (input != NULL) {
+
+		FILE * f;
+		if ((f = fopen(input, "rb")) == NULL) {
+			fprintf(stderr, "Couldn't open input file: %s\n", input);
+			return EXIT_FAILURE;
+		}
+
+		fseek(f, 0, SEEK_END);
+		frames = ftell(f) / 4;
+		rewind(f);
+
+		int16_t * buffer = malloc(frames * 4);
+		pcm = malloc(frames * 2 * sizeof(*pcm));
+		if (buffer == NULL || pcm == NULL || fread(buffer, 4, frames, f) != frames) {
+			fprintf(stderr, "Couldn't read input file: %s\n", input);
+			return EXIT_FAILURE;
+		}
+
+		for (size_t i = 0; i < frames * 2; i++)
+			pcm[i] = buffer[i] * 256;
+
+		free(buffer);
+		fclose(f);
+
+	} else {
+		if ((pcm = malloc(frames * 2 * sizeof(*pcm))) == NULL)
+			return EXIT_FAILURE;
+		generate(pcm, frames);
+	}
+
+	if (frames < SKIP_FRAMES + MAX_LAG + 4) {
+		fprintf(stderr, "Input is too short\n");
+		return EXIT_FAILURE;
+	}
+
+	if (bench(pcm, frames, OPENAPTX_CODEC_APTX_HD, OPENAPTX_CODEC_APTX, nloops) != 0 ||
+	    bench(pcm, frames, OPENAPTX_CODEC_APTX, OPENAPTX_CODEC_APTX_HD, nloops) != 0) {
+		fprintf(stderr, "Couldn't transcode stream\n");
+		return EXIT_FAILURE;
+	}
+
+	free(pcm);
+	return EXIT_SUCCESS;
+}
@@ -65,6 +65,12 @@ echo "libaptXHD-1.0.0"
 ln -srf build/src/libaptxHD-1.0.0.so build/libaptx.so
 time build/utils/aptxhdenc input.wav >/dev/null
 
+# Compare subband-domain transcoding with decode and re-encode.
+cmake --build build --target bench-transcode
+ffmpeg -i input.wav -f s16le -y input.raw
+echo "openaptx-transcode"
+build/test/bench-transcode --input=input.raw
+
 # Prepare FFmpeg backend.
 cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DWITH_SNDFILE=ON \
 	-DWITH_FFMPEG=ON -DWITH_FREEAPTX=OFF \
@@ -80,6 +86,11 @@ time  build/utils/aptxenc input.wav >/dev/null
 echo "openaptx-ffmpeg-aptX (HD)"
 time build/utils/aptxhdenc input.wav >/dev/null
 
+# Measure stream open latency with FFmpeg backend.
+cmake --build build --target bench-open
+echo "openaptx-ffmpeg stream open"
+build/test/bench-open
+
 # Prepare freeaptx backend.
 cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DWITH_SNDFILE=ON \
 	-DWITH_FFMPEG=OFF -DWITH_FREEAPTX=ON \
@@ -94,6 +105,20 @@ time  build/utils/aptxenc input.wav >/dev/null
 echo "openaptx-freeaptx-aptX (HD)"
 time build/utils/aptxhdenc input.wav >/dev/null
 
+# Compare all backends loaded by the runtime dispatcher.
+cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DENABLE_DISPATCHER=ON \
+	-DENABLE_APTX422=ON -DENABLE_APTXHD100=ON -DWITH_FFMPEG=ON -DWITH_FREEAPTX=ON \
+	-Dpkgcfg_lib_FFLibAVCodec_avcodec=FFmpeg/libavcodec/libavcodec.so \
+	-Dpkgcfg_lib_FFLibAVCodec_avutil=FFmpeg/libavutil/libavutil.so \
+	-Dpkgcfg_lib_FreeAptX_freeaptx=libfreeaptx/libfreeaptx.so \
+	-DCMAKE_C_FLAGS_RELEASE="-O3 -I$PWD/FFmpeg -I$PWD/libfreeaptx"
+cmake --build build --target bench-backends
+
+export LD_LIBRARY_PATH=$PWD/FFmpeg/libavcodec:$PWD/FFmpeg/libavutil:$PWD/libfreeaptx:$LD_LIBRARY_PATH_SAVED
+
+echo "openaptx-backends"
+build/test/bench-backends
+
 # Test the original libraries.
 export LD_LIBRARY_PATH=$PWD/build:$LD_LIBRARY_PATH_SAVED
 
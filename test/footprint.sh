@@ -0,0 +1,147 @@
+#!/bin/sh
+#
+# [open]aptx - footprint.sh
+# Copyright (c) 2017-2024 Arkadiusz Bokowy
+#
+# This file is a part of [open]aptx.
+#
+# This project is licensed under the terms of the MIT license.
+#
+# Report the footprint of the freestanding encoder library: code and
+# read-only data size, writable static data size, external symbols and
+# the maximum stack depth of the public entry points. Sizes are taken from
+# the relocatable object with the given entry points and everything they
+# reference (the library has to be built with -ffunction-sections and
+# -fdata-sections), as it would be linked into the firmware with the
+# --gc-sections linker option. The stack depth is
+# calculated from the call graph files (*.ci) generated by GCC with the
+# -fcallgraph-info=su option, which have to be in the given directory.
+#
+# Usage: footprint.sh <LIBRARY.a> <CALLGRAPH-DIR> <ENTRY>...
+#
+# The exit status is non-zero if the library depends on any external
+# symbol, has writable static data, or if the stack depth can not be
+# determined (recursion, dynamic stack allocation or indirect calls).
+
+LD=${LD:-ld}
+NM=${NM:-nm}
+SIZE=${SIZE:-size}
+
+if [ $# -lt 3 ]; then
+	echo "Usage: $0 <LIBRARY.a> <CALLGRAPH-DIR> <ENTRY>..." >&2
+	exit 1
+fi
+
+LIBRARY=$1
+CALLGRAPH=$2
+shift 2
+
+RV=0
+
+echo "$(basename "$LIBRARY"):"
+
+OBJECT=$(mktemp)
+trap 'rm -f "$OBJECT"' EXIT
+
+# shellcheck disable=SC2046
+$LD -r --gc-sections $(printf -- "-u %s " "$@") "$LIBRARY" -o "$OBJECT" || exit 1
+
+# sizes of the linked sections by the section kind
+$SIZE -A "$OBJECT" | awk '
+	$1 ~ /^\.text/ { text += $2 }
+	# constant tables with pointers are read-only after relocation
+	$1 ~ /^\.(s?rodata|data\.rel\.ro)/ { rodata += $2; next }
+	$1 ~ /^\.(s?data|s?bss|tbss|tdata)/ { data += $2 }
+	END {
+		printf "  code:\t\t%d bytes\n", text
+		printf "  rodata:\t%d bytes\n", rodata
+		printf "  data+bss:\t%d bytes\n", data
+		exit data != 0
+	}' || { echo "Error: Library has writable static data" >&2; RV=1; }
+
+# symbols which are not defined by any member of the archive
+EXTERNAL=$({
+	$NM --defined-only -g "$LIBRARY" | awk 'NF == 3 { print "D", $3 }'
+	$NM -u "$LIBRARY" | awk '$1 == "U" { print "U", $2 }'
+} | awk '
+	$1 == "D" { defined[$2] = 1 }
+	$1 == "U" { undefined[$2] = 1 }
+	END { for (s in undefined) if (!(s in defined)) print s }' | sort)
+if [ -n "$EXTERNAL" ]; then
+	echo "  external:\t$(echo $EXTERNAL)"
+	echo "Error: Library depends on external symbols" >&2
+	RV=1
+else
+	echo "  external:\tnone"
+fi
+
+# longest path in the call graph weighted with the stack usage
+CI=$(find "$CALLGRAPH" -name '*.ci')
+if [ -z "$CI" ]; then
+	echo "  stack:\t\tunknown (no call graph files)"
+	exit $RV
+fi
+
+# shellcheck disable=SC2086
+awk -v entries="$*" '
+	/^node:/ {
+		match($0, /title: "[^"]*"/)
+		name = substr($0, RSTART + 8, RLENGTH - 9)
+		if (match($0, /[0-9]+ bytes \([a-z,]+\)/)) {
+			split(substr($0, RSTART, RLENGTH), a, " ")
+			stack[name] = a[1]
+			if (a[3] == "(dynamic)")
+				dynamic[name] = 1
+		}
+	}
+	/^edge:/ {
+		match($0, /sourcename: "[^"]*"/)
+		src = substr($0, RSTART + 13, RLENGTH - 14)
+		match($0, /targetname: "[^"]*"/)
+		dst = substr($0, RSTART + 13, RLENGTH - 14)
+		if (!((src, dst) in seen)) {
+			seen[src, dst] = 1
+			calls[src] = calls[src] " " dst
+		}
+	}
+	function depth(name, level,    n, i, callee, d, max) {
+		if (name in memo)
+			return memo[name]
+		if (level > 64 || name in visiting) {
+			unbounded = unbounded " " name
+			return 0
+		}
+		if (!(name in stack))
+			undefined = undefined " " name
+		if (name in dynamic)
+			unbounded = unbounded " " name
+		visiting[name] = 1
+		max = 0
+		n = split(calls[name], callee, " ")
+		for (i = 1; i <= n; i++) {
+			# the target of the indirect call (and its stack usage) is not known
+			if (callee[i] == "__indirect_call") {
+				indirect = indirect " " name
+				continue
+			}
+			if ((d = depth(callee[i], level + 1)) > max)
+				max = d
+		}
+		delete visiting[name]
+		return memo[name] = stack[name] + max
+	}
+	END {
+		n = split(entries, entry, " ")
+		for (i = 1; i <= n; i++)
+			printf "  stack:\t\t%d bytes (%s)\n", depth(entry[i], 0), entry[i]
+		if (undefined != "")
+			printf "Warning: Unknown stack usage:%s\n", undefined > "/dev/stderr"
+		if (indirect != "")
+			printf "Error: Unresolved indirect call:%s\n", indirect > "/dev/stderr"
+		if (unbounded != "")
+			printf "Error: Unbounded stack usage:%s\n", unbounded > "/dev/stderr"
+		if (indirect != "" || unbounded != "")
+			exit 1
+	}' $CI || RV=1
+
+exit $RV
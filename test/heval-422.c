@@ -20,6 +20,7 @@
 #include "openaptx.h"
 
 #include "../src/aptx422/encode.h"
+#include "../src/aptx422/fused.h"
 #include "../src/aptx422/params.h"
 #include "../src/aptx422/processor.h"
 #include "../src/aptx422/qmf.h"
@@ -473,6 +474,69 @@ static int eval_aptxbtenc_encodestereo(size_t nloops, bool errstop) {
 	return 0;
 }
 
+/**
+ * Compare fused encoding kernel with the staged encoder. */
+static int eval_encode_fused(size_t nloops, bool errstop) {
+	fprintf(stderr, "%s: ", __func__);
+
+	aptX_encoder_422 enc_ref;
+	aptX_encoder_422 enc_fused;
+
+	short endian = rand() > (RAND_MAX / 2);
+	aptX_encoder_init(&enc_ref, endian);
+	aptX_encoder_init(&enc_fused, endian);
+
+	while (nloops--) {
+
+		int32_t pcmL[4] = { rand(), rand(), rand(), rand() };
+		int32_t pcmR[4] = { rand(), rand(), rand(), rand() };
+
+		/* exercise also the clamp-free path with quiet signal */
+		if (nloops % 2 == 0)
+			for (size_t i = 0; i < 4; i++) {
+				pcmL[i] >>= 12;
+				pcmR[i] >>= 12;
+			}
+		/* and the silent path with runs of digital silence */
+		if (nloops / 64 % 4 == 0) {
+			memset(pcmL, 0, sizeof(pcmL));
+			memset(pcmR, 0, sizeof(pcmR));
+		}
+
+		uint16_t code_ref[2];
+		uint16_t code_fused[2];
+		uint16_t tmp;
+
+		aptX_encode(pcmL, &enc_ref.analyzer[0], &enc_ref.encoder[0]);
+		aptX_encode(pcmR, &enc_ref.analyzer[1], &enc_ref.encoder[1]);
+		aptX_insert_sync(&enc_ref.encoder[0], &enc_ref.encoder[1], &enc_ref.sync);
+		aptX_post_encode(&enc_ref.encoder[0]);
+		aptX_post_encode(&enc_ref.encoder[1]);
+		tmp = aptX_pack_codeword(&enc_ref.encoder[0]);
+		code_ref[0] = (tmp >> enc_ref.shift) | (tmp << enc_ref.shift);
+		tmp = aptX_pack_codeword(&enc_ref.encoder[1]);
+		code_ref[1] = (tmp >> enc_ref.shift) | (tmp << enc_ref.shift);
+
+		if (nloops % 2)
+			aptX_encode_fused(&enc_fused, pcmL, pcmR, code_fused);
+		else
+			aptX_encode_fused_guarded(&enc_fused, pcmL, pcmR, code_fused);
+
+		int ret = 0;
+		ret |= aptX_encoder_422_cmp("\tenc", &enc_fused, &enc_ref);
+		ret |= diffmem("\tcode", code_fused, code_ref, sizeof(code_fused));
+		if (ret) {
+			fprintf(stderr, "Failed: TTL %zd\n", nloops);
+			if (errstop)
+				return -1;
+			memcpy(&enc_fused, &enc_ref, sizeof(enc_fused));
+		}
+	}
+
+	fprintf(stderr, "OK\n");
+	return 0;
+}
+
 int main(int argc, char * argv[]) {
 
 	bool errstop = true;
@@ -513,6 +577,7 @@ int main(int argc, char * argv[]) {
 	ret |= eval_processSubband(APTX_SUBBAND_HL, nloops, errstop);
 	ret |= eval_packCodeword(nloops, errstop);
 	ret |= eval_aptxbtenc_encodestereo(nloops, errstop);
+	ret |= eval_encode_fused(nloops, errstop);
 
 	return ret;
 }
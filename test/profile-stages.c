@@ -0,0 +1,469 @@
+/*
+ * profile-stages.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx.h"
+#include "signals.h"
+
+#if APTXHD
+#	include "aptxHD100.h"
+#	include "../src/aptxhd100/encode.h"
+#	include "../src/aptxhd100/fused.h"
+#	include "../src/aptxhd100/qmf.h"
+#	include "../src/aptxhd100/quantizer.h"
+#	define _codec_name_ "apt-X HD"
+#	define _sample_bits_ 24
+#	define _encoder_t_ aptXHD_encoder_100
+#	define _subband_encoder_t_ aptXHD_subband_encoder_100
+#	define _analyzer_t_ aptXHD_QMF_analyzer_100
+#	define _codeword_t_ uint32_t
+#	define _encoder_init_ aptXHD_encoder_init
+#	define _encodestereo_ aptxhdbtenc_encodestereo
+#	define _generate_dither_ aptXHD_generate_dither
+#	define _QMF_analysis_ aptXHD_QMF_analysis
+#	define _quantize_difference_LL_ aptXHD_quantize_difference_LL
+#	define _quantize_difference_LH_ aptXHD_quantize_difference_LH
+#	define _quantize_difference_HL_ aptXHD_quantize_difference_HL
+#	define _quantize_difference_HH_ aptXHD_quantize_difference_HH
+#	define _insert_sync_ aptXHD_insert_sync
+#	define _post_encode_ aptXHD_post_encode
+#	define _pack_codeword_ aptXHD_pack_codeword
+#	define _encode_fused_guarded_ aptXHD_encode_fused_guarded
+#else
+#	include "aptx422.h"
+#	include "../src/aptx422/encode.h"
+#	include "../src/aptx422/fused.h"
+#	include "../src/aptx422/qmf.h"
+#	include "../src/aptx422/quantizer.h"
+#	define _codec_name_ "apt-X"
+#	define _sample_bits_ 16
+#	define _encoder_t_ aptX_encoder_422
+#	define _subband_encoder_t_ aptX_subband_encoder_422
+#	define _analyzer_t_ aptX_QMF_analyzer_422
+#	define _codeword_t_ uint16_t
+#	define _encoder_init_ aptX_encoder_init
+#	define _encodestereo_ aptxbtenc_encodestereo
+#	define _generate_dither_ aptX_generate_dither
+#	define _QMF_analysis_ aptX_QMF_analysis
+#	define _quantize_difference_LL_ aptX_quantize_difference_LL
+#	define _quantize_difference_LH_ aptX_quantize_difference_LH
+#	define _quantize_difference_HL_ aptX_quantize_difference_HL
+#	define _quantize_difference_HH_ aptX_quantize_difference_HH
+#	define _insert_sync_ aptX_insert_sync
+#	define _post_encode_ aptX_post_encode
+#	define _pack_codeword_ aptX_pack_codeword
+#	define _encode_fused_guarded_ aptX_encode_fused_guarded
+#endif
+
+enum stage {
+	STAGE_DITHER = 0,
+	STAGE_QMF,
+	STAGE_QUANTIZE,
+	STAGE_SYNC,
+	STAGE_PROCESS,
+	STAGE_PACK,
+	STAGES,
+};
+
+static const char * stage_names[STAGES] = {
+	[STAGE_DITHER] = "dither",
+	[STAGE_QMF] = "qmf",
+	[STAGE_QUANTIZE] = "quantize",
+	[STAGE_SYNC] = "sync",
+	[STAGE_PROCESS] = "process",
+	[STAGE_PACK] = "pack",
+};
+
+enum counter {
+	COUNTER_CYCLES = 0,
+	COUNTER_BRANCHES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_L1D_MISSES,
+	COUNTERS,
+};
+
+/**
+ * Hardware performance counters of the calling thread. When they are not
+ * available (e.g. in a virtual machine or with restrictive paranoid level),
+ * nanoseconds are counted instead of cycles and branches and cache misses
+ * are not counted. */
+static struct {
+	int fd;
+	/* number of events in the group */
+	size_t events;
+} perf = { .fd = -1 };
+
+static int perf_open(uint32_t type, uint64_t config, int group) {
+	struct perf_event_attr attr = {
+		.size = sizeof(attr),
+		.type = type,
+		.config = config,
+		.disabled = group == -1,
+		/* system call used to read counters shall not be counted */
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+		.read_format = PERF_FORMAT_GROUP,
+	};
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void perf_init(void) {
+
+	if ((perf.fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1)) == -1)
+		return;
+	perf.events = 1;
+
+	/* branch counters are optional, but both are required for the miss rate */
+	if (perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, perf.fd) != -1 &&
+	    perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, perf.fd) != -1)
+		perf.events = 3;
+
+	/* counters are read in the group order, so the cache miss counter is
+	 * used only when the branch counters are available as well */
+	if (perf.events == 3 &&
+	    perf_open(PERF_TYPE_HW_CACHE,
+	              PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+	              perf.fd) != -1)
+		perf.events = 4;
+
+	ioctl(perf.fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+}
+
+static inline void perf_sample(uint64_t v[COUNTERS]) {
+
+	if (perf.fd == -1) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		v[COUNTER_CYCLES] = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		return;
+	}
+
+	uint64_t buffer[1 + COUNTERS];
+	if (read(perf.fd, buffer, sizeof(buffer)) == -1)
+		return;
+	for (size_t i = 0; i < perf.events; i++)
+		v[i] = buffer[1 + i];
+
+}
+
+static inline void accumulate(uint64_t acc[COUNTERS], const uint64_t v1[COUNTERS], const uint64_t v0[COUNTERS]) {
+	for (size_t i = 0; i < COUNTERS; i++)
+		acc[i] += v1[i] - v0[i];
+}
+
+/**
+ * Cost of taking a single sample, which is subtracted from stage results. */
+static void perf_calibrate(uint64_t overhead[COUNTERS]) {
+
+	const size_t n = 100000;
+	uint64_t acc[COUNTERS] = { 0 };
+	uint64_t v0[COUNTERS] = { 0 }, v1[COUNTERS] = { 0 };
+
+	for (size_t i = 0; i < n; i++) {
+		perf_sample(v0);
+		perf_sample(v1);
+		accumulate(acc, v1, v0);
+	}
+
+	for (size_t i = 0; i < COUNTERS; i++)
+		overhead[i] = acc[i] / n;
+
+}
+
+struct profile {
+	/* counters accumulated per stage */
+	uint64_t stages[STAGES][COUNTERS];
+	/* whole encoding without per-stage sampling */
+	uint64_t total[COUNTERS];
+	size_t blocks;
+	size_t fast_blocks;
+};
+
+static void encode_block(_encoder_t_ * e, const int32_t pcmL[4], const int32_t pcmR[4], _codeword_t_ code[2],
+                         struct profile * p) {
+
+	_subband_encoder_t_ * const se[2] = { &e->encoder[0], &e->encoder[1] };
+	_analyzer_t_ * const qmf[2] = { &e->analyzer[0], &e->analyzer[1] };
+	const int32_t * const pcm[2] = { pcmL, pcmR };
+	uint64_t v[STAGES + 1][COUNTERS] = { 0 };
+	int32_t diffs[2][4];
+	_codeword_t_ tmp;
+	size_t ch;
+
+	perf_sample(v[0]);
+
+	for (ch = 0; ch < 2; ch++)
+		_generate_dither_(se[ch]);
+
+	perf_sample(v[1]);
+
+	for (ch = 0; ch < 2; ch++) {
+		const int32_t refs[4] = {
+			se[ch]->processor[0].filter.unk8,
+			se[ch]->processor[1].filter.unk8,
+			se[ch]->processor[2].filter.unk8,
+			se[ch]->processor[3].filter.unk8,
+		};
+		_QMF_analysis_(qmf[ch], pcm[ch], refs, diffs[ch]);
+	}
+
+	perf_sample(v[2]);
+
+	for (ch = 0; ch < 2; ch++) {
+		_subband_encoder_t_ * const s = se[ch];
+		_quantize_difference_LL_(diffs[ch][0], s->dither[0], s->processor[0].inverter.unk9, &s->quantizer[0]);
+		_quantize_difference_LH_(diffs[ch][1], s->dither[1], s->processor[1].inverter.unk9, &s->quantizer[1]);
+		_quantize_difference_HL_(diffs[ch][2], s->dither[2], s->processor[2].inverter.unk9, &s->quantizer[2]);
+		_quantize_difference_HH_(diffs[ch][3], s->dither[3], s->processor[3].inverter.unk9, &s->quantizer[3]);
+	}
+
+	perf_sample(v[3]);
+
+	_insert_sync_(se[0], se[1], &e->sync);
+
+	perf_sample(v[4]);
+
+	for (ch = 0; ch < 2; ch++)
+		_post_encode_(se[ch]);
+
+	perf_sample(v[5]);
+
+	for (ch = 0; ch < 2; ch++) {
+		tmp = _pack_codeword_(se[ch]);
+		code[ch] = (tmp >> e->shift) | (tmp << e->shift);
+	}
+
+	perf_sample(v[6]);
+
+	for (size_t i = 0; i < STAGES; i++)
+		accumulate(p->stages[i], v[i + 1], v[i]);
+
+}
+
+static void profile(const int32_t * pcmL, const int32_t * pcmR, size_t blocks, _codeword_t_ * code,
+                    _encoder_t_ * e, struct profile * p) {
+
+	uint64_t v0[COUNTERS] = { 0 }, v1[COUNTERS] = { 0 };
+
+	_encoder_init_(e, 0);
+	for (size_t i = 0; i < blocks; i++)
+		encode_block(e, &pcmL[i * 4], &pcmR[i * 4], &code[i * 2], p);
+
+	/* verify that stages were called exactly as in the library */
+	_codeword_t_ * code_fused = code + blocks * 2;
+	_encoder_init_(e, 0);
+	for (size_t i = 0; i < blocks; i++)
+		if (_encode_fused_guarded_(e, &pcmL[i * 4], &pcmR[i * 4], &code_fused[i * 2]))
+			p->fast_blocks++;
+	if (memcmp(code, code_fused, blocks * 2 * sizeof(*code)) != 0)
+		fprintf(stderr, "Codeword mismatch between staged and fused encoder\n");
+
+	_encoder_init_(e, 0);
+	perf_sample(v0);
+	for (size_t i = 0; i < blocks; i++)
+		_encodestereo_(e, &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]);
+	perf_sample(v1);
+	accumulate(p->total, v1, v0);
+
+	p->blocks += blocks;
+
+}
+
+int main(int argc, char * argv[]) {
+
+	const char * opts = "hc:n:s:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "class", required_argument, NULL, 'c' },
+		{ "loops", required_argument, NULL, 'n' },
+		{ "seconds", required_argument, NULL, 's' },
+		{ 0, 0, 0, 0 },
+	};
+
+	bool classes[SIGNAL_CLASSES] = { 0 };
+	bool classes_selected = false;
+	size_t nloops = 3;
+	size_t seconds = 2;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h':
+			printf("usage: %s [OPTION]...\n"
+			       "\nProfile stages of the %s encoder with various classes of test signals.\n"
+			       "Cost is given per stereo sample in CPU cycles (or in nanoseconds when\n"
+			       "hardware performance counters are not available). The sum of stages\n"
+			       "is given next to the total cost of the library encoding function.\n"
+			       "Branch miss rate and L1 data cache read misses are given as well, if\n"
+			       "the CPU exposes such counters.\n"
+			       "\noptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -c, --class=NAME\tprofile given signal class only (repeatable)\n"
+			       "  -n, --loops=NUM\tnumber of profiling rounds\n"
+			       "  -s, --seconds=NUM\tduration of the test signal\n"
+			       "\nsignal classes:\n",
+			       argv[0], _codec_name_);
+			for (size_t i = 0; i < SIGNAL_CLASSES; i++)
+				printf("  %s\n", signal_class_name(i));
+			return EXIT_SUCCESS;
+		case 'c': {
+			int c;
+			if ((c = signal_class_from_name(optarg)) == -1) {
+				fprintf(stderr, "Invalid signal class: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			classes[c] = classes_selected = true;
+			break;
+		}
+		case 'n':
+			nloops = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (nloops == 0)
+		nloops = 1;
+	if (seconds == 0)
+		seconds = 1;
+	if (!classes_selected)
+		for (size_t i = 0; i < SIGNAL_CLASSES; i++)
+			classes[i] = true;
+
+	const size_t blocks = seconds * 48000 / 4;
+	int32_t * pcmL = malloc(blocks * 4 * sizeof(*pcmL));
+	int32_t * pcmR = malloc(blocks * 4 * sizeof(*pcmR));
+	_codeword_t_ * code = malloc(blocks * 2 * 2 * sizeof(*code));
+	_encoder_t_ * e = malloc(sizeof(*e));
+
+	if (pcmL == NULL || pcmR == NULL || code == NULL || e == NULL) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	perf_init();
+	uint64_t overhead[COUNTERS];
+	perf_calibrate(overhead);
+
+	const bool cycles = perf.fd != -1;
+	const bool branches = perf.events >= 3;
+	const bool misses = perf.events == 4;
+	printf("%s stage profile (%zu samples per class, cost in %s per sample)\n",
+	       _codec_name_, blocks * 4, cycles ? "cycles" : "ns");
+
+	printf("%-8s", "class");
+	for (size_t i = 0; i < STAGES; i++)
+		printf(" %8s", stage_names[i]);
+	printf(" %8s %8s %10s\n", "sum", "total", "clamp-free");
+
+	struct profile profiles[SIGNAL_CLASSES] = { 0 };
+	for (size_t c = 0; c < SIGNAL_CLASSES; c++) {
+
+		if (!classes[c])
+			continue;
+
+		struct profile * p = &profiles[c];
+		signal_generate(c, pcmL, pcmR, blocks * 4, _sample_bits_);
+		/* the first round warms up caches and branch predictors */
+		struct profile warmup = { 0 };
+		profile(pcmL, pcmR, blocks, code, e, &warmup);
+		for (size_t n = 0; n < nloops; n++)
+			profile(pcmL, pcmR, blocks, code, e, p);
+
+		const double samples = p->blocks * 4;
+		double sum = 0;
+
+		printf("%-8s", signal_class_name(c));
+		for (size_t i = 0; i < STAGES; i++) {
+			const double v = (p->stages[i][COUNTER_CYCLES] - (double)overhead[COUNTER_CYCLES] * p->blocks) / samples;
+			printf(" %8.2f", v);
+			sum += v;
+		}
+		printf(" %8.2f %8.2f %9.1f%%\n", sum, p->total[COUNTER_CYCLES] / samples,
+		       100.0 * p->fast_blocks / p->blocks);
+
+	}
+
+	printf("\nbranch miss rate (%%)\n");
+	printf("%-8s", "class");
+	for (size_t i = 0; i < STAGES; i++)
+		printf(" %8s", stage_names[i]);
+	printf(" %8s\n", "total");
+
+	for (size_t c = 0; c < SIGNAL_CLASSES; c++) {
+
+		if (!classes[c])
+			continue;
+
+		const struct profile * p = &profiles[c];
+		printf("%-8s", signal_class_name(c));
+		for (size_t i = 0; i <= STAGES; i++) {
+			const uint64_t * v = i < STAGES ? p->stages[i] : p->total;
+			const double n = i < STAGES ? p->blocks : 0;
+			const double b = v[COUNTER_BRANCHES] - (double)overhead[COUNTER_BRANCHES] * n;
+			const double m = v[COUNTER_BRANCH_MISSES] - (double)overhead[COUNTER_BRANCH_MISSES] * n;
+			if (!branches || b <= 0)
+				printf(" %8s", "n/a");
+			else
+				printf(" %8.2f", m < 0 ? 0 : 100.0 * m / b);
+		}
+		printf("\n");
+
+	}
+
+	printf("\nL1D read misses (per 1000 samples)\n");
+	printf("%-8s", "class");
+	for (size_t i = 0; i < STAGES; i++)
+		printf(" %8s", stage_names[i]);
+	printf(" %8s\n", "total");
+
+	for (size_t c = 0; c < SIGNAL_CLASSES; c++) {
+
+		if (!classes[c])
+			continue;
+
+		const struct profile * p = &profiles[c];
+		const double samples = p->blocks * 4;
+		printf("%-8s", signal_class_name(c));
+		for (size_t i = 0; i <= STAGES; i++) {
+			const uint64_t * v = i < STAGES ? p->stages[i] : p->total;
+			const double n = i < STAGES ? p->blocks : 0;
+			const double m = v[COUNTER_L1D_MISSES] - (double)overhead[COUNTER_L1D_MISSES] * n;
+			if (!misses)
+				printf(" %8s", "n/a");
+			else
+				printf(" %8.2f", m < 0 ? 0 : 1000.0 * m / samples);
+		}
+		printf("\n");
+
+	}
+
+	free(pcmL);
+	free(pcmR);
+	free(code);
+	free(e);
+	return EXIT_SUCCESS;
+}
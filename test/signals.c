@@ -0,0 +1,175 @@
+/*
+ * signals.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "signals.h"
+
+#include <math.h>
+#include <string.h>
+#include <strings.h>
+
+#define SAMPLING_RATE 48000
+
+static const char * names[SIGNAL_CLASSES] = {
+	[SIGNAL_SILENCE] = "silence",
+	[SIGNAL_NOISE] = "noise",
+	[SIGNAL_SWEEP] = "sweep",
+	[SIGNAL_SQUARE] = "square",
+	[SIGNAL_SPEECH] = "speech",
+	[SIGNAL_PINK] = "pink",
+};
+
+const char * signal_class_name(enum signal_class c) {
+	if (c >= SIGNAL_CLASSES)
+		return "unknown";
+	return names[c];
+}
+
+int signal_class_from_name(const char * name) {
+	for (size_t i = 0; i < SIGNAL_CLASSES; i++)
+		if (strcasecmp(names[i], name) == 0)
+			return i;
+	return -1;
+}
+
+/**
+ * Uniformly distributed random value from the [-1, 1) range. Samples are
+ * generated with own LCG, so the signal does not depend on the libc. */
+static double random_uniform(uint32_t * seed) {
+	*seed = *seed * 1664525 + 1013904223;
+	return (int32_t)*seed / 2147483648.0;
+}
+
+/**
+ * Paul Kellet's economy pink noise filter. */
+static double random_pink(uint32_t * seed, double b[3]) {
+	const double white = random_uniform(seed);
+	b[0] = 0.99765 * b[0] + white * 0.0990460;
+	b[1] = 0.96300 * b[1] + white * 0.2965164;
+	b[2] = 0.57000 * b[2] + white * 1.0526913;
+	return (b[0] + b[1] + b[2] + white * 0.1848) / 4;
+}
+
+static double sweep(size_t i, double phase) {
+	/* one second long sweep repeated until the end of the signal */
+	const double t = (double)(i % SAMPLING_RATE) / SAMPLING_RATE;
+	const double f0 = 20, f1 = 20000, k = log(f1 / f0);
+	return sin(2 * M_PI * f0 * (exp(t * k) - 1) / k + phase);
+}
+
+static double square(size_t i, double freq) {
+	const double x = 8 * sin(2 * M_PI * freq * i / SAMPLING_RATE);
+	return x > 1 ? 1 : x < -1 ? -1 : x;
+}
+
+struct speech {
+	uint32_t seed;
+	/* length of the current segment and position within it */
+	size_t length;
+	size_t position;
+	/* 0 - pause, 1 - voiced, 2 - unvoiced */
+	int type;
+	double pitch;
+	double phase;
+	double gain;
+	double last;
+};
+
+/**
+ * Syllable-like segments: harmonic bursts with pitch jitter, noisy bursts
+ * and pauses with the background noise. */
+static double speech(struct speech * s) {
+
+	if (s->position == s->length) {
+		const double r = random_uniform(&s->seed);
+		s->type = r < -0.4 ? 0 : r < 0.6 ? 1 : 2;
+		s->length = SAMPLING_RATE * (0.06 + 0.1 * (random_uniform(&s->seed) + 1));
+		s->position = 0;
+		s->pitch = 150 + 50 * random_uniform(&s->seed);
+		s->gain = 0.25 + 0.1 * random_uniform(&s->seed);
+	}
+
+	const double envelope = sin(M_PI * s->position++ / s->length);
+	double x = 0;
+
+	switch (s->type) {
+	case 0:
+		return 0.0005 * random_uniform(&s->seed);
+	case 1:
+		s->phase += 2 * M_PI * s->pitch * (1 + 0.002 * random_uniform(&s->seed)) / SAMPLING_RATE;
+		/* harmonics up to 4 kHz with the first formant emphasized */
+		for (size_t k = 1; k * s->pitch < 4000; k++)
+			x += sin(k * s->phase) / k * (k * s->pitch < 1000 ? 1.0 : 0.3);
+		x *= 0.5;
+		break;
+	case 2: {
+		/* high-passed noise for fricatives */
+		const double white = random_uniform(&s->seed);
+		x = 0.5 * (white - s->last);
+		s->last = white;
+		break;
+	}
+	}
+
+	return s->gain * envelope * x;
+}
+
+static int32_t quantize(double x, unsigned int bits) {
+	const double max = (1 << (bits - 1)) - 1;
+	x = round(x * max);
+	return x > max ? max : x < -max - 1 ? -max - 1 : x;
+}
+
+/**
+ * Generate deterministic stereo test signal of the given class.
+ *
+ * @param c Signal class.
+ * @param pcmL Buffer for left channel samples.
+ * @param pcmR Buffer for right channel samples.
+ * @param frames Number of frames to generate.
+ * @param bits Sample resolution, e.g. 16 for apt-X and 24 for apt-X HD. */
+void signal_generate(enum signal_class c, int32_t * pcmL, int32_t * pcmR, size_t frames, unsigned int bits) {
+
+	uint32_t seedL = 0x12345678 + c;
+	uint32_t seedR = 0x87654321 + c;
+	double pinkL[3] = { 0 }, pinkR[3] = { 0 };
+	struct speech s = { .seed = 0xC0FFEE };
+
+	for (size_t i = 0; i < frames; i++) {
+		double l = 0, r = 0;
+		switch (c) {
+		case SIGNAL_SILENCE:
+		case SIGNAL_CLASSES:
+			break;
+		case SIGNAL_NOISE:
+			l = 0.001 * random_uniform(&seedL);
+			r = 0.001 * random_uniform(&seedR);
+			break;
+		case SIGNAL_SWEEP:
+			l = sweep(i, 0);
+			r = sweep(i, M_PI / 2);
+			break;
+		case SIGNAL_SQUARE:
+			l = square(i, 440);
+			r = square(i, 659.25);
+			break;
+		case SIGNAL_SPEECH:
+			l = speech(&s);
+			r = 0.8 * l;
+			break;
+		case SIGNAL_PINK:
+			l = random_pink(&seedL, pinkL);
+			r = random_pink(&seedR, pinkR);
+			break;
+		}
+		pcmL[i] = quantize(l, bits);
+		pcmR[i] = quantize(r, bits);
+	}
+
+}
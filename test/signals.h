@@ -0,0 +1,40 @@
+/*
+ * signals.h
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef OPENAPTX_SIGNALS_H_
+#define OPENAPTX_SIGNALS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Classes of test signals which exercise different paths of the encoder. */
+enum signal_class {
+	/* all samples equal to zero */
+	SIGNAL_SILENCE = 0,
+	/* white noise at -60 dBFS */
+	SIGNAL_NOISE,
+	/* full-scale logarithmic sine sweep from 20 Hz to 20 kHz */
+	SIGNAL_SWEEP,
+	/* overdriven sine clipped to a full-scale square wave */
+	SIGNAL_SQUARE,
+	/* voiced and unvoiced bursts separated by pauses */
+	SIGNAL_SPEECH,
+	/* pink noise at about -12 dBFS RMS */
+	SIGNAL_PINK,
+	SIGNAL_CLASSES,
+};
+
+const char * signal_class_name(enum signal_class c);
+int signal_class_from_name(const char * name);
+
+void signal_generate(enum signal_class c, int32_t * pcmL, int32_t * pcmR, size_t frames, unsigned int bits);
+
+#endif
@@ -0,0 +1,692 @@
+/*
+ * [open]aptx - aptxd.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "openaptx.h"
+
+#include "daemon.h"
+#include "stream.h"
+
+/* Maximal number of worker threads. */
+#define WORKERS_MAX 64
+
+enum watch_type {
+	WATCH_LISTEN,
+	WATCH_SIGNAL,
+	WATCH_SOCKET,
+	WATCH_EVENT,
+};
+
+struct watch {
+	enum watch_type type;
+	struct stream * s;
+};
+
+struct stream {
+
+	unsigned int id;
+	pid_t pid;
+	struct timespec opened;
+
+	int sock;
+	int efd_daemon;
+	int efd_client;
+
+	enum openaptx_codec codec;
+	APTXENC enc;
+
+	struct daemon_shm * shm;
+	size_t shm_size;
+	int32_t * pcm;
+	size_t pcm_frames;
+	uint8_t * code;
+	size_t code_size;
+	size_t block_size;
+	/* local copies of the positions owned by the daemon */
+	uint64_t pcm_tail;
+	uint64_t code_head;
+
+	struct watch w_sock;
+	struct watch w_event;
+
+	/* encoder failure, accessed by the worker processing the stream */
+	bool failed;
+
+	/* scheduling state guarded by the pool mutex */
+	bool scheduled;
+	bool pending;
+	bool closed;
+	struct stream * job_next;
+
+	/* list of active streams owned by the main thread */
+	struct stream * next;
+
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct stream * head;
+	struct stream * tail;
+	size_t queued;
+	bool quit;
+} pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static struct stream * streams = NULL;
+static unsigned int streams_id = 0;
+static int verbose = 0;
+
+static uint64_t timespec_ns(const struct timespec * ts) {
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void stream_free(struct stream * s) {
+	if (s->shm != MAP_FAILED)
+		munmap(s->shm, s->shm_size);
+	stream_encoder_free(s->codec, s->enc);
+	if (s->efd_client != -1)
+		close(s->efd_client);
+	if (s->efd_daemon != -1)
+		close(s->efd_daemon);
+	if (s->sock != -1)
+		close(s->sock);
+	free(s);
+}
+
+/**
+ * Encode all complete blocks available in the PCM ring. */
+static void stream_process(struct stream * s) {
+
+	struct daemon_shm * shm = s->shm;
+	struct timespec t0, t1;
+	uint64_t frames = 0;
+
+	if (s->failed)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (;;) {
+
+		/* Never trust positions written by the client. */
+		uint64_t pcm_queued = atomic_load_explicit(&shm->pcm.head, memory_order_acquire) - s->pcm_tail;
+		if (pcm_queued > s->pcm_frames)
+			pcm_queued = s->pcm_frames;
+		uint64_t code_queued = s->code_head - atomic_load_explicit(&shm->code.tail, memory_order_acquire);
+		if (code_queued > s->code_size)
+			code_queued = s->code_size;
+
+		if (pcm_queued > atomic_load_explicit(&shm->stats.pcm_queued_max, memory_order_relaxed))
+			atomic_store_explicit(&shm->stats.pcm_queued_max, pcm_queued, memory_order_relaxed);
+
+		const size_t pcm_offset = s->pcm_tail % s->pcm_frames;
+		const size_t code_offset = s->code_head % s->code_size;
+
+		size_t blocks = pcm_queued / 4;
+		if (blocks > (s->pcm_frames - pcm_offset) / 4)
+			blocks = (s->pcm_frames - pcm_offset) / 4;
+		if (blocks > (s->code_size - code_queued) / s->block_size)
+			blocks = (s->code_size - code_queued) / s->block_size;
+		if (blocks > (s->code_size - code_offset) / s->block_size)
+			blocks = (s->code_size - code_offset) / s->block_size;
+		if (blocks == 0)
+			break;
+
+		if (stream_encode(s->codec, s->enc, &s->pcm[pcm_offset * 2], blocks * 4, &s->code[code_offset]) != 0) {
+			fprintf(stderr, "Error: Stream %u: Couldn't encode PCM samples\n", s->id);
+			/* The socket hang-up terminates the stream on the client side
+			 * and makes the main thread close the stream. */
+			s->failed = true;
+			shutdown(s->sock, SHUT_RDWR);
+			eventfd_write(s->efd_client, 1);
+			break;
+		}
+
+		s->pcm_tail += blocks * 4;
+		s->code_head += blocks * s->block_size;
+		frames += blocks * 4;
+
+		atomic_store_explicit(&shm->pcm.tail, s->pcm_tail, memory_order_release);
+		atomic_store_explicit(&shm->code.head, s->code_head, memory_order_release);
+
+	}
+
+	if (frames == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	atomic_fetch_add_explicit(&shm->stats.frames, frames, memory_order_relaxed);
+	atomic_fetch_add_explicit(&shm->stats.encode_ns, timespec_ns(&t1) - timespec_ns(&t0), memory_order_relaxed);
+
+	eventfd_write(s->efd_client, 1);
+
+}
+
+static void pool_push(struct stream * s) {
+	s->job_next = NULL;
+	if (pool.tail != NULL)
+		pool.tail->job_next = s;
+	else
+		pool.head = s;
+	pool.tail = s;
+	pool.queued++;
+	pthread_cond_signal(&pool.cond);
+}
+
+/**
+ * Schedule stream processing on the worker pool.
+ *
+ * A stream is processed by at most one worker at a time. If it is already
+ * scheduled, it will be processed once again after the current run. */
+static void pool_schedule(struct stream * s) {
+	pthread_mutex_lock(&pool.mutex);
+	if (s->scheduled)
+		s->pending = true;
+	else {
+		s->scheduled = true;
+		pool_push(s);
+	}
+	pthread_mutex_unlock(&pool.mutex);
+}
+
+static void * pool_worker(void * arg) {
+	(void)arg;
+
+	pthread_mutex_lock(&pool.mutex);
+	for (;;) {
+
+		while (pool.head == NULL && !pool.quit)
+			pthread_cond_wait(&pool.cond, &pool.mutex);
+		if (pool.head == NULL)
+			break;
+
+		struct stream * s = pool.head;
+		if ((pool.head = s->job_next) == NULL)
+			pool.tail = NULL;
+		pool.queued--;
+		s->pending = false;
+
+		if (!s->closed) {
+			pthread_mutex_unlock(&pool.mutex);
+			stream_process(s);
+			pthread_mutex_lock(&pool.mutex);
+		}
+
+		if (s->closed) {
+			pthread_mutex_unlock(&pool.mutex);
+			stream_free(s);
+			pthread_mutex_lock(&pool.mutex);
+		} else if (s->pending) {
+			s->pending = false;
+			pool_push(s);
+		} else
+			s->scheduled = false;
+
+	}
+	pthread_mutex_unlock(&pool.mutex);
+
+	return NULL;
+}
+
+/**
+ * Release stream. If the stream is being processed, it will be freed by
+ * the worker thread. */
+static void pool_release(struct stream * s) {
+	pthread_mutex_lock(&pool.mutex);
+	s->closed = true;
+	const bool scheduled = s->scheduled;
+	pthread_mutex_unlock(&pool.mutex);
+	if (!scheduled)
+		stream_free(s);
+}
+
+static void stream_close(int epfd, struct stream * s) {
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, s->sock, NULL);
+	epoll_ctl(epfd, EPOLL_CTL_DEL, s->efd_daemon, NULL);
+
+	for (struct stream ** tmp = &streams; *tmp != NULL; tmp = &(*tmp)->next)
+		if (*tmp == s) {
+			*tmp = s->next;
+			break;
+		}
+
+	if (verbose)
+		fprintf(stderr, "Stream %u closed: pid=%d frames=%" PRIu64 "\n", s->id, s->pid,
+		        atomic_load(&s->shm->stats.frames));
+
+	pool_release(s);
+
+}
+
+static int stream_open(int epfd, int sock, const struct daemon_request * req, const int fds[3]) {
+
+	struct stream * s;
+	struct stat st;
+	int seals;
+
+	if (req->codec != OPENAPTX_CODEC_APTX && req->codec != OPENAPTX_CODEC_APTX_HD)
+		return errno = EINVAL, -1;
+	if (req->pcm_frames % 4 != 0 || req->pcm_frames < DAEMON_RING_FRAMES_MIN ||
+	    req->pcm_frames > DAEMON_RING_FRAMES_MAX)
+		return errno = EINVAL, -1;
+
+	const size_t shm_size = daemon_shm_size(req->codec, req->pcm_frames);
+
+	/* The shared memory has to be sealed against shrinking, otherwise the
+	 * client could truncate it and crash the daemon with SIGBUS. */
+	if (fstat(fds[0], &st) == -1 || (size_t)st.st_size < shm_size)
+		return errno = EINVAL, -1;
+	if ((seals = fcntl(fds[0], F_GET_SEALS)) == -1 || !(seals & F_SEAL_SHRINK))
+		return errno = EPERM, -1;
+
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return -1;
+
+	s->sock = s->efd_daemon = s->efd_client = -1;
+	s->shm = MAP_FAILED;
+	s->codec = req->codec;
+	s->pcm_frames = req->pcm_frames;
+	s->code_size = daemon_code_size(req->codec, req->pcm_frames);
+	s->block_size = daemon_code_size(req->codec, 4);
+	s->shm_size = shm_size;
+
+	if ((s->shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0)) == MAP_FAILED)
+		goto fail;
+	if (s->shm->magic != DAEMON_SHM_MAGIC || s->shm->version != DAEMON_SHM_VERSION) {
+		errno = EPROTO;
+		goto fail;
+	}
+
+	if ((s->enc = stream_encoder_new(s->codec, req->endian)) == NULL) {
+		errno = ENOTSUP;
+		goto fail;
+	}
+
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+		s->pid = cred.pid;
+
+	s->id = ++streams_id;
+	s->pcm = daemon_shm_pcm(s->shm);
+	s->code = daemon_shm_code(s->shm, s->pcm_frames);
+	s->pcm_tail = atomic_load(&s->shm->pcm.tail);
+	s->code_head = atomic_load(&s->shm->code.head);
+	clock_gettime(CLOCK_MONOTONIC, &s->opened);
+
+	s->sock = sock;
+	s->efd_daemon = fds[1];
+	s->efd_client = fds[2];
+	s->w_sock = (struct watch){ WATCH_SOCKET, s };
+	s->w_event = (struct watch){ WATCH_EVENT, s };
+
+	struct epoll_event ev_sock = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = &s->w_sock };
+	struct epoll_event ev_event = { .events = EPOLLIN, .data.ptr = &s->w_event };
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->sock, &ev_sock) == -1 ||
+	    epoll_ctl(epfd, EPOLL_CTL_ADD, s->efd_daemon, &ev_event) == -1) {
+		epoll_ctl(epfd, EPOLL_CTL_DEL, s->sock, NULL);
+		s->sock = s->efd_daemon = s->efd_client = -1;
+		goto fail;
+	}
+
+	close(fds[0]);
+	s->next = streams;
+	streams = s;
+
+	if (verbose)
+		fprintf(stderr, "Stream %u opened: pid=%d codec=%s ring=%zu\n", s->id, s->pid,
+		        s->codec == OPENAPTX_CODEC_APTX_HD ? "apt-X HD" : "apt-X", s->pcm_frames);
+
+	/* encode samples written before the stream was registered */
+	pool_schedule(s);
+	return 0;
+
+fail:;
+	const int err = errno;
+	stream_free(s);
+	return errno = err, -1;
+}
+
+static void stats_write(int sock) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	char * buffer = NULL;
+	size_t size = 0;
+	FILE * f;
+
+	if ((f = open_memstream(&buffer, &size)) == NULL)
+		return;
+
+	pthread_mutex_lock(&pool.mutex);
+	const size_t queued = pool.queued;
+	pthread_mutex_unlock(&pool.mutex);
+
+	fprintf(f, "Scheduled streams: %zu\n", queued);
+	fprintf(f, "%4s %8s %-8s %12s %10s %8s %8s %8s %8s\n", "ID", "PID", "CODEC", "FRAMES", "FRAMES/S", "CPU",
+	        "QUEUED", "MAX", "RING");
+
+	for (struct stream * s = streams; s != NULL; s = s->next) {
+
+		struct daemon_shm * shm = s->shm;
+		const uint64_t frames = atomic_load_explicit(&shm->stats.frames, memory_order_relaxed);
+		const uint64_t encode_ns = atomic_load_explicit(&shm->stats.encode_ns, memory_order_relaxed);
+		uint64_t pcm_queued = atomic_load_explicit(&shm->pcm.head, memory_order_relaxed) -
+		                      atomic_load_explicit(&shm->pcm.tail, memory_order_relaxed);
+		if (pcm_queued > s->pcm_frames)
+			pcm_queued = s->pcm_frames;
+
+		const double elapsed = (timespec_ns(&now) - timespec_ns(&s->opened)) / 1e9;
+		fprintf(f, "%4u %8d %-8s %12" PRIu64 " %10.0f %7.2f%% %8" PRIu64 " %8" PRIu64 " %8zu\n", s->id, s->pid,
+		        s->codec == OPENAPTX_CODEC_APTX_HD ? "aptX-HD" : "aptX", frames,
+		        elapsed > 0 ? frames / elapsed : 0, elapsed > 0 ? 100 * encode_ns / 1e9 / elapsed : 0, pcm_queued,
+		        (uint64_t)atomic_load_explicit(&shm->stats.pcm_queued_max, memory_order_relaxed), s->pcm_frames);
+
+	}
+
+	fclose(f);
+
+	for (size_t i = 0; i < size;) {
+		ssize_t len;
+		if ((len = send(sock, &buffer[i], size - i, MSG_NOSIGNAL)) <= 0)
+			break;
+		i += len;
+	}
+
+	free(buffer);
+}
+
+/**
+ * Handle the first request on the newly accepted connection. */
+static void client_accept(int epfd, int lfd) {
+
+	int sock;
+	if ((sock = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) == -1)
+		return;
+
+	/* do not let misbehaving clients block the main loop */
+	const struct timeval timeout = { .tv_sec = 1 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	struct daemon_request req;
+	char buf[CMSG_SPACE(3 * sizeof(int))];
+	struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = buf,
+		.msg_controllen = sizeof(buf),
+	};
+
+	int fds[3] = { -1, -1, -1 };
+	size_t nfds = 0;
+	ssize_t len;
+
+	if ((len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) != sizeof(req))
+		goto close;
+
+	for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), (nfds > 3 ? 3 : nfds) * sizeof(int));
+		}
+
+	struct daemon_response rsp = { 0 };
+
+	switch (req.type) {
+	case DAEMON_REQUEST_OPEN:
+		if (nfds != 3 || (msg.msg_flags & MSG_CTRUNC)) {
+			rsp.error = EINVAL;
+			break;
+		}
+		if (stream_open(epfd, sock, &req, fds) == -1) {
+			rsp.error = errno;
+			break;
+		}
+		send(sock, &rsp, sizeof(rsp), MSG_NOSIGNAL);
+		return;
+	case DAEMON_REQUEST_STATS:
+		stats_write(sock);
+		goto close;
+	default:
+		rsp.error = EINVAL;
+	}
+
+	send(sock, &rsp, sizeof(rsp), MSG_NOSIGNAL);
+
+close:
+	for (size_t i = 0; i < 3; i++)
+		if (fds[i] != -1)
+			close(fds[i]);
+	close(sock);
+}
+
+static int stats_request(const char * path) {
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	int sock;
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+	    connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error: Couldn't connect to daemon: %s\n", strerror(errno));
+		return -1;
+	}
+
+	const struct daemon_request req = { .type = DAEMON_REQUEST_STATS };
+	if (send(sock, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req)) {
+		fprintf(stderr, "Error: Couldn't send request: %s\n", strerror(errno));
+		return -1;
+	}
+
+	char buffer[4096];
+	ssize_t len;
+	while ((len = recv(sock, buffer, sizeof(buffer), 0)) > 0)
+		fwrite(buffer, 1, len, stdout);
+
+	close(sock);
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hj:s:Sv";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "socket", required_argument, NULL, 's' },
+		{ "stats", no_argument, NULL, 'S' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ 0, 0, 0, 0 },
+	};
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	daemon_socket_path(addr.sun_path, sizeof(addr.sun_path));
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+	bool stats = false;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+			printf("Usage:\n"
+			       "  %s [OPTION]...\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -j, --jobs=NUM\tnumber of encoding threads\n"
+			       "  -s, --socket=PATH\tdaemon socket path (default: %s)\n"
+			       "  -S, --stats\t\tprint statistics of running daemon and exit\n"
+			       "  -v, --verbose\t\tprint stream events\n",
+			       argv[0], addr.sun_path);
+			return EXIT_SUCCESS;
+
+		case 'j' /* --jobs=NUM */:
+			workers = strtol(optarg, NULL, 10);
+			if (workers < 1 || workers > WORKERS_MAX) {
+				fprintf(stderr, "Error: Invalid number of jobs {1..%d}: %s\n", WORKERS_MAX, optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 's' /* --socket=PATH */:
+			if (strlen(optarg) >= sizeof(addr.sun_path)) {
+				fprintf(stderr, "Error: Socket path too long: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			strcpy(addr.sun_path, optarg);
+			break;
+
+		case 'S' /* --stats */:
+			stats = true;
+			break;
+
+		case 'v' /* --verbose */:
+			verbose++;
+			break;
+
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (stats)
+		return stats_request(addr.sun_path) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (workers < 1)
+		workers = 1;
+	if (workers > WORKERS_MAX)
+		workers = WORKERS_MAX;
+
+	sigset_t sigset;
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGINT);
+	sigaddset(&sigset, SIGTERM);
+	/* block signals before spawning workers, so they will inherit the mask */
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	int epfd, sfd, lfd;
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+	    (sfd = signalfd(-1, &sigset, SFD_CLOEXEC)) == -1 ||
+	    (lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+		fprintf(stderr, "Error: Couldn't create descriptors: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	unlink(addr.sun_path);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(lfd, 16) == -1) {
+		fprintf(stderr, "Error: Couldn't bind socket: %s: %s\n", addr.sun_path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	struct watch w_listen = { WATCH_LISTEN, NULL };
+	struct watch w_signal = { WATCH_SIGNAL, NULL };
+	struct epoll_event ev_listen = { .events = EPOLLIN, .data.ptr = &w_listen };
+	struct epoll_event ev_signal = { .events = EPOLLIN, .data.ptr = &w_signal };
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev_listen);
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev_signal);
+
+	pthread_t threads[WORKERS_MAX];
+	for (long i = 0; i < workers; i++)
+		if ((errno = pthread_create(&threads[i], NULL, pool_worker, NULL)) != 0) {
+			fprintf(stderr, "Error: Couldn't create worker thread: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+	if (verbose)
+		fprintf(stderr, "Listening on %s with %ld worker(s)\n", addr.sun_path, workers);
+
+	bool running = true;
+	while (running) {
+
+		struct epoll_event events[32];
+		int n;
+
+		if ((n = epoll_wait(epfd, events, 32, -1)) == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error: Couldn't wait for events: %s\n", strerror(errno));
+			break;
+		}
+
+		/* Handle stream events first, so a socket closed in this batch will
+		 * not be referenced by the eventfd event of the same stream. */
+		for (int i = 0; i < n; i++) {
+			struct watch * w = events[i].data.ptr;
+			if (w->type == WATCH_EVENT) {
+				eventfd_t tmp;
+				eventfd_read(w->s->efd_daemon, &tmp);
+				pool_schedule(w->s);
+			}
+		}
+
+		for (int i = 0; i < n; i++) {
+			struct watch * w = events[i].data.ptr;
+			switch (w->type) {
+			case WATCH_LISTEN:
+				client_accept(epfd, lfd);
+				break;
+			case WATCH_SIGNAL:
+				running = false;
+				break;
+			case WATCH_SOCKET:
+				/* the client shall not send anything after the setup */
+				stream_close(epfd, w->s);
+				break;
+			case WATCH_EVENT:
+				break;
+			}
+		}
+
+	}
+
+	while (streams != NULL)
+		stream_close(epfd, streams);
+
+	pthread_mutex_lock(&pool.mutex);
+	pool.quit = true;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.mutex);
+	for (long i = 0; i < workers; i++)
+		pthread_join(threads[i], NULL);
+
+	unlink(addr.sun_path);
+	return EXIT_SUCCESS;
+}
@@ -14,155 +14,217 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#if WITH_SNDFILE
-#	include <sndfile.h>
+#include "openaptx.h"
+#if ENABLE_CONTAINER
+#	include "openaptx-container.h"
 #endif
 
-#include "openaptx.h"
+#include "codeword.h"
+#include "wavfile.h"
 
 #if APTXHD
 #	define _aptxdec_size_ SizeofAptxhdbtdec
 #	define _aptxdec_init_ aptxhdbtdec_init
 #	define _aptxdec_destroy_ aptxhdbtdec_destroy
-#	define _aptxdec_encode_ aptxhdbtdec_decodestereo
+#	define _aptxdec_decode_ aptxhdbtdec_decodestereo
 #	define _aptxdec_build_ aptxhdbtdec_build
 #	define _aptxdec_version_ aptxhdbtdec_version
+#	define _aptxdec_code_t_ uint32_t
+#	define _aptxdec_unpack_ codeword_unpack24
+#	define _aptxdec_codeword_size_ 3
 #else
 #	define _aptxdec_size_ SizeofAptxbtdec
 #	define _aptxdec_init_ aptxbtdec_init
 #	define _aptxdec_destroy_ aptxbtdec_destroy
-#	define _aptxdec_encode_ aptxbtdec_decodestereo
+#	define _aptxdec_decode_ aptxbtdec_decodestereo
 #	define _aptxdec_build_ aptxbtdec_build
 #	define _aptxdec_version_ aptxbtdec_version
+#	define _aptxdec_code_t_ uint16_t
+#	define _aptxdec_unpack_ codeword_unpack16
+#	define _aptxdec_codeword_size_ 2
 #endif
 
-void decode(const char * filename) {
-
-	FILE * f_in = stdin;
-	if (strcmp(filename, "-") != 0 && (f_in = fopen(filename, "r")) == NULL) {
-		fprintf(stderr, "Error: Couldn't open input stream: %s\n", strerror(errno));
-		return;
-	}
-
-	APTXDEC dec;
-	if ((dec = malloc(_aptxdec_size_())) == NULL) {
-		fprintf(stderr, "Error: Couldn't allocate apt-X decoder: %s\n", strerror(errno));
-		return;
-	}
-
-	if (_aptxdec_init_(dec, 0) != 0) {
-		fprintf(stderr, "Error: Couldn't initialize apt-X decoder\n");
-		return;
-	}
-
-#if WITH_SNDFILE
-	SNDFILE * sf = NULL;
-#endif
-
-	while (!feof(f_in)) {
+/* number of blocks read, deserialized and converted at once */
+#define DECODE_BLOCKS 1024
 
 #if APTXHD
-		uint8_t data[6];
+/* signed 24-bit integer stored on 4-bytes */
+#	define _aptxdec_bits_ 24
+#	define _aptxdec_wav_format_ WAVFILE_S24
 #else
-		uint8_t data[4];
+/* signed 16-bit integer stored on 4-bytes */
+#	define _aptxdec_bits_ 16
+#	define _aptxdec_wav_format_ WAVFILE_S16
 #endif
 
+/* position in milliseconds at which decoding starts */
+static unsigned int seek_ms = 0;
+/* sampling rate of the raw apt-X stream */
+static unsigned int raw_rate = 44100;
+
+/* write WAV file instead of raw S16 LE samples */
 #if WITH_SNDFILE
-		int32_t pcm[8];
+static bool output_wav = true;
 #else
-		int16_t pcm[8];
+static bool output_wav = false;
 #endif
 
-		int32_t pcmL[4];
-		int32_t pcmR[4];
-
-		if (fread(data, 1, sizeof(data), f_in) != sizeof(data)) {
-			break;
-		}
+/**
+ * Initialize the writer for the standard output. */
+static int output_init(struct wavfile_writer * w, unsigned int rate) {
+	/* apt-X HD is written with the full resolution in the WAV file only */
+	const enum wavfile_format format = output_wav ? _aptxdec_wav_format_ : WAVFILE_S16;
+	if (wavfile_writer_init(w, STDOUT_FILENO, format, rate, output_wav) == -1) {
+		fprintf(stderr, "Error: Couldn't create audio file: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
 
-#if APTXHD
+static void output_close(struct wavfile_writer * w) {
+	if (wavfile_writer_close(w) == -1)
+		fprintf(stderr, "Warning: Couldn't write all samples: %s\n", strerror(errno));
+}
 
-		uint32_t code[2] = { (data[0] << 16) | (data[1] << 8) | data[2], (data[3] << 16) | (data[4] << 8) | data[5] };
-		aptxhdbtdec_decodestereo(dec, pcmL, pcmR, code);
+#if ENABLE_CONTAINER
 
-		/* extract signed 24-bit integer stored on 4-bytes */
-#	if WITH_SNDFILE
-		for (size_t i = 0; i < 4; i++) {
-			pcm[i * 2 + 0] = pcmL[i] << 8;
-			pcm[i * 2 + 1] = pcmR[i] << 8;
-		}
+#	if APTXHD
+#		define _aptxdec_codec_ OPENAPTX_CODEC_APTX_HD
 #	else
-		for (size_t i = 0; i < 4; i++) {
-			pcm[i * 2 + 0] = pcmL[i] >> 8;
-			pcm[i * 2 + 1] = pcmR[i] >> 8;
-		}
+#		define _aptxdec_codec_ OPENAPTX_CODEC_APTX
 #	endif
 
-#else
+/**
+ * Decode the seekable container with the reverse-engineered decoder. */
+static void decode_container(openaptx_container_reader * r) {
 
-		uint16_t code[2] = { (data[0] << 8) | data[1], (data[2] << 8) | data[3] };
-		aptxbtdec_decodestereo(dec, pcmL, pcmR, code);
+	if (openaptx_container_codec(r) != _aptxdec_codec_) {
+		fprintf(stderr, "Error: Container codec mismatch\n");
+		return;
+	}
+
+	const unsigned int rate = openaptx_container_rate(r);
+	if (openaptx_container_seek(r, (uint64_t)seek_ms * rate / 1000) == -1) {
+		fprintf(stderr, "Error: Couldn't seek container: %s\n", strerror(errno));
+		return;
+	}
+
+	struct wavfile_writer w;
+	if (output_init(&w, rate) == -1)
+		return;
+
+	int32_t pcm24[1024 * 2];
+	int32_t pcmL[1024];
+	int32_t pcmR[1024];
+	ssize_t frames;
 
-		/* extract signed 16-bit integer stored on 4-bytes */
-#	if WITH_SNDFILE
-		for (size_t i = 0; i < 4; i++) {
-			pcm[i * 2 + 0] = pcmL[i] << 16;
-			pcm[i * 2 + 1] = pcmR[i] << 16;
+	while ((frames = openaptx_container_read(r, pcm24, 1024)) > 0) {
+		for (ssize_t i = 0; i < frames; i++) {
+			pcmL[i] = pcm24[i * 2 + 0];
+			pcmR[i] = pcm24[i * 2 + 1];
 		}
-#	else
-		for (size_t i = 0; i < 4; i++) {
-			pcm[i * 2 + 0] = pcmL[i];
-			pcm[i * 2 + 1] = pcmR[i];
+		/* container samples are 24-bit regardless of the codec */
+		if (wavfile_write(&w, pcmL, pcmR, frames, 24) == -1) {
+			fprintf(stderr, "Warning: Couldn't write all samples: %s\n", strerror(errno));
+			break;
 		}
-#	endif
+	}
+
+	if (frames == -1)
+		fprintf(stderr, "Error: Couldn't decode container: %s\n", strerror(errno));
+
+	output_close(&w);
+}
 
 #endif
 
-#if WITH_SNDFILE
+void decode(const char * filename) {
 
-		if (sf == NULL) {
-			SF_INFO info = { .format = SF_FORMAT_AU | SF_FORMAT_PCM_32, .samplerate = 44100, .channels = 2 };
-			if ((sf = sf_open_fd(fileno(stdout), SFM_WRITE, &info, 0)) == NULL) {
-				fprintf(stderr, "Error: Couldn't create audio file: %s\n", sf_strerror(sf));
-				return;
-			}
-		}
+	FILE * f_in = stdin;
+	if (strcmp(filename, "-") != 0 && (f_in = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "Error: Couldn't open input stream: %s\n", strerror(errno));
+		return;
+	}
 
-		int samples = sizeof(pcm) / sizeof(*pcm);
-		if (sf_write_int(sf, pcm, samples) != samples) {
-			fprintf(stderr, "Warning: Couldn't write all samples\n");
-		}
+#if ENABLE_CONTAINER
+	openaptx_container_reader * r;
+	if ((r = openaptx_container_reader_new(fileno(f_in))) != NULL) {
+		decode_container(r);
+		openaptx_container_reader_free(r);
+		goto final;
+	}
+	if (errno != EBADMSG && errno != ESPIPE) {
+		fprintf(stderr, "Error: Couldn't open container: %s\n", strerror(errno));
+		goto final;
+	}
+#endif
 
-#else
+	if (seek_ms != 0)
+		fprintf(stderr, "Warning: Seeking is supported for containers only\n");
+
+	APTXDEC dec;
+	if ((dec = malloc(_aptxdec_size_())) == NULL) {
+		fprintf(stderr, "Error: Couldn't allocate apt-X decoder: %s\n", strerror(errno));
+		goto final;
+	}
+
+	if (_aptxdec_init_(dec, 0) != 0) {
+		fprintf(stderr, "Error: Couldn't initialize apt-X decoder\n");
+		goto final_alloc;
+	}
+
+	struct wavfile_writer w;
+	if (output_init(&w, raw_rate) == -1)
+		goto final_init;
+
+	uint8_t data[DECODE_BLOCKS * 2 * _aptxdec_codeword_size_];
+	_aptxdec_code_t_ codes[DECODE_BLOCKS * 2];
+	int32_t pcmL[DECODE_BLOCKS * 4];
+	int32_t pcmR[DECODE_BLOCKS * 4];
+	size_t blocks;
+
+	while ((blocks = fread(data, 2 * _aptxdec_codeword_size_, DECODE_BLOCKS, f_in)) != 0) {
+
+		_aptxdec_unpack_(codes, data, blocks * 2);
 
-		if (fwrite(pcm, 1, sizeof(pcm), stdout) != sizeof(pcm)) {
-			fprintf(stderr, "Warning: Couldn't write all samples\n");
+		for (size_t i = 0; i < blocks; i++)
+			_aptxdec_decode_(dec, &pcmL[i * 4], &pcmR[i * 4], &codes[i * 2]);
+
+		if (wavfile_write(&w, pcmL, pcmR, blocks * 4, _aptxdec_bits_) == -1) {
+			fprintf(stderr, "Warning: Couldn't write all samples: %s\n", strerror(errno));
+			break;
 		}
 
-#endif
 	}
 
-	if (f_in != stdin)
-		fclose(f_in);
-#if WITH_SNDFILE
-	sf_close(sf);
-#endif
+	output_close(&w);
+final_init:
 	_aptxdec_destroy_(dec);
+final_alloc:
 	free(dec);
+final:
+	if (f_in != stdin)
+		fclose(f_in);
 }
 
 int main(int argc, char * argv[]) {
 
 	int opt;
-	const char * opts = "hv";
+	const char * opts = "hvr:s:w";
 	const struct option longopts[] = {
 		{ "help", no_argument, NULL, 'h' },
 		{ "version", no_argument, NULL, 'v' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ "seek", required_argument, NULL, 's' },
+		{ "raw", no_argument, NULL, 'R' },
+		{ "wav", no_argument, NULL, 'w' },
 		{ 0, 0, 0, 0 },
 	};
 
@@ -174,7 +236,11 @@ int main(int argc, char * argv[]) {
 			       "  %s [OPTION]... <FILE>...\n"
 			       "\nOptions:\n"
 			       "  -h, --help\t\tprint this help and exit\n"
-			       "  -v, --version\t\tprint library version and exit\n",
+			       "  -v, --version\t\tprint library version and exit\n"
+			       "  -r, --rate=HZ\t\tsampling rate of the raw stream (default: 44100)\n"
+			       "  -s, --seek=MS\t\tstart decoding container at given position\n"
+			       "  --raw\t\t\twrite raw 2-channels S16 LE samples\n"
+			       "  -w, --wav\t\twrite WAV file (24-bit for apt-X HD)\n",
 			       argv[0]);
 			return EXIT_SUCCESS;
 
@@ -184,6 +250,25 @@ int main(int argc, char * argv[]) {
 			fprintf(stderr, "  version number:\t%s\n", _aptxdec_version_());
 			return EXIT_SUCCESS;
 
+		case 'r' /* --rate=HZ */:
+			if ((raw_rate = strtoul(optarg, NULL, 10)) == 0) {
+				fprintf(stderr, "Error: Invalid sampling rate: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'R' /* --raw */:
+			output_wav = false;
+			break;
+
+		case 'w' /* --wav */:
+			output_wav = true;
+			break;
+
+		case 's' /* --seek=MS */:
+			seek_ms = strtoul(optarg, NULL, 10);
+			break;
+
 		default:
 			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
 			return EXIT_FAILURE;
@@ -13,18 +13,25 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
-#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #if WITH_SNDFILE
 #	include <sndfile.h>
 #endif
 
 #include "openaptx.h"
+#if ENABLE_CONTAINER
+#	include "openaptx-container.h"
+#endif
+
+#include "codeword.h"
+#include "wavfile.h"
 
 #if APTXHD
 #	define _aptxenc_size_ SizeofAptxhdbtenc
@@ -33,6 +40,10 @@
 #	define _aptxenc_encode_ aptxhdbtenc_encodestereo
 #	define _aptxenc_build_ aptxhdbtenc_build
 #	define _aptxenc_version_ aptxhdbtenc_version
+#	define _aptxenc_codec_ OPENAPTX_CODEC_APTX_HD
+#	define _aptxenc_code_t_ uint32_t
+#	define _aptxenc_pack_ codeword_pack24
+#	define _aptxenc_codeword_size_ 3
 #else
 #	define _aptxenc_size_ SizeofAptxbtenc
 #	define _aptxenc_init_ aptxbtenc_init
@@ -40,136 +51,238 @@
 #	define _aptxenc_encode_ aptxbtenc_encodestereo
 #	define _aptxenc_build_ aptxbtenc_build
 #	define _aptxenc_version_ aptxbtenc_version
+#	define _aptxenc_codec_ OPENAPTX_CODEC_APTX
+#	define _aptxenc_code_t_ uint16_t
+#	define _aptxenc_pack_ codeword_pack16
+#	define _aptxenc_codeword_size_ 2
 #endif
 
-void encode(const char * filename) {
+/* number of blocks converted, serialized and written at once */
+#define ENCODE_BLOCKS 1024
+
+#if APTXHD
+/* signed 24-bit integer stored on 4-bytes */
+#	define _aptxenc_bits_ 24
+#else
+/* signed 16-bit integer stored on 4-bytes */
+#	define _aptxenc_bits_ 16
+#endif
 
-	const int read_samples = 8;
-	int samples;
+#if ENABLE_CONTAINER
+/* interval between container snapshots in milliseconds or 0 for raw stream */
+static unsigned int container_interval = 0;
+#endif
 
+/**
+ * Source of the PCM samples. */
+struct source {
+	/* memory-mapped WAV/RF64 or raw file */
+	struct wavfile wf;
+	size_t offset;
+	/* raw S16 LE stream, e.g. standard input */
+	FILE * f;
 #if WITH_SNDFILE
-
+	/* any other format supported by libsndfile */
 	SNDFILE * sf;
-	SF_INFO info = { .format = 0 };
+#endif
+};
+
+#if ENABLE_CONTAINER
+static void write_data(openaptx_container_writer * w, const uint8_t * data, size_t len) {
+	if (w != NULL) {
+		if (openaptx_container_write(w, data, len) == -1)
+			fprintf(stderr, "Warning: Couldn't write data: %s\n", strerror(errno));
+		return;
+	}
+#else
+static void write_data(void * w, const uint8_t * data, size_t len) {
+	(void)w;
+#endif
+	if (fwrite(data, 1, len, stdout) != len)
+		fprintf(stderr, "Warning: Couldn't write data: %s\n", strerror(errno));
+}
+
+/**
+ * Open the audio file.
+ *
+ * @return On success, the sampling rate is returned. Otherwise, 0 is
+ *   returned and the error message is printed. */
+static unsigned int source_open(struct source * src, const char * filename) {
+
+	memset(src, 0, sizeof(*src));
+
+	int fd = STDIN_FILENO;
+	if (strcmp(filename, "-") != 0 && (fd = open(filename, O_RDONLY)) == -1) {
+		fprintf(stderr, "Error: Couldn't open audio file: %s\n", strerror(errno));
+		return 0;
+	}
+
+	int rv = wavfile_open(&src->wf, fd);
+	const int err = errno;
 
-	if (strcmp(filename, "-") == 0) {
-		if ((sf = sf_open_fd(fileno(stdin), SFM_READ, &info, 0)) == NULL) {
-			fprintf(stderr, "Error: Couldn't open audio file: %s\n", sf_strerror(sf));
-			return;
+#if WITH_SNDFILE
+	if (rv == -1 || !src->wf.wave) {
+		wavfile_close(&src->wf);
+		SF_INFO info = { .format = 0 };
+		if ((src->sf = sf_open_fd(fd, SFM_READ, &info, fd != STDIN_FILENO)) == NULL) {
+			fprintf(stderr, "Error: Couldn't open audio file: %s\n", sf_strerror(src->sf));
+			return 0;
 		}
-	} else {
-		if ((sf = sf_open(filename, SFM_READ, &info)) == NULL) {
-			fprintf(stderr, "Error: Couldn't open audio file: %s\n", sf_strerror(sf));
-			return;
+		if (info.channels != 2) {
+			fprintf(stderr, "Error: Unsupported number of channels: %d != %d\n", info.channels, 2);
+			sf_close(src->sf);
+			return 0;
 		}
+		return info.samplerate;
 	}
+#endif
 
-	if (info.channels != 2) {
-		fprintf(stderr, "Error: Unsupported number of channels: %d != %d\n", info.channels, 2);
-		return;
+	if (rv == -1 && err == ENODEV) {
+		/* not a regular file (e.g. a pipe), so the stream has to be read */
+		if (fd == STDIN_FILENO)
+			src->f = stdin;
+		else if ((src->f = fdopen(fd, "r")) == NULL) {
+			fprintf(stderr, "Error: Couldn't open audio file: %s\n", strerror(errno));
+			close(fd);
+			return 0;
+		}
+		fprintf(stderr, "Assuming RAW format: 2-channels S16 LE\n");
+		return 44100;
 	}
 
-	samples = info.frames * info.channels;
+	/* the file is either mapped or not used at all */
+	if (fd != STDIN_FILENO)
+		close(fd);
 
-#else
+	if (rv == -1) {
+		fprintf(stderr, "Error: Couldn't open audio file: %s\n", strerror(err));
+		return 0;
+	}
 
-	FILE * f;
+	if (!src->wf.wave)
+		fprintf(stderr, "Assuming RAW format: 2-channels S16 LE\n");
 
-	if (strcmp(filename, "-") == 0) {
-		f = stdin;
-	} else {
-		if ((f = fopen(filename, "r")) == NULL) {
-			fprintf(stderr, "Error: Couldn't open audio file: %s\n", strerror(errno));
-			return;
+	return src->wf.rate;
+}
+
+/**
+ * Read frames into planar buffers.
+ *
+ * @return The number of read frames, which is less than requested at the
+ *   end of the input only. */
+static size_t source_read(struct source * src, int32_t * pcmL, int32_t * pcmR, size_t frames) {
+
+#if WITH_SNDFILE
+	if (src->sf != NULL) {
+		int32_t pcm[ENCODE_BLOCKS * 4 * 2];
+		sf_count_t n;
+		if ((n = sf_readf_int(src->sf, pcm, frames)) < 0)
+			n = 0;
+		for (sf_count_t i = 0; i < n; i++) {
+			pcmL[i] = pcm[i * 2 + 0] >> (32 - _aptxenc_bits_);
+			pcmR[i] = pcm[i * 2 + 1] >> (32 - _aptxenc_bits_);
 		}
+		return n;
 	}
+#endif
 
-	fprintf(stderr, "Assuming RAW format: 2-channels S16 LE\n");
-	samples = INT_MAX;
+	if (src->f != NULL) {
+		uint8_t pcm[ENCODE_BLOCKS * 4 * 4];
+		const size_t n = fread(pcm, 4, frames, src->f);
+		wavfile_convert(WAVFILE_S16, pcm, n, pcmL, pcmR, _aptxenc_bits_);
+		return n;
+	}
 
+	const size_t n = wavfile_read(&src->wf, src->offset, pcmL, pcmR, frames, _aptxenc_bits_);
+	src->offset += n;
+	return n;
+}
+
+static void source_close(struct source * src) {
+#if WITH_SNDFILE
+	if (src->sf != NULL)
+		sf_close(src->sf);
 #endif
+	if (src->f != NULL && src->f != stdin)
+		fclose(src->f);
+	wavfile_close(&src->wf);
+}
+
+void encode(const char * filename) {
+
+	struct source src;
+	unsigned int rate;
+
+	if ((rate = source_open(&src, filename)) == 0)
+		return;
+
+#if ENABLE_CONTAINER
+	openaptx_container_writer * w = NULL;
+	if (container_interval != 0 &&
+	    (w = openaptx_container_writer_new(fileno(stdout), _aptxenc_codec_, 0, rate, container_interval)) == NULL) {
+		fprintf(stderr, "Error: Couldn't create container: %s\n", strerror(errno));
+		source_close(&src);
+		return;
+	}
+#else
+	void * w = NULL;
+#endif
+
+	int32_t pcmL[ENCODE_BLOCKS * 4];
+	int32_t pcmR[ENCODE_BLOCKS * 4];
+	_aptxenc_code_t_ code[ENCODE_BLOCKS * 2];
+	uint8_t data[ENCODE_BLOCKS * 2 * _aptxenc_codeword_size_];
 
 	APTXENC enc;
 	if ((enc = malloc(_aptxenc_size_())) == NULL) {
 		fprintf(stderr, "Error: Couldn't allocate apt-X encoder: %s\n", strerror(errno));
+		source_close(&src);
 		return;
 	}
 
 	if (_aptxenc_init_(enc, 0) != 0) {
 		fprintf(stderr, "Error: Couldn't initialize apt-X encoder\n");
+		source_close(&src);
+		free(enc);
 		return;
 	}
 
-	while (samples >= read_samples) {
-
-#if WITH_SNDFILE
-		int32_t pcm[read_samples];
-		if (sf_read_int(sf, pcm, read_samples) != read_samples) {
-			fprintf(stderr, "Warning: Couldn't read PCM: %s\n", sf_strerror(sf));
-			continue;
-		}
-#else
-		int16_t pcm[read_samples];
-		if (fread(pcm, sizeof(int16_t), read_samples, f) != (size_t)read_samples) {
-			return;
-		}
-#endif
-
-#if APTXHD
+	for (;;) {
 
-		/* signed 24-bit integer stored on 4-bytes */
-#	if WITH_SNDFILE
-		int32_t pcmL[4] = { pcm[0] >> 8, pcm[2] >> 8, pcm[4] >> 8, pcm[6] >> 8 };
-		int32_t pcmR[4] = { pcm[1] >> 8, pcm[3] >> 8, pcm[5] >> 8, pcm[7] >> 8 };
-#	else
-		int32_t pcmL[4] = { pcm[0] << 8, pcm[2] << 8, pcm[4] << 8, pcm[6] << 8 };
-		int32_t pcmR[4] = { pcm[1] << 8, pcm[3] << 8, pcm[5] << 8, pcm[7] << 8 };
-#	endif
-		uint32_t code[2];
+		const size_t frames = source_read(&src, pcmL, pcmR, ENCODE_BLOCKS * 4);
+		/* trailing incomplete block is dropped */
+		const size_t blocks = frames / 4;
 
-		aptxhdbtenc_encodestereo(enc, pcmL, pcmR, code);
-		uint8_t data[6] = { code[0] >> 16, code[0] >> 8, code[0] >> 0, code[1] >> 16, code[1] >> 8, code[1] >> 0 };
+		for (size_t i = 0; i < blocks; i++)
+			_aptxenc_encode_(enc, &pcmL[i * 4], &pcmR[i * 4], &code[i * 2]);
 
-#else
+		_aptxenc_pack_(data, code, blocks * 2);
+		write_data(w, data, blocks * 2 * _aptxenc_codeword_size_);
 
-		/* signed 16-bit integer stored on 4-bytes */
-#	if WITH_SNDFILE
-		int32_t pcmL[4] = { pcm[0] >> 16, pcm[2] >> 16, pcm[4] >> 16, pcm[6] >> 16 };
-		int32_t pcmR[4] = { pcm[1] >> 16, pcm[3] >> 16, pcm[5] >> 16, pcm[7] >> 16 };
-#	else
-		int32_t pcmL[4] = { pcm[0], pcm[2], pcm[4], pcm[6] };
-		int32_t pcmR[4] = { pcm[1], pcm[3], pcm[5], pcm[7] };
-#	endif
-		uint16_t code[2];
+		if (frames != ENCODE_BLOCKS * 4)
+			break;
 
-		aptxbtenc_encodestereo(enc, pcmL, pcmR, code);
-		uint8_t data[4] = { code[0] >> 8, code[0] >> 0, code[1] >> 8, code[1] >> 0 };
+	}
 
+#if ENABLE_CONTAINER
+	if (w != NULL && openaptx_container_writer_close(w) == -1)
+		fprintf(stderr, "Warning: Couldn't write data: %s\n", strerror(errno));
 #endif
 
-		samples -= read_samples;
-		if (fwrite(data, 1, sizeof(data), stdout) != sizeof(data)) {
-			fprintf(stderr, "Warning: Couldn't write data: %s\n", strerror(errno));
-		}
-	}
-
 	if (_aptxenc_destroy_ != NULL)
 		_aptxenc_destroy_(enc);
-#if WITH_SNDFILE
-	sf_close(sf);
-#else
-	fclose(f);
-#endif
+	source_close(&src);
 	free(enc);
 }
 
 int main(int argc, char * argv[]) {
 
 	int opt;
-	const char * opts = "hv";
+	const char * opts = "hvc::";
 	const struct option longopts[] = {
 		{ "help", no_argument, NULL, 'h' },
 		{ "version", no_argument, NULL, 'v' },
+		{ "container", optional_argument, NULL, 'c' },
 		{ 0, 0, 0, 0 },
 	};
 
@@ -181,7 +294,9 @@ int main(int argc, char * argv[]) {
 			       "  %s [OPTION]... <FILE>...\n"
 			       "\nOptions:\n"
 			       "  -h, --help\t\tprint this help and exit\n"
-			       "  -v, --version\t\tprint library version and exit\n",
+			       "  -v, --version\t\tprint library version and exit\n"
+			       "  -c, --container[=MS]\twrite seekable container with snapshots\n"
+			       "\t\t\tevery MS milliseconds (default: 1000)\n",
 			       argv[0]);
 			return EXIT_SUCCESS;
 
@@ -191,6 +306,18 @@ int main(int argc, char * argv[]) {
 			fprintf(stderr, "  version number:\t%s\n", _aptxenc_version_());
 			return EXIT_SUCCESS;
 
+		case 'c' /* --container[=MS] */:
+#if ENABLE_CONTAINER
+			if ((container_interval = optarg != NULL ? strtoul(optarg, NULL, 10) : 1000) == 0) {
+				fprintf(stderr, "Error: Invalid snapshot interval: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+#else
+			fprintf(stderr, "Error: Container support not available\n");
+			return EXIT_FAILURE;
+#endif
+
 		default:
 			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
 			return EXIT_FAILURE;
@@ -0,0 +1,973 @@
+/*
+ * [open]aptx - aptxsnoop.c
+ * Copyright (c) 2017-2024 Arkadiusz Bokowy
+ *
+ * This file is a part of [open]aptx.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "openaptx.h"
+
+#include "codeword.h"
+
+/* Maximum number of tracked ACL links (per direction). */
+#define MAX_LINKS 32
+/* Maximum number of tracked L2CAP channel endpoints. */
+#define MAX_ROUTES 128
+/* Maximum number of L2CAP connection requests waiting for response. */
+#define MAX_PENDING 32
+
+/* Maximum size of the reassembled L2CAP frame. */
+#define L2CAP_MAX_FRAME (65535 + 4)
+#define L2CAP_CID_SIGNALING 0x0001
+#define L2CAP_PSM_AVDTP 0x0019
+
+#define AVDTP_SET_CONFIGURATION 0x03
+#define AVDTP_RECONFIGURE 0x07
+#define AVDTP_CATEGORY_MEDIA_CODEC 0x07
+#define AVDTP_CODEC_VENDOR 0xFF
+
+/* Microseconds between 0 AD and the Unix epoch used by btsnoop. */
+#define BTSNOOP_EPOCH_DELTA 0x00dcddb30f2f8000ULL
+#define BTSNOOP_DATALINK_H4 1002
+#define BTSNOOP_DATALINK_HCI 1001
+
+#define PCAP_LINKTYPE_H4 187
+#define PCAP_LINKTYPE_H4_WITH_PHDR 201
+
+#define H4_ACL 0x02
+#define H4_EVENT 0x04
+
+#define HCI_EV_DISCONNECTION_COMPLETE 0x05
+
+enum codec {
+	CODEC_UNKNOWN,
+	CODEC_APTX,
+	CODEC_APTX_HD,
+};
+
+static const char * codec_names[] = { "unknown", "apt-X", "apt-X HD" };
+
+/**
+ * Reassembly buffer of a fragmented ACL packet. */
+struct link {
+	uint16_t handle;
+	/* direction: 0 - sent by the host, 1 - received by the host */
+	uint8_t dir;
+	size_t len;
+	uint8_t * buffer;
+	/* codec configured with the last AVDTP signaling command */
+	enum codec codec;
+	unsigned int rate;
+};
+
+struct pending {
+	uint16_t handle;
+	/* direction of the connection request */
+	uint8_t dir;
+	uint16_t scid;
+	uint16_t psm;
+};
+
+struct stream {
+	unsigned int id;
+	uint16_t handle;
+	enum codec codec;
+	unsigned int rate;
+	APTXDEC dec;
+	bool decoded;
+	FILE * wav;
+	uint64_t wav_bytes;
+	/* statistics */
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t blocks;
+	uint64_t truncated;
+	uint64_t sync_errors;
+	uint64_t gaps;
+	uint64_t lost;
+	double gap_max_us;
+	/* timing of the previous packet */
+	int64_t ts_first;
+	int64_t ts_last;
+	double duration_last_us;
+	/* RTP sequence number of the previous packet */
+	bool has_seq;
+	uint16_t seq;
+};
+
+/**
+ * Endpoint of the AVDTP L2CAP channel as seen in one direction. */
+struct route {
+	uint16_t handle;
+	uint8_t dir;
+	uint16_t cid;
+	/* peer endpoint, used to close both on disconnection */
+	uint16_t peer_cid;
+	/* NULL for the signaling channel */
+	struct stream * stream;
+};
+
+static struct {
+	struct link links[MAX_LINKS];
+	size_t links_count;
+	struct route routes[MAX_ROUTES];
+	size_t routes_count;
+	struct pending pending[MAX_PENDING];
+	size_t pending_count;
+	struct stream ** streams;
+	size_t streams_count;
+	uint64_t acl_packets;
+	uint64_t malformed;
+} snoop;
+
+static const char * output_dir = ".";
+static const char * output_prefix = "stream";
+static enum codec force_codec = CODEC_UNKNOWN;
+static unsigned int force_rate = 0;
+static double gap_tolerance_us = 20000;
+static bool decode_enabled = true;
+static bool verbose = false;
+
+static uint16_t le16(const uint8_t * p) {
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t * p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t be16(const uint8_t * p) {
+	return p[0] << 8 | p[1];
+}
+
+static uint32_t be32(const uint8_t * p) {
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint64_t be64(const uint8_t * p) {
+	return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+static void put_le16(uint8_t * p, uint16_t v) {
+	p[0] = v, p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t * p, uint32_t v) {
+	p[0] = v, p[1] = v >> 8, p[2] = v >> 16, p[3] = v >> 24;
+}
+
+/**
+ * Write WAV header for stereo PCM with the given data size. */
+static int wav_write_header(FILE * f, unsigned int rate, unsigned int bits, uint64_t bytes) {
+
+	/* sizes are saturated, if data exceeds the RIFF limit */
+	const uint32_t size = bytes > UINT32_MAX - 36 ? UINT32_MAX - 36 : bytes;
+	const unsigned int align = 2 * bits / 8;
+	uint8_t h[44];
+
+	memcpy(&h[0], "RIFF", 4);
+	put_le32(&h[4], 36 + size);
+	memcpy(&h[8], "WAVEfmt ", 8);
+	put_le32(&h[16], 16);
+	put_le16(&h[20], 1 /* PCM */);
+	put_le16(&h[22], 2);
+	put_le32(&h[24], rate);
+	put_le32(&h[28], rate * align);
+	put_le16(&h[32], align);
+	put_le16(&h[34], bits);
+	memcpy(&h[36], "data", 4);
+	put_le32(&h[40], size);
+
+	return fwrite(h, sizeof(h), 1, f) == 1 ? 0 : -1;
+}
+
+static unsigned int stream_bits(const struct stream * s) {
+	return s->codec == CODEC_APTX_HD ? 24 : 16;
+}
+
+static struct stream * stream_new(uint16_t handle, enum codec codec, unsigned int rate) {
+
+	struct stream ** tmp;
+	if ((tmp = realloc(snoop.streams, (snoop.streams_count + 1) * sizeof(*tmp))) == NULL)
+		return NULL;
+	snoop.streams = tmp;
+
+	struct stream * s;
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return NULL;
+
+	s->id = snoop.streams_count;
+	s->handle = handle;
+	s->codec = force_codec != CODEC_UNKNOWN ? force_codec : codec;
+	s->rate = force_rate != 0 ? force_rate : rate != 0 ? rate : 48000;
+	snoop.streams[snoop.streams_count++] = s;
+
+	if (s->codec == CODEC_UNKNOWN) {
+		fprintf(stderr, "Warning: Stream %u: Codec configuration not found in the capture "
+		                "(use --codec to force it)\n", s->id);
+		return s;
+	}
+
+	if (!decode_enabled)
+		return s;
+
+	const bool hd = s->codec == CODEC_APTX_HD;
+	if ((s->dec = malloc(hd ? SizeofAptxhdbtdec() : SizeofAptxbtdec())) == NULL ||
+	    (hd ? aptxhdbtdec_init(s->dec, 0) : aptxbtdec_init(s->dec, 0)) != 0) {
+		fprintf(stderr, "Error: Stream %u: Couldn't initialize %s decoder\n", s->id, codec_names[s->codec]);
+		free(s->dec);
+		s->dec = NULL;
+		return s;
+	}
+
+	s->decoded = true;
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s-%u.wav", output_dir, output_prefix, s->id);
+	if ((s->wav = fopen(path, "wb")) == NULL || wav_write_header(s->wav, s->rate, stream_bits(s), 0) != 0) {
+		fprintf(stderr, "Error: Couldn't create audio file: %s: %s\n", path, strerror(errno));
+		if (s->wav != NULL)
+			fclose(s->wav);
+		s->wav = NULL;
+	}
+
+	return s;
+}
+
+static void stream_close(struct stream * s) {
+
+	if (s->wav != NULL) {
+		if (fseek(s->wav, 0, SEEK_SET) != 0 || wav_write_header(s->wav, s->rate, stream_bits(s), s->wav_bytes) != 0)
+			fprintf(stderr, "Warning: Stream %u: Couldn't update WAV header\n", s->id);
+		fclose(s->wav);
+		s->wav = NULL;
+	}
+
+	if (s->dec != NULL) {
+		if (s->codec == CODEC_APTX_HD)
+			aptxhdbtdec_destroy(s->dec);
+		else
+			aptxbtdec_destroy(s->dec);
+		free(s->dec);
+		s->dec = NULL;
+	}
+
+}
+
+/**
+ * Decode codewords of a media packet and append PCM to the WAV file. */
+static void stream_decode(struct stream * s, const uint8_t * data, size_t blocks) {
+
+	const bool hd = s->codec == CODEC_APTX_HD;
+	const size_t size = hd ? 6 : 4;
+	uint8_t pcm[4 * 2 * 3 * 64];
+	size_t len = 0;
+
+	for (size_t i = 0; i < blocks; i++, data += size) {
+
+		int32_t pcmL[4], pcmR[4];
+		int rv;
+
+		if (hd) {
+			uint32_t code[2];
+			codeword_unpack24(code, data, 2);
+			rv = aptxhdbtdec_decodestereo(s->dec, pcmL, pcmR, code);
+		}
+		else {
+			uint16_t code[2];
+			codeword_unpack16(code, data, 2);
+			rv = aptxbtdec_decodestereo(s->dec, pcmL, pcmR, code);
+		}
+
+		/* decoders report the auto-sync mismatch as an error */
+		if (rv != 0) {
+			s->sync_errors++;
+			memset(pcmL, 0, sizeof(pcmL));
+			memset(pcmR, 0, sizeof(pcmR));
+		}
+
+		if (s->wav == NULL)
+			continue;
+
+		for (size_t ii = 0; ii < 4; ii++)
+			if (hd) {
+				const int32_t samples[2] = { pcmL[ii], pcmR[ii] };
+				for (size_t c = 0; c < 2; c++, len += 3)
+					pcm[len] = samples[c], pcm[len + 1] = samples[c] >> 8, pcm[len + 2] = samples[c] >> 16;
+			}
+			else {
+				put_le16(&pcm[len], pcmL[ii]);
+				put_le16(&pcm[len + 2], pcmR[ii]);
+				len += 4;
+			}
+
+		if (len == sizeof(pcm) || i + 1 == blocks) {
+			if (fwrite(pcm, 1, len, s->wav) != len)
+				fprintf(stderr, "Warning: Stream %u: Couldn't write all samples\n", s->id);
+			s->wav_bytes += len;
+			len = 0;
+		}
+
+	}
+
+}
+
+/**
+ * Process AVDTP media packet. */
+static void stream_media(struct stream * s, const uint8_t * data, size_t len, int64_t ts) {
+
+	s->packets++;
+	s->bytes += len;
+
+	/* apt-X HD packets start with the RTP header, apt-X packets do not */
+	if (s->codec == CODEC_APTX_HD) {
+
+		if (len < 12 || data[0] >> 6 != 2) {
+			snoop.malformed++;
+			return;
+		}
+
+		size_t offset = 12 + (data[0] & 0x0F) * 4;
+		if (data[0] & 0x10 /* extension */ && len >= offset + 4)
+			offset += 4 + be16(&data[offset + 2]) * 4;
+		if (data[0] & 0x20 /* padding */) {
+			/* the last octet is the padding count, including itself */
+			if (len <= offset || data[len - 1] == 0 || data[len - 1] > len - offset) {
+				snoop.malformed++;
+				return;
+			}
+			len -= data[len - 1];
+		}
+		if (offset > len) {
+			snoop.malformed++;
+			return;
+		}
+
+		const uint16_t seq = be16(&data[2]);
+		if (s->has_seq) {
+			const uint16_t delta = seq - s->seq;
+			/* packets which came out of order are not counted as lost */
+			if (delta != 1 && delta < 0x8000)
+				s->lost += delta - 1;
+		}
+		s->has_seq = true;
+		s->seq = seq;
+
+		data += offset;
+		len -= offset;
+
+	}
+
+	/* Audio is played from the buffer of the sink, so the packet interval
+	 * can vary, but when it exceeds the duration of the previous packet by
+	 * more than the tolerance, the sink is likely to run out of audio. */
+	if (s->packets == 1)
+		s->ts_first = ts;
+	else {
+		const double interval = ts - s->ts_last;
+		if (interval > s->duration_last_us + gap_tolerance_us) {
+			s->gaps++;
+			if (interval > s->gap_max_us)
+				s->gap_max_us = interval;
+		}
+	}
+
+	const size_t size = s->codec == CODEC_APTX_HD ? 6 : 4;
+	const size_t blocks = len / size;
+	if (len % size != 0)
+		s->truncated++;
+
+	s->ts_last = ts;
+	s->duration_last_us = 1e6 * blocks * 4 / s->rate;
+	s->blocks += blocks;
+
+	if (s->dec != NULL)
+		stream_decode(s, data, blocks);
+
+}
+
+static struct link * link_get(uint16_t handle, uint8_t dir) {
+
+	for (size_t i = 0; i < snoop.links_count; i++)
+		if (snoop.links[i].handle == handle && snoop.links[i].dir == dir)
+			return &snoop.links[i];
+
+	if (snoop.links_count == MAX_LINKS)
+		return NULL;
+
+	struct link * l = &snoop.links[snoop.links_count];
+	if ((l->buffer = malloc(L2CAP_MAX_FRAME)) == NULL)
+		return NULL;
+
+	snoop.links_count++;
+	l->handle = handle;
+	l->dir = dir;
+	l->len = 0;
+	return l;
+}
+
+/**
+ * Get the link state shared by both directions. */
+static struct link * link_config(uint16_t handle) {
+	return link_get(handle, 0);
+}
+
+static struct route * route_find(uint16_t handle, uint8_t dir, uint16_t cid) {
+	for (size_t i = 0; i < snoop.routes_count; i++)
+		if (snoop.routes[i].handle == handle && snoop.routes[i].dir == dir && snoop.routes[i].cid == cid)
+			return &snoop.routes[i];
+	return NULL;
+}
+
+/**
+ * Check whether the link has AVDTP signaling channel. */
+static bool signaling_find(uint16_t handle) {
+	for (size_t i = 0; i < snoop.routes_count; i++)
+		if (snoop.routes[i].handle == handle && snoop.routes[i].stream == NULL)
+			return true;
+	return false;
+}
+
+static void route_add(uint16_t handle, uint8_t dir, uint16_t cid, uint16_t peer_cid, struct stream * s) {
+	if (snoop.routes_count == MAX_ROUTES) {
+		fprintf(stderr, "Warning: Too many L2CAP channels\n");
+		return;
+	}
+	snoop.routes[snoop.routes_count++] = (struct route){
+		.handle = handle, .dir = dir, .cid = cid, .peer_cid = peer_cid, .stream = s };
+}
+
+static void route_remove(struct route * r) {
+	*r = snoop.routes[--snoop.routes_count];
+}
+
+/**
+ * Close AVDTP channel given by the endpoint in the given direction. */
+static void channel_close(uint16_t handle, uint8_t dir, uint16_t cid) {
+
+	struct route * r;
+	if ((r = route_find(handle, dir, cid)) == NULL)
+		return;
+
+	struct stream * s = r->stream;
+	const uint16_t peer_cid = r->peer_cid;
+	route_remove(r);
+	if ((r = route_find(handle, !dir, peer_cid)) != NULL)
+		route_remove(r);
+
+	if (s != NULL)
+		stream_close(s);
+
+}
+
+/**
+ * Parse media codec capability of the AVDTP configuration. */
+static void avdtp_codec(struct link * l, const uint8_t * data, size_t len) {
+
+	if (len < 9 || data[1] != AVDTP_CODEC_VENDOR)
+		return;
+
+	const uint32_t vendor = le32(&data[2]);
+	const uint16_t codec = le16(&data[6]);
+
+	if (vendor == 0x0000004F && codec == 0x0001)
+		l->codec = CODEC_APTX;
+	else if (vendor == 0x000000D7 && codec == 0x0024)
+		l->codec = CODEC_APTX_HD;
+	else
+		return;
+
+	if (data[8] & 0x10)
+		l->rate = 48000;
+	else if (data[8] & 0x20)
+		l->rate = 44100;
+	else if (data[8] & 0x40)
+		l->rate = 32000;
+	else if (data[8] & 0x80)
+		l->rate = 16000;
+
+}
+
+/**
+ * Process AVDTP signaling packet. Only commands with the configuration of
+ * the stream end-point are of interest, because they carry the codec. */
+static void avdtp_signaling(uint16_t handle, const uint8_t * data, size_t len) {
+
+	/* single packet command */
+	if (len < 2 || (data[0] & 0x0F) != 0x00)
+		return;
+
+	size_t offset;
+	switch (data[1] & 0x3F) {
+	case AVDTP_SET_CONFIGURATION:
+		offset = 4;
+		break;
+	case AVDTP_RECONFIGURE:
+		offset = 3;
+		break;
+	default:
+		return;
+	}
+
+	struct link * l;
+	if ((l = link_config(handle)) == NULL)
+		return;
+
+	while (offset + 2 <= len) {
+		const uint8_t category = data[offset];
+		const size_t length = data[offset + 1];
+		if (offset + 2 + length > len)
+			break;
+		if (category == AVDTP_CATEGORY_MEDIA_CODEC)
+			avdtp_codec(l, &data[offset + 2], length);
+		offset += 2 + length;
+	}
+
+}
+
+/**
+ * Process L2CAP signaling channel, in order to find AVDTP channels. */
+static void l2cap_signaling(uint16_t handle, uint8_t dir, const uint8_t * data, size_t len) {
+
+	while (len >= 4) {
+
+		const uint8_t code = data[0];
+		const size_t length = le16(&data[2]);
+		const uint8_t * cmd = &data[4];
+
+		if (length + 4 > len)
+			break;
+
+		if (code == 0x02 /* connection request */ && length >= 4) {
+			if (snoop.pending_count < MAX_PENDING)
+				snoop.pending[snoop.pending_count++] = (struct pending){
+					.handle = handle, .dir = dir, .psm = le16(&cmd[0]), .scid = le16(&cmd[2]) };
+		}
+		else if (code == 0x03 /* connection response */ && length >= 8) {
+
+			const uint16_t dcid = le16(&cmd[0]);
+			const uint16_t scid = le16(&cmd[2]);
+			const uint16_t result = le16(&cmd[4]);
+
+			for (size_t i = 0; i < snoop.pending_count; i++) {
+
+				struct pending * p = &snoop.pending[i];
+				if (p->handle != handle || p->dir == dir || p->scid != scid)
+					continue;
+				/* wait for the final response */
+				if (result == 0x0001)
+					break;
+
+				if (result == 0x0000 && p->psm == L2CAP_PSM_AVDTP) {
+					/* endpoints of channels which were not closed (e.g. the
+					 * disconnection was not captured) are reused */
+					channel_close(handle, dir, scid);
+					channel_close(handle, !dir, dcid);
+					struct link * l;
+					if ((l = link_config(handle)) != NULL) {
+						/* the first AVDTP channel is the signaling one */
+						struct stream * s = NULL;
+						if (signaling_find(handle) && (s = stream_new(handle, l->codec, l->rate)) == NULL)
+							break;
+						/* the response travels from the responder to the requester,
+						 * in the same direction as packets addressed to the requester */
+						route_add(handle, dir, scid, dcid, s);
+						route_add(handle, !dir, dcid, scid, s);
+					}
+				}
+
+				*p = snoop.pending[--snoop.pending_count];
+				break;
+			}
+
+		}
+		else if (code == 0x06 /* disconnection request */ && length >= 4) {
+			/* the request is addressed to the channel endpoint of the peer */
+			channel_close(handle, !dir, le16(&cmd[0]));
+		}
+
+		data += 4 + length;
+		len -= 4 + length;
+	}
+
+}
+
+static void l2cap_frame(uint16_t handle, uint8_t dir, const uint8_t * data, size_t len, int64_t ts) {
+
+	const uint16_t cid = le16(&data[2]);
+	data += 4;
+	len -= 4;
+
+	if (cid == L2CAP_CID_SIGNALING) {
+		l2cap_signaling(handle, dir, data, len);
+		return;
+	}
+
+	struct route * r;
+	if ((r = route_find(handle, dir, cid)) == NULL)
+		return;
+
+	if (r->stream == NULL)
+		avdtp_signaling(handle, data, len);
+	else if (r->stream->codec != CODEC_UNKNOWN)
+		stream_media(r->stream, data, len, ts);
+	else
+		r->stream->packets++;
+
+}
+
+/**
+ * Process HCI event. On disconnection, all channels of the link are closed. */
+static void hci_event(const uint8_t * data, size_t len) {
+
+	if (len < 6 || data[0] != HCI_EV_DISCONNECTION_COMPLETE || data[2] != 0x00)
+		return;
+
+	const uint16_t handle = le16(&data[3]) & 0x0FFF;
+	for (size_t i = 0; i < snoop.routes_count;)
+		if (snoop.routes[i].handle == handle)
+			channel_close(handle, snoop.routes[i].dir, snoop.routes[i].cid);
+		else
+			i++;
+
+	for (size_t i = 0; i < snoop.links_count; i++)
+		if (snoop.links[i].handle == handle) {
+			snoop.links[i].len = 0;
+			snoop.links[i].codec = CODEC_UNKNOWN;
+			snoop.links[i].rate = 0;
+		}
+
+}
+
+/**
+ * Process HCI ACL packet, reassembling L2CAP frames. */
+static void hci_acl(uint8_t dir, const uint8_t * data, size_t len, int64_t ts) {
+
+	if (len < 4) {
+		snoop.malformed++;
+		return;
+	}
+
+	const uint16_t handle = le16(&data[0]) & 0x0FFF;
+	const uint8_t pb = (data[1] >> 4) & 0x03;
+	size_t dlen = le16(&data[2]);
+
+	if (dlen > len - 4) {
+		snoop.malformed++;
+		dlen = len - 4;
+	}
+
+	snoop.acl_packets++;
+	data += 4;
+
+	struct link * l;
+	if ((l = link_get(handle, dir)) == NULL)
+		return;
+
+	if (pb != 0x01 /* start of L2CAP frame */) {
+		if (l->len != 0)
+			snoop.malformed++;
+		l->len = 0;
+		/* fast path: complete frame in a single packet */
+		if (dlen >= 4 && le16(data) + 4u == dlen) {
+			l2cap_frame(handle, dir, data, dlen, ts);
+			return;
+		}
+	}
+	else if (l->len == 0) {
+		/* continuation without start */
+		snoop.malformed++;
+		return;
+	}
+
+	if (l->len + dlen > L2CAP_MAX_FRAME) {
+		snoop.malformed++;
+		l->len = 0;
+		return;
+	}
+
+	memcpy(&l->buffer[l->len], data, dlen);
+	l->len += dlen;
+
+	if (l->len >= 4 && l->len >= le16(l->buffer) + 4u) {
+		l2cap_frame(handle, dir, l->buffer, le16(l->buffer) + 4, ts);
+		l->len = 0;
+	}
+
+}
+
+/**
+ * Process btsnoop file. See RFC 1761 and the Android btsnoop format. */
+static int parse_btsnoop(const uint8_t * data, size_t size) {
+
+	const uint32_t datalink = be32(&data[12]);
+	if (datalink != BTSNOOP_DATALINK_H4 && datalink != BTSNOOP_DATALINK_HCI) {
+		fprintf(stderr, "Error: Unsupported btsnoop datalink type: %u\n", datalink);
+		return -1;
+	}
+
+	for (size_t offset = 16; offset + 24 <= size;) {
+
+		const uint8_t * rec = &data[offset];
+		const size_t len = be32(&rec[4]);
+		const uint32_t flags = be32(&rec[8]);
+		const int64_t ts = be64(&rec[16]) - BTSNOOP_EPOCH_DELTA;
+
+		if (offset + 24 + len > size) {
+			fprintf(stderr, "Warning: Truncated btsnoop record at offset %zu\n", offset);
+			break;
+		}
+
+		const uint8_t * pkt = &rec[24];
+		/* bit 0: direction, bit 1: command or event */
+		const uint8_t dir = flags & 0x01;
+		if (datalink == BTSNOOP_DATALINK_H4) {
+			if (len > 0 && pkt[0] == H4_ACL)
+				hci_acl(dir, pkt + 1, len - 1, ts);
+			else if (len > 0 && pkt[0] == H4_EVENT)
+				hci_event(pkt + 1, len - 1);
+		}
+		else if ((flags & 0x02) == 0)
+			hci_acl(dir, pkt, len, ts);
+		else if (dir == 1)
+			hci_event(pkt, len);
+
+		offset += 24 + len;
+	}
+
+	return 0;
+}
+
+/**
+ * Process pcap file with Bluetooth H4 link type. */
+static int parse_pcap(const uint8_t * data, size_t size) {
+
+	const uint32_t magic = le32(data);
+	const bool swap = magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1;
+	const bool nsec = magic == 0xA1B23C4D || magic == 0x4D3CB2A1;
+#define pcap32(p) (swap ? be32(p) : le32(p))
+
+	const uint32_t linktype = pcap32(&data[20]) & 0x0FFFFFFF;
+	if (linktype != PCAP_LINKTYPE_H4 && linktype != PCAP_LINKTYPE_H4_WITH_PHDR) {
+		fprintf(stderr, "Error: Unsupported pcap link type: %u\n", linktype);
+		return -1;
+	}
+
+	for (size_t offset = 24; offset + 16 <= size;) {
+
+		const uint8_t * rec = &data[offset];
+		const size_t len = pcap32(&rec[8]);
+		const int64_t ts = (int64_t)pcap32(&rec[0]) * 1000000 + pcap32(&rec[4]) / (nsec ? 1000 : 1);
+
+		if (offset + 16 + len > size) {
+			fprintf(stderr, "Warning: Truncated pcap record at offset %zu\n", offset);
+			break;
+		}
+
+		const uint8_t * pkt = &rec[16];
+		size_t plen = len;
+		/* direction: 0 - sent by the host, 1 - received by the host */
+		uint8_t dir = 0;
+		if (linktype == PCAP_LINKTYPE_H4_WITH_PHDR) {
+			if (plen < 4)
+				goto next;
+			dir = be32(pkt) & 0x01;
+			pkt += 4, plen -= 4;
+		}
+
+		if (plen > 0 && pkt[0] == H4_ACL)
+			hci_acl(dir, pkt + 1, plen - 1, ts);
+		else if (plen > 0 && pkt[0] == H4_EVENT)
+			hci_event(pkt + 1, plen - 1);
+
+	next:
+		offset += 16 + len;
+	}
+
+#undef pcap32
+	return 0;
+}
+
+static void print_stream(const struct stream * s) {
+
+	const double seconds = (double)s->blocks * 4 / s->rate;
+	const double span = (s->ts_last - s->ts_first) / 1e6;
+
+	printf("Stream %u: ACL handle %#x, %s, %u Hz\n", s->id, s->handle, codec_names[s->codec], s->rate);
+	printf("  packets: %llu (%llu bytes, %llu truncated)\n", (unsigned long long)s->packets,
+	       (unsigned long long)s->bytes, (unsigned long long)s->truncated);
+	printf("  audio: %.3f s in %.3f s of capture\n", seconds, span);
+	printf("  gaps: %llu (longest interval: %.1f ms)\n", (unsigned long long)s->gaps, s->gap_max_us / 1e3);
+	if (s->codec == CODEC_APTX_HD)
+		printf("  lost packets (RTP): %llu\n", (unsigned long long)s->lost);
+	if (s->decoded)
+		printf("  sync errors: %llu of %llu blocks\n", (unsigned long long)s->sync_errors,
+		       (unsigned long long)s->blocks);
+	if (s->wav_bytes != 0)
+		printf("  output: %s/%s-%u.wav\n", output_dir, output_prefix, s->id);
+
+}
+
+static int snoop_file(const char * path) {
+
+	int fd;
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		fprintf(stderr, "Error: Couldn't open capture: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < 24) {
+		fprintf(stderr, "Error: Invalid capture file: %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	const size_t size = st.st_size;
+	const uint8_t * data;
+	if ((data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "Error: Couldn't map capture: %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	/* records are processed once, from the beginning to the end */
+	madvise((void *)data, size, MADV_SEQUENTIAL);
+
+	const uint32_t magic = le32(data);
+	int rv;
+
+	if (memcmp(data, "btsnoop", 8) == 0)
+		rv = parse_btsnoop(data, size);
+	else if (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1 || magic == 0xA1B23C4D || magic == 0x4D3CB2A1)
+		rv = parse_pcap(data, size);
+	else {
+		fprintf(stderr, "Error: Unsupported capture format: %s\n", path);
+		rv = -1;
+	}
+
+	munmap((void *)data, size);
+	close(fd);
+	return rv;
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	const char * opts = "hvc:g:no:p:r:";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ "codec", required_argument, NULL, 'c' },
+		{ "gap", required_argument, NULL, 'g' },
+		{ "no-decode", no_argument, NULL, 'n' },
+		{ "output-dir", required_argument, NULL, 'o' },
+		{ "prefix", required_argument, NULL, 'p' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ 0, 0, 0, 0 },
+	};
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */:
+		usage:
+			printf("Usage:\n"
+			       "  %s [OPTION]... <FILE>\n"
+			       "\nExtract apt-X and apt-X HD streams from btsnoop or pcap capture of HCI\n"
+			       "traffic and decode every stream to the WAV file.\n"
+			       "\nOptions:\n"
+			       "  -h, --help\t\tprint this help and exit\n"
+			       "  -v, --verbose\t\tprint capture summary\n"
+			       "  -c, --codec=NAME\tassume 'aptx' or 'aptx-hd' for all streams\n"
+			       "  -g, --gap=MS\t\tpacket interval tolerance (default: %.0f ms)\n"
+			       "  -n, --no-decode\tcollect statistics only\n"
+			       "  -o, --output-dir=DIR\tdirectory for decoded streams (default: %s)\n"
+			       "  -p, --prefix=NAME\tname prefix of decoded streams (default: %s)\n"
+			       "  -r, --rate=HZ\t\tassume sampling rate for all streams\n",
+			       argv[0], gap_tolerance_us / 1e3, output_dir, output_prefix);
+			return EXIT_SUCCESS;
+
+		case 'v' /* --verbose */:
+			verbose = true;
+			break;
+
+		case 'c' /* --codec=NAME */:
+			if (strcmp(optarg, "aptx") == 0)
+				force_codec = CODEC_APTX;
+			else if (strcmp(optarg, "aptx-hd") == 0)
+				force_codec = CODEC_APTX_HD;
+			else {
+				fprintf(stderr, "Error: Invalid codec: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'g' /* --gap=MS */:
+			gap_tolerance_us = strtod(optarg, NULL) * 1e3;
+			break;
+
+		case 'n' /* --no-decode */:
+			decode_enabled = false;
+			break;
+
+		case 'o' /* --output-dir=DIR */:
+			output_dir = optarg;
+			break;
+
+		case 'p' /* --prefix=NAME */:
+			output_prefix = optarg;
+			break;
+
+		case 'r' /* --rate=HZ */:
+			force_rate = strtoul(optarg, NULL, 10);
+			break;
+
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	if (optind + 1 != argc)
+		goto usage;
+
+	int rv = snoop_file(argv[optind]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (verbose)
+		fprintf(stderr, "ACL packets: %llu, malformed: %llu\n", (unsigned long long)snoop.acl_packets,
+		        (unsigned long long)snoop.malformed);
+
+	if (snoop.streams_count == 0)
+		fprintf(stderr, "Warning: No AVDTP media channels found\n");
+
+	for (size_t i = 0; i < snoop.streams_count; i++) {
+		struct stream * s = snoop.streams[i];
+		stream_close(s);
+		print_stream(s);
+		free(s);
+	}
+
+	for (size_t i = 0; i < snoop.links_count; i++)
+		free(snoop.links[i].buffer);
+	free(snoop.streams);
+
+	return rv;
+}